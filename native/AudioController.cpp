@@ -1,10 +1,17 @@
 #include "AudioController.h"
 
+#include <cmath>
+#include <cstring>
+#include <random>
+
 // Forward declaration of platform-specific factory
 std::unique_ptr<AudioEngine> CreatePlatformAudioEngine();
 
 Napi::FunctionReference AudioController::constructor;
 
+// Longest pre-roll history; at 48 kHz stereo PCM this is about 115 MB
+static const double kMaxPreRollSeconds = 600;
+
 Napi::Object AudioController::Init(Napi::Env env, Napi::Object exports) {
   Napi::HandleScope scope(env);
 
@@ -12,10 +19,16 @@ Napi::Object AudioController::Init(Napi::Env env, Napi::Object exports) {
       env, "AudioController",
       {InstanceMethod("start", &AudioController::Start),
        InstanceMethod("stop", &AudioController::Stop),
+       InstanceMethod("prepare", &AudioController::Prepare),
+       InstanceMethod("unprepare", &AudioController::Unprepare),
+       InstanceMethod("commit", &AudioController::Commit),
+       InstanceMethod("getStats", &AudioController::GetStats),
+       InstanceMethod("getSpectrum", &AudioController::GetSpectrum),
        StaticMethod("getDevices", &AudioController::GetDevices),
        StaticMethod("getDeviceFormat", &AudioController::GetDeviceFormat),
        StaticMethod("checkPermission", &AudioController::CheckPermission),
-       StaticMethod("requestPermission", &AudioController::RequestPermission)});
+       StaticMethod("requestPermission", &AudioController::RequestPermission),
+       StaticMethod("recoverRecording", &AudioController::RecoverRecording)});
 
   constructor = Napi::Persistent(func);
   constructor.SuppressDestruct();
@@ -27,30 +40,16 @@ Napi::Object AudioController::Init(Napi::Env env, Napi::Object exports) {
 AudioController::AudioController(const Napi::CallbackInfo &info)
     : Napi::ObjectWrap<AudioController>(info) {
   this->engine = CreatePlatformAudioEngine();
+  this->state = std::make_shared<StreamState>();
 }
 
-AudioController::~AudioController() {
-  if (this->engine) {
-    this->engine->Stop();
-  }
-  if (this->tsfn) {
-    this->tsfn->Release();
-  }
-}
-
-Napi::Value AudioController::Start(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
-
-  if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsFunction()) {
-    Napi::TypeError::New(env, "Expected config object and callback function")
-        .ThrowAsJavaScriptException();
-    return env.Null();
-  }
-
-  Napi::Object config = info[0].As<Napi::Object>();
+AudioController::~AudioController() { CloseStream(); }
 
+bool AudioController::ParseDeviceConfig(Napi::Env env, Napi::Object config,
+                                        std::string &deviceType,
+                                        std::string &deviceId) {
   // Parse deviceType (required)
-  std::string deviceType = AudioEngine::DEVICE_TYPE_INPUT; // default to input
+  deviceType = AudioEngine::DEVICE_TYPE_INPUT; // default to input
   if (config.Has("deviceType")) {
     Napi::Value typeVal = config.Get("deviceType");
     if (typeVal.IsString()) {
@@ -63,11 +62,11 @@ Napi::Value AudioController::Start(const Napi::CallbackInfo &info) {
       deviceType != AudioEngine::DEVICE_TYPE_OUTPUT) {
     Napi::TypeError::New(env, "deviceType must be 'input' or 'output'")
         .ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
   // Parse deviceId (required)
-  std::string deviceId = "";
+  deviceId = "";
   if (config.Has("deviceId")) {
     Napi::Value idVal = config.Get("deviceId");
     if (idVal.IsString()) {
@@ -78,69 +77,1433 @@ Napi::Value AudioController::Start(const Napi::CallbackInfo &info) {
   if (deviceId.empty()) {
     Napi::TypeError::New(env, "deviceId is required")
         .ThrowAsJavaScriptException();
-    return env.Null();
+    return false;
   }
 
-  Napi::Function callback = info[1].As<Napi::Function>();
+  return true;
+}
 
-  // Create a ThreadSafeFunction to call back into JS from the audio thread
-  this->tsfn = std::make_shared<Napi::ThreadSafeFunction>(
-      Napi::ThreadSafeFunction::New(env, callback, "AudioDataCallback", 0, 1));
-
-  auto dataCallback = [tsfn = this->tsfn](const uint8_t *data, size_t size) {
-    // Copy data to a vector to pass to the JS thread safely
-    auto dataVec = new std::vector<uint8_t>(data, data + size);
-
-    napi_status status =
-        tsfn->BlockingCall(dataVec, [](Napi::Env env, Napi::Function jsCallback,
-                                       std::vector<uint8_t> *vec) {
-          // This runs on the JS main thread
-          Napi::Buffer<uint8_t> buffer =
-              Napi::Buffer<uint8_t>::Copy(env, vec->data(), vec->size());
-          jsCallback.Call({env.Null(), buffer});
-          delete vec;
-        });
-
-    if (status != napi_ok) {
-      // Handle error or shutdown
-      delete dataVec;
+// Read an optional boolean option; throws into JS and returns false if it
+// has the wrong type
+static bool GetBooleanOption(Napi::Env env, Napi::Object config,
+                             const char *name, bool &value) {
+  if (!config.Has(name))
+    return true;
+  Napi::Value val = config.Get(name);
+  if (val.IsUndefined())
+    return true;
+  if (!val.IsBoolean()) {
+    Napi::TypeError::New(env, std::string(name) + " must be a boolean")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  value = val.As<Napi::Boolean>().Value();
+  return true;
+}
+
+// Read an optional non-negative number option
+static bool GetNumberOption(Napi::Env env, Napi::Object config,
+                            const char *name, double &value) {
+  if (!config.Has(name))
+    return true;
+  Napi::Value val = config.Get(name);
+  if (val.IsUndefined())
+    return true;
+  if (!val.IsNumber() || val.As<Napi::Number>().DoubleValue() < 0) {
+    Napi::TypeError::New(env,
+                         std::string(name) + " must be a non-negative number")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  value = val.As<Napi::Number>().DoubleValue();
+  return true;
+}
+
+// Read an optional number option that may be negative, such as a level in
+// dB
+static bool GetSignedNumberOption(Napi::Env env, Napi::Object config,
+                                  const char *name, double &value) {
+  if (!config.Has(name))
+    return true;
+  Napi::Value val = config.Get(name);
+  if (val.IsUndefined())
+    return true;
+  if (!val.IsNumber()) {
+    Napi::TypeError::New(env, std::string(name) + " must be a number")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  value = val.As<Napi::Number>().DoubleValue();
+  return true;
+}
+
+bool AudioController::ParseStreamOptions(Napi::Env env, Napi::Object config,
+                                         StreamOptions &options) {
+  options = StreamOptions();
+
+  if (!GetBooleanOption(env, config, "sharedScheduler",
+                        options.sharedScheduler) ||
+      !GetBooleanOption(env, config, "realtimePriority",
+                        options.threadPriority.realtime) ||
+      !GetBooleanOption(env, config, "exclusive", options.buffer.exclusive)) {
+    return false;
+  }
+
+  double bufferFrames = 0;
+  if (!GetNumberOption(env, config, "latencyMs", options.buffer.latencyMs) ||
+      !GetNumberOption(env, config, "bufferFrames", bufferFrames)) {
+    return false;
+  }
+  options.buffer.bufferFrames = (uint32_t)bufferFrames;
+
+  if (config.Has("cpuAffinity")) {
+    Napi::Value affinityVal = config.Get("cpuAffinity");
+    if (affinityVal.IsArray()) {
+      Napi::Array cores = affinityVal.As<Napi::Array>();
+      for (uint32_t i = 0; i < cores.Length(); i++) {
+        Napi::Value core = cores.Get(i);
+        if (!core.IsNumber() || core.As<Napi::Number>().Int32Value() < 0) {
+          Napi::TypeError::New(env,
+                               "cpuAffinity must be an array of core indices")
+              .ThrowAsJavaScriptException();
+          return false;
+        }
+        options.threadPriority.cpuCores.push_back(
+            core.As<Napi::Number>().Int32Value());
+      }
+    } else if (!affinityVal.IsUndefined()) {
+      Napi::TypeError::New(env, "cpuAffinity must be an array of core indices")
+          .ThrowAsJavaScriptException();
+      return false;
     }
-  };
+  }
+
+  if (config.Has("dither")) {
+    Napi::Value ditherVal = config.Get("dither");
+    std::string dither =
+        ditherVal.IsString() ? ditherVal.As<Napi::String>().Utf8Value() : "";
+    if (dither == "none") {
+      options.dither = DitherMode::None;
+    } else if (dither == "tpdf") {
+      options.dither = DitherMode::Tpdf;
+    } else if (dither == "shaped") {
+      options.dither = DitherMode::Shaped;
+    } else if (!ditherVal.IsUndefined()) {
+      Napi::TypeError::New(env, "dither must be 'none', 'tpdf' or 'shaped'")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool AudioController::ParseAnalysisOptions(Napi::Env env,
+                                           Napi::Object config, bool &enabled,
+                                           SpectrumSettings &settings) {
+  enabled = false;
+  settings = SpectrumSettings();
+  if (!config.Has("analysis"))
+    return true;
+  Napi::Value analysisVal = config.Get("analysis");
+  if (analysisVal.IsUndefined())
+    return true;
+  if (!analysisVal.IsObject()) {
+    Napi::TypeError::New(env, "analysis must be an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Object analysis = analysisVal.As<Napi::Object>();
+
+  double fftSize = settings.fftSize;
+  double bands = settings.bands;
+  if (!GetNumberOption(env, analysis, "fftSize", fftSize) ||
+      !GetNumberOption(env, analysis, "overlap", settings.overlap) ||
+      !GetNumberOption(env, analysis, "bands", bands) ||
+      !GetNumberOption(env, analysis, "minFrequency",
+                       settings.minFrequency) ||
+      !GetNumberOption(env, analysis, "maxFrequency",
+                       settings.maxFrequency) ||
+      !GetNumberOption(env, analysis, "updateRate", settings.updateRate)) {
+    return false;
+  }
+  settings.fftSize = (uint32_t)fftSize;
+  settings.bands = (uint32_t)bands;
+
+  std::string error;
+  if (!ValidateSpectrumSettings(settings, error)) {
+    Napi::RangeError::New(env, "analysis." + error)
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  enabled = true;
+  return true;
+}
+
+bool AudioController::ParseDenoiseOptions(Napi::Env env, Napi::Object config,
+                                          bool &enabled,
+                                          DenoiseSettings &settings) {
+  enabled = false;
+  settings = DenoiseSettings();
+  if (!config.Has("denoise"))
+    return true;
+  Napi::Value denoiseVal = config.Get("denoise");
+  if (denoiseVal.IsUndefined())
+    return true;
+  if (denoiseVal.IsBoolean()) {
+    enabled = denoiseVal.As<Napi::Boolean>().Value();
+    return true;
+  }
+  if (!denoiseVal.IsObject()) {
+    Napi::TypeError::New(env, "denoise must be a boolean or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Object denoise = denoiseVal.As<Napi::Object>();
+
+  if (!GetNumberOption(env, denoise, "maxAttenuationDb",
+                       settings.maxAttenuationDb)) {
+    return false;
+  }
+
+  std::string error;
+  if (!ValidateDenoiseSettings(settings, error)) {
+    Napi::RangeError::New(env, "denoise." + error)
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  enabled = true;
+  return true;
+}
+
+bool AudioController::ParseFileOptions(Napi::Env env, Napi::Object config,
+                                       FileSinkSettings &settings) {
+  settings = FileSinkSettings();
+  if (!config.Has("file"))
+    return true;
+  Napi::Value fileVal = config.Get("file");
+  if (fileVal.IsUndefined())
+    return true;
+  if (fileVal.IsString()) {
+    settings.path = fileVal.As<Napi::String>().Utf8Value();
+  } else if (fileVal.IsObject()) {
+    Napi::Object file = fileVal.As<Napi::Object>();
+    Napi::Value pathVal = file.Get("path");
+    if (!pathVal.IsString()) {
+      Napi::TypeError::New(env, "file.path must be a string")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    settings.path = pathVal.As<Napi::String>().Utf8Value();
+    double segmentBytes = 0;
+    if (!GetNumberOption(env, file, "segmentSeconds",
+                         settings.segmentSeconds) ||
+        !GetNumberOption(env, file, "segmentBytes", segmentBytes) ||
+        !GetBooleanOption(env, file, "direct", settings.direct) ||
+        !GetNumberOption(env, file, "checkpointSeconds",
+                         settings.checkpointSeconds)) {
+      return false;
+    }
+    settings.segmentBytes = (uint64_t)segmentBytes;
+  } else {
+    Napi::TypeError::New(env, "file must be a string or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  std::string error;
+  if (!ValidateFileSinkSettings(settings, error)) {
+    Napi::RangeError::New(env, "file." + error).ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+bool AudioController::ParseMappedOptions(Napi::Env env, Napi::Object config,
+                                         MappedCaptureSettings &settings) {
+  settings = MappedCaptureSettings();
+  if (!config.Has("mappedFile"))
+    return true;
+  Napi::Value mappedVal = config.Get("mappedFile");
+  if (mappedVal.IsUndefined())
+    return true;
+  if (mappedVal.IsString()) {
+    settings.path = mappedVal.As<Napi::String>().Utf8Value();
+  } else if (mappedVal.IsObject()) {
+    Napi::Object mapped = mappedVal.As<Napi::Object>();
+    Napi::Value pathVal = mapped.Get("path");
+    if (!pathVal.IsString()) {
+      Napi::TypeError::New(env, "mappedFile.path must be a string")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    settings.path = pathVal.As<Napi::String>().Utf8Value();
+    if (mapped.Has("mode") && !mapped.Get("mode").IsUndefined()) {
+      Napi::Value modeVal = mapped.Get("mode");
+      std::string mode =
+          modeVal.IsString() ? modeVal.As<Napi::String>().Utf8Value() : "";
+      if (mode == "append") {
+        settings.mode = MappedMode::Append;
+      } else if (mode == "ring") {
+        settings.mode = MappedMode::Ring;
+      } else {
+        Napi::TypeError::New(env,
+                             "mappedFile.mode must be 'append' or 'ring'")
+            .ThrowAsJavaScriptException();
+        return false;
+      }
+    }
+    if (!GetNumberOption(env, mapped, "seconds", settings.seconds)) {
+      return false;
+    }
+  } else {
+    Napi::TypeError::New(env, "mappedFile must be a string or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  std::string error;
+  if (!ValidateMappedCaptureSettings(settings, error)) {
+    Napi::RangeError::New(env, "mappedFile." + error)
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+bool AudioController::ParseSyncOptions(Napi::Env env, Napi::Object config,
+                                       SyncSettings &settings) {
+  settings = SyncSettings();
+  if (!config.Has("sync"))
+    return true;
+  Napi::Value syncVal = config.Get("sync");
+  if (syncVal.IsUndefined())
+    return true;
+  if (syncVal.IsString()) {
+    settings.session = syncVal.As<Napi::String>().Utf8Value();
+  } else if (syncVal.IsObject()) {
+    Napi::Object sync = syncVal.As<Napi::Object>();
+    Napi::Value sessionVal = sync.Get("session");
+    if (!sessionVal.IsString()) {
+      Napi::TypeError::New(env, "sync.session must be a string")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    settings.session = sessionVal.As<Napi::String>().Utf8Value();
+    if (!GetBooleanOption(env, sync, "master", settings.master)) {
+      return false;
+    }
+  } else {
+    Napi::TypeError::New(env, "sync must be a string or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  std::string error;
+  if (!ValidateSyncSettings(settings, error)) {
+    Napi::RangeError::New(env, "sync." + error).ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+bool AudioController::ParseContainerOptions(Napi::Env env,
+                                            Napi::Object config,
+                                            const FileSinkSettings &file,
+                                            ContainerSettings &settings) {
+  settings = ContainerSettings();
+  if (!config.Has("container"))
+    return true;
+  Napi::Value containerVal = config.Get("container");
+  if (containerVal.IsUndefined())
+    return true;
+  Napi::Value formatVal = containerVal;
+  if (containerVal.IsObject()) {
+    Napi::Object container = containerVal.As<Napi::Object>();
+    formatVal = container.Get("format");
+    if (container.Has("codec") && !container.Get("codec").IsUndefined()) {
+      Napi::Value codecVal = container.Get("codec");
+      std::string codec =
+          codecVal.IsString() ? codecVal.As<Napi::String>().Utf8Value() : "";
+      if (codec != "flac") {
+        Napi::TypeError::New(env, "container.codec must be 'flac'")
+            .ThrowAsJavaScriptException();
+        return false;
+      }
+    }
+    if (!GetNumberOption(env, container, "chunkSeconds",
+                         settings.chunkSeconds)) {
+      return false;
+    }
+  }
+  std::string format =
+      formatVal.IsString() ? formatVal.As<Napi::String>().Utf8Value() : "";
+  if (format == "ogg") {
+    settings.format = ContainerFormat::Ogg;
+  } else if (format == "webm") {
+    settings.format = ContainerFormat::WebM;
+  } else {
+    Napi::TypeError::New(env, containerVal.IsObject()
+                                  ? "container.format must be 'ogg' or 'webm'"
+                                  : "container must be 'ogg', 'webm' or an "
+                                    "object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  std::string error;
+  if (!ValidateContainerSettings(settings, error)) {
+    Napi::RangeError::New(env, "container." + error)
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  if (!file.path.empty() &&
+      (file.segmentSeconds > 0 || file.segmentBytes > 0 ||
+       file.checkpointSeconds > 0)) {
+    Napi::RangeError::New(env,
+                          "file only takes path and direct with container")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+bool AudioController::ParseFilterOptions(Napi::Env env, Napi::Object config,
+                                         std::vector<BiquadSpec> &sections) {
+  sections.clear();
+  if (!config.Has("filters"))
+    return true;
+  Napi::Value filtersVal = config.Get("filters");
+  if (filtersVal.IsUndefined())
+    return true;
+  if (!filtersVal.IsArray()) {
+    Napi::TypeError::New(env, "filters must be an array")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Array filters = filtersVal.As<Napi::Array>();
+  if (filters.Length() > FilterBank::kMaxSections) {
+    Napi::RangeError::New(env, "filters may hold at most " +
+                                   std::to_string(FilterBank::kMaxSections) +
+                                   " sections")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < filters.Length(); i++) {
+    std::string prefix = "filters[" + std::to_string(i) + "]";
+    Napi::Value filterVal = filters.Get(i);
+    if (!filterVal.IsObject()) {
+      Napi::TypeError::New(env, prefix + " must be an object")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    Napi::Object filter = filterVal.As<Napi::Object>();
+
+    BiquadSpec spec;
+    Napi::Value typeVal = filter.Get("type");
+    std::string type =
+        typeVal.IsString() ? typeVal.As<Napi::String>().Utf8Value() : "";
+    if (type == "highpass") {
+      spec.type = FilterType::HighPass;
+    } else if (type == "lowpass") {
+      spec.type = FilterType::LowPass;
+    } else if (type == "lowshelf") {
+      spec.type = FilterType::LowShelf;
+    } else if (type == "highshelf") {
+      spec.type = FilterType::HighShelf;
+    } else if (type == "notch") {
+      spec.type = FilterType::Notch;
+      spec.q = 10; // Narrow enough to leave the neighbouring band alone
+    } else {
+      Napi::TypeError::New(env, prefix +
+                                    ".type must be 'highpass', 'lowpass', "
+                                    "'lowshelf', 'highshelf' or 'notch'")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if (!filter.Has("frequency") || !filter.Get("frequency").IsNumber()) {
+      Napi::TypeError::New(env, prefix + ".frequency must be a number")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if (!GetNumberOption(env, filter, "frequency", spec.frequency) ||
+        !GetNumberOption(env, filter, "q", spec.q) ||
+        !GetSignedNumberOption(env, filter, "gainDb", spec.gainDb)) {
+      return false;
+    }
+
+    std::string error;
+    if (!ValidateBiquadSpec(spec, error)) {
+      Napi::RangeError::New(env, prefix + "." + error)
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    sections.push_back(spec);
+  }
+  return true;
+}
+
+bool AudioController::ParseGainOptions(Napi::Env env, Napi::Object config,
+                                       bool &enabled,
+                                       GainSettings &settings) {
+  enabled = false;
+  settings = GainSettings();
+  if (!config.Has("gainControl"))
+    return true;
+  Napi::Value gainVal = config.Get("gainControl");
+  if (gainVal.IsUndefined())
+    return true;
+  if (gainVal.IsBoolean()) {
+    enabled = gainVal.As<Napi::Boolean>().Value();
+    return true;
+  }
+  if (!gainVal.IsObject()) {
+    Napi::TypeError::New(env, "gainControl must be a boolean or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Object gain = gainVal.As<Napi::Object>();
+
+  if (!GetSignedNumberOption(env, gain, "targetLevelDb",
+                             settings.targetLevelDb) ||
+      !GetNumberOption(env, gain, "maxGainDb", settings.maxGainDb) ||
+      !GetNumberOption(env, gain, "attackMs", settings.attackMs) ||
+      !GetNumberOption(env, gain, "releaseMs", settings.releaseMs) ||
+      !GetSignedNumberOption(env, gain, "ceilingDb", settings.ceilingDb)) {
+    return false;
+  }
 
-  auto errorCallback = [tsfn = this->tsfn](const std::string &errorMsg) {
-    auto errorStr = new std::string(errorMsg);
-    napi_status status = tsfn->BlockingCall(
-        errorStr,
-        [](Napi::Env env, Napi::Function jsCallback, std::string *str) {
-          // Pass error to JS callback as first argument
-          jsCallback.Call({Napi::Error::New(env, *str).Value(), env.Null()});
-          delete str;
-        });
-    if (status != napi_ok) {
-      delete errorStr;
+  std::string error;
+  if (!ValidateGainSettings(settings, error)) {
+    Napi::RangeError::New(env, "gainControl." + error)
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  enabled = true;
+  return true;
+}
+
+bool AudioController::ParseEchoOptions(Napi::Env env, Napi::Object config,
+                                       const std::string &deviceType,
+                                       bool &enabled, EchoSettings &settings,
+                                       std::string &referenceId) {
+  enabled = false;
+  settings = EchoSettings();
+  referenceId.clear();
+  if (!config.Has("echoCancellation"))
+    return true;
+  Napi::Value echoVal = config.Get("echoCancellation");
+  if (echoVal.IsUndefined())
+    return true;
+  if (echoVal.IsBoolean()) {
+    enabled = echoVal.As<Napi::Boolean>().Value();
+  } else if (echoVal.IsObject()) {
+    Napi::Object echo = echoVal.As<Napi::Object>();
+    if (!GetNumberOption(env, echo, "tailMs", settings.tailMs)) {
+      return false;
+    }
+    if (echo.Has("referenceDeviceId")) {
+      Napi::Value idVal = echo.Get("referenceDeviceId");
+      if (idVal.IsString()) {
+        referenceId = idVal.As<Napi::String>().Utf8Value();
+      } else if (!idVal.IsUndefined()) {
+        Napi::TypeError::New(
+            env, "echoCancellation.referenceDeviceId must be a string")
+            .ThrowAsJavaScriptException();
+        return false;
+      }
+    }
+    std::string error;
+    if (!ValidateEchoSettings(settings, error)) {
+      Napi::RangeError::New(env, "echoCancellation." + error)
+          .ThrowAsJavaScriptException();
+      return false;
     }
+    enabled = true;
+  } else {
+    Napi::TypeError::New(env,
+                         "echoCancellation must be a boolean or an object")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (enabled && deviceType != AudioEngine::DEVICE_TYPE_INPUT) {
+    Napi::TypeError::New(env, "echoCancellation requires an input device")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+bool AudioController::ParseProcessing(Napi::Env env, Napi::Object config,
+                                      const std::string &deviceType,
+                                      ProcessingConfig &processing) {
+  return ParseFilterOptions(env, config, processing.filters) &&
+         ParseEchoOptions(env, config, deviceType, processing.echo,
+                          processing.echoSettings,
+                          processing.echoReferenceId) &&
+         ParseDenoiseOptions(env, config, processing.denoise,
+                             processing.denoiseSettings) &&
+         ParseGainOptions(env, config, processing.gain,
+                          processing.gainSettings) &&
+         ParseAnalysisOptions(env, config, processing.analysis,
+                              processing.spectrum);
+}
+
+bool AudioController::AttachProcessing(Napi::Env env,
+                                       const ProcessingConfig &processing,
+                                       StreamOptions &options) {
+  this->filterBank.reset();
+  this->echoCanceller.reset();
+  this->echoReference.reset();
+  this->denoiser.reset();
+  this->gainControl.reset();
+
+  // Filter first, so DC and rumble reach none of the later stages
+  if (!processing.filters.empty()) {
+    this->filterBank = std::make_shared<FilterBank>(processing.filters);
+    options.stages.push_back(this->filterBank);
+  }
+  if (processing.echo) {
+    // Default to the output device the system plays through
+    std::string referenceId = processing.echoReferenceId;
+    if (referenceId.empty()) {
+      for (const AudioDevice &device : this->engine->GetDevices()) {
+        if (device.type == AudioEngine::DEVICE_TYPE_OUTPUT &&
+            (referenceId.empty() || device.isDefault)) {
+          referenceId = device.id;
+        }
+      }
+    }
+    if (referenceId.empty()) {
+      Napi::Error::New(env, "No output device for the echo reference")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    this->echoReferenceId = referenceId;
+    this->echoReference = std::make_shared<EchoReference>();
+    this->echoCanceller = std::make_shared<EchoCanceller>(
+        this->echoReference, processing.echoSettings);
+    options.stages.push_back(this->echoCanceller);
+  }
+  // Denoise after the linear echo canceller, and before the analysis so it
+  // sees the cleaned audio
+  if (processing.denoise) {
+    this->denoiser = std::make_shared<Denoiser>(processing.denoiseSettings);
+    options.stages.push_back(this->denoiser);
+  }
+  // Level the cleaned audio, so residual noise does not steer the AGC, and
+  // limit it ahead of the final quantisation
+  if (processing.gain) {
+    this->gainControl =
+        std::make_shared<GainControl>(processing.gainSettings);
+    options.stages.push_back(this->gainControl);
+  }
+  if (processing.analysis) {
+    AttachAnalysis(env, processing.spectrum, options);
+  }
+  return true;
+}
+
+void AudioController::AttachAnalysis(Napi::Env env,
+                                     const SpectrumSettings &settings,
+                                     StreamOptions &options) {
+  // Allocated by the JS engine so it works where external buffers are not
+  // allowed; the backing store does not move while referenced
+  Napi::ArrayBuffer buffer =
+      Napi::ArrayBuffer::New(env, (1 + settings.bands) * sizeof(float));
+  this->spectrumBuffer = Napi::Persistent(buffer);
+  options.stages.push_back(std::make_shared<SpectrumAnalyzer>(
+      settings, (float *)buffer.Data()));
+}
+
+JsBridge::~JsBridge() {
+  std::vector<JsMessage *> left;
+  queue.Take(left);
+  left.insert(left.end(), batch.begin(), batch.end());
+  for (JsMessage *message : left) {
+    if (message->kind != JsMessage::Kind::Pcm) {
+      delete message;
+    }
+  }
+}
+
+void JsBridge::Recycle(JsMessage *message) {
+  if (message->kind == JsMessage::Kind::Pcm) {
+    messages.Release(message);
+  } else {
+    delete message;
+  }
+}
+
+static Napi::Buffer<uint8_t> ChunkBuffer(Napi::Env env,
+                                         const JsMessage &chunk) {
+  return Napi::Buffer<uint8_t>::Copy(env, chunk.pcm.data(), chunk.size);
+}
+
+// A run of audio chunks in one call. Each chunk keeps a Buffer of its own;
+// with more than one, they come as an array in the fourth argument.
+static void DeliverChunks(Napi::Env env, Napi::Function jsCallback,
+                          JsMessage *const *chunks, size_t count) {
+  if (count == 1) {
+    jsCallback.Call({env.Null(), ChunkBuffer(env, *chunks[0])});
+    return;
+  }
+  Napi::Array buffers = Napi::Array::New(env, count);
+  for (size_t i = 0; i < count; i++) {
+    buffers[(uint32_t)i] = ChunkBuffer(env, *chunks[i]);
+  }
+  jsCallback.Call({env.Null(), env.Null(), env.Undefined(), buffers});
+}
+
+void DeliverToJs(Napi::Env env, Napi::Function jsCallback, JsBridge *bridge,
+                 JsMessage *) {
+  std::vector<JsMessage *> &batch = bridge->batch;
+  bridge->queue.Take(batch);
+  bool live = env != nullptr && jsCallback != nullptr;
+  size_t i = 0;
+  try {
+    while (i < batch.size()) {
+      JsMessage *message = batch[i];
+      if (message->kind == JsMessage::Kind::Pcm) {
+        // Consecutive chunks go out together; errors and segments keep
+        // their place between them
+        size_t end = i + 1;
+        while (end < batch.size() &&
+               batch[end]->kind == JsMessage::Kind::Pcm) {
+          end++;
+        }
+        if (live) {
+          bridge->calls.fetch_add(1, std::memory_order_relaxed);
+          bridge->chunks.fetch_add(end - i, std::memory_order_relaxed);
+          DeliverChunks(env, jsCallback, batch.data() + i, end - i);
+        }
+        for (; i < end; i++) {
+          bridge->Recycle(batch[i]);
+        }
+        continue;
+      }
+      if (live) {
+        bridge->calls.fetch_add(1, std::memory_order_relaxed);
+        if (message->kind == JsMessage::Kind::Error) {
+          jsCallback.Call(
+              {Napi::Error::New(env, message->error).Value(), env.Null()});
+        } else {
+          const SegmentInfo &info = message->segment;
+          Napi::Object event = Napi::Object::New(env);
+          event.Set("path", info.path);
+          event.Set("index", info.index);
+          event.Set("startFrame", (double)info.startFrame);
+          event.Set("frames", (double)info.frames);
+          event.Set("startTime", info.startTimeNs / 1e6);
+          event.Set("endTime", info.endTimeNs / 1e6);
+          jsCallback.Call({env.Null(), env.Null(), event});
+        }
+      }
+      bridge->Recycle(message);
+      i++;
+    }
+  } catch (...) {
+    // A listener threw: the rest of the batch is not delivered
+    for (; i < batch.size(); i++) {
+      bridge->Recycle(batch[i]);
+    }
+    batch.clear();
+    throw;
+  }
+  batch.clear();
+}
+
+// Queue a message for the JS callback. The thread-safe function is only
+// called when the queue was empty; until that call runs, later messages
+// join the same batch.
+static void QueueMessage(const std::shared_ptr<JsCallback> &tsfn,
+                         JsMessage *message) {
+  JsBridge *bridge = tsfn->GetContext();
+  if (bridge->queue.Push(message) && tsfn->BlockingCall() != napi_ok) {
+    // Shutting down: nothing will deliver them
+    std::vector<JsMessage *> dropped;
+    bridge->queue.Take(dropped);
+    for (JsMessage *queued : dropped) {
+      bridge->Recycle(queued);
+    }
+  }
+}
+
+// Copy a chunk of data into a pooled message and queue it for the JS
+// callback; after warm-up this does not allocate
+static void QueueBytes(const std::shared_ptr<JsCallback> &tsfn,
+                       const uint8_t *data, size_t size) {
+  JsMessage *message = tsfn->GetContext()->messages.Acquire();
+  if (message->pcm.size() < size) {
+    message->pcm.resize(size);
+  }
+  std::memcpy(message->pcm.data(), data, size);
+  message->size = size;
+  QueueMessage(tsfn, message);
+}
+
+static void QueueData(const std::shared_ptr<JsCallback> &tsfn,
+                      const int16_t *samples, size_t sampleCount) {
+  QueueBytes(tsfn, (const uint8_t *)samples, sampleCount * sizeof(int16_t));
+}
+
+// Pass an error to the JS callback as its first argument
+static void QueueError(const std::shared_ptr<JsCallback> &tsfn,
+                       const std::string &error) {
+  auto message = new JsMessage();
+  message->kind = JsMessage::Kind::Error;
+  message->error = error;
+  QueueMessage(tsfn, message);
+}
+
+// Route file output errors to the JS callback
+static FileSink::ErrorCallback
+MakeErrorCallback(const std::shared_ptr<JsCallback> &tsfn) {
+  return [tsfn](const std::string &error) { QueueError(tsfn, error); };
+}
+
+// Report finished file segments to the JS callback as its third argument
+static FileSink::SegmentCallback
+MakeSegmentCallback(const std::shared_ptr<JsCallback> &tsfn) {
+  return [tsfn](const SegmentInfo &segment) {
+    auto message = new JsMessage();
+    message->kind = JsMessage::Kind::Segment;
+    message->segment = segment;
+    QueueMessage(tsfn, message);
   };
+}
+
+// What every stream the controller opens delivers into. The class is final
+// and does all of a packet's work itself, so the engine's call to OnData is
+// the only indirect call per packet.
+class AudioController::StreamSink final : public CaptureSink {
+public:
+  // Without a state the sink only reports errors, as for the echo
+  // reference's loopback
+  StreamSink(std::shared_ptr<JsCallback> tsfn,
+             std::shared_ptr<StreamState> state, std::string errorPrefix)
+      : tsfn(std::move(tsfn)), state(std::move(state)),
+        errorPrefix(std::move(errorPrefix)) {}
+
+  void OnData(const PcmBlock &block) override {
+    if (!state) {
+      return;
+    }
+    if (state->channels != 0 && (block.channels != state->channels ||
+                                 block.sampleRate != state->sampleRate)) {
+      // Headers, segment lengths and history would not describe it
+      if (!state->formatMismatch.exchange(true)) {
+        OnError("Device delivered " + std::to_string(block.sampleRate) +
+                " Hz, " + std::to_string(block.channels) +
+                " channels, but the recording was set up for " +
+                std::to_string(state->sampleRate) + " Hz, " +
+                std::to_string(state->channels) + " channels");
+      }
+      return;
+    }
+    const int16_t *samples = block.samples;
+    size_t sampleCount = block.frames * block.channels;
+    if (!state->isActive.load(std::memory_order_acquire)) {
+      int64_t commitFrames = state->commitFrames.exchange(-1);
+      if (commitFrames < 0) {
+        // Prepared but not started: keep a history if asked to, else drop
+        if (state->preRoll) {
+          state->preRoll->Write(samples, sampleCount);
+        }
+        return;
+      }
+
+      // commit(): flush the retained audio, then continue with live data
+      std::vector<int16_t> &history = state->history;
+      if ((state->deliverPcm || state->file || state->mapped ||
+           state->container) &&
+          state->preRoll->ReadLatest((size_t)commitFrames, history) > 0) {
+        Write(history.data(), history.size(), CaptureMetadata());
+      }
+      state->preRoll->Clear();
+      state->isActive.store(true);
+    } else if (state->preRoll && state->preRoll->FrameCount() > 0) {
+      // Started without commit(): history must not overlap delivered audio
+      state->preRoll->Clear();
+    }
+    Write(samples, sampleCount, block.meta);
+  }
+
+  void OnError(const std::string &error) override {
+    QueueError(tsfn, errorPrefix + error);
+  }
+
+private:
+  // Hand audio to the native outputs, then to JS. A containerised stream
+  // passes its chunks on itself.
+  void Write(const int16_t *samples, size_t sampleCount,
+             const CaptureMetadata &meta) {
+    if (state->file) {
+      state->file->Write(samples, sampleCount, meta);
+    }
+    if (state->mapped) {
+      state->mapped->Write(samples, sampleCount);
+    }
+    if (state->container) {
+      state->container->Write(samples, sampleCount, meta);
+    } else if (state->deliverPcm) {
+      QueueData(tsfn, samples, sampleCount);
+    }
+  }
+
+  std::shared_ptr<JsCallback> tsfn;
+  std::shared_ptr<StreamState> state;
+  std::string errorPrefix;
+};
+
+void AudioController::OpenStream(Napi::Env env, const std::string &deviceType,
+                                 const std::string &deviceId,
+                                 Napi::Function callback, bool active,
+                                 bool deliverPcm,
+                                 std::unique_ptr<PreRollBuffer> preRoll,
+                                 const OutputConfig &outputs) {
+  // Create a ThreadSafeFunction to call back into JS from the audio thread
+  this->tsfn = std::make_shared<JsCallback>(JsCallback::New(
+      env, callback, "AudioDataCallback", 0, 1, new JsBridge(),
+      [](Napi::Env, void *, JsBridge *bridge) { delete bridge; }));
+  this->state = std::make_shared<StreamState>();
+  this->state->isActive.store(active);
+  this->state->deliverPcm = deliverPcm;
+  this->state->preRoll = std::move(preRoll);
+  if (this->state->preRoll) {
+    this->state->history.reserve(this->state->preRoll->CapacityFrames() *
+                                 this->state->preRoll->Channels());
+  }
+
+  bool containerised = outputs.container.format != ContainerFormat::None;
+  if (this->state->preRoll || !outputs.file.path.empty() ||
+      !outputs.mapped.path.empty() || containerised) {
+    // What the engine will open, which exclusive mode may negotiate away
+    // from the mix format
+    AudioFormat format = this->engine->GetStreamFormat(deviceType, deviceId);
+    if (format.sampleRate == 0 || format.channels == 0) {
+      AbortOpen(env, "Failed to get device format");
+      return;
+    }
+    this->state->sampleRate = format.sampleRate;
+    this->state->channels = format.channels;
+  }
+  if (!outputs.file.path.empty() || !outputs.mapped.path.empty() ||
+      containerised) {
+    int sampleRate = this->state->sampleRate;
+    int channels = this->state->channels;
+    std::string error;
+    if (!outputs.file.path.empty() && containerised) {
+      auto file = std::make_shared<ContainerFile>(
+          outputs.file.path, outputs.file.direct,
+          MakeErrorCallback(this->tsfn));
+      if (!file->Open(error)) {
+        AbortOpen(env, error);
+        return;
+      }
+      this->state->containerFile = file;
+    } else if (!outputs.file.path.empty()) {
+      auto sink = std::make_shared<FileSink>(
+          outputs.file, sampleRate, channels,
+          MakeSegmentCallback(this->tsfn), MakeErrorCallback(this->tsfn));
+      if (!sink->Open(error)) {
+        AbortOpen(env, error);
+        return;
+      }
+      this->state->file = sink;
+    }
+    if (!outputs.mapped.path.empty()) {
+      auto mapped = std::make_shared<MappedCaptureWriter>(
+          outputs.mapped, sampleRate, channels);
+      if (!mapped->Open(error)) {
+        AbortOpen(env, error);
+        return;
+      }
+      this->state->mapped = mapped;
+    }
+    if (containerised) {
+      // Each chunk is whole, so JS can pass it on as it comes
+      std::shared_ptr<JsCallback> jsCallback = this->tsfn;
+      std::shared_ptr<ContainerFile> file = this->state->containerFile;
+      this->state->container = std::make_unique<ContainerStream>(
+          outputs.container, sampleRate, channels,
+          std::random_device()(),
+          [jsCallback, file, deliverPcm](const uint8_t *data, size_t size) {
+            if (file) {
+              file->Write(data, size);
+            }
+            if (deliverPcm) {
+              QueueBytes(jsCallback, data, size);
+            }
+          });
+    }
+  }
+
+  // A synchronised stream reaches its own sink through the session's
+  this->syncSink.reset();
+  std::shared_ptr<CaptureSink> sink =
+      std::make_shared<StreamSink>(this->tsfn, this->state, "");
+  if (!outputs.sync.session.empty()) {
+    std::shared_ptr<SyncSession> session =
+        SyncSession::Get(outputs.sync.session);
+    if (outputs.sync.master && !session->ClaimMaster()) {
+      AbortOpen(env, "Sync session '" + outputs.sync.session +
+                         "' already has a master");
+      return;
+    }
+    this->syncSink = std::make_shared<SyncedSink>(
+        session, outputs.sync.master, sink);
+    sink = this->syncSink;
+  }
 
+  this->usageValid = ReadProcessUsage(this->usageAtStart);
   try {
-    this->engine->Start(deviceType, deviceId, dataCallback, errorCallback);
+    this->engine->Start(deviceType, deviceId, sink);
   } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    // Also gives up a master claim, so the session can have another
+    AbortOpen(env, e.what());
   }
+}
 
-  return env.Null();
+void AudioController::AbortOpen(Napi::Env env, const std::string &error) {
+  CloseStream();
+  // Left by CloseStream(); a failed stream has no sync stats to keep
+  this->syncSink.reset();
+  Napi::Error::New(env, error).ThrowAsJavaScriptException();
 }
 
-Napi::Value AudioController::Stop(const Napi::CallbackInfo &info) {
+void AudioController::StartEchoReference(Napi::Env env,
+                                         const StreamOptions &options) {
+  if (!this->echoReference) {
+    return;
+  }
+
+  // Loopback of the output device: only its tap is of interest, the PCM is
+  // dropped
+  StreamOptions referenceOptions;
+  referenceOptions.sharedScheduler = options.sharedScheduler;
+  referenceOptions.threadPriority = options.threadPriority;
+  referenceOptions.dither = DitherMode::None;
+  referenceOptions.stages.push_back(
+      std::make_shared<EchoReferenceTap>(this->echoReference));
+
+  this->referenceEngine = CreatePlatformAudioEngine();
+  if (!this->referenceEngine) {
+    Napi::Error::New(env, "Echo cancellation is not supported here")
+        .ThrowAsJavaScriptException();
+    CloseStream();
+    return;
+  }
+  this->referenceEngine->SetOptions(referenceOptions);
+  try {
+    this->referenceEngine->Start(
+        AudioEngine::DEVICE_TYPE_OUTPUT, this->echoReferenceId,
+        std::make_shared<StreamSink>(this->tsfn, nullptr, "Echo reference: "));
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, std::string("Echo reference: ") + e.what())
+        .ThrowAsJavaScriptException();
+    CloseStream();
+  }
+}
+
+void AudioController::CloseStream() {
+  this->state->isActive.store(false);
+  this->isPrepared = false;
+  this->preparedCallback.Reset();
   if (this->engine) {
     this->engine->Stop();
   }
+  if (this->referenceEngine) {
+    this->referenceEngine->Stop();
+    this->referenceEngine.reset();
+  }
+  // No more audio can arrive: write out the rest and report the last
+  // segment while the callback is still there
+  CloseOutputs();
+  if (this->syncSink) {
+    this->syncSink->Leave();
+  }
   if (this->tsfn) {
     this->tsfn->Release();
     this->tsfn = nullptr;
   }
+  // The engine has stopped writing into it
+  this->spectrumBuffer.Reset();
+}
+
+void AudioController::CloseOutputs() {
+  if (this->state->container) {
+    // The last packet and page go out before the file closes
+    this->state->container->Finish();
+    this->state->container.reset();
+  }
+  if (this->state->containerFile) {
+    this->state->containerFile->Close();
+    this->state->containerFile.reset();
+  }
+  if (this->state->file) {
+    this->state->file->Close();
+    this->state->file.reset();
+  }
+  if (this->state->mapped) {
+    this->state->mapped->Close();
+    this->state->mapped.reset();
+  }
+}
+
+// Options that set up a stream, as JSON by name. Those only prepare() takes
+// and the outputs, which start() may not give at all, are left out.
+static std::map<std::string, std::string> StreamSettings(Napi::Env env,
+                                                         Napi::Object config) {
+  static const char *const kSkipped[] = {
+      "deviceType", "deviceId", "preRollSeconds", "preRollEncoding",
+      "file",       "mappedFile", "sync",         "container"};
+  Napi::Function stringify = env.Global()
+                                 .Get("JSON")
+                                 .As<Napi::Object>()
+                                 .Get("stringify")
+                                 .As<Napi::Function>();
+  std::map<std::string, std::string> settings;
+  Napi::Array names = config.GetPropertyNames();
+  for (uint32_t i = 0; i < names.Length(); i++) {
+    std::string name = names.Get(i).ToString().Utf8Value();
+    bool skipped = false;
+    for (const char *skip : kSkipped) {
+      skipped = skipped || name == skip;
+    }
+    Napi::Value value = config.Get(name);
+    if (skipped || value.IsUndefined()) {
+      continue;
+    }
+    Napi::Value json = stringify.Call({value});
+    settings[name] = json.IsString() ? json.As<Napi::String>().Utf8Value() : "";
+  }
+  return settings;
+}
+
+Napi::Value AudioController::Start(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsFunction()) {
+    Napi::TypeError::New(env, "Expected config object and callback function")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string deviceType;
+  std::string deviceId;
+  if (!ParseDeviceConfig(env, info[0].As<Napi::Object>(), deviceType,
+                         deviceId)) {
+    return env.Null();
+  }
+
+  Napi::Object config = info[0].As<Napi::Object>();
+
+  StreamOptions options;
+  ProcessingConfig processing;
+  OutputConfig outputs;
+  bool deliverPcm = true;
+  if (!ParseStreamOptions(env, config, options) ||
+      !ParseProcessing(env, config, deviceType, processing) ||
+      !ParseFileOptions(env, config, outputs.file) ||
+      !ParseMappedOptions(env, config, outputs.mapped) ||
+      !ParseSyncOptions(env, config, outputs.sync) ||
+      !ParseContainerOptions(env, config, outputs.file, outputs.container) ||
+      !GetBooleanOption(env, config, "deliverPcm", deliverPcm)) {
+    return env.Null();
+  }
+
+  if (this->isPrepared) {
+    // The device is already open and running, just let data through
+    if (deviceType == this->preparedType && deviceId == this->preparedId) {
+      if (!outputs.file.path.empty() || !outputs.mapped.path.empty() ||
+          !outputs.sync.session.empty() ||
+          outputs.container.format != ContainerFormat::None) {
+        Napi::Error::New(env, "Give file, mappedFile, sync and container to "
+                              "prepare() for a prepared stream")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      // Everything else was set up by prepare(): start() may leave it out
+      // or repeat it, but not change it
+      std::map<std::string, std::string> settings = StreamSettings(env, config);
+      for (const auto &setting : settings) {
+        auto prepared = this->preparedSettings.find(setting.first);
+        if (prepared == this->preparedSettings.end() ||
+            prepared->second != setting.second) {
+          Napi::Error::New(env, "'" + setting.first +
+                                    "' of a prepared stream is set by "
+                                    "prepare() and cannot differ in start()")
+              .ThrowAsJavaScriptException();
+          return env.Null();
+        }
+      }
+      if (!info[1].StrictEquals(this->preparedCallback.Value())) {
+        Napi::Error::New(env, "A prepared stream delivers to the callback "
+                              "given to prepare()")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      this->state->commitFrames.store(-1);
+      this->state->isActive.store(true);
+      return env.Null();
+    }
+    CloseStream();
+  }
+
+  if (!AttachProcessing(env, processing, options)) {
+    return env.Null();
+  }
+  this->engine->SetOptions(options);
+  OpenStream(env, deviceType, deviceId, info[1].As<Napi::Function>(), true,
+             deliverPcm, nullptr, outputs);
+  if (!env.IsExceptionPending()) {
+    StartEchoReference(env, options);
+  }
+  return env.Null();
+}
+
+Napi::Value AudioController::Stop(const Napi::CallbackInfo &info) {
+  if (this->isPrepared) {
+    // Keep the device warm for the next start()
+    this->state->commitFrames.store(-1);
+    this->state->isActive.store(false);
+  } else {
+    CloseStream();
+  }
   return info.Env().Null();
 }
 
+Napi::Value AudioController::Prepare(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsFunction()) {
+    Napi::TypeError::New(env, "Expected config object and callback function")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string deviceType;
+  std::string deviceId;
+  if (!ParseDeviceConfig(env, info[0].As<Napi::Object>(), deviceType,
+                         deviceId)) {
+    return env.Null();
+  }
+
+  Napi::Object config = info[0].As<Napi::Object>();
+
+  StreamOptions options;
+  ProcessingConfig processing;
+  OutputConfig outputs;
+  bool deliverPcm = true;
+  if (!ParseStreamOptions(env, config, options) ||
+      !ParseProcessing(env, config, deviceType, processing) ||
+      !ParseFileOptions(env, config, outputs.file) ||
+      !ParseMappedOptions(env, config, outputs.mapped) ||
+      !ParseSyncOptions(env, config, outputs.sync) ||
+      !ParseContainerOptions(env, config, outputs.file, outputs.container) ||
+      !GetBooleanOption(env, config, "deliverPcm", deliverPcm)) {
+    return env.Null();
+  }
+
+  // Optional pre-roll history kept while the stream is idle
+  double preRollSeconds = 0;
+  if (!GetNumberOption(env, config, "preRollSeconds", preRollSeconds)) {
+    return env.Null();
+  }
+  if (!std::isfinite(preRollSeconds)) {
+    Napi::TypeError::New(env, "preRollSeconds must be a non-negative number")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  if (preRollSeconds > kMaxPreRollSeconds) {
+    Napi::RangeError::New(env, "preRollSeconds must be at most " +
+                                   std::to_string((int)kMaxPreRollSeconds))
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  PreRollBuffer::Encoding preRollEncoding = PreRollBuffer::Encoding::Pcm16;
+  if (config.Has("preRollEncoding")) {
+    Napi::Value encodingVal = config.Get("preRollEncoding");
+    std::string encoding =
+        encodingVal.IsString() ? encodingVal.As<Napi::String>().Utf8Value()
+                                : "";
+    if (encoding == "mulaw") {
+      preRollEncoding = PreRollBuffer::Encoding::MuLaw;
+    } else if (encoding != "pcm") {
+      Napi::TypeError::New(env, "preRollEncoding must be 'pcm' or 'mulaw'")
+          .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
+
+  CloseStream();
+
+  if (!AttachProcessing(env, processing, options)) {
+    return env.Null();
+  }
+  this->engine->SetOptions(options);
+
+  // Sized for the format the stream will open with
+  std::unique_ptr<PreRollBuffer> preRoll;
+  int sampleRate = 0;
+  if (preRollSeconds > 0) {
+    AudioFormat format = this->engine->GetStreamFormat(deviceType, deviceId);
+    if (format.sampleRate == 0) {
+      Napi::Error::New(env, "Failed to get device format")
+          .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    sampleRate = format.sampleRate;
+    preRoll = std::make_unique<PreRollBuffer>(
+        (size_t)(preRollSeconds * sampleRate), format.channels,
+        preRollEncoding);
+  }
+  OpenStream(env, deviceType, deviceId, info[1].As<Napi::Function>(), false,
+             deliverPcm, std::move(preRoll), outputs);
+  if (!env.IsExceptionPending()) {
+    StartEchoReference(env, options);
+  }
+  if (env.IsExceptionPending()) {
+    CloseStream();
+    return env.Null();
+  }
+
+  this->isPrepared = true;
+  this->preparedType = deviceType;
+  this->preparedId = deviceId;
+  this->preparedSampleRate = sampleRate;
+  this->preparedSettings = StreamSettings(env, config);
+  this->preparedCallback = Napi::Persistent(info[1].As<Napi::Function>());
+  return env.Null();
+}
+
+Napi::Value AudioController::Unprepare(const Napi::CallbackInfo &info) {
+  CloseStream();
+  return info.Env().Null();
+}
+
+Napi::Value AudioController::Commit(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(env, "Expected secondsBack number")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  if (!this->isPrepared || !this->state->preRoll) {
+    Napi::Error::New(env,
+                     "commit() requires a stream prepared with preRollSeconds")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  double secondsBack = info[0].As<Napi::Number>().DoubleValue();
+  if (secondsBack < 0) {
+    secondsBack = 0;
+  }
+
+  // The capture thread flushes the history ahead of its next packet and
+  // then switches to live delivery, so the two never interleave
+  if (!this->state->isActive.load()) {
+    this->state->commitFrames.store(
+        (int64_t)(secondsBack * this->preparedSampleRate));
+  }
+  return env.Null();
+}
+
+Napi::Value AudioController::GetStats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  StreamStats stats = this->engine->GetStats();
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("packets", (double)stats.packets);
+  result.Set("frames", (double)stats.frames);
+  result.Set("processingTimeMs", stats.processingTimeMs);
+  result.Set("avgLatencyMs", stats.avgLatencyMs);
+  result.Set("maxLatencyMs", stats.maxLatencyMs);
+  result.Set("sharedStreams", stats.sharedStreams);
+  result.Set("threadPriority", ThreadPriorityName(stats.threadPriority));
+  result.Set("affinityApplied", stats.affinityApplied);
+  ProcessUsage usage;
+  if (this->usageValid && ReadProcessUsage(usage)) {
+    result.Set("processCpuMs",
+               (double)(usage.cpuNs - this->usageAtStart.cpuNs) / 1e6);
+    result.Set("processWakeups",
+               (double)(usage.wakeups - this->usageAtStart.wakeups));
+  }
+  if (this->filterBank) {
+    result.Set("filterTimeMs", this->filterBank->ProcessingTimeMs());
+  }
+  if (this->denoiser) {
+    result.Set("denoiseTimeMs", this->denoiser->ProcessingTimeMs());
+  }
+  if (this->echoCanceller) {
+    result.Set("echoTimeMs", this->echoCanceller->ProcessingTimeMs());
+    result.Set("erleDb", this->echoCanceller->ErleDb());
+  }
+  if (this->gainControl) {
+    GainStats gain = this->gainControl->Stats();
+    result.Set("gainTimeMs", this->gainControl->ProcessingTimeMs());
+    result.Set("agcGainDb", gain.agcGainDb);
+    result.Set("gainReductionDb", gain.reductionDb);
+    result.Set("maxGainReductionDb", gain.maxReductionDb);
+    result.Set("limitedFrames", (double)gain.limitedFrames);
+  }
+  if (this->state && (this->state->file || this->state->containerFile)) {
+    BlockWriter::WriteStats file =
+        this->state->file ? this->state->file->GetWriteStats()
+                          : this->state->containerFile->GetWriteStats();
+    result.Set("fileBackend",
+               DiskBackendName(DiskWriter::Shared().ActiveBackend()));
+    result.Set("fileQueueDepth", (double)file.queueDepth);
+    result.Set("fileMaxQueueDepth", (double)file.maxQueueDepth);
+    result.Set("fileWriteLatencyMs", file.avgLatencyMs);
+    result.Set("fileMaxWriteLatencyMs", file.maxLatencyMs);
+  }
+  if (this->state && this->state->mapped) {
+    result.Set("mappedFrames", (double)this->state->mapped->WrittenFrames());
+    result.Set("mappedDroppedFrames",
+               (double)this->state->mapped->DroppedFrames());
+  }
+  if (this->tsfn) {
+    JsBridge *bridge = this->tsfn->GetContext();
+    result.Set("jsCalls",
+               (double)bridge->calls.load(std::memory_order_relaxed));
+    result.Set("jsChunks",
+               (double)bridge->chunks.load(std::memory_order_relaxed));
+  }
+  if (this->syncSink) {
+    SyncStats sync = this->syncSink->GetStats();
+    result.Set("syncRole", sync.master ? "master" : "follower");
+    result.Set("syncDriftPpm", sync.driftPpm);
+    result.Set("syncErrorUs", sync.errorUs);
+    result.Set("syncMaxErrorUs", sync.maxErrorUs);
+    result.Set("syncResyncs", (double)sync.resyncs);
+    result.Set("syncStartFrame", (double)sync.startFrame);
+  }
+
+  return result;
+}
+
+Napi::Value AudioController::GetSpectrum(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (this->spectrumBuffer.IsEmpty()) {
+    return env.Null();
+  }
+
+  // A live view: the capture thread keeps publishing into it
+  Napi::ArrayBuffer buffer = this->spectrumBuffer.Value();
+  return Napi::Float32Array::New(env, buffer.ByteLength() / sizeof(float),
+                                 buffer, 0);
+}
+
 Napi::Value AudioController::GetDevices(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
@@ -185,6 +1548,8 @@ Napi::Value AudioController::GetDeviceFormat(const Napi::CallbackInfo &info) {
   result.Set("channels", format.channels);
   result.Set("bitDepth", format.bitDepth);
   result.Set("rawBitDepth", format.rawBitDepth);
+  result.Set("periodFrames", format.periodFrames);
+  result.Set("minPeriodFrames", format.minPeriodFrames);
 
   return result;
 }
@@ -231,3 +1596,33 @@ Napi::Value AudioController::RequestPermission(const Napi::CallbackInfo &info) {
 
   return Napi::Boolean::New(env, granted);
 }
+
+Napi::Value AudioController::RecoverRecording(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Expected path string")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string path = info[0].As<Napi::String>().Utf8Value();
+  std::vector<RecoveredSegment> segments;
+  std::string error;
+  if (!::RecoverRecording(path, segments, error)) {
+    Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Array result = Napi::Array::New(env, segments.size());
+  for (size_t i = 0; i < segments.size(); i++) {
+    Napi::Object segment = Napi::Object::New(env);
+    segment.Set("path", segments[i].path);
+    segment.Set("index", segments[i].index);
+    segment.Set("frames", (double)segments[i].frames);
+    segment.Set("checkpointFrames", (double)segments[i].checkpointFrames);
+    segment.Set("repaired", segments[i].repaired);
+    result[i] = segment;
+  }
+  return result;
+}
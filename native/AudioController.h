@@ -1,10 +1,65 @@
 #pragma once
 
 #include "AudioEngine.h"
+#include "core/BatchQueue.h"
+#include "core/ContainerStream.h"
+#include "core/Denoiser.h"
+#include "core/EchoCanceller.h"
+#include "core/FileSink.h"
+#include "core/FilterBank.h"
+#include "core/GainControl.h"
+#include "core/MappedCapture.h"
+#include "core/PreRollBuffer.h"
+#include "core/ProcessUsage.h"
+#include "core/RecyclingPool.h"
+#include "core/SpectrumAnalyzer.h"
+#include "core/SyncSession.h"
+#include <atomic>
+#include <map>
 #include <memory>
 #include <napi.h>
 #include <thread>
 
+// A message from the capture side to the JS callback. Audio messages come
+// from the stream's pool and go back to it once delivered; errors and
+// finished segments are rare and allocated each time.
+struct JsMessage {
+  enum class Kind { Pcm, Error, Segment };
+  Kind kind = Kind::Pcm;
+  std::vector<uint8_t> pcm; // Grown to the largest packet, then reused
+  size_t size = 0;
+  std::string error;
+  SegmentInfo segment;
+};
+
+// Context of a stream's thread-safe function. Messages wait in its queue,
+// and the function is only called when the queue was empty, so one call
+// delivers everything that piled up meanwhile. Its finalizer deletes it
+// after the last queued call, so no message outlives the pool.
+struct JsBridge {
+  RecyclingPool<JsMessage> messages{16, JsMessage()};
+  BatchQueue<JsMessage *> queue{64};
+  std::vector<JsMessage *> batch; // Being delivered, on the JS thread
+  // Calls into JS, and audio chunks they delivered
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> chunks{0};
+
+  JsBridge() { batch.reserve(64); }
+  ~JsBridge();
+
+  // Return a message to the pool, or free it
+  void Recycle(JsMessage *message);
+};
+
+// Runs on the JS thread for each call and delivers the whole queue; env is
+// null when the function is torn down with calls still queued. Carries no
+// message of its own.
+void DeliverToJs(Napi::Env env, Napi::Function callback, JsBridge *bridge,
+                 JsMessage *message);
+
+using JsCallback =
+    Napi::TypedThreadSafeFunction<JsBridge, JsMessage, DeliverToJs>;
+
 class AudioController : public Napi::ObjectWrap<AudioController> {
 public:
   static Napi::Object Init(Napi::Env env, Napi::Object exports);
@@ -16,11 +71,190 @@ private:
 
   Napi::Value Start(const Napi::CallbackInfo &info);
   Napi::Value Stop(const Napi::CallbackInfo &info);
+  Napi::Value Prepare(const Napi::CallbackInfo &info);
+  Napi::Value Unprepare(const Napi::CallbackInfo &info);
+  Napi::Value Commit(const Napi::CallbackInfo &info);
+  Napi::Value GetStats(const Napi::CallbackInfo &info);
+  Napi::Value GetSpectrum(const Napi::CallbackInfo &info);
   static Napi::Value GetDevices(const Napi::CallbackInfo &info);
   static Napi::Value GetDeviceFormat(const Napi::CallbackInfo &info);
   static Napi::Value CheckPermission(const Napi::CallbackInfo &info);
   static Napi::Value RequestPermission(const Napi::CallbackInfo &info);
+  static Napi::Value RecoverRecording(const Napi::CallbackInfo &info);
+
+  // Parse and validate { deviceType, deviceId }; throws into JS and returns
+  // false on invalid input
+  static bool ParseDeviceConfig(Napi::Env env, Napi::Object config,
+                                std::string &deviceType,
+                                std::string &deviceId);
+
+  // Parse the optional stream settings; throws into JS and returns false on
+  // invalid input
+  static bool ParseStreamOptions(Napi::Env env, Napi::Object config,
+                                 StreamOptions &options);
+
+  // Parse the optional analysis settings; enabled is cleared when there are
+  // none. Throws into JS and returns false on invalid input.
+  static bool ParseAnalysisOptions(Napi::Env env, Napi::Object config,
+                                   bool &enabled, SpectrumSettings &settings);
+
+  // Parse the optional denoise setting, true or an object of settings;
+  // enabled is cleared when absent or false. Throws into JS and returns
+  // false on invalid input.
+  static bool ParseDenoiseOptions(Napi::Env env, Napi::Object config,
+                                  bool &enabled, DenoiseSettings &settings);
+
+  // Parse the optional filter cascade, an array of sections applied in
+  // order; sections is left empty when absent. Throws into JS and returns
+  // false on invalid input.
+  static bool ParseFilterOptions(Napi::Env env, Napi::Object config,
+                                 std::vector<BiquadSpec> &sections);
+
+  // Parse the optional gain control setting, true or an object of
+  // settings; enabled is cleared when absent or false. Throws into JS and
+  // returns false on invalid input.
+  static bool ParseGainOptions(Napi::Env env, Napi::Object config,
+                               bool &enabled, GainSettings &settings);
+
+  // Parse the optional echo cancellation setting, true or an object of
+  // settings; only input streams take it. referenceId is left empty for
+  // the default output device. Throws into JS and returns false on invalid
+  // input.
+  static bool ParseEchoOptions(Napi::Env env, Napi::Object config,
+                               const std::string &deviceType, bool &enabled,
+                               EchoSettings &settings,
+                               std::string &referenceId);
+
+  // Parse the optional native file output, a path or an object of
+  // settings; the path is left empty when absent. Throws into JS and returns
+  // false on invalid input.
+  static bool ParseFileOptions(Napi::Env env, Napi::Object config,
+                               FileSinkSettings &settings);
+  // Same for the memory-mapped capture file
+  static bool ParseMappedOptions(Napi::Env env, Napi::Object config,
+                                 MappedCaptureSettings &settings);
+  // Same for the sync session, a session name or an object of settings
+  static bool ParseSyncOptions(Napi::Env env, Napi::Object config,
+                               SyncSettings &settings);
+  // Parse the optional container, a format name or an object of settings;
+  // format is left None when absent. The file output then holds the
+  // container, so it only takes a path.
+  static bool ParseContainerOptions(Napi::Env env, Napi::Object config,
+                                    const FileSinkSettings &file,
+                                    ContainerSettings &settings);
+
+  // Native outputs requested for a stream, besides the JS callback
+  struct OutputConfig {
+    FileSinkSettings file;
+    MappedCaptureSettings mapped;
+    SyncSettings sync;
+    ContainerSettings container;
+  };
+
+  // Native processing requested for a stream
+  struct ProcessingConfig {
+    std::vector<BiquadSpec> filters;
+    bool echo = false;
+    EchoSettings echoSettings;
+    std::string echoReferenceId;
+    bool denoise = false;
+    DenoiseSettings denoiseSettings;
+    bool gain = false;
+    GainSettings gainSettings;
+    bool analysis = false;
+    SpectrumSettings spectrum;
+  };
+
+  static bool ParseProcessing(Napi::Env env, Napi::Object config,
+                              const std::string &deviceType,
+                              ProcessingConfig &processing);
+
+  // Add the stages for processing to options, in order: filters, echo
+  // cancellation, noise suppression, gain control, analysis. Throws into JS
+  // and returns false when the echo reference device cannot be resolved.
+  bool AttachProcessing(Napi::Env env, const ProcessingConfig &processing,
+                        StreamOptions &options);
+
+  // Allocate the spectrum output buffer and add the analysis stage
+  void AttachAnalysis(Napi::Env env, const SpectrumSettings &settings,
+                      StreamOptions &options);
+
+  // Start capturing the echo reference, if the stream cancels echo. On
+  // failure throws into JS and closes the stream.
+  void StartEchoReference(Napi::Env env, const StreamOptions &options);
+
+  // State shared with the engine callbacks on the capture thread
+  struct StreamState {
+    // Data is only forwarded to JS while set; a prepared stream keeps the
+    // device running with this cleared so start() is just a flag flip
+    std::atomic<bool> isActive{false};
+    // Cleared when only the analysis output is wanted
+    bool deliverPcm = true;
+    // Frames of history requested by commit(), -1 when none is pending
+    std::atomic<int64_t> commitFrames{-1};
+    // Audio retained while idle; only touched on the capture thread
+    std::unique_ptr<PreRollBuffer> preRoll;
+    // What commit() flushes of it, reserved for the whole pre-roll
+    std::vector<int16_t> history;
+    // Native recording of the delivered audio, if any
+    std::shared_ptr<FileSink> file;
+    // Memory-mapped copy of it for other readers, if any
+    std::shared_ptr<MappedCaptureWriter> mapped;
+    // Encoder and muxer of a containerised stream, if any; its chunks go
+    // to JS in place of the PCM, and to containerFile instead of file
+    std::unique_ptr<ContainerStream> container;
+    std::shared_ptr<ContainerFile> containerFile;
+    // Format the pre-roll and outputs above were sized for, 0 without any.
+    // Blocks in another format are refused, and reported once.
+    int sampleRate = 0;
+    int channels = 0;
+    std::atomic<bool> formatMismatch{false};
+  };
+
+  // Engine sink routing a stream's audio through its state, defined in
+  // AudioController.cpp
+  class StreamSink;
+
+  // Start the engine with its sink routed through the stream state, and
+  // the native outputs that have a path
+  void OpenStream(Napi::Env env, const std::string &deviceType,
+                  const std::string &deviceId, Napi::Function callback,
+                  bool active, bool deliverPcm,
+                  std::unique_ptr<PreRollBuffer> preRoll,
+                  const OutputConfig &outputs);
+  // Undo a stream OpenStream() could not finish, releasing the callback so
+  // it does not keep the event loop alive, and throw error
+  void AbortOpen(Napi::Env env, const std::string &error);
+  // Close and drop the native outputs
+  void CloseOutputs();
+  void CloseStream();
 
   std::unique_ptr<AudioEngine> engine;
-  std::shared_ptr<Napi::ThreadSafeFunction> tsfn;
+  std::shared_ptr<JsCallback> tsfn;
+  std::shared_ptr<StreamState> state;
+  // JS-owned memory the analysis stage publishes into, held while the
+  // stream runs
+  Napi::Reference<Napi::ArrayBuffer> spectrumBuffer;
+  // Stages of the last opened stream, kept for their stats
+  std::shared_ptr<FilterBank> filterBank;
+  std::shared_ptr<Denoiser> denoiser;
+  std::shared_ptr<EchoCanceller> echoCanceller;
+  std::shared_ptr<GainControl> gainControl;
+  // Session membership of the last opened stream, kept for its stats
+  std::shared_ptr<SyncedSink> syncSink;
+  // Process totals when the last stream started, for the usage stats
+  ProcessUsage usageAtStart;
+  bool usageValid = false;
+  // Loopback capture feeding the echo canceller its reference
+  std::unique_ptr<AudioEngine> referenceEngine;
+  std::shared_ptr<EchoReference> echoReference;
+  std::string echoReferenceId;
+  bool isPrepared = false;
+  int preparedSampleRate = 0;
+  std::string preparedType;
+  std::string preparedId;
+  // What start() has to repeat for a prepared stream: its options as JSON
+  // by name, and its callback
+  std::map<std::string, std::string> preparedSettings;
+  Napi::FunctionReference preparedCallback;
 };
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "core/BufferSizing.h"
+#include "core/CaptureCore.h"
+#include "core/StreamStats.h"
 #include <cstdint>
-#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,6 +20,11 @@ struct AudioFormat {
   int channels;
   int bitDepth;    // Output bit depth (always 16 for now)
   int rawBitDepth; // Native device bit depth
+  // Device period in frames: the achieved one while a stream is running on
+  // the device, otherwise the engine default (0 if unknown)
+  int periodFrames = 0;
+  // Smallest period a low-latency stream can get (0 if unknown)
+  int minPeriodFrames = 0;
 };
 
 // Permission status for audio recording
@@ -28,6 +36,29 @@ struct PermissionStatus {
 // Permission type for requesting
 enum class PermissionType { Mic, System };
 
+// Optional per-stream settings, applied by the next Start()
+struct StreamOptions {
+  // Drive the stream from the process-wide CaptureScheduler and WorkerPool
+  // instead of a dedicated thread (Windows; macOS capture is already
+  // dispatched on GCD queues)
+  bool sharedScheduler = false;
+
+  // Scheduling for the capture thread: real-time class and core pinning.
+  // A shared capture thread keeps the highest priority any of its streams
+  // asked for.
+  ThreadPriorityRequest threadPriority;
+
+  // Period / exclusive mode for the device stream (Windows)
+  BufferRequest buffer;
+
+  // Processing run by the engine's CaptureCore on float audio, in order,
+  // before conversion to 16-bit PCM
+  std::vector<std::shared_ptr<CaptureStage>> stages;
+
+  // Requantisation of float and 24/32-bit audio to 16-bit PCM
+  DitherMode dither = DitherMode::Tpdf;
+};
+
 class AudioEngine {
 public:
   virtual ~AudioEngine() = default;
@@ -43,20 +74,21 @@ public:
   static constexpr const char *PERMISSION_MIC = "mic";
   static constexpr const char *PERMISSION_SYSTEM = "system";
 
-  // Callback for receiving raw PCM data (16-bit, Native Sample Rate,
-  // Stereo/Mono)
-  using DataCallback = std::function<void(const uint8_t *data, size_t size)>;
-
-  // Callback for receiving error messages
-  using ErrorCallback = std::function<void(const std::string &error)>;
-
   // Start recording with explicit device type and ID
   // deviceType: "input" or "output"
   // deviceId: device identifier from GetDevices() (never empty)
+  // sink receives the 16-bit PCM (native sample rate and channels) and any
+  // errors; the engine holds it until the next Start()
   virtual void Start(const std::string &deviceType, const std::string &deviceId,
-                     DataCallback dataCb, ErrorCallback errorCb) = 0;
+                     std::shared_ptr<CaptureSink> sink) = 0;
   virtual void Stop() = 0;
 
+  // Set options for the next Start()
+  virtual void SetOptions(const StreamOptions &options) = 0;
+
+  // Statistics for the current (or most recent) stream
+  virtual StreamStats GetStats() = 0;
+
   // Get all available devices (both input and output)
   // All returned devices have valid id and type fields
   virtual std::vector<AudioDevice> GetDevices() = 0;
@@ -64,6 +96,15 @@ public:
   // Get format for specific device
   virtual AudioFormat GetDeviceFormat(const std::string &deviceId) = 0;
 
+  // Format the next Start() will deliver with the current options, for
+  // sizing native outputs. Differs from GetDeviceFormat() where the engine
+  // negotiates a format of its own, as WASAPI exclusive mode does.
+  virtual AudioFormat GetStreamFormat(const std::string &deviceType,
+                                      const std::string &deviceId) {
+    (void)deviceType;
+    return GetDeviceFormat(deviceId);
+  }
+
   // Check permission status for mic and system audio
   // Returns current permission status without prompting user
   virtual PermissionStatus CheckPermission() = 0;
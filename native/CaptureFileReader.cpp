@@ -0,0 +1,143 @@
+#include "CaptureFileReader.h"
+
+#include <algorithm>
+
+Napi::Object CaptureFileReader::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function func = DefineClass(
+      env, "CaptureFileReader",
+      {InstanceMethod("info", &CaptureFileReader::Info),
+       InstanceMethod("writtenFrames", &CaptureFileReader::WrittenFrames),
+       InstanceMethod("droppedFrames", &CaptureFileReader::DroppedFrames),
+       InstanceMethod("isClosed", &CaptureFileReader::IsClosed),
+       InstanceMethod("read", &CaptureFileReader::Read),
+       InstanceMethod("samples", &CaptureFileReader::Samples),
+       InstanceMethod("close", &CaptureFileReader::Close)});
+
+  exports.Set("CaptureFileReader", func);
+  return exports;
+}
+
+CaptureFileReader::CaptureFileReader(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<CaptureFileReader>(info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Expected a path").ThrowAsJavaScriptException();
+    return;
+  }
+  std::string error;
+  if (!reader.Open(info[0].As<Napi::String>().Utf8Value(), error)) {
+    Napi::Error::New(env, error).ThrowAsJavaScriptException();
+    return;
+  }
+  isOpen = true;
+}
+
+bool CaptureFileReader::CheckOpen(Napi::Env env) {
+  if (!isOpen) {
+    Napi::Error::New(env, "Capture file reader is closed")
+        .ThrowAsJavaScriptException();
+  }
+  return isOpen;
+}
+
+Napi::Value CaptureFileReader::Info(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("sampleRate", reader.SampleRate());
+  result.Set("channels", reader.Channels());
+  result.Set("mode", reader.Mode() == MappedMode::Ring ? "ring" : "append");
+  result.Set("capacityFrames", (double)reader.CapacityFrames());
+  return result;
+}
+
+Napi::Value CaptureFileReader::WrittenFrames(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  return Napi::Number::New(env, (double)reader.WrittenFrames());
+}
+
+Napi::Value CaptureFileReader::DroppedFrames(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  return Napi::Number::New(env, (double)reader.DroppedFrames());
+}
+
+Napi::Value CaptureFileReader::IsClosed(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  return Napi::Boolean::New(env, reader.IsClosed());
+}
+
+Napi::Value CaptureFileReader::Read(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+    Napi::TypeError::New(env, "Expected startFrame and maxFrames")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  double start = info[0].As<Napi::Number>().DoubleValue();
+  double maxFrames = info[1].As<Napi::Number>().DoubleValue();
+  if (!(start >= 0) || !(maxFrames >= 0)) {
+    Napi::RangeError::New(env, "startFrame and maxFrames must not be negative")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  uint64_t startFrame = (uint64_t)start;
+  size_t frames = (size_t)std::min<double>(
+      maxFrames, (double)reader.CapacityFrames());
+  Napi::Int16Array samples = Napi::Int16Array::New(
+      env, frames * reader.Channels(), napi_int16_array);
+  frames = reader.Read(startFrame, frames, samples.Data());
+
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("startFrame", (double)startFrame);
+  result.Set("samples",
+             Napi::Int16Array::New(env, frames * reader.Channels(),
+                                   samples.ArrayBuffer(), 0,
+                                   napi_int16_array));
+  return result;
+}
+
+Napi::Value CaptureFileReader::Samples(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (!CheckOpen(env)) {
+    return env.Null();
+  }
+  // The view keeps the mapping alive after close() until it is collected
+  size_t length = (size_t)reader.CapacityFrames() * reader.Channels();
+  auto mapping = new std::shared_ptr<MappedFile>(reader.Mapping());
+  napi_value buffer;
+  napi_status status = napi_create_external_arraybuffer(
+      env, (void *)reader.Samples(), length * sizeof(int16_t),
+      [](napi_env, void *, void *hint) {
+        delete (std::shared_ptr<MappedFile> *)hint;
+      },
+      mapping, &buffer);
+  if (status != napi_ok) {
+    delete mapping;
+    return env.Null();
+  }
+  return Napi::Int16Array::New(env, length, Napi::ArrayBuffer(env, buffer), 0,
+                               napi_int16_array);
+}
+
+Napi::Value CaptureFileReader::Close(const Napi::CallbackInfo &info) {
+  reader.Close();
+  isOpen = false;
+  return info.Env().Null();
+}
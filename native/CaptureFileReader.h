@@ -0,0 +1,32 @@
+#pragma once
+
+#include "core/MappedCapture.h"
+#include <napi.h>
+
+// JS access to a memory-mapped capture file written by this or another
+// process. Reads never block the writer: they load its cursor and copy,
+// or view the mapping directly.
+class CaptureFileReader : public Napi::ObjectWrap<CaptureFileReader> {
+public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports);
+  CaptureFileReader(const Napi::CallbackInfo &info);
+
+private:
+  // { sampleRate, channels, mode, capacityFrames }
+  Napi::Value Info(const Napi::CallbackInfo &info);
+  Napi::Value WrittenFrames(const Napi::CallbackInfo &info);
+  Napi::Value DroppedFrames(const Napi::CallbackInfo &info);
+  Napi::Value IsClosed(const Napi::CallbackInfo &info);
+  // read(startFrame, maxFrames): { startFrame, samples } copied out
+  Napi::Value Read(const Napi::CallbackInfo &info);
+  // Int16Array over the mapped data area, or null where the runtime does
+  // not allow external buffers
+  Napi::Value Samples(const Napi::CallbackInfo &info);
+  Napi::Value Close(const Napi::CallbackInfo &info);
+
+  // Throws into JS and returns false once closed
+  bool CheckOpen(Napi::Env env);
+
+  MappedCaptureReader reader;
+  bool isOpen = false;
+};
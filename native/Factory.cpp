@@ -5,6 +5,10 @@
 #include "win/WASAPIEngine.h"
 #elif defined(__APPLE__)
 #include "mac/AVFEngine.h"
+#elif defined(HAVE_PULSEAUDIO)
+#include "linux/PulseEngine.h"
+#else
+#include "NullEngine.h"
 #endif
 
 std::unique_ptr<AudioEngine> CreatePlatformAudioEngine() {
@@ -12,7 +16,9 @@ std::unique_ptr<AudioEngine> CreatePlatformAudioEngine() {
   return std::make_unique<WASAPIEngine>();
 #elif defined(__APPLE__)
   return std::make_unique<AVFEngine>();
+#elif defined(HAVE_PULSEAUDIO)
+  return std::make_unique<PulseEngine>();
 #else
-  return nullptr;
+  return std::make_unique<NullEngine>();
 #endif
 }
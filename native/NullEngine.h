@@ -0,0 +1,26 @@
+#pragma once
+
+#include "AudioEngine.h"
+
+// Engine for builds without a platform audio API, such as Linux without
+// libpulse. Lists no devices and fails every Start() through the sink, so
+// the addon loads and reports the missing backend instead of crashing.
+class NullEngine : public AudioEngine {
+public:
+  void Start(const std::string &deviceType, const std::string &deviceId,
+             std::shared_ptr<CaptureSink> sink) override {
+    if (sink) {
+      sink->OnError("Audio capture is not supported in this build");
+    }
+  }
+  void Stop() override {}
+  void SetOptions(const StreamOptions &options) override {}
+  StreamStats GetStats() override { return StreamStats(); }
+  std::vector<AudioDevice> GetDevices() override { return {}; }
+  AudioFormat GetDeviceFormat(const std::string &deviceId) override {
+    return AudioFormat();
+  }
+
+  PermissionStatus CheckPermission() override { return PermissionStatus(); }
+  bool RequestPermission(PermissionType type) override { return false; }
+};
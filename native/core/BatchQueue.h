@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Items handed from any number of threads to one consumer in batches.
+// Push() reports whether the queue was empty, the only time the consumer
+// has to be woken; Take() then hands over everything queued since. However
+// many items pile up while the consumer is busy, it wakes once for all of
+// them. The two lists swap back and forth, so once they have grown to the
+// largest batch neither allocates. Thread safe.
+template <typename T> class BatchQueue {
+public:
+  explicit BatchQueue(size_t capacity) { items.reserve(capacity); }
+
+  // Queue an item; true when the consumer has to be woken for it
+  bool Push(T item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool wake = items.empty();
+    items.push_back(std::move(item));
+    return wake;
+  }
+
+  // Replace batch with every item queued so far, oldest first. The next
+  // Push() wakes the consumer again.
+  void Take(std::vector<T> &batch) {
+    batch.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    items.swap(batch);
+  }
+
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return items.size();
+  }
+
+private:
+  mutable std::mutex mutex;
+  std::vector<T> items;
+};
@@ -0,0 +1,140 @@
+#include "BlockWriter.h"
+
+#include <algorithm>
+#include <new>
+
+BlockWriter::BlockWriter(ErrorCallback onError, FileName fileName,
+                         DiskWriter &writer)
+    : onError(std::move(onError)), fileName(std::move(fileName)),
+      writer(writer) {}
+
+BlockWriter::~BlockWriter() {
+  for (Block *spareBlock : spare) {
+    FreeAligned(spareBlock->data);
+    delete spareBlock;
+  }
+}
+
+BlockWriter::Block *BlockWriter::TakeBlock() {
+  Block *taken = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(blockMutex);
+    if (!spare.empty()) {
+      taken = spare.back();
+      spare.pop_back();
+    }
+  }
+  if (!taken) {
+    taken = new Block();
+    taken->data = (uint8_t *)AllocateAligned(kBlockBytes);
+    if (!taken->data) {
+      delete taken;
+      throw std::bad_alloc();
+    }
+  }
+  taken->used = 0;
+  taken->dataBytes = 0;
+  taken->fileIndex = 0;
+  taken->users = 1;
+  return taken;
+}
+
+void BlockWriter::ReleaseBlock(Block *block) {
+  std::lock_guard<std::mutex> lock(blockMutex);
+  if (--block->users == 0) {
+    spare.push_back(block);
+  }
+}
+
+void BlockWriter::WriteBlock(const std::shared_ptr<DiskFile> &file,
+                             Block *block, uint64_t offset) {
+  DiskRequest request;
+  request.file = file;
+  request.data = block->data;
+  request.size = kBlockBytes;
+  request.offset = offset;
+  request.done = [this, block](bool ok, int64_t latencyNs) {
+    if (ok) {
+      AddBytesWritten(block->dataBytes);
+    } else {
+      Fail("Failed to write " + fileName(block->fileIndex));
+    }
+    ReleaseBlock(block);
+    EndRequest(latencyNs);
+  };
+  BeginRequest();
+  writer.Submit(std::move(request));
+}
+
+void BlockWriter::WritePartial(const std::shared_ptr<DiskFile> &file,
+                               Block *block, size_t size, uint64_t offset) {
+  {
+    std::lock_guard<std::mutex> lock(blockMutex);
+    block->users++;
+  }
+  DiskRequest request;
+  request.file = file;
+  request.data = block->data;
+  request.size = size;
+  request.offset = offset;
+  request.done = [this, block](bool ok, int64_t latencyNs) {
+    if (!ok) {
+      Fail("Failed to write " + fileName(block->fileIndex));
+    }
+    ReleaseBlock(block);
+    EndRequest(latencyNs);
+  };
+  BeginRequest();
+  writer.Submit(std::move(request));
+}
+
+void BlockWriter::SubmitTask(const std::shared_ptr<DiskFile> &file,
+                             std::function<void()> task) {
+  DiskRequest request;
+  request.file = file;
+  request.task = std::move(task);
+  BeginRequest();
+  writer.Submit(std::move(request));
+}
+
+void BlockWriter::BeginRequest() {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  pending++;
+  maxPending = std::max(maxPending, pending);
+}
+
+void BlockWriter::EndRequest(int64_t latency) {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  if (latency >= 0) {
+    writes++;
+    latencyNs += latency;
+    maxLatencyNs = std::max(maxLatencyNs, latency);
+  }
+  if (--pending == 0) {
+    drained.notify_all();
+  }
+}
+
+void BlockWriter::Drain() {
+  std::unique_lock<std::mutex> lock(requestMutex);
+  drained.wait(lock, [this] { return pending == 0; });
+}
+
+void BlockWriter::Fail(const std::string &error) {
+  if (failed.exchange(true)) {
+    return;
+  }
+  if (onError) {
+    onError(error);
+  }
+}
+
+BlockWriter::WriteStats BlockWriter::GetWriteStats() const {
+  std::lock_guard<std::mutex> lock(requestMutex);
+  WriteStats stats;
+  stats.queueDepth = pending;
+  stats.maxQueueDepth = maxPending;
+  stats.avgLatencyMs = writes > 0 ? latencyNs / 1e6 / writes : 0;
+  stats.maxLatencyMs = maxLatencyNs / 1e6;
+  return stats;
+}
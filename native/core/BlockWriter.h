@@ -0,0 +1,109 @@
+#pragma once
+
+#include "DiskWriter.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The block and request bookkeeping of a file output written through a
+// DiskWriter. The capture side fills 64 KB blocks, aligned for direct I/O,
+// and hands them to WriteBlock(); they come back to a pool once written,
+// so a warmed-up output does not allocate. Every request is counted until
+// the writer is done with it, for Drain() and the write stats, and the
+// first failure is reported once. An output may write several files; a
+// block's fileIndex names the one it belongs to in error messages.
+class BlockWriter {
+public:
+  static const size_t kBlockBytes = 1 << 16;
+
+  struct Block {
+    uint8_t *data;
+    size_t used = 0;
+    size_t dataBytes = 0; // Payload in the block, counted once written
+    uint32_t fileIndex = 0;
+    int users = 0; // The capture side and writes of it, under blockMutex
+  };
+
+  // Disk writes of this output, queued or in flight
+  struct WriteStats {
+    size_t queueDepth;
+    size_t maxQueueDepth;
+    double avgLatencyMs; // Queued to completed, per block
+    double maxLatencyMs;
+  };
+
+  using ErrorCallback = std::function<void(const std::string &error)>;
+  using FileName = std::function<std::string(uint32_t fileIndex)>;
+
+  // onError runs on the writer's thread; fileName names a block's file
+  BlockWriter(ErrorCallback onError, FileName fileName,
+              DiskWriter &writer = DiskWriter::Shared());
+  // Drain() first
+  ~BlockWriter();
+
+  // An empty block held by the caller
+  Block *TakeBlock();
+  // Drop the caller's hold; the block goes back to the pool once no write
+  // of it is left
+  void ReleaseBlock(Block *block);
+
+  // Write the whole block at offset, count its payload and release it
+  void WriteBlock(const std::shared_ptr<DiskFile> &file, Block *block,
+                  uint64_t offset);
+  // Write the first size bytes of a block the caller goes on filling past
+  // them; its payload counts once the whole block is written
+  void WritePartial(const std::shared_ptr<DiskFile> &file, Block *block,
+                    size_t size, uint64_t offset);
+
+  // Queue a task, which has to call EndRequest(-1) when it is done
+  void SubmitTask(const std::shared_ptr<DiskFile> &file,
+                  std::function<void()> task);
+  // latencyNs is negative for tasks, which are not timed
+  void EndRequest(int64_t latencyNs);
+
+  // Wait until the writer is done with every request
+  void Drain();
+
+  // Report error, unless an earlier one was
+  void Fail(const std::string &error);
+  bool Failed() const { return failed.load(std::memory_order_relaxed); }
+
+  // Payload on disk so far
+  uint64_t BytesWritten() const {
+    return bytesWritten.load(std::memory_order_relaxed);
+  }
+  void AddBytesWritten(uint64_t bytes) {
+    bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  WriteStats GetWriteStats() const;
+
+private:
+  void BeginRequest();
+
+  ErrorCallback onError;
+  FileName fileName;
+  DiskWriter &writer;
+
+  std::mutex blockMutex;
+  std::vector<Block *> spare; // Blocks back from the writer
+
+  // Requests the writer has not finished
+  mutable std::mutex requestMutex;
+  std::condition_variable drained;
+  size_t pending = 0;
+  size_t maxPending = 0;
+  uint64_t writes = 0;
+  int64_t latencyNs = 0;
+  int64_t maxLatencyNs = 0;
+
+  std::atomic<bool> failed{false};
+  std::atomic<uint64_t> bytesWritten{0};
+};
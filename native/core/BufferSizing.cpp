@@ -0,0 +1,156 @@
+#include "BufferSizing.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int64_t kHnsPerSecond = 10000000;
+
+template <typename T> void AppendUnique(std::vector<T> &values, T value) {
+  if (std::find(values.begin(), values.end(), value) == values.end())
+    values.push_back(value);
+}
+
+} // namespace
+
+int64_t FramesToHns(uint64_t frames, int sampleRate) {
+  if (sampleRate <= 0)
+    return 0;
+  return (int64_t)std::llround((double)kHnsPerSecond * frames / sampleRate);
+}
+
+uint32_t HnsToFrames(int64_t hns, int sampleRate) {
+  if (hns <= 0)
+    return 0;
+  return (uint32_t)std::llround((double)hns * sampleRate / kHnsPerSecond);
+}
+
+uint32_t RequestedPeriodFrames(const BufferRequest &request, int sampleRate) {
+  if (request.bufferFrames > 0)
+    return request.bufferFrames;
+  if (request.latencyMs > 0)
+    return std::max<uint32_t>(
+        1, (uint32_t)std::llround(request.latencyMs * sampleRate / 1000.0));
+  return 0;
+}
+
+uint32_t AlignSharedPeriod(uint32_t frames,
+                           const SharedEnginePeriods &periods) {
+  if (frames <= periods.minFrames)
+    return periods.minFrames;
+  if (frames >= periods.maxFrames)
+    return periods.maxFrames;
+
+  uint32_t step = std::max<uint32_t>(1, periods.fundamentalFrames);
+  uint32_t steps = (frames - periods.minFrames + step - 1) / step;
+  return std::min(periods.maxFrames, periods.minFrames + steps * step);
+}
+
+std::vector<StreamFormat> ExclusiveFormatCandidates(const StreamFormat &mix) {
+  std::vector<int> channelCounts;
+  AppendUnique(channelCounts, mix.channels);
+  AppendUnique(channelCounts, 2);
+  AppendUnique(channelCounts, 1);
+
+  std::vector<int> sampleRates;
+  AppendUnique(sampleRates, mix.sampleRate);
+  AppendUnique(sampleRates, 48000);
+  AppendUnique(sampleRates, 44100);
+
+  // Exclusive-mode drivers commonly take only integer formats, so float
+  // is the last resort
+  const StreamFormat encodings[] = {
+      {0, 0, SampleEncoding::Int32, 32}, {0, 0, SampleEncoding::Int32, 24},
+      {0, 0, SampleEncoding::Int24, 24}, {0, 0, SampleEncoding::Int16, 16},
+      {0, 0, SampleEncoding::Float32, 32},
+  };
+
+  std::vector<StreamFormat> candidates;
+  for (int channels : channelCounts) {
+    if (channels <= 0)
+      continue;
+    for (int sampleRate : sampleRates) {
+      if (sampleRate <= 0)
+        continue;
+      for (const StreamFormat &encoding : encodings) {
+        candidates.push_back(
+            {sampleRate, channels, encoding.encoding, encoding.validBits});
+      }
+    }
+  }
+  return candidates;
+}
+
+bool PlanBuffer(const BufferRequest &request, const StreamFormat &mixFormat,
+                bool isLoopback, BufferClient &client, BufferPlan &plan,
+                std::string &error) {
+  plan = BufferPlan();
+  plan.format = mixFormat;
+
+  int64_t defaultHns = 0;
+  int64_t minimumHns = 0;
+  client.GetDevicePeriods(defaultHns, minimumHns);
+
+  if (request.exclusive) {
+    if (isLoopback) {
+      error = "Exclusive mode is not available for output (loopback) devices";
+      return false;
+    }
+
+    bool found = false;
+    for (const StreamFormat &candidate :
+         ExclusiveFormatCandidates(mixFormat)) {
+      if (client.IsExclusiveFormatSupported(candidate)) {
+        plan.format = candidate;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      error = "No exclusive-mode format is supported by the device";
+      return false;
+    }
+
+    // Event-driven exclusive streams need buffer == period
+    uint32_t frames = RequestedPeriodFrames(request, plan.format.sampleRate);
+    int64_t periodHns =
+        frames > 0 ? FramesToHns(frames, plan.format.sampleRate) : defaultHns;
+    periodHns = std::max(periodHns, minimumHns);
+
+    plan.mode = BufferMode::Exclusive;
+    plan.bufferHns = periodHns;
+    plan.periodHns = periodHns;
+    plan.periodFrames = HnsToFrames(periodHns, plan.format.sampleRate);
+    return true;
+  }
+
+  // Only periods below the engine default need IAudioClient3; its
+  // periods stop at the default, so longer requests take the classic path
+  uint32_t frames = RequestedPeriodFrames(request, mixFormat.sampleRate);
+  SharedEnginePeriods periods = {};
+  if (frames > 0 && !isLoopback &&
+      client.GetSharedEnginePeriods(mixFormat, periods) &&
+      frames < periods.defaultFrames) {
+    plan.mode = BufferMode::SharedLowLatency;
+    plan.periodFrames = AlignSharedPeriod(frames, periods);
+    return true;
+  }
+
+  // Classic shared mode always runs at the engine period; a request only
+  // shortens the buffer behind it
+  plan.mode = BufferMode::Shared;
+  plan.periodFrames = HnsToFrames(defaultHns, mixFormat.sampleRate);
+  plan.bufferHns =
+      frames > 0
+          ? std::max(FramesToHns(frames, mixFormat.sampleRate), defaultHns)
+          : kDefaultSharedBufferHns;
+  return true;
+}
+
+void RealignExclusivePlan(uint32_t alignedFrames, BufferPlan &plan) {
+  int64_t periodHns = FramesToHns(alignedFrames, plan.format.sampleRate);
+  plan.bufferHns = periodHns;
+  plan.periodHns = periodHns;
+  plan.periodFrames = alignedFrames;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "SampleConvert.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sample format of a device stream
+struct StreamFormat {
+  int sampleRate;
+  int channels;
+  SampleEncoding encoding;
+  int validBits; // Significant bits per sample, e.g. 24 in a 32-bit container
+};
+
+// Buffering requested through StreamOptions
+struct BufferRequest {
+  double latencyMs = 0;      // Target period; 0 keeps the engine default
+  uint32_t bufferFrames = 0; // Target period in frames; wins over latencyMs
+  bool exclusive = false;    // Bypass the shared-mode engine
+};
+
+// Period limits of the shared-mode audio engine for one format, in frames
+struct SharedEnginePeriods {
+  uint32_t defaultFrames;
+  uint32_t fundamentalFrames; // Valid periods are min + n * fundamental
+  uint32_t minFrames;
+  uint32_t maxFrames;
+};
+
+// Device queries the buffer planning depends on. Implemented over
+// IAudioClient/IAudioClient3 by WASAPIEngine and mocked in the tests.
+class BufferClient {
+public:
+  virtual ~BufferClient() = default;
+
+  // Default and minimum device periods, in 100 ns units
+  virtual bool GetDevicePeriods(int64_t &defaultHns, int64_t &minimumHns) = 0;
+
+  // Shared engine period limits; false when the device has no
+  // IAudioClient3 (Windows 8.1 and older, most loopback endpoints)
+  virtual bool GetSharedEnginePeriods(const StreamFormat &format,
+                                      SharedEnginePeriods &periods) = 0;
+
+  virtual bool IsExclusiveFormatSupported(const StreamFormat &format) = 0;
+};
+
+enum class BufferMode {
+  Shared,           // Classic shared mode, engine-sized period
+  SharedLowLatency, // IAudioClient3::InitializeSharedAudioStream
+  Exclusive         // Event-driven exclusive mode
+};
+
+struct BufferPlan {
+  BufferMode mode = BufferMode::Shared;
+  StreamFormat format = {};  // Format to initialise the client with
+  int64_t bufferHns = 0;     // Buffer duration for Initialize()
+  int64_t periodHns = 0;     // Periodicity for Initialize() (exclusive only)
+  uint32_t periodFrames = 0; // Expected device period
+};
+
+// Buffer used when nothing was requested, as before these options existed
+const int64_t kDefaultSharedBufferHns = 10000000; // 1 second
+
+// Conversions between frames and 100 ns units, rounded to nearest
+int64_t FramesToHns(uint64_t frames, int sampleRate);
+uint32_t HnsToFrames(int64_t hns, int sampleRate);
+
+// Requested period in frames at sampleRate, 0 when none was requested
+uint32_t RequestedPeriodFrames(const BufferRequest &request, int sampleRate);
+
+// Smallest valid shared engine period of at least frames, within limits
+uint32_t AlignSharedPeriod(uint32_t frames, const SharedEnginePeriods &periods);
+
+// Formats to try for exclusive mode, in order of preference: the mix
+// format's rate and channel count first, from the richest integer encoding
+// down to 16-bit, then float
+std::vector<StreamFormat> ExclusiveFormatCandidates(const StreamFormat &mix);
+
+// Choose the mode, format and buffer sizes for a request. Returns false
+// with error set when exclusive mode was requested but is unavailable.
+bool PlanBuffer(const BufferRequest &request, const StreamFormat &mixFormat,
+                bool isLoopback, BufferClient &client, BufferPlan &plan,
+                std::string &error);
+
+// Exclusive Initialize() failed with AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED;
+// re-derive the period from the aligned buffer size the device reported
+void RealignExclusivePlan(uint32_t alignedFrames, BufferPlan &plan);
@@ -0,0 +1,136 @@
+#include "CaptureCore.h"
+
+#include <algorithm>
+
+CaptureCore::CaptureCore(const InputDescriptor &input, CaptureSink &sink,
+                         std::vector<std::shared_ptr<CaptureStage>> stages,
+                         DitherMode dither)
+    : input(input), kernels(SelectKernels(input.encoding, input.channels)),
+      requantizer(dither, input.channels), sink(&sink),
+      stages(std::move(stages)) {
+  Init(dither);
+}
+
+CaptureCore::CaptureCore(const InputDescriptor &input, Sink sink,
+                         std::vector<std::shared_ptr<CaptureStage>> stages,
+                         DitherMode dither)
+    : input(input), kernels(SelectKernels(input.encoding, input.channels)),
+      requantizer(dither, input.channels), sink(nullptr),
+      stages(std::move(stages)) {
+  if (sink) {
+    ownedSink = std::make_unique<CallbackSink>(
+        [sink](const PcmBlock &block) {
+          sink(block.samples, block.frames * block.channels, block.meta);
+        });
+    this->sink = ownedSink.get();
+  }
+  Init(dither);
+}
+
+void CaptureCore::Init(DitherMode dither) {
+  // Nothing to requantise when the device already delivers 16 bits, and
+  // stages that only observe the audio do not change that
+  modifiesAudio = false;
+  for (auto &stage : this->stages) {
+    stage->Configure(input.sampleRate, input.channels);
+    modifiesAudio = modifiesAudio || stage->ModifiesAudio();
+  }
+  passthrough = !modifiesAudio && (dither == DitherMode::None ||
+                                   input.encoding == SampleEncoding::Int16);
+}
+
+void CaptureCore::Push(const uint8_t *data, size_t frames,
+                       CaptureMetadata meta) {
+  int channels = input.channels;
+  size_t numSamples = frames * channels;
+  meta.frameIndex = framePosition;
+  framePosition += frames;
+  if (!data)
+    meta.silent = true;
+
+  if (!passthrough || !stages.empty()) {
+    if (floats.size() < numSamples)
+      floats.resize(numSamples);
+    if (data) {
+      kernels.toFloat(data, frames, channels, floats.data());
+    } else {
+      std::fill(floats.begin(), floats.begin() + numSamples, 0.0f);
+    }
+    RunStages(frames, meta);
+    if (!passthrough) {
+      Requantize(frames, meta);
+      return;
+    }
+  }
+
+  // Device already delivers the output format: hand it over untouched
+  if (data && input.encoding == SampleEncoding::Int16) {
+    Deliver((const int16_t *)data, frames, meta);
+    return;
+  }
+
+  if (pcm.size() < numSamples)
+    pcm.resize(numSamples);
+  if (data) {
+    kernels.toPcm(data, frames, channels, pcm.data());
+  } else {
+    std::fill(pcm.begin(), pcm.begin() + numSamples, 0);
+  }
+  Deliver(pcm.data(), frames, meta);
+}
+
+void CaptureCore::PushPlanar(const uint8_t *const *planes, int planeCount,
+                             size_t frames, CaptureMetadata meta) {
+  int channels = input.channels;
+  size_t numSamples = frames * channels;
+  meta.frameIndex = framePosition;
+  framePosition += frames;
+
+  if (!passthrough || !stages.empty()) {
+    if (floats.size() < numSamples)
+      floats.resize(numSamples);
+    kernels.planarToFloat(planes, planeCount, frames, channels,
+                          floats.data());
+    RunStages(frames, meta);
+    if (!passthrough) {
+      Requantize(frames, meta);
+      return;
+    }
+  }
+
+  if (pcm.size() < numSamples)
+    pcm.resize(numSamples);
+  kernels.planarToPcm(planes, planeCount, frames, channels, pcm.data());
+  Deliver(pcm.data(), frames, meta);
+}
+
+void CaptureCore::Reserve(size_t frames) {
+  size_t numSamples = frames * input.channels;
+  if (!passthrough || !stages.empty()) {
+    floats.resize(std::max(floats.size(), numSamples));
+  }
+  pcm.resize(std::max(pcm.size(), numSamples));
+}
+
+void CaptureCore::RunStages(size_t frames, CaptureMetadata &meta) {
+  AudioBlock block = {floats.data(), frames, input.channels,
+                      input.sampleRate, meta};
+  for (auto &stage : stages) {
+    stage->Process(block);
+  }
+  meta = block.meta;
+}
+
+void CaptureCore::Requantize(size_t frames, const CaptureMetadata &meta) {
+  size_t numSamples = frames * input.channels;
+  if (pcm.size() < numSamples)
+    pcm.resize(numSamples);
+  if (meta.silent && !modifiesAudio) {
+    // Keep device silence digitally silent rather than dither noise
+    std::fill(pcm.begin(), pcm.begin() + numSamples, 0);
+  } else {
+    requantizer.Process(floats.data(), frames, pcm.data());
+  }
+
+  Deliver(pcm.data(), frames, meta);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "ConvertKernels.h"
+#include "Dither.h"
+#include "SampleConvert.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Layout of the raw buffers a device hands to the core
+struct InputDescriptor {
+  int sampleRate;
+  int channels;
+  SampleEncoding encoding;
+  bool planar; // One buffer per channel instead of interleaved frames
+};
+
+// Information travelling with each block of audio
+struct CaptureMetadata {
+  uint64_t frameIndex = 0;   // First frame's position since the stream began
+  int64_t timestampNs = 0;   // Capture time of the first frame on the
+                             // steady clock (QPC / host time), 0 if unknown
+  bool discontinuity = false; // Frames were lost before this block
+  bool silent = false;        // The device flagged the block as silence
+};
+
+// Interleaved float audio in [-1, 1] as seen by the stages
+struct AudioBlock {
+  float *samples;
+  size_t frames;
+  int channels;
+  int sampleRate;
+  CaptureMetadata meta;
+};
+
+// One processing step between conversion and output. Stages work in place
+// and keep the frame count; they run on the stream's delivery thread, one
+// block at a time.
+class CaptureStage {
+public:
+  virtual ~CaptureStage() = default;
+
+  // Called once with the stream format before the first block
+  virtual void Configure(int sampleRate, int channels) {}
+
+  virtual void Process(AudioBlock &block) = 0;
+
+  // False for stages that only read the audio (analysis); the core then
+  // keeps its exact 16-bit path and runs them on a float copy
+  virtual bool ModifiesAudio() const { return true; }
+};
+
+// Interleaved 16-bit audio as handed to a CaptureSink
+struct PcmBlock {
+  const int16_t *samples;
+  size_t frames;
+  int channels;
+  int sampleRate;
+  CaptureMetadata meta;
+};
+
+// Where a stream's output goes. Engines hand every frame of a device packet
+// to OnData in one call, on the stream's delivery thread, and report
+// failures through OnError from whichever thread hits them. The sink
+// outlives the stream; engines keep it without copying per packet.
+class CaptureSink {
+public:
+  virtual ~CaptureSink() = default;
+
+  virtual void OnData(const PcmBlock &block) = 0;
+  virtual void OnError(const std::string &error) = 0;
+};
+
+// Sink forwarding to functions, for tests and tools where a type-erased
+// call per packet does not matter
+class CallbackSink : public CaptureSink {
+public:
+  using DataFunction = std::function<void(const PcmBlock &block)>;
+  using ErrorFunction = std::function<void(const std::string &error)>;
+
+  explicit CallbackSink(DataFunction onData, ErrorFunction onError = nullptr)
+      : onData(std::move(onData)), onError(std::move(onError)) {}
+
+  void OnData(const PcmBlock &block) override {
+    if (onData) {
+      onData(block);
+    }
+  }
+  void OnError(const std::string &error) override {
+    if (onError) {
+      onError(error);
+    }
+  }
+
+private:
+  DataFunction onData;
+  ErrorFunction onError;
+};
+
+// Platform-neutral capture path: raw device buffers in, converted and
+// processed 16-bit PCM out. Engines describe the device format once and
+// push buffers; everything after that is shared by all platforms.
+class CaptureCore {
+public:
+  // Receives interleaved 16-bit PCM, sampleCount samples
+  using Sink = std::function<void(const int16_t *samples, size_t sampleCount,
+                                  const CaptureMetadata &meta)>;
+
+  // Float and wider-than-16-bit input is requantised with dither; 16-bit
+  // input without stages is delivered exactly as captured. Each packet is
+  // one virtual call into sink, which must outlive the core.
+  CaptureCore(const InputDescriptor &input, CaptureSink &sink,
+              std::vector<std::shared_ptr<CaptureStage>> stages = {},
+              DitherMode dither = DitherMode::None);
+
+  // Same, delivering to a function; for tests and tools
+  CaptureCore(const InputDescriptor &input, Sink sink,
+              std::vector<std::shared_ptr<CaptureStage>> stages = {},
+              DitherMode dither = DitherMode::None);
+
+  // Interleaved device buffer; nullptr means frames of silence
+  void Push(const uint8_t *data, size_t frames, CaptureMetadata meta);
+
+  // Planar device buffers, planeCount of them; missing planes are silent
+  void PushPlanar(const uint8_t *const *planes, int planeCount,
+                  size_t frames, CaptureMetadata meta);
+
+  // Size the scratch buffers for packets of up to frames frames, so even
+  // the first ones are converted without allocating
+  void Reserve(size_t frames);
+
+  const InputDescriptor &Input() const { return input; }
+
+  // Frames pushed so far
+  uint64_t FramePosition() const { return framePosition; }
+
+private:
+  void Init(DitherMode dither);
+  void Deliver(const int16_t *samples, size_t frames,
+               const CaptureMetadata &meta) {
+    if (sink) {
+      sink->OnData({samples, frames, input.channels, input.sampleRate, meta});
+    }
+  }
+  void RunStages(size_t frames, CaptureMetadata &meta);
+  void Requantize(size_t frames, const CaptureMetadata &meta);
+
+  InputDescriptor input;
+  ConversionKernels kernels; // Device format to PCM / float
+  Requantizer requantizer;   // Float to PCM
+  bool modifiesAudio;        // Some stage changes the samples
+  bool passthrough;          // Kernels may convert straight to PCM
+  CaptureSink *sink;
+  std::unique_ptr<CaptureSink> ownedSink; // Wraps a Sink function
+  std::vector<std::shared_ptr<CaptureStage>> stages;
+  uint64_t framePosition = 0;
+
+  // Scratch reused across pushes, grown to the largest packet seen
+  std::vector<float> floats;
+  std::vector<int16_t> pcm;
+};
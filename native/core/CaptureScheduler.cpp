@@ -0,0 +1,378 @@
+#include "CaptureScheduler.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <thread>
+
+#ifdef _WIN32
+#include <objbase.h>
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// One slot of the wait array is taken by the control event
+static const size_t MAX_STREAMS_PER_THREAD = MAXIMUM_WAIT_OBJECTS - 1;
+#else
+static const size_t MAX_STREAMS_PER_THREAD = 256;
+#endif
+
+class CaptureScheduler::CaptureThread {
+public:
+  CaptureThread() {
+#ifdef _WIN32
+    wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#elif defined(__linux__)
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // nullptr marks the control fd
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+#else
+    if (pipe(wakePipe) == 0) {
+      fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+      fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+    }
+#endif
+    thread = std::thread(&CaptureThread::Run, this);
+  }
+
+  ~CaptureThread() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      isStopping = true;
+    }
+    Wake();
+    thread.join();
+#ifdef _WIN32
+    CloseHandle(wakeEvent);
+#elif defined(__linux__)
+    close(epollFd);
+    close(wakeFd);
+#else
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+#endif
+  }
+
+  bool Add(std::shared_ptr<CaptureSource> source) {
+    return Submit(true, std::move(source));
+  }
+
+  void Remove(std::shared_ptr<CaptureSource> source) {
+    if (std::this_thread::get_id() == thread.get_id()) {
+      // Called from one of our own sources: detach inline
+      RemoveEntry(source.get());
+      return;
+    }
+    Submit(false, std::move(source));
+  }
+
+  // Sources attached or being attached; guarded by the scheduler mutex
+  size_t count = 0;
+
+private:
+  struct Entry {
+    std::shared_ptr<CaptureSource> source;
+    WaitHandle handle;
+  };
+
+  struct Command {
+    bool isAdd;
+    std::shared_ptr<CaptureSource> source;
+    std::promise<bool> done;
+  };
+
+  bool Submit(bool isAdd, std::shared_ptr<CaptureSource> source) {
+    auto command = std::make_unique<Command>();
+    command->isAdd = isAdd;
+    command->source = std::move(source);
+    std::future<bool> result = command->done.get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      commands.push_back(std::move(command));
+    }
+    Wake();
+    return result.get();
+  }
+
+  void Wake() {
+#ifdef _WIN32
+    SetEvent(wakeEvent);
+#elif defined(__linux__)
+    uint64_t one = 1;
+    (void)!write(wakeFd, &one, sizeof(one));
+#else
+    char byte = 1;
+    (void)!write(wakePipe[1], &byte, 1);
+#endif
+  }
+
+  void ClearWake() {
+#ifdef __linux__
+    uint64_t value;
+    (void)!read(wakeFd, &value, sizeof(value));
+#elif !defined(_WIN32)
+    char bytes[64];
+    while (read(wakePipe[0], bytes, sizeof(bytes)) > 0) {
+    }
+#endif
+  }
+
+  // Returns false once the thread should exit
+  bool ProcessCommands() {
+    std::deque<std::unique_ptr<Command>> pending;
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.swap(commands);
+      stopping = isStopping;
+    }
+
+    for (auto &command : pending) {
+      if (command->isAdd) {
+        WaitHandle handle;
+        bool opened = command->source->Open(handle);
+        if (opened) {
+          AddEntry({command->source, handle});
+        }
+        command->done.set_value(opened);
+      } else {
+        RemoveEntry(command->source.get());
+        command->done.set_value(true);
+      }
+    }
+
+    if (stopping) {
+      while (!entries.empty()) {
+        RemoveEntry(entries.back().source.get());
+      }
+    }
+    return !stopping;
+  }
+
+  void AddEntry(Entry entry) {
+#ifdef __linux__
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = entry.source.get();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, entry.handle, &ev);
+#endif
+    entries.push_back(std::move(entry));
+  }
+
+  void RemoveEntry(const CaptureSource *source) {
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [source](const Entry &entry) {
+                             return entry.source.get() == source;
+                           });
+    if (it == entries.end()) {
+      // Already detached itself by returning false from OnReady()
+      return;
+    }
+#ifdef __linux__
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, it->handle, nullptr);
+#endif
+    std::shared_ptr<CaptureSource> closing = it->source;
+    entries.erase(it);
+    closing->Close();
+  }
+
+  void Dispatch(CaptureSource *source) {
+    // Look the entry up again: an earlier callback in this round may have
+    // detached it
+    for (auto &entry : entries) {
+      if (entry.source.get() == source) {
+        std::shared_ptr<CaptureSource> keepAlive = entry.source;
+        if (!keepAlive->OnReady()) {
+          RemoveEntry(source);
+        }
+        return;
+      }
+    }
+  }
+
+  void Run() {
+#ifdef _WIN32
+    CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    std::vector<HANDLE> handles;
+    std::vector<CaptureSource *> ready;
+    while (true) {
+      handles.assign(1, wakeEvent);
+      for (auto &entry : entries) {
+        handles.push_back((HANDLE)entry.handle);
+      }
+
+      DWORD result = WaitForMultipleObjects((DWORD)handles.size(),
+                                            handles.data(), FALSE, INFINITE);
+      if (result == WAIT_FAILED) {
+        break;
+      }
+      DWORD index = result - WAIT_OBJECT_0;
+      if (index >= handles.size()) {
+        continue;
+      }
+
+      // WaitForMultipleObjects only reports the lowest signalled index;
+      // poll the rest so streams late in the array are not starved
+      ready.clear();
+      bool isControl = (index == 0);
+      for (size_t i = std::max<size_t>(index, 1); i < handles.size(); i++) {
+        if (i == index || WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) {
+          ready.push_back(entries[i - 1].source.get());
+        }
+      }
+      for (CaptureSource *source : ready) {
+        Dispatch(source);
+      }
+      if (isControl && !ProcessCommands()) {
+        break;
+      }
+    }
+    CoUninitialize();
+#elif defined(__linux__)
+    std::vector<epoll_event> events(64);
+    while (true) {
+      int count = epoll_wait(epollFd, events.data(), (int)events.size(), -1);
+      if (count < 0) {
+        continue; // EINTR
+      }
+      bool isControl = false;
+      for (int i = 0; i < count; i++) {
+        if (events[i].data.ptr == nullptr) {
+          isControl = true;
+        } else {
+          Dispatch((CaptureSource *)events[i].data.ptr);
+        }
+      }
+      if (isControl) {
+        ClearWake();
+        if (!ProcessCommands()) {
+          break;
+        }
+      }
+    }
+#else
+    std::vector<pollfd> fds;
+    std::vector<CaptureSource *> ready;
+    while (true) {
+      fds.assign(1, {wakePipe[0], POLLIN, 0});
+      for (auto &entry : entries) {
+        fds.push_back({entry.handle, POLLIN, 0});
+      }
+      if (poll(fds.data(), (nfds_t)fds.size(), -1) < 0) {
+        continue; // EINTR
+      }
+      ready.clear();
+      for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+          ready.push_back(entries[i - 1].source.get());
+        }
+      }
+      for (CaptureSource *source : ready) {
+        Dispatch(source);
+      }
+      if (fds[0].revents & POLLIN) {
+        ClearWake();
+        if (!ProcessCommands()) {
+          break;
+        }
+      }
+    }
+#endif
+  }
+
+  std::thread thread;
+  std::mutex mutex;
+  std::deque<std::unique_ptr<Command>> commands;
+  bool isStopping = false;
+  std::vector<Entry> entries; // Only touched on the capture thread
+
+#ifdef _WIN32
+  HANDLE wakeEvent;
+#elif defined(__linux__)
+  int wakeFd;
+  int epollFd;
+#else
+  int wakePipe[2] = {-1, -1};
+#endif
+};
+
+CaptureScheduler::CaptureScheduler(size_t streamsPerThread)
+    : streamsPerThread(
+          std::max<size_t>(1, std::min(streamsPerThread,
+                                       MAX_STREAMS_PER_THREAD))) {}
+
+CaptureScheduler::~CaptureScheduler() = default;
+
+CaptureScheduler &CaptureScheduler::Shared() {
+  static CaptureScheduler scheduler(16);
+  return scheduler;
+}
+
+bool CaptureScheduler::Add(std::shared_ptr<CaptureSource> source) {
+  CaptureThread *owner = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &thread : threads) {
+      if (thread->count < streamsPerThread) {
+        owner = thread.get();
+        break;
+      }
+    }
+    if (!owner) {
+      threads.push_back(std::make_unique<CaptureThread>());
+      owner = threads.back().get();
+    }
+    owner->count++;
+    owners[source.get()] = owner;
+  }
+
+  const CaptureSource *key = source.get();
+  if (owner->Add(std::move(source))) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  owner->count--;
+  owners.erase(key);
+  return false;
+}
+
+void CaptureScheduler::Remove(const std::shared_ptr<CaptureSource> &source) {
+  CaptureThread *owner = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = owners.find(source.get());
+    if (it == owners.end()) {
+      return;
+    }
+    owner = it->second;
+  }
+
+  owner->Remove(source);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (owners.erase(source.get()) > 0) {
+    owner->count--;
+  }
+}
+
+size_t CaptureScheduler::SharedStreamCount(const CaptureSource *source) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = owners.find(source);
+  return it == owners.end() ? 0 : it->second->count;
+}
+
+size_t CaptureScheduler::ThreadCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return threads.size();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Handle a capture source waits on: an event HANDLE on Windows, a readable
+// file descriptor elsewhere
+#ifdef _WIN32
+using WaitHandle = void *;
+#else
+using WaitHandle = int;
+#endif
+
+// A device stream driven by a shared capture thread instead of its own.
+// All methods are called on the capture thread that owns the source.
+class CaptureSource {
+public:
+  virtual ~CaptureSource() = default;
+
+  // Acquire the device and return the handle that is signalled whenever
+  // data is ready. Returns false on failure (the source reports the error).
+  virtual bool Open(WaitHandle &handle) = 0;
+
+  // The handle was signalled. Returns false to detach the source.
+  virtual bool OnReady() = 0;
+
+  // Release the device; called once after a successful Open()
+  virtual void Close() = 0;
+};
+
+// Multiplexes many capture sources onto a few event-driven threads, up to
+// streamsPerThread each: a multi-handle wait on Windows, epoll on Linux and
+// poll elsewhere. Heavy per-packet work belongs on a WorkerPool strand so
+// the capture threads only move data out of the device buffers.
+class CaptureScheduler {
+public:
+  explicit CaptureScheduler(size_t streamsPerThread);
+  ~CaptureScheduler();
+
+  // Attach a source to a capture thread with a free slot and open it there.
+  // Returns false if Open() failed.
+  bool Add(std::shared_ptr<CaptureSource> source);
+
+  // Detach and close a source; none of its methods run after this returns
+  void Remove(const std::shared_ptr<CaptureSource> &source);
+
+  // Number of sources sharing the capture thread of source (0 if detached)
+  size_t SharedStreamCount(const CaptureSource *source);
+
+  size_t ThreadCount();
+
+  // Process-wide scheduler used by the engines
+  static CaptureScheduler &Shared();
+
+private:
+  class CaptureThread;
+
+  std::mutex mutex;
+  size_t streamsPerThread;
+  std::vector<std::unique_ptr<CaptureThread>> threads;
+  std::unordered_map<const CaptureSource *, CaptureThread *> owners;
+};
@@ -0,0 +1,357 @@
+#include "ContainerMuxer.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Ogg
+
+const size_t kOggHeaderSize = 27;
+const uint8_t kOggContinued = 0x01;
+const uint8_t kOggFirst = 0x02;
+const uint8_t kOggLast = 0x04;
+
+struct OggCrcTable {
+  uint32_t table[256];
+
+  OggCrcTable() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i << 24;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+      }
+      table[i] = crc;
+    }
+  }
+};
+
+void PutLittle(uint8_t *p, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    p[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// EBML
+
+// Element IDs keep their length marker, so they are written as they are
+void PutId(std::vector<uint8_t> &out, uint32_t id) {
+  int bytes = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+  for (int i = bytes - 1; i >= 0; i--) {
+    out.push_back((uint8_t)(id >> (8 * i)));
+  }
+}
+
+// Shortest variable-size integer for size; all ones is reserved for
+// unknown sizes
+void PutSize(std::vector<uint8_t> &out, uint64_t size) {
+  int bytes = 1;
+  while (bytes < 8 && size >= (1ull << (7 * bytes)) - 1) {
+    bytes++;
+  }
+  uint64_t coded = size | (1ull << (7 * bytes));
+  for (int i = bytes - 1; i >= 0; i--) {
+    out.push_back((uint8_t)(coded >> (8 * i)));
+  }
+}
+
+void PutUint(std::vector<uint8_t> &out, uint32_t id, uint64_t value) {
+  int bytes = 1;
+  while (bytes < 8 && (value >> (8 * bytes)) != 0) {
+    bytes++;
+  }
+  PutId(out, id);
+  PutSize(out, (uint64_t)bytes);
+  for (int i = bytes - 1; i >= 0; i--) {
+    out.push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+
+void PutFloat(std::vector<uint8_t> &out, uint32_t id, double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  PutId(out, id);
+  PutSize(out, 8);
+  for (int i = 7; i >= 0; i--) {
+    out.push_back((uint8_t)(bits >> (8 * i)));
+  }
+}
+
+void PutBytes(std::vector<uint8_t> &out, uint32_t id, const uint8_t *data,
+              size_t size) {
+  PutId(out, id);
+  PutSize(out, size);
+  out.insert(out.end(), data, data + size);
+}
+
+void PutString(std::vector<uint8_t> &out, uint32_t id,
+               const std::string &value) {
+  PutBytes(out, id, (const uint8_t *)value.data(), value.size());
+}
+
+void PutMaster(std::vector<uint8_t> &out, uint32_t id,
+               const std::vector<uint8_t> &children) {
+  PutBytes(out, id, children.data(), children.size());
+}
+
+const uint32_t kEbml = 0x1A45DFA3;
+const uint32_t kEbmlVersion = 0x4286;
+const uint32_t kEbmlReadVersion = 0x42F7;
+const uint32_t kEbmlMaxIdLength = 0x42F2;
+const uint32_t kEbmlMaxSizeLength = 0x42F3;
+const uint32_t kDocType = 0x4282;
+const uint32_t kDocTypeVersion = 0x4287;
+const uint32_t kDocTypeReadVersion = 0x4285;
+const uint32_t kSegment = 0x18538067;
+const uint32_t kInfo = 0x1549A966;
+const uint32_t kTimecodeScale = 0x2AD7B1;
+const uint32_t kMuxingApp = 0x4D80;
+const uint32_t kWritingApp = 0x5741;
+const uint32_t kTracks = 0x1654AE6B;
+const uint32_t kTrackEntry = 0xAE;
+const uint32_t kTrackNumber = 0xD7;
+const uint32_t kTrackUid = 0x73C5;
+const uint32_t kTrackType = 0x83;
+const uint32_t kFlagLacing = 0x9C;
+const uint32_t kCodecId = 0x86;
+const uint32_t kCodecPrivate = 0x63A2;
+const uint32_t kAudio = 0xE1;
+const uint32_t kSamplingFrequency = 0xB5;
+const uint32_t kChannels = 0x9F;
+const uint32_t kBitDepth = 0x6264;
+const uint32_t kCluster = 0x1F43B675;
+const uint32_t kTimecode = 0xE7;
+const uint32_t kSimpleBlock = 0xA3;
+
+const char *const kApp = "native-recorder-nodejs";
+
+// Block timecodes are signed 16-bit offsets from their cluster's
+const uint64_t kMaxBlockOffset = 32767;
+
+uint64_t TimecodeOf(uint64_t position, int sampleRate) {
+  return (uint64_t)std::llround(position * 1000.0 / sampleRate);
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// OggMuxer
+
+OggMuxer::OggMuxer(ContainerTrack track, uint32_t serial,
+                   uint64_t chunkFrames, ChunkCallback onChunk)
+    : ContainerMuxer(std::move(track), chunkFrames, std::move(onChunk)),
+      serial(serial) {}
+
+uint32_t OggMuxer::Crc(const uint8_t *data, size_t size) {
+  static const OggCrcTable crc;
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value = (value << 8) ^ crc.table[(value >> 24) ^ data[i]];
+  }
+  return value;
+}
+
+void OggMuxer::Begin() {
+  if (track.oggHeaders.empty()) {
+    return;
+  }
+  // The first header alone on the first page, the others on pages of their
+  // own, so audio starts on a fresh page
+  Append(track.oggHeaders[0].data(), track.oggHeaders[0].size(), 0);
+  FlushPage(false);
+  for (size_t i = 1; i < track.oggHeaders.size(); i++) {
+    Append(track.oggHeaders[i].data(), track.oggHeaders[i].size(), 0);
+  }
+  FlushPage(false);
+}
+
+void OggMuxer::Add(const uint8_t *packet, size_t size, uint64_t position,
+                   uint32_t frames) {
+  if (segments == 0 && !continued) {
+    pageStart = position;
+  }
+  Append(packet, size, position + frames);
+  if (granule != kNoGranule && granule - pageStart >= chunkFrames) {
+    FlushPage(false);
+  }
+}
+
+void OggMuxer::Finish() {
+  if (finished) {
+    return;
+  }
+  // The last page carries the end-of-stream flag, even if it is empty
+  FlushPage(true);
+  finished = true;
+}
+
+void OggMuxer::Append(const uint8_t *packet, size_t size,
+                      uint64_t granuleEnd) {
+  // A packet is laced as runs of 255 bytes and a shorter last segment,
+  // possibly empty; one that does not fit continues on the next page
+  for (;;) {
+    while (size >= 255 && segments < 255) {
+      lacing[segments++] = 255;
+      body.insert(body.end(), packet, packet + 255);
+      packet += 255;
+      size -= 255;
+    }
+    if (segments == 255) {
+      FlushPage(false);
+      continued = true;
+      continue;
+    }
+    lacing[segments++] = (uint8_t)size;
+    body.insert(body.end(), packet, packet + size);
+    granule = granuleEnd;
+    return;
+  }
+}
+
+void OggMuxer::FlushPage(bool last) {
+  if (segments == 0 && !last) {
+    return;
+  }
+  uint8_t flags = 0;
+  if (continued) {
+    flags |= kOggContinued;
+  }
+  if (!started) {
+    flags |= kOggFirst;
+  }
+  if (last) {
+    flags |= kOggLast;
+  }
+  // An empty last page repeats the granule the stream ended on
+  uint64_t position =
+      granule == kNoGranule && segments == 0 ? lastGranule : granule;
+
+  page.resize(kOggHeaderSize + segments + body.size());
+  uint8_t *p = page.data();
+  std::memcpy(p, "OggS", 4);
+  p[4] = 0; // Version
+  p[5] = flags;
+  PutLittle(p + 6, position, 8);
+  PutLittle(p + 14, serial, 4);
+  PutLittle(p + 18, sequence++, 4);
+  PutLittle(p + 22, 0, 4);
+  p[26] = (uint8_t)segments;
+  std::memcpy(p + kOggHeaderSize, lacing, segments);
+  if (!body.empty()) {
+    std::memcpy(p + kOggHeaderSize + segments, body.data(), body.size());
+  }
+  PutLittle(p + 22, Crc(page.data(), page.size()), 4);
+  Emit(page.data(), page.size());
+
+  started = true;
+  continued = false;
+  if (granule != kNoGranule) {
+    lastGranule = granule;
+  }
+  granule = kNoGranule;
+  segments = 0;
+  body.clear();
+}
+
+// ---------------------------------------------------------------------------
+// MatroskaMuxer
+
+MatroskaMuxer::MatroskaMuxer(ContainerTrack track, uint64_t chunkFrames,
+                             ChunkCallback onChunk)
+    : ContainerMuxer(std::move(track), chunkFrames, std::move(onChunk)) {}
+
+void MatroskaMuxer::Begin() {
+  std::vector<uint8_t> header;
+  std::vector<uint8_t> children;
+  PutUint(children, kEbmlVersion, 1);
+  PutUint(children, kEbmlReadVersion, 1);
+  PutUint(children, kEbmlMaxIdLength, 4);
+  PutUint(children, kEbmlMaxSizeLength, 8);
+  PutString(children, kDocType, track.webm ? "webm" : "matroska");
+  PutUint(children, kDocTypeVersion, 4);
+  PutUint(children, kDocTypeReadVersion, 2); // SimpleBlock
+  PutMaster(header, kEbml, children);
+
+  // The segment runs until the stream ends: unknown size
+  PutId(header, kSegment);
+  header.push_back(0x01);
+  header.insert(header.end(), 7, 0xFF);
+
+  children.clear();
+  PutUint(children, kTimecodeScale, 1000000); // Milliseconds
+  PutString(children, kMuxingApp, kApp);
+  PutString(children, kWritingApp, kApp);
+  PutMaster(header, kInfo, children);
+
+  std::vector<uint8_t> audio;
+  PutFloat(audio, kSamplingFrequency, (double)track.sampleRate);
+  PutUint(audio, kChannels, (uint64_t)track.channels);
+  PutUint(audio, kBitDepth, (uint64_t)track.bitDepth);
+  std::vector<uint8_t> entry;
+  PutUint(entry, kTrackNumber, 1);
+  PutUint(entry, kTrackUid, 1);
+  PutUint(entry, kTrackType, 2); // Audio
+  PutUint(entry, kFlagLacing, 0);
+  PutString(entry, kCodecId, track.codecId);
+  if (!track.codecPrivate.empty()) {
+    PutMaster(entry, kCodecPrivate, track.codecPrivate);
+  }
+  PutMaster(entry, kAudio, audio);
+  children.clear();
+  PutMaster(children, kTrackEntry, entry);
+  PutMaster(header, kTracks, children);
+
+  Emit(header.data(), header.size());
+}
+
+void MatroskaMuxer::Add(const uint8_t *packet, size_t size,
+                        uint64_t position, uint32_t frames) {
+  uint64_t timecode = TimecodeOf(position, track.sampleRate);
+  if (clusterOpen && timecode - clusterTime > kMaxBlockOffset) {
+    FlushCluster();
+  }
+  if (!clusterOpen) {
+    clusterOpen = true;
+    clusterStart = position;
+    clusterTime = timecode;
+  }
+
+  // Track 1, offset from the cluster, keyframe
+  uint64_t offset = timecode - clusterTime;
+  PutId(blocks, kSimpleBlock);
+  PutSize(blocks, 4 + size);
+  blocks.push_back(0x81);
+  blocks.push_back((uint8_t)(offset >> 8));
+  blocks.push_back((uint8_t)offset);
+  blocks.push_back(0x80);
+  blocks.insert(blocks.end(), packet, packet + size);
+
+  if (position + frames - clusterStart >= chunkFrames) {
+    FlushCluster();
+  }
+}
+
+void MatroskaMuxer::Finish() {
+  if (clusterOpen) {
+    FlushCluster();
+  }
+}
+
+void MatroskaMuxer::FlushCluster() {
+  // Cluster size: the Timecode element (ID, size and value) and the blocks
+  int timecodeBytes = 1;
+  while (timecodeBytes < 8 && (clusterTime >> (8 * timecodeBytes)) != 0) {
+    timecodeBytes++;
+  }
+  cluster.clear();
+  PutId(cluster, kCluster);
+  PutSize(cluster, 2 + (uint64_t)timecodeBytes + blocks.size());
+  PutUint(cluster, kTimecode, clusterTime);
+  cluster.insert(cluster.end(), blocks.begin(), blocks.end());
+  Emit(cluster.data(), cluster.size());
+
+  blocks.clear();
+  clusterOpen = false;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// What a container needs to know about the encoded audio it carries
+struct ContainerTrack {
+  int sampleRate = 0;
+  int channels = 0;
+  int bitDepth = 16;
+  // Ogg header packets; the first goes alone on the beginning-of-stream
+  // page, the rest on the pages before the first audio packet
+  std::vector<std::vector<uint8_t>> oggHeaders;
+  // Matroska CodecID and CodecPrivate
+  std::string codecId;
+  std::vector<uint8_t> codecPrivate;
+  // WebM admits the codec (Opus, Vorbis); other codecs are written with
+  // the Matroska DocType
+  bool webm = false;
+};
+
+// Packs a stream of encoded packets into a container while it is being
+// recorded, handing out chunks that each stand on their own: one Ogg page,
+// or the Matroska header or one cluster. A chunk is about chunkFrames long
+// unless the stream ends first, so the chunks can be sent as they come, as
+// the parts of a chunked HTTP upload or to a MediaSource. Packets carry
+// their sample position on the stream, which may skip ahead over a gap.
+// Not thread-safe; once the buffers have grown to the largest chunk, adding
+// packets does not allocate.
+class ContainerMuxer {
+public:
+  // Called with each chunk; the data is only valid during the call
+  using ChunkCallback = std::function<void(const uint8_t *data, size_t size)>;
+
+  ContainerMuxer(ContainerTrack track, uint64_t chunkFrames,
+                 ChunkCallback onChunk)
+      : track(std::move(track)), chunkFrames(chunkFrames),
+        onChunk(std::move(onChunk)) {}
+  virtual ~ContainerMuxer() = default;
+
+  // Emit the stream headers; once, before the first packet
+  virtual void Begin() = 0;
+
+  // A packet of frames samples starting at sample position
+  virtual void Add(const uint8_t *packet, size_t size, uint64_t position,
+                   uint32_t frames) = 0;
+
+  // Emit what is held back; nothing may be added after this
+  virtual void Finish() = 0;
+
+  uint64_t Chunks() const { return chunks; }
+  uint64_t Bytes() const { return bytes; }
+
+protected:
+  void Emit(const uint8_t *data, size_t size) {
+    chunks++;
+    bytes += size;
+    if (onChunk) {
+      onChunk(data, size);
+    }
+  }
+
+  ContainerTrack track;
+  uint64_t chunkFrames;
+
+private:
+  ChunkCallback onChunk;
+  uint64_t chunks = 0;
+  uint64_t bytes = 0;
+};
+
+// Ogg bitstream (RFC 3533) of one logical stream. A page is emitted once
+// the packets ending on it span chunkFrames; packets longer than a page
+// continue on the next. The granule position of a page is the sample
+// position just after the last packet that ends on it, -1 when none does.
+class OggMuxer : public ContainerMuxer {
+public:
+  OggMuxer(ContainerTrack track, uint32_t serial, uint64_t chunkFrames,
+           ChunkCallback onChunk);
+
+  void Begin() override;
+  void Add(const uint8_t *packet, size_t size, uint64_t position,
+           uint32_t frames) override;
+  void Finish() override;
+
+  // The CRC-32 of Ogg pages (polynomial 0x04c11db7, unreflected, from 0)
+  static uint32_t Crc(const uint8_t *data, size_t size);
+
+private:
+  static const uint64_t kNoGranule = ~0ull;
+
+  void Append(const uint8_t *packet, size_t size, uint64_t granuleEnd);
+  void FlushPage(bool last);
+
+  uint32_t serial;
+  uint32_t sequence = 0;
+  bool started = false;  // The beginning-of-stream page is out
+  bool finished = false;
+  bool continued = false; // The page starts inside a packet
+  uint64_t pageStart = 0; // Position of the page's first packet
+  uint64_t granule = kNoGranule;
+  uint64_t lastGranule = 0;
+  uint8_t lacing[255];
+  int segments = 0;
+  std::vector<uint8_t> body;
+  std::vector<uint8_t> page;
+};
+
+// Matroska, or WebM for the codecs it admits, in the live layout: a
+// Segment of unknown size, then Info and Tracks, all emitted as the first
+// chunk; then clusters of SimpleBlocks, each emitted whole once it spans
+// chunkFrames, so the size of every cluster is known. Timecodes are in
+// milliseconds; a cluster is also closed before its blocks' offsets would
+// overflow.
+class MatroskaMuxer : public ContainerMuxer {
+public:
+  MatroskaMuxer(ContainerTrack track, uint64_t chunkFrames,
+                ChunkCallback onChunk);
+
+  void Begin() override;
+  void Add(const uint8_t *packet, size_t size, uint64_t position,
+           uint32_t frames) override;
+  void Finish() override;
+
+private:
+  void FlushCluster();
+
+  bool clusterOpen = false;
+  uint64_t clusterStart = 0;  // Position of the first block
+  uint64_t clusterTime = 0;   // Its timecode
+  std::vector<uint8_t> blocks;
+  std::vector<uint8_t> cluster;
+};
@@ -0,0 +1,208 @@
+#include "ContainerStream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+bool ValidateContainerSettings(const ContainerSettings &settings,
+                               std::string &error) {
+  // Matroska block offsets cover about 32 seconds
+  if (!(settings.chunkSeconds > 0 && settings.chunkSeconds <= 30)) {
+    error = "chunkSeconds must be more than 0 and at most 30";
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// GranuleClock
+
+uint64_t GranuleClock::Place(size_t frames, int64_t timestampNs,
+                             bool discontinuity) {
+  if (timestampNs != 0) {
+    if (clock.IsValid()) {
+      int64_t gapNs = timestampNs - clock.TimeOf((double)next);
+      if (gapNs > 0 && (discontinuity || gapNs > kMaxGapNs)) {
+        uint64_t gap =
+            (uint64_t)std::llround(gapNs * clock.SampleRate() / 1e9);
+        next += gap;
+        skipped += gap;
+        discontinuity = true;
+      }
+    }
+    clock.Update(next, timestampNs, discontinuity);
+  }
+  uint64_t position = next;
+  next += frames;
+  return position;
+}
+
+// ---------------------------------------------------------------------------
+// ContainerStream
+
+ContainerStream::ContainerStream(const ContainerSettings &settings,
+                                 int sampleRate, int channels,
+                                 uint32_t serial,
+                                 ContainerMuxer::ChunkCallback onChunk)
+    : channels(channels),
+      encoder(sampleRate, channels,
+              (uint32_t)std::min<double>(
+                  kFlacBlockFrames,
+                  std::ceil(settings.chunkSeconds * sampleRate))),
+      clock(sampleRate) {
+  uint64_t chunkFrames = std::max<uint64_t>(
+      1, (uint64_t)std::llround(settings.chunkSeconds * sampleRate));
+
+  ContainerTrack track;
+  track.sampleRate = sampleRate;
+  track.channels = channels;
+  track.bitDepth = 16;
+  track.oggHeaders = {encoder.OggFirstPacket(), encoder.OggCommentPacket()};
+  track.codecId = "A_FLAC";
+  std::vector<uint8_t> metadata = encoder.MetadataBlocks();
+  track.codecPrivate = {'f', 'L', 'a', 'C'};
+  track.codecPrivate.insert(track.codecPrivate.end(), metadata.begin(),
+                            metadata.end());
+  if (settings.format == ContainerFormat::WebM) {
+    muxer = std::make_unique<MatroskaMuxer>(std::move(track), chunkFrames,
+                                            std::move(onChunk));
+  } else {
+    muxer = std::make_unique<OggMuxer>(std::move(track), serial, chunkFrames,
+                                       std::move(onChunk));
+  }
+  pending.resize((size_t)encoder.MaxBlockFrames() * channels);
+}
+
+void ContainerStream::Write(const int16_t *samples, size_t sampleCount,
+                            const CaptureMetadata &meta) {
+  size_t frames = sampleCount / channels;
+  if (finished || frames == 0) {
+    return;
+  }
+  if (!started) {
+    muxer->Begin();
+    started = true;
+  }
+
+  // A packet covers contiguous samples: after a gap, start a new one
+  uint64_t position =
+      clock.Place(frames, meta.timestampNs, meta.discontinuity);
+  if (pendingFrames > 0 && position != pendingStart + pendingFrames) {
+    EncodePending();
+  }
+  if (pendingFrames == 0) {
+    pendingStart = position;
+  }
+
+  size_t blockFrames = encoder.MaxBlockFrames();
+  size_t done = 0;
+  while (done < frames) {
+    size_t count = std::min(frames - done, blockFrames - pendingFrames);
+    std::memcpy(pending.data() + pendingFrames * channels,
+                samples + done * channels,
+                count * channels * sizeof(int16_t));
+    pendingFrames += count;
+    done += count;
+    if (pendingFrames == blockFrames) {
+      EncodePending();
+    }
+  }
+}
+
+void ContainerStream::Finish() {
+  if (finished || !started) {
+    finished = true;
+    return;
+  }
+  EncodePending();
+  muxer->Finish();
+  finished = true;
+}
+
+void ContainerStream::EncodePending() {
+  if (pendingFrames == 0) {
+    return;
+  }
+  encoder.EncodeFrame(pending.data(), (uint32_t)pendingFrames, pendingStart,
+                      packet);
+  muxer->Add(packet.data(), packet.size(), pendingStart,
+             (uint32_t)pendingFrames);
+  pendingStart += pendingFrames;
+  pendingFrames = 0;
+}
+
+// ---------------------------------------------------------------------------
+// ContainerFile
+
+ContainerFile::ContainerFile(std::string path, bool direct,
+                             ErrorCallback onError, DiskWriter &writer)
+    : path(std::move(path)), direct(direct),
+      blocks(std::move(onError),
+             [this](uint32_t) { return this->path; }, writer) {}
+
+ContainerFile::~ContainerFile() { Close(); }
+
+bool ContainerFile::Open(std::string &error) {
+  std::lock_guard<std::mutex> lock(mutex);
+  file = std::make_shared<DiskFile>();
+  if (!file->Open(path, direct, error)) {
+    file.reset();
+    return false;
+  }
+  offset = 0;
+  block = blocks.TakeBlock();
+  isOpen = true;
+  return true;
+}
+
+void ContainerFile::Write(const uint8_t *data, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!isOpen || blocks.Failed()) {
+    return;
+  }
+  while (size > 0) {
+    size_t count = std::min(size, kBlockBytes - block->used);
+    std::memcpy(block->data + block->used, data, count);
+    block->used += count;
+    block->dataBytes += count;
+    data += count;
+    size -= count;
+    if (block->used == kBlockBytes) {
+      blocks.WriteBlock(file, block, offset);
+      offset += kBlockBytes;
+      block = blocks.TakeBlock();
+    }
+  }
+}
+
+void ContainerFile::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isOpen) {
+      return;
+    }
+    isOpen = false;
+
+    // Runs once every full block is in the file. Direct I/O takes whole
+    // sectors only, so the tail goes through the page cache.
+    BlockWriter::Block *tail = block;
+    uint64_t tailOffset = offset;
+    block = nullptr;
+    blocks.SubmitTask(file, [this, tail, tailOffset] {
+      bool ok = file->IsOpen() &&
+                (tail->used == 0 ||
+                 (file->DisableDirect() &&
+                  file->WriteAt(tail->data, tail->used, tailOffset)));
+      ok = file->Close() && ok;
+      if (ok) {
+        blocks.AddBytesWritten(tail->dataBytes);
+      }
+      blocks.ReleaseBlock(tail);
+      if (!ok) {
+        blocks.Fail("Failed to finish " + path);
+      }
+      blocks.EndRequest(-1);
+    });
+  }
+  blocks.Drain();
+}
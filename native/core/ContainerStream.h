@@ -0,0 +1,141 @@
+#pragma once
+
+#include "BlockWriter.h"
+#include "CaptureCore.h"
+#include "ContainerMuxer.h"
+#include "DiskWriter.h"
+#include "FlacEncoder.h"
+#include "StreamClock.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ContainerFormat { None, Ogg, WebM };
+
+enum class ContainerCodec { Flac };
+
+// Settings of an encoded, containerised stream
+struct ContainerSettings {
+  ContainerFormat format = ContainerFormat::None; // None: plain PCM
+  ContainerCodec codec = ContainerCodec::Flac;
+  // Each page or cluster, and so each chunk handed out, spans about this
+  double chunkSeconds = 0.5;
+};
+
+// Checks the ranges the stream supports; false with error set otherwise
+bool ValidateContainerSettings(const ContainerSettings &settings,
+                               std::string &error);
+
+// Places a stream's blocks on the sample timeline of its container from
+// their capture timestamps. Blocks follow each other without a gap until
+// frames are lost: at a discontinuity, or when a block arrives more than
+// kMaxGapNs after its predecessor should have ended, the position skips
+// ahead by the time that went by. It never goes back, so late timestamps
+// only delay the next skip. Blocks without a timestamp just follow on. Not
+// thread-safe.
+class GranuleClock {
+public:
+  static const int64_t kMaxGapNs = 100000000; // 100 ms
+
+  explicit GranuleClock(int sampleRate) : clock(sampleRate) {}
+
+  // Position of the block's first frame, in samples since the first block
+  uint64_t Place(size_t frames, int64_t timestampNs, bool discontinuity);
+
+  // Samples skipped over gaps so far
+  uint64_t SkippedFrames() const { return skipped; }
+
+private:
+  StreamClock clock;
+  uint64_t next = 0;
+  uint64_t skipped = 0;
+};
+
+// Encodes a stream's 16-bit PCM and packs it into its container, handing
+// each finished chunk to a callback on the capture thread. Audio collects
+// into full encoder blocks; a gap in the timeline ends the block early, so
+// every packet's position is exact. Not thread-safe: written from the
+// capture thread, finished once capture has stopped. After warm-up, Write()
+// does not allocate.
+class ContainerStream {
+public:
+  ContainerStream(const ContainerSettings &settings, int sampleRate,
+                  int channels, uint32_t serial,
+                  ContainerMuxer::ChunkCallback onChunk);
+
+  // Queue interleaved samples, a whole number of frames
+  void Write(const int16_t *samples, size_t sampleCount,
+             const CaptureMetadata &meta);
+
+  // Encode what is left and emit the rest of the container. A stream that
+  // never had audio emits nothing, not even its headers.
+  void Finish();
+
+  uint64_t Chunks() const { return muxer->Chunks(); }
+  uint64_t Bytes() const { return muxer->Bytes(); }
+  uint64_t SkippedFrames() const { return clock.SkippedFrames(); }
+
+private:
+  void EncodePending();
+
+  int channels;
+  FlacEncoder encoder;
+  std::unique_ptr<ContainerMuxer> muxer;
+  GranuleClock clock;
+  bool started = false;
+  bool finished = false;
+  // Samples waiting for a full block, and where they start
+  std::vector<int16_t> pending;
+  size_t pendingFrames = 0;
+  uint64_t pendingStart = 0;
+  std::vector<uint8_t> packet;
+};
+
+// Writes a container stream to one file through a DiskWriter. Chunks are
+// copied into 64 KB blocks of a BlockWriter, each written once it is full,
+// and the partial last one on Close(); the capture thread never touches
+// the file. Once its blocks have been recycled, Write() does not allocate.
+class ContainerFile {
+public:
+  using ErrorCallback = std::function<void(const std::string &error)>;
+  // Disk writes of this file, queued or in flight
+  using WriteStats = BlockWriter::WriteStats;
+
+  // direct bypasses the page cache where supported; onError runs on the
+  // writer's thread
+  ContainerFile(std::string path, bool direct, ErrorCallback onError,
+                DiskWriter &writer = DiskWriter::Shared());
+  ~ContainerFile();
+
+  // Create the file
+  bool Open(std::string &error);
+
+  // Append a chunk; called by the capture thread
+  void Write(const uint8_t *data, size_t size);
+
+  // Write out the rest and wait for the writer to close the file
+  void Close();
+
+  uint64_t BytesWritten() const { return blocks.BytesWritten(); }
+
+  WriteStats GetWriteStats() const { return blocks.GetWriteStats(); }
+
+private:
+  static const size_t kBlockBytes = BlockWriter::kBlockBytes;
+
+  std::string path;
+  bool direct;
+  BlockWriter blocks;
+  std::shared_ptr<DiskFile> file;
+
+  // Capture side, under mutex
+  std::mutex mutex;
+  bool isOpen = false;
+  BlockWriter::Block *block = nullptr;
+  uint64_t offset = 0; // Of the block being filled
+};
@@ -0,0 +1,161 @@
+#include "ConvertKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Per-encoding sample access. Loads go through memcpy so packed 24-bit and
+// unaligned device buffers are read safely; compilers turn them into plain
+// loads.
+template <SampleEncoding E> struct Sample;
+
+template <> struct Sample<SampleEncoding::Int16> {
+  static constexpr size_t kBytes = 2;
+  static int16_t Load(const uint8_t *p) {
+    int16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static int16_t ToPcm(const uint8_t *p) { return Load(p); }
+  static float ToFloat(const uint8_t *p) { return Load(p) / 32768.0f; }
+};
+
+template <> struct Sample<SampleEncoding::Int24> {
+  static constexpr size_t kBytes = 3;
+  static int32_t Load(const uint8_t *p) {
+    return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) |
+                     ((uint32_t)p[2] << 24));
+  }
+  // Top 16 of the 24 bits
+  static int16_t ToPcm(const uint8_t *p) {
+    return (int16_t)((uint16_t)p[1] | ((uint16_t)p[2] << 8));
+  }
+  static float ToFloat(const uint8_t *p) { return Load(p) / 2147483648.0f; }
+};
+
+template <> struct Sample<SampleEncoding::Int32> {
+  static constexpr size_t kBytes = 4;
+  static int32_t Load(const uint8_t *p) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static int16_t ToPcm(const uint8_t *p) { return (int16_t)(Load(p) >> 16); }
+  static float ToFloat(const uint8_t *p) { return Load(p) / 2147483648.0f; }
+};
+
+template <> struct Sample<SampleEncoding::Float32> {
+  static constexpr size_t kBytes = 4;
+  static float Load(const uint8_t *p) {
+    float v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  // Same scaling as ConvertFloatToInt16; min/max compile to branch-free
+  // clamps
+  static int16_t ToPcm(const uint8_t *p) {
+    return (int16_t)(int32_t)(std::min(1.0f, std::max(-1.0f, Load(p))) *
+                              32767.0f);
+  }
+  static float ToFloat(const uint8_t *p) { return Load(p); }
+};
+
+// Kernels, with Channels == 0 meaning "taken at run time"
+template <int Channels>
+inline int ChannelCount(int channels) {
+  return Channels > 0 ? Channels : channels;
+}
+
+template <SampleEncoding E, int Channels>
+void InterleavedToPcm(const uint8_t *src, size_t frames, int channels,
+                      int16_t *dst) {
+  size_t count = frames * ChannelCount<Channels>(channels);
+  if (E == SampleEncoding::Int16) {
+    memcpy(dst, src, count * sizeof(int16_t));
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = Sample<E>::ToPcm(src + i * Sample<E>::kBytes);
+  }
+}
+
+template <SampleEncoding E, int Channels>
+void InterleavedToFloat(const uint8_t *src, size_t frames, int channels,
+                        float *dst) {
+  size_t count = frames * ChannelCount<Channels>(channels);
+  if (E == SampleEncoding::Float32) {
+    memcpy(dst, src, count * sizeof(float));
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = Sample<E>::ToFloat(src + i * Sample<E>::kBytes);
+  }
+}
+
+template <SampleEncoding E, int Channels, typename Out, typename Convert>
+void PlanarToInterleaved(const uint8_t *const *planes, int planeCount,
+                         size_t frames, int channels, Out *dst,
+                         Convert convert) {
+  int stride = ChannelCount<Channels>(channels);
+  for (int ch = 0; ch < stride; ch++) {
+    Out *out = dst + ch;
+    if (ch >= planeCount || !planes[ch]) {
+      for (size_t frame = 0; frame < frames; frame++)
+        out[frame * stride] = Out();
+      continue;
+    }
+    const uint8_t *in = planes[ch];
+    for (size_t frame = 0; frame < frames; frame++)
+      out[frame * stride] = convert(in + frame * Sample<E>::kBytes);
+  }
+}
+
+template <SampleEncoding E, int Channels>
+void PlanarToPcm(const uint8_t *const *planes, int planeCount, size_t frames,
+                 int channels, int16_t *dst) {
+  // Mono planar is already interleaved
+  if (Channels == 1 && planeCount >= 1 && planes[0]) {
+    InterleavedToPcm<E, 1>(planes[0], frames, 1, dst);
+    return;
+  }
+  PlanarToInterleaved<E, Channels>(planes, planeCount, frames, channels, dst,
+                                   Sample<E>::ToPcm);
+}
+
+template <SampleEncoding E, int Channels>
+void PlanarToFloat(const uint8_t *const *planes, int planeCount,
+                   size_t frames, int channels, float *dst) {
+  if (Channels == 1 && planeCount >= 1 && planes[0]) {
+    InterleavedToFloat<E, 1>(planes[0], frames, 1, dst);
+    return;
+  }
+  PlanarToInterleaved<E, Channels>(planes, planeCount, frames, channels, dst,
+                                   Sample<E>::ToFloat);
+}
+
+template <SampleEncoding E, int Channels>
+constexpr ConversionKernels Kernels() {
+  return {InterleavedToPcm<E, Channels>, InterleavedToFloat<E, Channels>,
+          PlanarToPcm<E, Channels>, PlanarToFloat<E, Channels>};
+}
+
+// Dispatch table: [encoding in SampleEncoding order][mono, stereo, other]
+const ConversionKernels kKernels[4][3] = {
+    {Kernels<SampleEncoding::Int16, 1>(), Kernels<SampleEncoding::Int16, 2>(),
+     Kernels<SampleEncoding::Int16, 0>()},
+    {Kernels<SampleEncoding::Int24, 1>(), Kernels<SampleEncoding::Int24, 2>(),
+     Kernels<SampleEncoding::Int24, 0>()},
+    {Kernels<SampleEncoding::Int32, 1>(), Kernels<SampleEncoding::Int32, 2>(),
+     Kernels<SampleEncoding::Int32, 0>()},
+    {Kernels<SampleEncoding::Float32, 1>(),
+     Kernels<SampleEncoding::Float32, 2>(),
+     Kernels<SampleEncoding::Float32, 0>()},
+};
+
+} // namespace
+
+ConversionKernels SelectKernels(SampleEncoding encoding, int channels) {
+  int column = channels == 1 ? 0 : channels == 2 ? 1 : 2;
+  return kKernels[(int)encoding][column];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "SampleConvert.h"
+#include <cstddef>
+#include <cstdint>
+
+// Interleaved device samples to interleaved output
+using PcmKernel = void (*)(const uint8_t *src, size_t frames, int channels,
+                           int16_t *dst);
+using FloatKernel = void (*)(const uint8_t *src, size_t frames, int channels,
+                             float *dst);
+
+// Planar device buffers, planeCount of them, to interleaved output. Channels
+// without a plane (or with a null one) come out silent.
+using PlanarPcmKernel = void (*)(const uint8_t *const *planes, int planeCount,
+                                 size_t frames, int channels, int16_t *dst);
+using PlanarFloatKernel = void (*)(const uint8_t *const *planes,
+                                   int planeCount, size_t frames, int channels,
+                                   float *dst);
+
+// Conversions for one device format, chosen once when a stream opens. Each
+// kernel is instantiated per encoding and channel count (mono, stereo, or
+// any other count), so the per-sample loops carry no format branches.
+// Integer sources reach 16-bit PCM without going through float, and a
+// source that already is 16-bit PCM (or float, for toFloat) is a memcpy.
+struct ConversionKernels {
+  PcmKernel toPcm;
+  FloatKernel toFloat;
+  PlanarPcmKernel planarToPcm;
+  PlanarFloatKernel planarToFloat;
+};
+
+ConversionKernels SelectKernels(SampleEncoding encoding, int channels);
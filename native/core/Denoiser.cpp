@@ -0,0 +1,192 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// Weight of the previous hop in the smoothed bin power
+const float kPowerSmoothing = 0.8f;
+
+// The noise floor follows the smoothed power down at once but rises by at
+// most 5 dB per second, so speech rarely lifts it while a changed
+// background is picked up within a few seconds
+const float kNoiseRise = 1.0116f; // 10^(0.05 / 10) per 10 ms hop
+
+// A minimum sits below the mean of the noise it tracks
+const float kNoiseBias = 2.0f;
+
+// Decision-directed weight of the previous clean estimate in the a priori
+// SNR; higher is smoother with less musical noise
+const float kDecisionDirected = 0.96f;
+
+const float kPowerEpsilon = 1e-12f;
+
+} // namespace
+
+bool ValidateDenoiseSettings(const DenoiseSettings &settings,
+                             std::string &error) {
+  if (!(settings.maxAttenuationDb >= 0 && settings.maxAttenuationDb <= 60)) {
+    error = "maxAttenuationDb must be between 0 and 60";
+    return false;
+  }
+  return true;
+}
+
+Denoiser::Denoiser(const DenoiseSettings &settings)
+    : settings(settings),
+      gainFloor((float)std::pow(10.0, -settings.maxAttenuationDb / 20.0)),
+      fft(kFftSize) {
+  // Periodic square-root Hann: applied on analysis and synthesis, its
+  // square overlap-adds to one at a hop of half the window
+  window.resize(kWindow);
+  for (size_t i = 0; i < kWindow; i++) {
+    window[i] =
+        (float)std::sqrt(0.5 - 0.5 * std::cos(2.0 * kPi * i / kWindow));
+  }
+  windowed.resize(kFftSize);
+  binRe.resize(kFftSize / 2 + 1);
+  binIm.resize(kFftSize / 2 + 1);
+  hopIn.resize(kHop);
+  hopOut.resize(kHop);
+}
+
+void Denoiser::Configure(int sampleRate, int channels) {
+  this->sampleRate = sampleRate;
+  this->channels = channels;
+
+  size_t bins = kFftSize / 2 + 1;
+  state.assign(channels, Channel());
+  for (Channel &channel : state) {
+    channel.frame.assign(kWindow, 0.0f);
+    channel.overlap.assign(kHop, 0.0f);
+    channel.smoothed.assign(bins, 0.0f);
+    channel.noise.assign(bins, 0.0f);
+    channel.prevClean.assign(bins, 0.0f);
+  }
+
+  // Output lags input by one hop inside the STFT, plus up to a hop of input
+  // waiting to fill a hop. Holding that much back in the output FIFO means
+  // every block can be answered in full.
+  size_t hold = kHop - 1;
+  if (sampleRate != kProcessRate) {
+    toProcess.reset(new Resampler(channels, sampleRate, kProcessRate));
+    fromProcess.reset(new Resampler(channels, kProcessRate, sampleRate));
+    // Both converters add their kernel delay, and each can hold back a frame
+    double inputSide = hold + Resampler::kHalfTaps + 2;
+    hold = (size_t)std::ceil(inputSide * sampleRate / kProcessRate) +
+           Resampler::kHalfTaps + 2;
+  } else {
+    toProcess.reset();
+    fromProcess.reset();
+  }
+  latency =
+      hold + (size_t)std::lround((double)kHop * sampleRate / kProcessRate);
+
+  pending.clear();
+  processed.clear();
+  output.assign(hold * channels, 0.0f);
+}
+
+void Denoiser::Process(AudioBlock &block) {
+  auto begin = std::chrono::steady_clock::now();
+  size_t frames = block.frames;
+  float *samples = block.samples;
+
+  if (toProcess) {
+    toProcess->Process(samples, frames, pending);
+  } else {
+    pending.insert(pending.end(), samples, samples + frames * channels);
+  }
+
+  // Whole hops go through the STFT; at kProcessRate they can land in the
+  // output FIFO directly
+  size_t hops = pending.size() / channels / kHop;
+  std::vector<float> &target = fromProcess ? processed : output;
+  size_t base = target.size();
+  target.resize(base + hops * kHop * channels);
+  for (size_t h = 0; h < hops; h++) {
+    const float *src = pending.data() + h * kHop * channels;
+    float *dst = target.data() + base + h * kHop * channels;
+    for (int ch = 0; ch < channels; ch++) {
+      for (size_t i = 0; i < kHop; i++) {
+        hopIn[i] = src[i * channels + ch];
+      }
+      ProcessHop(state[ch], hopIn.data(), hopOut.data());
+      for (size_t i = 0; i < kHop; i++) {
+        dst[i * channels + ch] = hopOut[i];
+      }
+    }
+  }
+  pending.erase(pending.begin(), pending.begin() + hops * kHop * channels);
+
+  if (fromProcess) {
+    fromProcess->Process(processed.data(), processed.size() / channels,
+                         output);
+    processed.clear();
+  }
+  // Answer with the oldest frames; the hold-back should make a shortfall
+  // impossible, but pad with silence rather than stall if one happens
+  size_t take = std::min(frames, output.size() / channels);
+  memcpy(samples, output.data(), take * channels * sizeof(float));
+  if (take < frames) {
+    std::fill(samples + take * channels, samples + frames * channels, 0.0f);
+  }
+  output.erase(output.begin(), output.begin() + take * channels);
+
+  processingNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count(),
+                         std::memory_order_relaxed);
+}
+
+void Denoiser::ProcessHop(Channel &channel, const float *in, float *out) {
+  float *frame = channel.frame.data();
+  memmove(frame, frame + kHop, (kWindow - kHop) * sizeof(float));
+  memcpy(frame + kWindow - kHop, in, kHop * sizeof(float));
+
+  for (size_t i = 0; i < kWindow; i++) {
+    windowed[i] = frame[i] * window[i];
+  }
+  std::fill(windowed.begin() + kWindow, windowed.end(), 0.0f);
+  fft.Forward(windowed.data(), binRe.data(), binIm.data());
+
+  size_t bins = kFftSize / 2 + 1;
+  float *smoothed = channel.smoothed.data();
+  float *noise = channel.noise.data();
+  float *prevClean = channel.prevClean.data();
+  for (size_t k = 0; k < bins; k++) {
+    float power = binRe[k] * binRe[k] + binIm[k] * binIm[k] + kPowerEpsilon;
+    if (!channel.primed) {
+      smoothed[k] = power;
+      noise[k] = power;
+      prevClean[k] = 0.0f;
+    }
+    smoothed[k] = kPowerSmoothing * smoothed[k] +
+                  (1.0f - kPowerSmoothing) * power;
+    noise[k] = std::min(noise[k] * kNoiseRise, smoothed[k]);
+
+    float noisePower = noise[k] * kNoiseBias;
+    float posterior = power / noisePower;
+    float prior = kDecisionDirected * prevClean[k] / noisePower +
+                  (1.0f - kDecisionDirected) *
+                      std::max(posterior - 1.0f, 0.0f);
+    float gain = std::max(prior / (1.0f + prior), gainFloor);
+    prevClean[k] = gain * gain * power;
+    binRe[k] *= gain;
+    binIm[k] *= gain;
+  }
+  channel.primed = true;
+
+  fft.Inverse(binRe.data(), binIm.data(), windowed.data());
+
+  float *overlap = channel.overlap.data();
+  for (size_t i = 0; i < kHop; i++) {
+    out[i] = overlap[i] + windowed[i] * window[i];
+    overlap[i] = windowed[kHop + i] * window[kHop + i];
+  }
+}
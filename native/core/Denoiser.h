@@ -0,0 +1,91 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include "Fft.h"
+#include "Resampler.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Settings of the noise suppression stage
+struct DenoiseSettings {
+  double maxAttenuationDb = 24; // Deepest cut applied to a noise-only bin
+};
+
+// Checks the ranges the denoiser supports; false with error set otherwise
+bool ValidateDenoiseSettings(const DenoiseSettings &settings,
+                             std::string &error);
+
+// Noise suppression stage. Each channel is processed at 48 kHz in 10 ms
+// hops of a 20 ms square-root Hann STFT: a slowly rising minimum tracker
+// estimates the noise floor per bin and a decision-directed Wiener gain
+// (Ephraim-Malah) attenuates bins by how far they stand above it. Streams
+// at other rates are resampled in and back out.
+//
+// Audio comes out delayed by Latency() frames. Working buffers are sized on
+// the first blocks and reused after that. Time spent in Process is
+// accumulated for stats and may be read from any thread.
+class Denoiser : public CaptureStage {
+public:
+  static const int kProcessRate = 48000;
+  static const size_t kHop = 480;    // 10 ms at kProcessRate
+  static const size_t kWindow = 960; // 20 ms
+  static const size_t kFftSize = 1024;
+
+  explicit Denoiser(const DenoiseSettings &settings = DenoiseSettings());
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+
+  // Delay from input to output, in frames of the stream rate (rounded)
+  size_t Latency() const { return latency; }
+
+  // Thread time spent suppressing noise since construction
+  double ProcessingTimeMs() const {
+    return processingNs.load(std::memory_order_relaxed) / 1e6;
+  }
+
+private:
+  // STFT and gain state of one channel
+  struct Channel {
+    std::vector<float> frame;   // Last kWindow input samples
+    std::vector<float> overlap; // Second half of the previous output frame
+    std::vector<float> smoothed; // Smoothed bin power
+    std::vector<float> noise;    // Noise floor estimate per bin
+    std::vector<float> prevClean; // Clean power estimate of the last hop
+    bool primed = false;
+  };
+
+  // Denoise kHop samples of one channel
+  void ProcessHop(Channel &channel, const float *in, float *out);
+
+  DenoiseSettings settings;
+  float gainFloor;
+  int sampleRate = 0;
+  int channels = 0;
+  size_t latency = 0;
+
+  RealFft fft;
+  std::vector<float> window; // Square-root Hann, analysis and synthesis
+  std::vector<float> windowed;
+  std::vector<float> binRe;
+  std::vector<float> binIm;
+  std::vector<float> hopIn;
+  std::vector<float> hopOut;
+  std::vector<Channel> state;
+
+  // Only used when the stream is not at kProcessRate
+  std::unique_ptr<Resampler> toProcess;
+  std::unique_ptr<Resampler> fromProcess;
+
+  // Interleaved FIFOs: input at kProcessRate awaiting a full hop, processed
+  // audio at kProcessRate, and output at the stream rate
+  std::vector<float> pending;
+  std::vector<float> processed;
+  std::vector<float> output;
+
+  std::atomic<int64_t> processingNs{0};
+};
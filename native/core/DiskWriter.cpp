@@ -0,0 +1,705 @@
+#include "DiskWriter.h"
+
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+namespace {
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#ifdef _WIN32
+std::wstring WidePath(const std::string &path) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+  std::wstring wide(length > 0 ? length : 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+  return wide;
+}
+
+// A direct file is reopened buffered for its unaligned tail while the
+// direct handle is still open, so it has to share write access with itself
+DWORD ShareMode(bool direct) {
+  return direct ? FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_READ;
+}
+#endif
+
+} // namespace
+
+void *AllocateAligned(size_t size) {
+  size = (size + kDiskAlignment - 1) / kDiskAlignment * kDiskAlignment;
+#ifdef _WIN32
+  return _aligned_malloc(size, kDiskAlignment);
+#else
+  void *buffer = nullptr;
+  return posix_memalign(&buffer, kDiskAlignment, size) == 0 ? buffer
+                                                            : nullptr;
+#endif
+}
+
+void FreeAligned(void *buffer) {
+#ifdef _WIN32
+  _aligned_free(buffer);
+#else
+  std::free(buffer);
+#endif
+}
+
+void RemoveFile(const std::string &path) {
+#ifdef _WIN32
+  _wremove(WidePath(path).c_str());
+#else
+  std::remove(path.c_str());
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// DiskFile
+
+bool DiskFile::Open(const std::string &path, bool direct, std::string &error) {
+  Close();
+#ifdef _WIN32
+  DWORD flags = direct ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL;
+  HANDLE file = CreateFileW(WidePath(path).c_str(), GENERIC_WRITE,
+                            ShareMode(direct), nullptr, CREATE_ALWAYS, flags,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    error = "Failed to create " + path;
+    return false;
+  }
+  handle = file;
+  isDirect = direct;
+#else
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#ifdef O_DIRECT
+  if (direct) {
+    fd = open(path.c_str(), flags | O_DIRECT, 0644);
+    // tmpfs and some network file systems refuse O_DIRECT
+    isDirect = fd >= 0;
+  }
+#endif
+  if (fd < 0) {
+    fd = open(path.c_str(), flags, 0644);
+  }
+  if (fd < 0) {
+    error = "Failed to create " + path + ": " + std::strerror(errno);
+    return false;
+  }
+#ifdef F_NOCACHE
+  if (direct && fcntl(fd, F_NOCACHE, 1) == 0) {
+    isDirect = true;
+  }
+#endif
+#endif
+  return true;
+}
+
+bool DiskFile::IsOpen() const {
+#ifdef _WIN32
+  return handle != nullptr;
+#else
+  return fd >= 0;
+#endif
+}
+
+bool DiskFile::WriteAt(const void *data, size_t size, uint64_t offset) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  while (size > 0) {
+#ifdef _WIN32
+    OVERLAPPED position = {};
+    position.Offset = (DWORD)offset;
+    position.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD count = (DWORD)std::min<size_t>(size, 1u << 30);
+    DWORD written = 0;
+    if (!WriteFile((HANDLE)handle, bytes, count, &written, &position) ||
+        written == 0) {
+      return false;
+    }
+#else
+    ssize_t written = pwrite(fd, bytes, size, (off_t)offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+#endif
+    bytes += written;
+    size -= (size_t)written;
+    offset += (uint64_t)written;
+  }
+  return true;
+}
+
+bool DiskFile::DisableDirect() {
+  if (!isDirect) {
+    return true;
+  }
+  isDirect = false;
+#ifdef _WIN32
+  HANDLE buffered = ReOpenFile((HANDLE)handle, GENERIC_WRITE,
+                               ShareMode(true), FILE_ATTRIBUTE_NORMAL);
+  if (buffered == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  CloseHandle((HANDLE)handle);
+  handle = buffered;
+  return true;
+#elif defined(O_DIRECT)
+  int flags = fcntl(fd, F_GETFL);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+#elif defined(F_NOCACHE)
+  return fcntl(fd, F_NOCACHE, 0) == 0;
+#else
+  return true;
+#endif
+}
+
+bool DiskFile::Sync() {
+  if (!IsOpen()) {
+    return false;
+  }
+#ifdef _WIN32
+  return FlushFileBuffers((HANDLE)handle) != 0;
+#elif defined(__linux__)
+  return fdatasync(fd) == 0;
+#else
+  return fsync(fd) == 0;
+#endif
+}
+
+bool DiskFile::Close() {
+  if (!IsOpen()) {
+    return true;
+  }
+#ifdef _WIN32
+  bool ok = CloseHandle((HANDLE)handle) != 0;
+  handle = nullptr;
+#else
+  bool ok = close(fd) == 0;
+  fd = -1;
+#endif
+  isDirect = false;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// io_uring
+
+#ifdef HAVE_IO_URING
+
+// Submission and completion rings mapped from the kernel, driven with raw
+// system calls so there is no liburing dependency
+struct DiskWriter::Ring {
+  static const unsigned kEntries = 256;
+  static const uint64_t kWakeTag = ~0ull;
+
+  int ringFd = -1;
+  int wakeFd = -1;
+  void *sqMap = MAP_FAILED;
+  void *cqMap = MAP_FAILED;
+  size_t sqMapSize = 0;
+  size_t cqMapSize = 0;
+  io_uring_sqe *sqes = (io_uring_sqe *)MAP_FAILED;
+  unsigned sqEntries = 0;
+
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned *cqHead, *cqTail, *cqMask;
+  io_uring_cqe *cqes;
+  unsigned toSubmit = 0;
+
+  // One slot per write in flight; the wake poll takes the last SQ entry
+  std::vector<DiskRequest> slots;
+  std::vector<iovec> iovecs;
+  std::vector<size_t> freeSlots;
+  std::deque<DiskRequest> backlog; // Writes waiting for a slot
+  std::atomic<bool> isBroken{false};
+
+  bool Setup() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd = (int)syscall(__NR_io_uring_setup, kEntries, &params);
+    if (ringFd < 0) {
+      return false; // Old kernel, or blocked by a seccomp policy
+    }
+    sqEntries = params.sq_entries;
+    sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqMapSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+      sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+    }
+    sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqMap == MAP_FAILED) {
+      return false;
+    }
+    cqMap = single ? sqMap
+                   : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_CQ_RING);
+    if (cqMap == MAP_FAILED) {
+      return false;
+    }
+    sqes = (io_uring_sqe *)mmap(
+        nullptr, params.sq_entries * sizeof(io_uring_sqe),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    uint8_t *sq = (uint8_t *)sqMap;
+    uint8_t *cq = (uint8_t *)cqMap;
+    sqHead = (unsigned *)(sq + params.sq_off.head);
+    sqTail = (unsigned *)(sq + params.sq_off.tail);
+    sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned *)(sq + params.sq_off.array);
+    cqHead = (unsigned *)(cq + params.cq_off.head);
+    cqTail = (unsigned *)(cq + params.cq_off.tail);
+    cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) {
+      return false;
+    }
+    slots.resize(sqEntries - 1);
+    iovecs.resize(sqEntries - 1);
+    for (size_t i = slots.size(); i-- > 0;) {
+      freeSlots.push_back(i);
+    }
+    return true;
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqEntries * sizeof(io_uring_sqe));
+    }
+    if (cqMap != MAP_FAILED && cqMap != sqMap) {
+      munmap(cqMap, cqMapSize);
+    }
+    if (sqMap != MAP_FAILED) {
+      munmap(sqMap, sqMapSize);
+    }
+    if (wakeFd >= 0) {
+      close(wakeFd);
+    }
+    if (ringFd >= 0) {
+      close(ringFd);
+    }
+  }
+
+  // Slots plus the wake poll never exceed the SQ, so there is always room
+  io_uring_sqe *NextSqe() {
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    return sqe;
+  }
+
+  void ArmWake() {
+    io_uring_sqe *sqe = NextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeFd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = kWakeTag;
+  }
+
+  void PushWrite(size_t slot) {
+    const DiskRequest &request = slots[slot];
+    iovecs[slot].iov_base = (void *)request.data;
+    iovecs[slot].iov_len = request.size;
+    io_uring_sqe *sqe = NextSqe();
+    sqe->opcode = IORING_OP_WRITEV; // Plain WRITE needs a newer kernel
+    sqe->fd = request.file->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&iovecs[slot];
+    sqe->len = 1;
+    sqe->off = request.offset;
+    sqe->user_data = slot;
+  }
+
+  // Submit what was queued and wait for at least one completion
+  bool Enter() {
+    int fd = isBroken.load(std::memory_order_relaxed) ? -1 : ringFd;
+    int submitted = (int)syscall(__NR_io_uring_enter, fd, toSubmit, 1,
+                                 IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (submitted < 0) {
+      return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+    }
+    toSubmit -= std::min<unsigned>(toSubmit, (unsigned)submitted);
+    return true;
+  }
+};
+
+#else
+
+struct DiskWriter::Ring {};
+
+#endif
+
+// ---------------------------------------------------------------------------
+// DiskWriter
+
+DiskWriter::DiskWriter(Backend preferred) : backend(Backend::Thread) {
+#ifdef HAVE_IO_URING
+  if (preferred != Backend::Thread) {
+    ring.reset(new Ring());
+    if (ring->Setup()) {
+      backend = Backend::IoUring;
+    } else {
+      ring.reset();
+    }
+  }
+#else
+  (void)preferred;
+#endif
+  if (backend.load() == Backend::IoUring) {
+    thread = std::thread([this] { RingLoop(); });
+  } else {
+    thread = std::thread([this] { ThreadLoop(); });
+  }
+}
+
+DiskWriter::~DiskWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+#ifdef HAVE_IO_URING
+  if (ring) {
+    uint64_t one = 1;
+    (void)!write(ring->wakeFd, &one, sizeof(one));
+  }
+#endif
+  wake.notify_one();
+  thread.join();
+}
+
+DiskWriter &DiskWriter::Shared() {
+  static DiskWriter writer;
+  return writer;
+}
+
+void DiskWriter::BreakRingForTesting() {
+#ifdef HAVE_IO_URING
+  if (ring) {
+    ring->isBroken = true;
+    uint64_t one = 1;
+    (void)!write(ring->wakeFd, &one, sizeof(one));
+  }
+#endif
+}
+
+const char *DiskBackendName(DiskWriter::Backend backend) {
+  switch (backend) {
+  case DiskWriter::Backend::IoUring:
+    return "io_uring";
+  case DiskWriter::Backend::Thread:
+    return "thread";
+  default:
+    return "auto";
+  }
+}
+
+void DiskWriter::Submit(DiskRequest request) {
+  request.queuedNs = NowNs();
+  bool needWake;
+  bool useRing;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(request));
+    size_t depth = queueDepth.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (depth > maxQueueDepth.load(std::memory_order_relaxed)) {
+      maxQueueDepth.store(depth, std::memory_order_relaxed);
+    }
+    needWake = !isWakePending;
+    isWakePending = true;
+    useRing = backend.load() == Backend::IoUring;
+  }
+  if (!needWake) {
+    return;
+  }
+#ifdef HAVE_IO_URING
+  if (useRing) {
+    uint64_t one = 1;
+    (void)!write(ring->wakeFd, &one, sizeof(one));
+    return;
+  }
+#endif
+  wake.notify_one();
+}
+
+DiskWriter::Stats DiskWriter::GetStats() const {
+  Stats stats;
+  stats.writes = writes.load(std::memory_order_relaxed);
+  stats.bytes = bytes.load(std::memory_order_relaxed);
+  stats.queueDepth = queueDepth.load(std::memory_order_relaxed);
+  stats.maxQueueDepth = maxQueueDepth.load(std::memory_order_relaxed);
+  stats.avgLatencyMs =
+      stats.writes > 0
+          ? latencyNs.load(std::memory_order_relaxed) / 1e6 / stats.writes
+          : 0;
+  stats.maxLatencyMs = maxLatencyNs.load(std::memory_order_relaxed) / 1e6;
+  return stats;
+}
+
+bool DiskWriter::TakeQueued() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (backend.load() != Backend::IoUring) {
+    wake.wait(lock, [this] {
+      return isStopping || !queue.empty();
+    });
+  }
+  if (queue.empty()) {
+    isWakePending = false;
+    return !(isStopping && active == 0);
+  }
+  // Moved rather than swapped, so each keeps the largest capacity it has
+  // needed instead of trading it for the other's
+  taken.insert(taken.end(), std::make_move_iterator(queue.begin()),
+               std::make_move_iterator(queue.end()));
+  queue.clear();
+  isWakePending = false;
+  active += taken.size();
+  return true;
+}
+
+void DiskWriter::Dispatch(DiskRequest request) {
+  DiskFile &file = *request.file;
+  if (!file.waiting.empty() || (request.task && file.inFlight > 0)) {
+    file.waiting.push_back(std::move(request));
+    return;
+  }
+  Start(std::move(request));
+}
+
+void DiskWriter::Start(DiskRequest request) {
+  if (request.task) {
+    request.task();
+    Complete(request, true);
+    return;
+  }
+  request.file->inFlight++;
+  SubmitWrite(std::move(request));
+}
+
+void DiskWriter::Complete(DiskRequest &request, bool ok) {
+  std::shared_ptr<DiskFile> file = std::move(request.file);
+  active--;
+  queueDepth.fetch_sub(1, std::memory_order_relaxed);
+  if (!request.task) {
+    file->inFlight--;
+    int64_t latency = NowNs() - request.queuedNs;
+    writes.fetch_add(1, std::memory_order_relaxed);
+    latencyNs.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > maxLatencyNs.load(std::memory_order_relaxed)) {
+      maxLatencyNs.store(latency, std::memory_order_relaxed);
+    }
+    if (request.done) {
+      request.done(ok, latency);
+    }
+  }
+
+  // Release what the file held back, up to the next task that still has
+  // writes to wait for
+  while (!file->waiting.empty() &&
+         !(file->waiting.front().task && file->inFlight > 0)) {
+    DiskRequest next = std::move(file->waiting.front());
+    file->waiting.pop_front();
+    Start(std::move(next));
+  }
+}
+
+void DiskWriter::SubmitWrite(DiskRequest request) {
+#ifdef HAVE_IO_URING
+  if (backend.load() == Backend::IoUring) {
+    if (ring->freeSlots.empty() || !request.file->IsOpen()) {
+      if (!request.file->IsOpen()) {
+        Complete(request, false);
+      } else {
+        ring->backlog.push_back(std::move(request));
+      }
+      return;
+    }
+    size_t slot = ring->freeSlots.back();
+    ring->freeSlots.pop_back();
+    ring->slots[slot] = std::move(request);
+    ring->PushWrite(slot);
+    return;
+  }
+#endif
+  bool ok = request.file->IsOpen() &&
+            request.file->WriteAt(request.data, request.size, request.offset);
+  if (ok) {
+    bytes.fetch_add(request.size, std::memory_order_relaxed);
+  }
+  Complete(request, ok);
+}
+
+void DiskWriter::ThreadLoop() {
+  for (;;) {
+    if (!TakeQueued()) {
+      return;
+    }
+    for (DiskRequest &request : taken) {
+      Dispatch(std::move(request));
+    }
+    taken.clear();
+  }
+}
+
+void DiskWriter::RingLoop() {
+#ifdef HAVE_IO_URING
+  ring->ArmWake();
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (isStopping && queue.empty() && active == 0) {
+        return;
+      }
+    }
+    // Everything dispatched since the last call goes in one submission
+    if (!ring->Enter()) {
+      AbandonRing();
+      ThreadLoop();
+      return;
+    }
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    bool woken = false;
+    for (; head != tail; head++) {
+      io_uring_cqe cqe = ring->cqes[head & *ring->cqMask];
+      if (cqe.user_data == Ring::kWakeTag) {
+        woken = true;
+        continue;
+      }
+      size_t slot = (size_t)cqe.user_data;
+      DiskRequest &request = ring->slots[slot];
+      if (cqe.res > 0) {
+        bytes.fetch_add((uint64_t)cqe.res, std::memory_order_relaxed);
+      }
+      if (cqe.res > 0 && (size_t)cqe.res < request.size) {
+        // Short write: submit the rest from the same slot
+        request.data = (const uint8_t *)request.data + cqe.res;
+        request.size -= (size_t)cqe.res;
+        request.offset += (uint64_t)cqe.res;
+        ring->PushWrite(slot);
+        continue;
+      }
+      DiskRequest done = std::move(request);
+      ring->freeSlots.push_back(slot);
+      Complete(done, cqe.res >= 0 && (size_t)cqe.res == done.size);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+    if (woken) {
+      uint64_t count;
+      (void)!read(ring->wakeFd, &count, sizeof(count));
+      ring->ArmWake();
+      TakeQueued();
+      for (DiskRequest &request : taken) {
+        Dispatch(std::move(request));
+      }
+      taken.clear();
+    }
+    while (!ring->backlog.empty() && !ring->freeSlots.empty()) {
+      DiskRequest request = std::move(ring->backlog.front());
+      ring->backlog.pop_front();
+      SubmitWrite(std::move(request));
+    }
+  }
+#endif
+}
+
+void DiskWriter::AbandonRing() {
+#ifdef HAVE_IO_URING
+  // Later requests are written by this thread; a Submit racing with the
+  // switch has queued its request before it, so ThreadLoop finds it
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    backend = Backend::Thread;
+    isWakePending = false; // The next Submit has to notify
+  }
+  // Writes still in the SQ never reached the kernel and fail at once. The
+  // kernel may still be reading the buffers of the others, which are only
+  // released once their completions have been reaped: those go on being
+  // posted to the mapped CQ without io_uring_enter.
+  std::vector<DiskRequest> lost;
+  unsigned sqHead = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+  for (unsigned i = sqHead; i != *ring->sqTail; i++) {
+    uint64_t tag = ring->sqes[ring->sqArray[i & *ring->sqMask]].user_data;
+    if (tag != Ring::kWakeTag) {
+      lost.push_back(std::move(ring->slots[(size_t)tag]));
+      ring->slots[(size_t)tag] = DiskRequest();
+    }
+  }
+  size_t outstanding = 0;
+  for (const DiskRequest &request : ring->slots) {
+    outstanding += request.file ? 1 : 0;
+  }
+  while (outstanding > 0) {
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    for (; head != tail; head++) {
+      io_uring_cqe cqe = ring->cqes[head & *ring->cqMask];
+      if (cqe.user_data == Ring::kWakeTag) {
+        continue;
+      }
+      // A short write cannot be resubmitted, so it fails
+      DiskRequest done = std::move(ring->slots[(size_t)cqe.user_data]);
+      ring->slots[(size_t)cqe.user_data] = DiskRequest();
+      outstanding--;
+      if (cqe.res > 0) {
+        bytes.fetch_add((uint64_t)cqe.res, std::memory_order_relaxed);
+      }
+      Complete(done, cqe.res >= 0 && (size_t)cqe.res == done.size);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+  for (DiskRequest &request : ring->backlog) {
+    lost.push_back(std::move(request));
+  }
+  ring->backlog.clear();
+  // Completing a write may start what its file held back, now on the
+  // thread backend
+  for (DiskRequest &request : lost) {
+    Complete(request, false);
+  }
+#endif
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Offsets and sizes of direct writes are multiples of this, and their
+// buffers start on it
+static const size_t kDiskAlignment = 4096;
+
+// Buffer for direct writes; free with FreeAligned
+void *AllocateAligned(size_t size);
+void FreeAligned(void *buffer);
+
+// Delete the file at a UTF-8 path, if it exists
+void RemoveFile(const std::string &path);
+
+class DiskFile;
+
+// A positional write or a task, queued on a DiskWriter
+struct DiskRequest {
+  std::shared_ptr<DiskFile> file;
+  // A write of size bytes at offset; done gets whether all of it was
+  // written and the time from Submit to completion
+  const void *data = nullptr;
+  size_t size = 0;
+  uint64_t offset = 0;
+  std::function<void(bool ok, int64_t latencyNs)> done;
+  // Or a task, run once every earlier write to file has completed
+  std::function<void()> task;
+  int64_t queuedNs = 0;
+};
+
+// A file written through a DiskWriter. The synchronous calls are for tasks
+// running on the writer's thread and for opening the first file of a
+// recording.
+class DiskFile {
+public:
+  DiskFile() = default;
+  ~DiskFile() { Close(); }
+  DiskFile(const DiskFile &) = delete;
+  DiskFile &operator=(const DiskFile &) = delete;
+
+  // Create or truncate path for writing. With direct, writes bypass the
+  // page cache (O_DIRECT, F_NOCACHE, FILE_FLAG_NO_BUFFERING) and must be
+  // aligned to kDiskAlignment; file systems without support get a
+  // buffered file instead.
+  bool Open(const std::string &path, bool direct, std::string &error);
+  bool IsOpen() const;
+  // Whether writes bypass the page cache
+  bool IsDirect() const { return isDirect; }
+
+  // Write all of data at offset, from the calling thread
+  bool WriteAt(const void *data, size_t size, uint64_t offset);
+
+  // Go back to buffered writes, for a tail that is not a whole block
+  bool DisableDirect();
+
+  // Flush what was written to stable storage (fdatasync)
+  bool Sync();
+
+  bool Close();
+
+private:
+  friend class DiskWriter;
+
+#ifdef _WIN32
+  void *handle = nullptr; // HANDLE
+#else
+  int fd = -1;
+#endif
+  bool isDirect = false;
+
+  // Writer thread state: requests held back behind a task, and writes
+  // submitted but not completed
+  std::deque<DiskRequest> waiting;
+  size_t inFlight = 0;
+};
+
+// Asynchronous disk I/O shared by all native file outputs. Capture threads
+// only queue requests; one writer thread submits them in batches to an
+// io_uring on Linux, or writes them itself with pwrite (WriteFile
+// elsewhere) when io_uring is unavailable. Writes to a file may complete
+// in any order, but a task on a file waits for all writes queued before it
+// and holds back the requests after it, so opening, header patching and
+// closing can be ordered around the audio without blocking capture.
+class DiskWriter {
+public:
+  enum class Backend { Auto, IoUring, Thread };
+
+  struct Stats {
+    uint64_t writes;
+    uint64_t bytes;
+    size_t queueDepth;    // Requests queued or in flight
+    size_t maxQueueDepth;
+    double avgLatencyMs;  // Submit to completion, over all writes
+    double maxLatencyMs;
+  };
+
+  // Auto uses io_uring where the kernel allows it
+  explicit DiskWriter(Backend backend = Backend::Auto);
+  ~DiskWriter();
+
+  // io_uring or thread; io_uring falls back to thread if the ring fails
+  Backend ActiveBackend() const { return backend.load(); }
+
+  // Queue a request; any thread
+  void Submit(DiskRequest request);
+
+  Stats GetStats() const;
+
+  // Make the next io_uring_enter fail as on a lost ring; for tests
+  void BreakRingForTesting();
+
+  // Process-wide writer used by the file outputs
+  static DiskWriter &Shared();
+
+private:
+  struct Ring;
+
+  void RingLoop();
+  void ThreadLoop();
+  // Take the queued requests, waiting for some without io_uring; false
+  // when stopping and idle
+  bool TakeQueued();
+  // Start a request, or hold it back behind its file's pending task
+  void Dispatch(DiskRequest request);
+  void Start(DiskRequest request);
+  void Complete(DiskRequest &request, bool ok);
+  // Backend specific: start a write, which later calls Complete
+  void SubmitWrite(DiskRequest request);
+  // After a hard io_uring error: fail the writes the ring holds and go on
+  // with the thread backend
+  void AbandonRing();
+
+  std::atomic<Backend> backend; // Changed under mutex
+  std::unique_ptr<Ring> ring;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  // Moved to taken at each wakeup; both keep their capacity, so a Submit
+  // does not allocate once the writer has seen its largest backlog
+  std::vector<DiskRequest> queue;
+  bool isWakePending = false;
+  bool isStopping = false;
+  std::thread thread;
+
+  // Writer thread state
+  std::vector<DiskRequest> taken;
+  size_t active = 0; // Requests taken from the queue and not completed
+
+  std::atomic<uint64_t> writes{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<int64_t> latencyNs{0};
+  std::atomic<int64_t> maxLatencyNs{0};
+  std::atomic<size_t> queueDepth{0};
+  std::atomic<size_t> maxQueueDepth{0};
+};
+
+const char *DiskBackendName(DiskWriter::Backend backend);
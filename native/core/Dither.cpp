@@ -0,0 +1,92 @@
+#include "Dither.h"
+
+#include "ConvertKernels.h"
+#include <algorithm>
+
+namespace {
+
+// Round to nearest after clamping. Adding an offset keeps the value
+// positive so truncation acts as floor, which vectorises without SSE4.1.
+inline int16_t RoundToInt16(float value) {
+  value = std::min(32767.0f, std::max(-32768.0f, value));
+  return (int16_t)((int32_t)(value + 32768.5f) - 32768);
+}
+
+} // namespace
+
+Requantizer::Requantizer(DitherMode mode, int channels, uint32_t seed)
+    : mode(mode), channels(channels),
+      dither(std::max<size_t>(kBlock,
+                              (channels + kLanes - 1) / kLanes * kLanes)),
+      error1(channels, 0.0f), error2(channels, 0.0f) {
+  for (size_t lane = 0; lane < kLanes; lane++) {
+    // Distinct non-zero states per lane
+    uint32_t s = seed + (uint32_t)lane * 0x6d2b79f5u;
+    state[lane] = s ? s : 1;
+  }
+}
+
+void Requantizer::FillDither() {
+  // Lanes live in locals so the compiler keeps them in vector registers
+  uint32_t lanes[kLanes];
+  std::copy(state, state + kLanes, lanes);
+  float *out = dither.data();
+  for (size_t i = 0; i < dither.size(); i += kLanes) {
+    for (size_t lane = 0; lane < kLanes; lane++) {
+      uint32_t x = lanes[lane];
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      lanes[lane] = x;
+      // Difference of two 16-bit uniforms: triangular over (-1, 1) LSB
+      out[i + lane] =
+          ((int32_t)(x >> 16) - (int32_t)(x & 0xffff)) * (1.0f / 65536.0f);
+    }
+  }
+  std::copy(lanes, lanes + kLanes, state);
+}
+
+void Requantizer::Process(const float *src, size_t frames, int16_t *dst) {
+  size_t count = frames * channels;
+
+  if (mode == DitherMode::None) {
+    SelectKernels(SampleEncoding::Float32, channels)
+        .toPcm((const uint8_t *)src, frames, channels, dst);
+    return;
+  }
+
+  if (mode == DitherMode::Tpdf) {
+    for (size_t offset = 0; offset < count; offset += kBlock) {
+      size_t n = std::min<size_t>(kBlock, count - offset);
+      FillDither();
+      const float *in = src + offset;
+      const float *noise = dither.data();
+      int16_t *out = dst + offset;
+      for (size_t i = 0; i < n; i++) {
+        out[i] = RoundToInt16(in[i] * 32768.0f + noise[i]);
+      }
+    }
+    return;
+  }
+
+  // Error feedback with noise transfer function (1 - z^-1)^2: quantisation
+  // noise moves out of the low frequencies, where hearing is most
+  // sensitive. The feedback runs along each channel so it stays scalar.
+  size_t blockFrames = dither.size() / channels;
+  for (size_t frame = 0; frame < frames;) {
+    size_t n = std::min(blockFrames, frames - frame);
+    FillDither();
+    for (size_t f = 0; f < n; f++, frame++) {
+      for (int ch = 0; ch < channels; ch++) {
+        size_t i = frame * channels + ch;
+        float wanted = src[i] * 32768.0f - (2.0f * error1[ch] - error2[ch]);
+        int16_t q = RoundToInt16(wanted + dither[f * channels + ch]);
+        // Clipping would otherwise feed back huge errors and ring
+        float error = std::min(1.5f, std::max(-1.5f, q - wanted));
+        error2[ch] = error1[ch];
+        error1[ch] = error;
+        dst[i] = q;
+      }
+    }
+  }
+}
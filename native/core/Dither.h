@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How float audio is requantised to 16-bit PCM
+enum class DitherMode {
+  None,  // Truncate, scaled by 32767 as before dithering existed
+  Tpdf,  // Round with triangular dither of +-1 LSB
+  Shaped // TPDF with second-order noise shaping towards high frequencies
+};
+
+// Float to 16-bit PCM with dither. Rounding uses the symmetric 32768 scale
+// and clamps to [-32768, 32767]. The random numbers come from eight
+// independent xorshift32 generators stepped together, so dither for a
+// whole block is generated with vector instructions.
+class Requantizer {
+public:
+  Requantizer(DitherMode mode, int channels, uint32_t seed = 0x9e3779b9u);
+
+  // frames interleaved frames of channels samples
+  void Process(const float *src, size_t frames, int16_t *dst);
+
+  DitherMode Mode() const { return mode; }
+
+private:
+  static const size_t kLanes = 8;
+  static const size_t kBlock = 256; // Samples of dither generated at a time
+
+  void FillDither();
+
+  DitherMode mode;
+  int channels;
+  uint32_t state[kLanes];
+  std::vector<float> dither; // kBlock, or a lane-rounded frame if larger
+
+  // Shaped mode: last two quantisation errors of each channel
+  std::vector<float> error1;
+  std::vector<float> error2;
+};
@@ -0,0 +1,394 @@
+#include "EchoCanceller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Largest adaptation step, reached when the error is all echo
+const float kStep = 0.8f;
+
+// Smallest fraction of kStep used, so an untrained filter still learns
+const float kMinStepScale = 0.2f;
+
+// Reference blocks quieter than this per sample (-70 dBFS) do not adapt
+const float kActivePower = 1e-7f;
+
+// Regularisation of the per-bin normalisation, per partition and sample
+const float kRegularisation = 1e-6f;
+
+// Weight of the history in the ERLE estimate, per block
+const double kErleSmoothing = 0.99;
+
+// Host time now, backdated by a block's duration: the best guess at the
+// capture time of its first frame when the device gives none
+int64_t EstimateTimestamp(size_t frames, int sampleRate) {
+  int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+  return now - (int64_t)(frames * 1e9 / sampleRate);
+}
+
+} // namespace
+
+bool ValidateEchoSettings(const EchoSettings &settings, std::string &error) {
+  if (!(settings.tailMs >= 10 && settings.tailMs <= 500)) {
+    error = "tailMs must be between 10 and 500";
+    return false;
+  }
+  return true;
+}
+
+void EchoReference::SetRate(int sampleRate) {
+  std::lock_guard<std::mutex> lock(mutex);
+  rate = sampleRate;
+  ring.assign((size_t)(kHistoryNs * (double)sampleRate / 1e9), 0.0f);
+  writeIndex = 0;
+  validFrom = 0;
+  sourceRate = 0;
+  clock.reset();
+  resampler.reset();
+}
+
+void EchoReference::Write(const float *mono, size_t frames, int sampleRate,
+                          uint64_t position, int64_t timestampNs,
+                          bool discontinuity) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (rate == 0 || frames == 0) {
+    return;
+  }
+
+  if (!clock || sampleRate != sourceRate) {
+    sourceRate = sampleRate;
+    clock.reset(new StreamClock(sampleRate));
+  }
+  uint64_t anchors = clock->Anchors();
+  clock->Update(position, timestampNs, discontinuity);
+
+  // A new timeline: earlier samples no longer map to host time
+  if (clock->Anchors() != anchors) {
+    step = (double)sourceRate / rate;
+    if (sourceRate != rate) {
+      resampler.reset(new Resampler(1, sourceRate, rate));
+    } else {
+      resampler.reset();
+    }
+    firstIndex = writeIndex;
+    firstPosition = (double)position;
+    validFrom = writeIndex;
+  }
+
+  const float *samples = mono;
+  size_t count = frames;
+  if (resampler) {
+    converted.clear();
+    resampler->Process(mono, frames, converted);
+    samples = converted.data();
+    count = converted.size();
+  }
+
+  size_t capacity = ring.size();
+  for (size_t i = 0; i < count; i++) {
+    ring[(writeIndex + i) % capacity] = samples[i];
+  }
+  writeIndex += count;
+}
+
+double EchoReference::SourcePosition(double index) const {
+  return firstPosition + (index - (double)firstIndex) * step;
+}
+
+int64_t EchoReference::IndexAt(int64_t timeNs) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!clock) {
+    return 0;
+  }
+  double position = clock->PositionAt(timeNs);
+  return (int64_t)firstIndex +
+         std::llround((position - firstPosition) / step);
+}
+
+void EchoReference::Read(int64_t index, size_t frames, float *out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t capacity = ring.size();
+  int64_t oldest = (int64_t)std::max<uint64_t>(
+      validFrom, writeIndex > capacity ? writeIndex - capacity : 0);
+  for (size_t i = 0; i < frames; i++) {
+    int64_t at = index + (int64_t)i;
+    out[i] = at >= oldest && at < (int64_t)writeIndex
+                 ? ring[(size_t)at % capacity]
+                 : 0.0f;
+  }
+}
+
+int64_t EchoReference::EndTimeNs() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!clock || writeIndex == validFrom) {
+    return 0;
+  }
+  return clock->TimeOf(SourcePosition((double)writeIndex));
+}
+
+void EchoReferenceTap::Configure(int sampleRate, int channels) {
+  mono.clear();
+}
+
+void EchoReferenceTap::Process(AudioBlock &block) {
+  if (mono.size() < block.frames) {
+    mono.resize(block.frames);
+  }
+  float scale = 1.0f / block.channels;
+  for (size_t frame = 0; frame < block.frames; frame++) {
+    float sum = 0.0f;
+    for (int ch = 0; ch < block.channels; ch++) {
+      sum += block.samples[frame * block.channels + ch];
+    }
+    mono[frame] = sum * scale;
+  }
+
+  int64_t timestamp = block.meta.timestampNs;
+  if (timestamp == 0) {
+    timestamp = EstimateTimestamp(block.frames, block.sampleRate);
+  }
+  reference->Write(mono.data(), block.frames, block.sampleRate,
+                   block.meta.frameIndex, timestamp, block.meta.discontinuity);
+}
+
+EchoCanceller::EchoCanceller(std::shared_ptr<EchoReference> reference,
+                             const EchoSettings &settings)
+    : reference(std::move(reference)), settings(settings), fft(2 * kBlock) {
+  bins = kBlock + 1;
+  time.resize(2 * kBlock);
+  specRe.resize(bins);
+  specIm.resize(bins);
+  errRe.resize(bins);
+  errIm.resize(bins);
+  refPower.resize(bins);
+}
+
+void EchoCanceller::Configure(int sampleRate, int channels) {
+  this->sampleRate = sampleRate;
+  this->channels = channels;
+  clock = StreamClock(sampleRate);
+  reference->SetRate(sampleRate);
+
+  partitions = std::max<size_t>(
+      1, (size_t)std::ceil(settings.tailMs * sampleRate / 1000.0 / kBlock));
+  refRe.assign(partitions * bins, 0.0f);
+  refIm.assign(partitions * bins, 0.0f);
+  refHead = 0;
+  refTime.assign(2 * kBlock, 0.0f);
+  refActive = false;
+
+  state.assign(channels, Channel());
+  for (Channel &channel : state) {
+    channel.weightRe.assign(partitions * bins, 0.0f);
+    channel.weightIm.assign(partitions * bins, 0.0f);
+    channel.mic.resize(kBlock);
+  }
+
+  // Up to a block short of a full one, plus the wait for the reference,
+  // can be pending: hold that much back so every block is answered in full
+  latency = kBlock + (size_t)std::ceil(kWaitNs * (double)sampleRate / 1e9);
+  pending.clear();
+  output.assign(latency * channels, 0.0f);
+  blocksDone = 0;
+  locked = false;
+  micEnergy = 0;
+  errorEnergy = 0;
+  erleDb.store(0, std::memory_order_relaxed);
+}
+
+void EchoCanceller::Process(AudioBlock &block) {
+  auto begin = std::chrono::steady_clock::now();
+  size_t frames = block.frames;
+  float *samples = block.samples;
+
+  int64_t timestamp = block.meta.timestampNs;
+  if (timestamp == 0) {
+    timestamp = EstimateTimestamp(frames, sampleRate);
+  }
+  clock.Update(block.meta.frameIndex, timestamp, block.meta.discontinuity);
+
+  // Pending frames run up to this block; lost frames are simply skipped
+  size_t pendingFrames = pending.size() / channels;
+  double pendingPosition = (double)block.meta.frameIndex - pendingFrames;
+  pending.insert(pending.end(), samples, samples + frames * channels);
+  pendingFrames += frames;
+  int64_t newestNs = clock.TimeOf((double)block.meta.frameIndex + frames);
+
+  size_t done = 0;
+  while (pendingFrames - done >= kBlock) {
+    double position = pendingPosition + done;
+    int64_t endNs = clock.TimeOf(position + kBlock);
+    // Give the reference stream a little time to deliver the same span
+    if (reference->EndTimeNs() < endNs && newestNs - endNs < kWaitNs) {
+      break;
+    }
+
+    int64_t index = reference->IndexAt(clock.TimeOf(position));
+    int64_t offset = index - (int64_t)position;
+    if (!locked || std::llabs(offset - referenceOffset) > kRelockFrames) {
+      referenceOffset = offset;
+      locked = true;
+    }
+    ProcessBlock((int64_t)position + referenceOffset,
+                 pending.data() + done * channels);
+    done += kBlock;
+  }
+  pending.erase(pending.begin(), pending.begin() + done * channels);
+
+  // Answer with the oldest frames; pad with silence rather than stall
+  size_t take = std::min(frames, output.size() / channels);
+  memcpy(samples, output.data(), take * channels * sizeof(float));
+  if (take < frames) {
+    std::fill(samples + take * channels, samples + frames * channels, 0.0f);
+  }
+  output.erase(output.begin(), output.begin() + take * channels);
+
+  processingNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count(),
+                         std::memory_order_relaxed);
+}
+
+void EchoCanceller::ProcessBlock(int64_t referenceIndex, const float *mic) {
+  // Newest reference block spectrum, from the previous and current block
+  memmove(refTime.data(), refTime.data() + kBlock, kBlock * sizeof(float));
+  reference->Read(referenceIndex, kBlock, refTime.data() + kBlock);
+  refHead = (refHead + partitions - 1) % partitions;
+  float *newRe = &refRe[refHead * bins];
+  float *newIm = &refIm[refHead * bins];
+  fft.Forward(refTime.data(), newRe, newIm);
+
+  float refEnergy = 0.0f;
+  for (size_t i = kBlock; i < 2 * kBlock; i++) {
+    refEnergy += refTime[i] * refTime[i];
+  }
+  refActive = refEnergy > kActivePower * kBlock;
+
+  // Normaliser: reference power of every partition, per bin
+  std::fill(refPower.begin(), refPower.end(),
+            kRegularisation * partitions * 2 * kBlock);
+  for (size_t p = 0; p < partitions; p++) {
+    const float *xr = &refRe[p * bins];
+    const float *xi = &refIm[p * bins];
+    for (size_t k = 0; k < bins; k++) {
+      refPower[k] += xr[k] * xr[k] + xi[k] * xi[k];
+    }
+  }
+
+  size_t base = output.size();
+  output.resize(base + kBlock * channels);
+  double blockMic = 0, blockError = 0;
+  for (int c = 0; c < channels; c++) {
+    Channel &channel = state[c];
+    for (size_t i = 0; i < kBlock; i++) {
+      channel.mic[i] = mic[i * channels + c];
+    }
+
+    // Echo estimate: sum of every partition's filter times its block
+    std::fill(specRe.begin(), specRe.end(), 0.0f);
+    std::fill(specIm.begin(), specIm.end(), 0.0f);
+    for (size_t p = 0; p < partitions; p++) {
+      size_t slot = (refHead + p) % partitions;
+      const float *xr = &refRe[slot * bins];
+      const float *xi = &refIm[slot * bins];
+      const float *wr = &channel.weightRe[p * bins];
+      const float *wi = &channel.weightIm[p * bins];
+      for (size_t k = 0; k < bins; k++) {
+        specRe[k] += wr[k] * xr[k] - wi[k] * xi[k];
+        specIm[k] += wr[k] * xi[k] + wi[k] * xr[k];
+      }
+    }
+    specIm[0] = 0.0f;
+    specIm[kBlock] = 0.0f;
+    fft.Inverse(specRe.data(), specIm.data(), time.data());
+
+    // Overlap-save: the second half is the linear convolution
+    float *echo = time.data() + kBlock;
+    double micPower = 0, echoPower = 0, errorPower = 0;
+    for (size_t i = 0; i < kBlock; i++) {
+      float error = channel.mic[i] - echo[i];
+      micPower += channel.mic[i] * channel.mic[i];
+      echoPower += echo[i] * echo[i];
+      errorPower += error * error;
+      echo[i] = error;
+    }
+
+    // A filter that adds more than it removes has diverged: start over
+    if (errorPower > 4 * micPower + 1e-6 && echoPower > micPower) {
+      ResetFilter(channel);
+      memcpy(echo, channel.mic.data(), kBlock * sizeof(float));
+      errorPower = micPower;
+      echoPower = 0;
+    }
+
+    float *dst = output.data() + base;
+    for (size_t i = 0; i < kBlock; i++) {
+      dst[i * channels + c] = echo[i];
+    }
+    blockMic += micPower;
+    blockError += errorPower;
+
+    if (refActive) {
+      // Step down while the error is mostly not echo (near-end speech)
+      float scale = errorPower > 0 ? (float)(echoPower / errorPower) : 1.0f;
+      scale = std::min(1.0f, std::max(kMinStepScale, scale));
+      std::fill(time.begin(), time.begin() + kBlock, 0.0f);
+      fft.Forward(time.data(), errRe.data(), errIm.data());
+      Adapt(channel, kStep * scale);
+    }
+  }
+
+  if (refActive) {
+    micEnergy = kErleSmoothing * micEnergy + (1 - kErleSmoothing) * blockMic;
+    errorEnergy =
+        kErleSmoothing * errorEnergy + (1 - kErleSmoothing) * blockError;
+    if (errorEnergy > 0 && micEnergy > 0) {
+      erleDb.store(10 * std::log10(micEnergy / errorEnergy),
+                   std::memory_order_relaxed);
+    }
+  }
+  blocksDone++;
+}
+
+void EchoCanceller::Adapt(Channel &channel, float step) {
+  for (size_t p = 0; p < partitions; p++) {
+    size_t slot = (refHead + p) % partitions;
+    const float *xr = &refRe[slot * bins];
+    const float *xi = &refIm[slot * bins];
+    float *wr = &channel.weightRe[p * bins];
+    float *wi = &channel.weightIm[p * bins];
+
+    // Normalised gradient: conj(X) E / |X|^2
+    float *gr = specRe.data();
+    float *gi = specIm.data();
+    for (size_t k = 0; k < bins; k++) {
+      float mu = step / refPower[k];
+      gr[k] = mu * (xr[k] * errRe[k] + xi[k] * errIm[k]);
+      gi[k] = mu * (xr[k] * errIm[k] - xi[k] * errRe[k]);
+    }
+
+    // Keep the causal half only, so each partition stays a linear filter.
+    // Costs two FFTs per partition, but leaving it to one partition per
+    // block converges several times slower.
+    gi[0] = 0.0f;
+    gi[kBlock] = 0.0f;
+    fft.Inverse(gr, gi, time.data());
+    std::fill(time.begin() + kBlock, time.end(), 0.0f);
+    fft.Forward(time.data(), gr, gi);
+
+    for (size_t k = 0; k < bins; k++) {
+      wr[k] += gr[k];
+      wi[k] += gi[k];
+    }
+  }
+}
+
+void EchoCanceller::ResetFilter(Channel &channel) {
+  std::fill(channel.weightRe.begin(), channel.weightRe.end(), 0.0f);
+  std::fill(channel.weightIm.begin(), channel.weightIm.end(), 0.0f);
+}
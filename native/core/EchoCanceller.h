@@ -0,0 +1,176 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include "Fft.h"
+#include "Resampler.h"
+#include "StreamClock.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Settings of the echo cancellation stage
+struct EchoSettings {
+  double tailMs = 128; // Longest echo path the filter models
+};
+
+// Checks the ranges the canceller supports; false with error set otherwise
+bool ValidateEchoSettings(const EchoSettings &settings, std::string &error);
+
+// Far-end (loopback) audio shared between the two capture streams of an
+// echo cancelling session. The reference stream writes mono audio with its
+// capture timestamps; the mic stream reads it back by host time, converted
+// to its own rate. Thread-safe.
+class EchoReference {
+public:
+  static const int64_t kHistoryNs = 2000000000; // 2 s kept
+
+  // Rate the reference is kept at, the mic stream's. Clears the history.
+  void SetRate(int sampleRate);
+
+  // Mono audio of the reference stream at its own rate, starting at frame
+  // position with the block's capture timestamp. Dropped until SetRate.
+  void Write(const float *mono, size_t frames, int sampleRate,
+             uint64_t position, int64_t timestampNs, bool discontinuity);
+
+  // Index of the stored sample captured at host time timeNs, rounded.
+  // Indices are contiguous within a timeline; a new one starts when the
+  // reference stream reports lost frames or its timestamps jump.
+  int64_t IndexAt(int64_t timeNs);
+
+  // Copy frames samples starting at index; anything not captured (yet) or
+  // from an earlier timeline reads as silence
+  void Read(int64_t index, size_t frames, float *out);
+
+  // Host time up to which the reference has been captured, 0 if none
+  int64_t EndTimeNs();
+
+private:
+  // Reference stream position of stored sample index
+  double SourcePosition(double index) const;
+
+  std::mutex mutex;
+  int rate = 0;
+  int sourceRate = 0;
+  std::unique_ptr<StreamClock> clock;
+  std::unique_ptr<Resampler> resampler;
+  std::vector<float> converted; // Resampler output, reused
+
+  std::vector<float> ring;
+  uint64_t writeIndex = 0; // Samples stored so far
+  uint64_t validFrom = 0;  // First index on the current timeline
+  // Sample firstIndex came from reference position firstPosition; later
+  // ones follow at one per step positions
+  uint64_t firstIndex = 0;
+  double firstPosition = 0;
+  double step = 1;
+};
+
+// Analysis-only stage on the reference stream: mixes it to mono and feeds
+// an EchoReference
+class EchoReferenceTap : public CaptureStage {
+public:
+  explicit EchoReferenceTap(std::shared_ptr<EchoReference> reference)
+      : reference(std::move(reference)) {}
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+  bool ModifiesAudio() const override { return false; }
+
+private:
+  std::shared_ptr<EchoReference> reference;
+  std::vector<float> mono;
+};
+
+// Acoustic echo canceller for the mic stream. A partitioned-block
+// frequency-domain adaptive filter (overlap-save, kBlock samples per
+// partition) per mic channel predicts the echo from the aligned reference
+// and subtracts it. Adaptation is normalised per bin and slowed while the
+// error holds more than the predicted echo, i.e. during double talk.
+//
+// Mic frames map to reference samples by host time, but only through a
+// fixed offset that is re-locked when the timestamps disagree with it by
+// more than kRelockFrames: timestamp jitter would otherwise move the
+// reference under the filter. The mic is held back kWaitNs so the reference
+// for the same span has usually arrived; audio comes out delayed by
+// Latency() frames.
+class EchoCanceller : public CaptureStage {
+public:
+  static const size_t kBlock = 256;
+  static const int64_t kWaitNs = 20000000; // 20 ms
+  static const int64_t kRelockFrames = 48;
+
+  EchoCanceller(std::shared_ptr<EchoReference> reference,
+                const EchoSettings &settings = EchoSettings());
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+
+  size_t Latency() const { return latency; }
+
+  // Thread time spent cancelling echo since construction
+  double ProcessingTimeMs() const {
+    return processingNs.load(std::memory_order_relaxed) / 1e6;
+  }
+
+  // Echo return loss enhancement: smoothed ratio of mic to output power
+  // while the reference is active, in dB
+  double ErleDb() const { return erleDb.load(std::memory_order_relaxed); }
+
+private:
+  struct Channel {
+    std::vector<float> weightRe; // partitions * bins
+    std::vector<float> weightIm;
+    std::vector<float> mic;      // One block, deinterleaved
+  };
+
+  // Cancel the echo in kBlock interleaved mic frames whose reference starts
+  // at referenceIndex, appending the result to the output FIFO
+  void ProcessBlock(int64_t referenceIndex, const float *mic);
+  void Adapt(Channel &channel, float step);
+  void ResetFilter(Channel &channel);
+
+  std::shared_ptr<EchoReference> reference;
+  EchoSettings settings;
+  int sampleRate = 0;
+  int channels = 0;
+  size_t partitions = 0;
+  size_t bins = 0;
+  size_t latency = 0;
+  uint64_t blocksDone = 0;
+  bool locked = false;
+  int64_t referenceOffset = 0; // Reference index minus mic position
+
+  StreamClock clock{48000};
+  RealFft fft;
+
+  // Spectra of the last partitions reference blocks, newest at refHead
+  std::vector<float> refRe;
+  std::vector<float> refIm;
+  size_t refHead = 0;
+  std::vector<float> refPower; // Summed over the partitions, per bin
+  std::vector<float> refTime;  // Previous and current reference block
+  bool refActive = false;
+
+  // FFT work buffers
+  std::vector<float> time;
+  std::vector<float> specRe;
+  std::vector<float> specIm;
+  std::vector<float> errRe;
+  std::vector<float> errIm;
+
+  std::vector<Channel> state;
+
+  // Interleaved mic awaiting a block and its reference, and processed
+  // output awaiting delivery
+  std::vector<float> pending;
+  std::vector<float> output;
+
+  double micEnergy = 0;
+  double errorEnergy = 0;
+  std::atomic<double> erleDb{0};
+  std::atomic<int64_t> processingNs{0};
+};
@@ -0,0 +1,161 @@
+#include "Fft.h"
+
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// One run of radix-2 butterflies. The halves never overlap; saying so lets
+// the compiler vectorise the loop.
+void Butterflies(float *__restrict ar, float *__restrict ai,
+                 float *__restrict br, float *__restrict bi,
+                 const float *__restrict twRe, const float *__restrict twIm,
+                 size_t span) {
+  for (size_t j = 0; j < span; j++) {
+    float tr = br[j] * twRe[j] - bi[j] * twIm[j];
+    float ti = br[j] * twIm[j] + bi[j] * twRe[j];
+    br[j] = ar[j] - tr;
+    bi[j] = ai[j] - ti;
+    ar[j] += tr;
+    ai[j] += ti;
+  }
+}
+
+} // namespace
+
+bool RealFft::IsValidSize(size_t size) {
+  return size >= 4 && (size & (size - 1)) == 0;
+}
+
+RealFft::RealFft(size_t size)
+    : n(size), half(size / 2), bitReverse(half), splitRe(half + 1),
+      splitIm(half + 1), workRe(half), workIm(half) {
+  int bits = 0;
+  while (((size_t)1 << bits) < half)
+    bits++;
+  for (size_t i = 0; i < half; i++) {
+    uint32_t r = 0;
+    for (int b = 0; b < bits; b++) {
+      if (i & ((size_t)1 << b))
+        r |= 1u << (bits - 1 - b);
+    }
+    bitReverse[i] = r;
+  }
+
+  // Stage with butterflies of span len uses exp(-2 pi i j / len), j < len/2
+  for (size_t len = 2; len <= half; len *= 2) {
+    for (size_t j = 0; j < len / 2; j++) {
+      double angle = -2.0 * kPi * j / len;
+      stageRe.push_back((float)std::cos(angle));
+      stageIm.push_back((float)std::sin(angle));
+    }
+  }
+
+  for (size_t k = 0; k <= half; k++) {
+    double angle = -2.0 * kPi * k / n;
+    splitRe[k] = (float)std::cos(angle);
+    splitIm[k] = (float)std::sin(angle);
+  }
+}
+
+void RealFft::Transform() {
+  float *zr = workRe.data();
+  float *zi = workIm.data();
+
+  // The first two stages only need twiddles of 1 and -i: do them together
+  // as one radix-4 pass
+  size_t firstLen = 2;
+  if (half >= 4) {
+    for (size_t start = 0; start < half; start += 4) {
+      float *r = zr + start;
+      float *i = zi + start;
+      float s0r = r[0] + r[1], s0i = i[0] + i[1];
+      float d0r = r[0] - r[1], d0i = i[0] - i[1];
+      float s1r = r[2] + r[3], s1i = i[2] + i[3];
+      float d1r = r[2] - r[3], d1i = i[2] - i[3];
+      r[0] = s0r + s1r;
+      i[0] = s0i + s1i;
+      r[2] = s0r - s1r;
+      i[2] = s0i - s1i;
+      // d1 * -i
+      r[1] = d0r + d1i;
+      i[1] = d0i - d1r;
+      r[3] = d0r - d1i;
+      i[3] = d0i + d1r;
+    }
+    firstLen = 8;
+  }
+
+  const float *twRe = stageRe.data() + (firstLen / 2 - 1);
+  const float *twIm = stageIm.data() + (firstLen / 2 - 1);
+  for (size_t len = firstLen; len <= half; len *= 2) {
+    size_t span = len / 2;
+    for (size_t start = 0; start < half; start += len) {
+      Butterflies(zr + start, zi + start, zr + start + span,
+                  zi + start + span, twRe, twIm, span);
+    }
+    twRe += span;
+    twIm += span;
+  }
+}
+
+void RealFft::Forward(const float *input, float *re, float *im) {
+  float *zr = workRe.data();
+  float *zi = workIm.data();
+
+  // Pack even samples as real, odd as imaginary parts
+  for (size_t i = 0; i < half; i++) {
+    size_t j = bitReverse[i];
+    zr[j] = input[2 * i];
+    zi[j] = input[2 * i + 1];
+  }
+
+  Transform();
+
+  // Split the half-size transform into the spectrum of the real input.
+  // Z[half] wraps to Z[0], so DC and Nyquist come from Z[0] alone.
+  re[0] = zr[0] + zi[0];
+  im[0] = 0.0f;
+  re[half] = zr[0] - zi[0];
+  im[half] = 0.0f;
+  for (size_t k = 1; k < half; k++) {
+    size_t b = half - k;
+    float evenRe = 0.5f * (zr[k] + zr[b]);
+    float evenIm = 0.5f * (zi[k] - zi[b]);
+    float oddRe = 0.5f * (zi[k] + zi[b]);
+    float oddIm = -0.5f * (zr[k] - zr[b]);
+    re[k] = evenRe + splitRe[k] * oddRe - splitIm[k] * oddIm;
+    im[k] = evenIm + splitRe[k] * oddIm + splitIm[k] * oddRe;
+  }
+}
+
+void RealFft::Inverse(const float *re, const float *im, float *output) {
+  float *zr = workRe.data();
+  float *zi = workIm.data();
+
+  // Undo the split: Z[k] = E[k] + i O[k], where E and O are the spectra of
+  // the even and odd samples. The inverse runs as a forward transform of the
+  // conjugate, so conjugate while packing in bit-reversed order.
+  for (size_t k = 0; k < half; k++) {
+    size_t b = half - k;
+    float evenRe = 0.5f * (re[k] + re[b]);
+    float evenIm = 0.5f * (im[k] - im[b]);
+    float dr = 0.5f * (re[k] - re[b]);
+    float di = 0.5f * (im[k] + im[b]);
+    // O[k] = (X[k] - conj(X[half - k])) / 2 * conj(w^k)
+    float oddRe = dr * splitRe[k] + di * splitIm[k];
+    float oddIm = di * splitRe[k] - dr * splitIm[k];
+    size_t j = bitReverse[k];
+    zr[j] = evenRe - oddIm;
+    zi[j] = -(evenIm + oddRe);
+  }
+
+  Transform();
+
+  float scale = 1.0f / half;
+  for (size_t i = 0; i < half; i++) {
+    output[2 * i] = zr[i] * scale;
+    output[2 * i + 1] = -zi[i] * scale;
+  }
+}
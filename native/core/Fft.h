@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FFT of real input and its inverse, power-of-two sizes. Runs as a half-size
+// complex FFT on split real/imaginary arrays with per-stage twiddle tables,
+// so every butterfly loop walks contiguous memory and vectorises.
+class RealFft {
+public:
+  explicit RealFft(size_t size); // Power of two, at least 4
+
+  size_t Size() const { return n; }
+
+  // size real samples in, size / 2 + 1 bins out (DC to Nyquist)
+  void Forward(const float *input, float *re, float *im);
+
+  // size / 2 + 1 bins in, size real samples out; scaled so that
+  // Inverse(Forward(x)) == x. The imaginary parts of DC and Nyquist must
+  // be zero, as they are for any real signal.
+  void Inverse(const float *re, const float *im, float *output);
+
+  static bool IsValidSize(size_t size);
+
+private:
+  // In-place complex FFT of the bit-reversed work arrays
+  void Transform();
+
+  size_t n;
+  size_t half;
+  std::vector<uint32_t> bitReverse;
+  std::vector<float> stageRe; // Twiddles of every stage, back to back
+  std::vector<float> stageIm;
+  std::vector<float> splitRe; // exp(-2 pi i k / n) for the real split
+  std::vector<float> splitIm;
+  std::vector<float> workRe;
+  std::vector<float> workIm;
+};
@@ -0,0 +1,359 @@
+#include "FileSink.h"
+#include "WavHeader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+int64_t WallClockNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+bool ValidateFileSinkSettings(const FileSinkSettings &settings,
+                              std::string &error) {
+  if (settings.path.empty()) {
+    error = "path must not be empty";
+    return false;
+  }
+  if (!(settings.segmentSeconds >= 0)) {
+    error = "segmentSeconds must not be negative";
+    return false;
+  }
+  if (settings.segmentBytes != 0 && settings.segmentBytes < 4096) {
+    error = "segmentBytes must be 0 or at least 4096";
+    return false;
+  }
+  if (!(settings.checkpointSeconds >= 0)) {
+    error = "checkpointSeconds must not be negative";
+    return false;
+  }
+  return true;
+}
+
+std::string SegmentPath(const std::string &path, uint32_t index) {
+  char number[16];
+  std::snprintf(number, sizeof(number), "%05u", index);
+
+  size_t placeholder = path.find("{index}");
+  if (placeholder != std::string::npos) {
+    return path.substr(0, placeholder) + number +
+           path.substr(placeholder + 7);
+  }
+  if (index == 0) {
+    return path;
+  }
+  // Before the extension of the file name, if it has one
+  size_t slash = path.find_last_of("/\\");
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    dot = path.size();
+  }
+  return path.substr(0, dot) + "-" + number + path.substr(dot);
+}
+
+FileSink::FileSink(const FileSinkSettings &settings, int sampleRate,
+                   int channels, SegmentCallback onSegment,
+                   ErrorCallback onError, DiskWriter &writer)
+    : settings(settings), sampleRate(sampleRate), channels(channels),
+      onSegment(std::move(onSegment)),
+      blocks(std::move(onError),
+             [this](uint32_t index) {
+               return SegmentPath(this->settings.path, index);
+             },
+             writer) {
+  uint64_t frameBytes = (uint64_t)channels * sizeof(int16_t);
+  segmentFrames = kWavMaxDataBytes / frameBytes;
+  if (settings.segmentSeconds > 0) {
+    uint64_t frames =
+        (uint64_t)std::llround(settings.segmentSeconds * sampleRate);
+    segmentFrames = std::min(segmentFrames, std::max<uint64_t>(1, frames));
+  }
+  if (settings.segmentBytes > 0) {
+    uint64_t frames = (settings.segmentBytes - kWavHeaderSize) / frameBytes;
+    segmentFrames = std::min(segmentFrames, std::max<uint64_t>(1, frames));
+  }
+  if (settings.checkpointSeconds > 0) {
+    checkpointFrames = std::max<uint64_t>(
+        1, (uint64_t)std::llround(settings.checkpointSeconds * sampleRate));
+  }
+}
+
+FileSink::~FileSink() { Close(); }
+
+bool FileSink::Open(std::string &error) {
+  std::lock_guard<std::mutex> lock(mutex);
+  current = Segment();
+  current.file = std::make_shared<DiskFile>();
+  if (!current.file->Open(SegmentPath(settings.path, 0), settings.direct,
+                          error)) {
+    current.file.reset();
+    return false;
+  }
+  if (checkpointFrames > 0) {
+    journal = std::make_unique<RecordingJournal>();
+    if (!journal->Open(JournalPath(settings.path), sampleRate, channels,
+                       error)) {
+      journal.reset();
+      current.file->Close();
+      RemoveFile(SegmentPath(settings.path, 0));
+      current.file.reset();
+      return false;
+    }
+  }
+  next = NewSegment(1);
+  StartBlock();
+  // Fixed for the recording, so segment times follow the capture clock
+  // without jumping when the wall clock is adjusted
+  wallOffsetNs = WallClockNs() - SteadyNowNs();
+  isOpen = true;
+  return true;
+}
+
+void FileSink::Write(const int16_t *samples, size_t sampleCount,
+                     const CaptureMetadata &meta) {
+  size_t frames = sampleCount / channels;
+  if (frames == 0) {
+    return;
+  }
+  size_t frameBytes = channels * sizeof(int16_t);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!isOpen || blocks.Failed()) {
+    return;
+  }
+  // Without a capture time, the block was captured over the time it
+  // covers, ending about now
+  int64_t timeNs =
+      meta.timestampNs != 0
+          ? meta.timestampNs + wallOffsetNs
+          : WallClockNs() - (int64_t)(frames * 1000000000ull / sampleRate);
+  size_t done = 0;
+  while (done < frames) {
+    if (current.frames == 0) {
+      current.startTimeNs =
+          timeNs + (int64_t)(done * 1000000000ull / sampleRate);
+    }
+    size_t count = (size_t)std::min<uint64_t>(frames - done,
+                                              segmentFrames - current.frames);
+    Append((const uint8_t *)(samples + done * channels), count * frameBytes);
+    current.frames += count;
+    done += count;
+    endTimeNs = timeNs + (int64_t)(done * 1000000000ull / sampleRate);
+    if (current.frames == segmentFrames) {
+      Rotate();
+    }
+  }
+  if (checkpointFrames > 0 &&
+      current.frames - current.checkpointed >= checkpointFrames &&
+      !checkpointPending.load(std::memory_order_acquire)) {
+    SubmitCheckpoint();
+  }
+}
+
+void FileSink::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isOpen) {
+      return;
+    }
+    isOpen = false;
+    // A segment that was only opened ahead of time is not part of the
+    // recording; neither is an empty one that follows a rotation on the
+    // last frame.
+    if (current.frames == 0 && current.index > 0) {
+      blocks.ReleaseBlock(block);
+      SubmitDiscard(current);
+    } else {
+      SubmitFinish(current, endTimeNs);
+    }
+    block = nullptr;
+    SubmitDiscard(next);
+  }
+  blocks.Drain();
+  // The files are whole now; after a failure the journal stays for
+  // RecoverRecording
+  if (journal) {
+    if (blocks.Failed()) {
+      journal->Close();
+    } else {
+      journal->Remove();
+    }
+  }
+}
+
+void FileSink::Append(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    size_t count = std::min(size, kBlockBytes - block->used);
+    std::memcpy(block->data + block->used, data, count);
+    block->used += count;
+    block->dataBytes += count;
+    data += count;
+    size -= count;
+    if (block->used == kBlockBytes) {
+      SubmitBlock();
+    }
+  }
+}
+
+void FileSink::StartBlock() {
+  block = blocks.TakeBlock();
+  block->fileIndex = current.index;
+  if (current.offset == 0) {
+    // Placeholder header until the segment is finished
+    BuildWavHeader(block->data, sampleRate, channels, 0);
+    block->used = kWavHeaderSize;
+  }
+}
+
+void FileSink::SubmitBlock() {
+  blocks.WriteBlock(current.file, block, current.offset);
+  current.offset += kBlockBytes;
+  StartBlock();
+}
+
+void FileSink::SubmitCheckpoint() {
+  // Write out the block being filled as far as it goes. Append only adds
+  // past used, so the writer can read this much while capture goes on;
+  // the full block is written over it later. Direct I/O takes whole
+  // sectors only.
+  size_t stable = settings.direct
+                      ? block->used / kDiskAlignment * kDiskAlignment
+                      : block->used;
+  uint64_t fileBytes = current.offset + stable;
+  uint64_t frames = fileBytes > kWavHeaderSize
+                        ? (fileBytes - kWavHeaderSize) /
+                              ((uint64_t)channels * sizeof(int16_t))
+                        : 0;
+  current.checkpointed = current.frames;
+  if (stable > 0) {
+    blocks.WritePartial(current.file, block, stable, current.offset);
+  }
+
+  // Runs once everything before it reached the file. Only this capture
+  // is kept in the task, which std::function stores without allocating.
+  checkpoint.file = current.file;
+  checkpoint.index = current.index;
+  checkpoint.frames = frames;
+  checkpointPending.store(true, std::memory_order_relaxed);
+  blocks.SubmitTask(current.file, [this] {
+    if (!checkpoint.file->IsOpen() || !checkpoint.file->Sync() ||
+        !journal->Checkpoint(checkpoint.index, checkpoint.frames)) {
+      blocks.Fail("Failed to checkpoint " +
+                  SegmentPath(settings.path, checkpoint.index));
+    }
+    checkpoint.file.reset();
+    checkpointPending.store(false, std::memory_order_release);
+    blocks.EndRequest(-1);
+  });
+}
+
+void FileSink::Rotate() {
+  // The next file was opened ahead of time; open the one after it before
+  // the next boundary can come up
+  uint64_t startFrame = current.startFrame + current.frames;
+  SubmitFinish(current, endTimeNs);
+  current = std::move(next);
+  current.startFrame = startFrame;
+  next = NewSegment(current.index + 1);
+  StartBlock();
+}
+
+void FileSink::SubmitFinish(Segment &segment, int64_t endTimeNs) {
+  SegmentInfo info;
+  info.path = SegmentPath(settings.path, segment.index);
+  info.index = segment.index;
+  info.startFrame = segment.startFrame;
+  info.frames = segment.frames;
+  info.startTimeNs = segment.frames > 0 ? segment.startTimeNs : endTimeNs;
+  info.endTimeNs = segment.frames > 0 ? endTimeNs : info.startTimeNs;
+
+  // Runs once the segment's full blocks are on disk
+  Block *tail = block;
+  std::shared_ptr<DiskFile> file = segment.file;
+  uint64_t offset = segment.offset;
+  blocks.SubmitTask(file, [this, file, tail, offset, info] {
+    uint64_t dataBytes = info.frames * channels * sizeof(int16_t);
+    uint8_t header[kWavHeaderSize];
+    BuildWavHeader(header, sampleRate, channels, dataBytes);
+    bool ok = file->IsOpen() && file->DisableDirect() &&
+              file->WriteAt(tail->data, tail->used, offset) &&
+              file->WriteAt(header, sizeof(header), 0) &&
+              (!journal || file->Sync());
+    ok = file->Close() && ok;
+    if (ok && journal) {
+      ok = journal->Finish(info.index, info.frames);
+    }
+    if (ok) {
+      blocks.AddBytesWritten(tail->dataBytes);
+    }
+    blocks.ReleaseBlock(tail);
+    if (!ok) {
+      blocks.Fail("Failed to finish " + info.path);
+    } else {
+      Report(info);
+    }
+    blocks.EndRequest(-1);
+  });
+}
+
+void FileSink::SubmitDiscard(Segment &segment) {
+  std::shared_ptr<DiskFile> file = segment.file;
+  uint32_t index = segment.index;
+  blocks.SubmitTask(file, [this, file, index] {
+    if (file->IsOpen()) {
+      file->Close();
+      RemoveFile(SegmentPath(settings.path, index));
+    }
+    blocks.EndRequest(-1);
+  });
+}
+
+FileSink::Segment FileSink::NewSegment(uint32_t index) {
+  Segment segment;
+  segment.file = std::make_shared<DiskFile>();
+  segment.index = index;
+
+  std::shared_ptr<DiskFile> file = segment.file;
+  blocks.SubmitTask(file, [this, file, index] {
+    std::string error;
+    if (!file->Open(SegmentPath(settings.path, index), settings.direct,
+                    error)) {
+      blocks.Fail(error);
+    }
+    blocks.EndRequest(-1);
+  });
+  return segment;
+}
+
+void FileSink::Report(const SegmentInfo &info) {
+  // Segments finish in order of their last write, which with io_uring need
+  // not be the order of the segments; hold later ones back
+  finished.insert(std::upper_bound(finished.begin(), finished.end(), info,
+                                   [](const SegmentInfo &a,
+                                      const SegmentInfo &b) {
+                                     return a.index < b.index;
+                                   }),
+                  info);
+  while (!finished.empty() && finished.front().index == nextReport) {
+    if (onSegment) {
+      onSegment(finished.front());
+    }
+    finished.erase(finished.begin());
+    nextReport++;
+  }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "BlockWriter.h"
+#include "CaptureCore.h"
+#include "DiskWriter.h"
+#include "RecordingJournal.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Settings of a native WAV recording
+struct FileSinkSettings {
+  // Output path. "{index}" is replaced by the zero-padded segment number;
+  // without it, segments after the first get "-00001" and so on before the
+  // extension. Empty when no file is written.
+  std::string path;
+  double segmentSeconds = 0; // Start a new file after this long, 0 = never
+  uint64_t segmentBytes = 0; // Or before a file would exceed this, 0 = never
+  bool direct = false;       // Bypass the page cache where supported
+  // Sync the file and note the frames on disk in a journal this often, for
+  // RecoverRecording after a crash; 0 = no journal
+  double checkpointSeconds = 0;
+};
+
+// Checks the ranges the sink supports; false with error set otherwise
+bool ValidateFileSinkSettings(const FileSinkSettings &settings,
+                              std::string &error);
+
+// Path of segment index for settings.path
+std::string SegmentPath(const std::string &path, uint32_t index);
+
+// A finished file of a recording
+struct SegmentInfo {
+  std::string path;
+  uint32_t index;
+  uint64_t startFrame;  // Position of its first frame in the recording
+  uint64_t frames;
+  int64_t startTimeNs;  // Wall clock (system_clock) of its first frame
+  int64_t endTimeNs;    // Wall clock just after its last frame
+};
+
+// Writes a stream's 16-bit PCM into WAV files, rotating by duration or size.
+// Splits are sample-exact: every frame lands in exactly one segment, in
+// order. Write() copies the audio into 64 KB file blocks, aligned for
+// direct I/O, and hands each full block to a DiskWriter; the writer's
+// thread opens the next segment's file ahead of time, and once a
+// segment's blocks are on disk writes its partial last block, patches the
+// header and closes it. A file is also split before it outgrows what a WAV
+// header can describe. With checkpoints, the block being filled is written
+// out as far as it goes and a writer task syncs the file and appends the
+// frame count to a RecordingJournal; the capture thread only queues them,
+// and skips a checkpoint while the last one is still pending. Once its
+// blocks have been recycled, Write() does not allocate.
+class FileSink {
+public:
+  using SegmentCallback = std::function<void(const SegmentInfo &segment)>;
+  using ErrorCallback = std::function<void(const std::string &error)>;
+  // Disk writes through this sink, queued or in flight
+  using WriteStats = BlockWriter::WriteStats;
+
+  // Callbacks run on the writer's thread; segments are reported in order
+  FileSink(const FileSinkSettings &settings, int sampleRate, int channels,
+           SegmentCallback onSegment, ErrorCallback onError,
+           DiskWriter &writer = DiskWriter::Shared());
+  ~FileSink();
+
+  // Create the first file; later ones are created by the writer
+  bool Open(std::string &error);
+
+  // Queue interleaved samples, a whole number of frames; called by the
+  // capture thread. Segment times follow meta.timestampNs, or the wall
+  // clock at the call for blocks without one.
+  void Write(const int16_t *samples, size_t sampleCount,
+             const CaptureMetadata &meta = CaptureMetadata());
+
+  // Write out everything queued, finish the last segment and wait for the
+  // writer to be done with this sink
+  void Close();
+
+  // Frames that reached a file so far
+  uint64_t FramesWritten() const {
+    return blocks.BytesWritten() / ((uint64_t)channels * sizeof(int16_t));
+  }
+
+  // Frames a segment holds at most
+  uint64_t SegmentFrames() const { return segmentFrames; }
+
+  WriteStats GetWriteStats() const { return blocks.GetWriteStats(); }
+
+private:
+  static const size_t kBlockBytes = BlockWriter::kBlockBytes;
+
+  // Its fileIndex is the segment; dataBytes leaves out the header
+  using Block = BlockWriter::Block;
+
+  struct Segment {
+    std::shared_ptr<DiskFile> file;
+    uint32_t index = 0;
+    uint64_t startFrame = 0;
+    uint64_t frames = 0;
+    int64_t startTimeNs = 0;
+    uint64_t offset = 0; // Of the block being filled
+    uint64_t checkpointed = 0; // frames at the last checkpoint
+  };
+
+  // Capture side, under mutex
+  void Append(const uint8_t *data, size_t size);
+  void StartBlock();
+  void SubmitBlock();
+  void SubmitCheckpoint();
+  void Rotate();
+  void SubmitFinish(Segment &segment, int64_t endTimeNs);
+  void SubmitDiscard(Segment &segment);
+  Segment NewSegment(uint32_t index);
+
+  // Writer thread: pass finished segments on in index order
+  void Report(const SegmentInfo &info);
+
+  FileSinkSettings settings;
+  int sampleRate;
+  int channels;
+  uint64_t segmentFrames;
+  uint64_t checkpointFrames = 0;
+  SegmentCallback onSegment;
+  BlockWriter blocks;
+
+  std::mutex mutex;
+  bool isOpen = false;
+  Segment current;
+  Segment next; // Its file is opened ahead of the rotation
+  Block *block = nullptr;
+  int64_t endTimeNs = 0;
+  int64_t wallOffsetNs = 0; // Wall clock minus steady clock, at Open()
+
+  // The checkpoint in flight; set by the capture thread while
+  // checkpointPending is clear, then read by the writer's task
+  struct Checkpoint {
+    std::shared_ptr<DiskFile> file;
+    uint32_t index = 0;
+    uint64_t frames = 0;
+  };
+  Checkpoint checkpoint;
+  std::atomic<bool> checkpointPending{false};
+
+  // Writer thread state
+  std::unique_ptr<RecordingJournal> journal;
+  std::vector<SegmentInfo> finished; // Waiting for an earlier segment
+  uint32_t nextReport = 0;
+};
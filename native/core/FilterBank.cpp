@@ -0,0 +1,146 @@
+#include "FilterBank.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// Highest design frequency as a fraction of the sample rate
+const double kMaxFrequencyRatio = 0.45;
+
+// State this small is flushed to zero after each block, so a filter ringing
+// out into silence never reaches denormals
+const float kStateFloor = 1e-20f;
+
+// Filter lanes (at most kLanes) channels, stride samples apart per frame,
+// through one section. The lane loop is innermost and its state lives in
+// locals the samples cannot alias, so the compiler vectorises it across
+// channels; the coefficients are copied out of k for the same reason.
+void RunSection(const BiquadCoefficients &k, size_t lanes, float *samples,
+                size_t frames, size_t stride, float *z1, float *z2) {
+  const float b0 = k.b0, b1 = k.b1, b2 = k.b2, a1 = k.a1, a2 = k.a2;
+  float s1[FilterBank::kLanes], s2[FilterBank::kLanes];
+  for (size_t l = 0; l < lanes; l++) {
+    s1[l] = z1[l];
+    s2[l] = z2[l];
+  }
+  float *p = samples;
+  for (size_t i = 0; i < frames; i++, p += stride) {
+    for (size_t l = 0; l < lanes; l++) {
+      float x = p[l];
+      float y = b0 * x + s1[l];
+      s1[l] = b1 * x - a1 * y + s2[l];
+      s2[l] = b2 * x - a2 * y;
+      p[l] = y;
+    }
+  }
+  for (size_t l = 0; l < lanes; l++) {
+    z1[l] = std::fabs(s1[l]) < kStateFloor ? 0.0f : s1[l];
+    z2[l] = std::fabs(s2[l]) < kStateFloor ? 0.0f : s2[l];
+  }
+}
+
+} // namespace
+
+bool ValidateBiquadSpec(const BiquadSpec &spec, std::string &error) {
+  if (!(spec.frequency >= 1 && spec.frequency <= 96000)) {
+    error = "frequency must be between 1 and 96000";
+    return false;
+  }
+  if (!(spec.q >= 0.1 && spec.q <= 50)) {
+    error = "q must be between 0.1 and 50";
+    return false;
+  }
+  if (!(spec.gainDb >= -24 && spec.gainDb <= 24)) {
+    error = "gainDb must be between -24 and 24";
+    return false;
+  }
+  return true;
+}
+
+BiquadCoefficients DesignBiquad(const BiquadSpec &spec, int sampleRate) {
+  double frequency = std::min(spec.frequency, kMaxFrequencyRatio * sampleRate);
+  double w0 = 2 * kPi * frequency / sampleRate;
+  double cosw = std::cos(w0);
+  double alpha = std::sin(w0) / (2 * spec.q);
+  double a = std::pow(10.0, spec.gainDb / 40);
+  double shelf = 2 * std::sqrt(a) * alpha;
+
+  double b0, b1, b2, a0, a1, a2;
+  switch (spec.type) {
+  case FilterType::HighPass:
+    b0 = (1 + cosw) / 2;
+    b1 = -(1 + cosw);
+    b2 = (1 + cosw) / 2;
+    a0 = 1 + alpha;
+    a1 = -2 * cosw;
+    a2 = 1 - alpha;
+    break;
+  case FilterType::LowPass:
+    b0 = (1 - cosw) / 2;
+    b1 = 1 - cosw;
+    b2 = (1 - cosw) / 2;
+    a0 = 1 + alpha;
+    a1 = -2 * cosw;
+    a2 = 1 - alpha;
+    break;
+  case FilterType::LowShelf:
+    b0 = a * ((a + 1) - (a - 1) * cosw + shelf);
+    b1 = 2 * a * ((a - 1) - (a + 1) * cosw);
+    b2 = a * ((a + 1) - (a - 1) * cosw - shelf);
+    a0 = (a + 1) + (a - 1) * cosw + shelf;
+    a1 = -2 * ((a - 1) + (a + 1) * cosw);
+    a2 = (a + 1) + (a - 1) * cosw - shelf;
+    break;
+  case FilterType::HighShelf:
+    b0 = a * ((a + 1) + (a - 1) * cosw + shelf);
+    b1 = -2 * a * ((a - 1) + (a + 1) * cosw);
+    b2 = a * ((a + 1) + (a - 1) * cosw - shelf);
+    a0 = (a + 1) - (a - 1) * cosw + shelf;
+    a1 = 2 * ((a - 1) - (a + 1) * cosw);
+    a2 = (a + 1) - (a - 1) * cosw - shelf;
+    break;
+  default: // Notch
+    b0 = 1;
+    b1 = -2 * cosw;
+    b2 = 1;
+    a0 = 1 + alpha;
+    a1 = -2 * cosw;
+    a2 = 1 - alpha;
+    break;
+  }
+  return {(float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0),
+          (float)(a1 / a0), (float)(a2 / a0)};
+}
+
+void FilterBank::Configure(int sampleRate, int channels) {
+  this->channels = channels;
+  sections.clear();
+  for (const BiquadSpec &spec : specs) {
+    Section section;
+    section.coefficients = DesignBiquad(spec, sampleRate);
+    section.z1.assign(channels, 0.0f);
+    section.z2.assign(channels, 0.0f);
+    sections.push_back(std::move(section));
+  }
+}
+
+void FilterBank::Process(AudioBlock &block) {
+  auto begin = std::chrono::steady_clock::now();
+  size_t ch = (size_t)channels;
+  for (Section &section : sections) {
+    for (size_t c = 0; c < ch; c += kLanes) {
+      size_t lanes = ch - c < kLanes ? ch - c : kLanes;
+      RunSection(section.coefficients, lanes, block.samples + c,
+                 block.frames, ch, section.z1.data() + c,
+                 section.z2.data() + c);
+    }
+  }
+  processingNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count(),
+                         std::memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class FilterType { HighPass, LowPass, LowShelf, HighShelf, Notch };
+
+// One second-order section of a filter bank
+struct BiquadSpec {
+  FilterType type = FilterType::HighPass;
+  double frequency = 80; // Corner, shelf midpoint or notch centre, Hz
+  double q = 0.7071;     // Resonance; the notch width is frequency / q
+  double gainDb = 0;     // Shelves only
+};
+
+// Checks the ranges a section supports; false with error set otherwise
+bool ValidateBiquadSpec(const BiquadSpec &spec, std::string &error);
+
+// Normalised biquad coefficients (a0 = 1), from the RBJ audio EQ cookbook
+struct BiquadCoefficients {
+  float b0, b1, b2, a1, a2;
+};
+
+// Coefficients of spec at sampleRate. Frequencies are capped a little below
+// Nyquist, where the cookbook designs stay well conditioned.
+BiquadCoefficients DesignBiquad(const BiquadSpec &spec, int sampleRate);
+
+// Cascade of biquads applied in place to every channel, in the order given.
+// Each section runs over the whole block in transposed direct form II with
+// the channels of a frame side by side in SIMD lanes, in groups of up to
+// kLanes channels.
+class FilterBank : public CaptureStage {
+public:
+  static const size_t kMaxSections = 16;
+  static const size_t kLanes = 8;
+
+  explicit FilterBank(std::vector<BiquadSpec> sections)
+      : specs(std::move(sections)) {}
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+
+  // Thread time spent filtering since construction
+  double ProcessingTimeMs() const {
+    return processingNs.load(std::memory_order_relaxed) / 1e6;
+  }
+
+private:
+  struct Section {
+    BiquadCoefficients coefficients;
+    std::vector<float> z1; // State per channel
+    std::vector<float> z2;
+  };
+
+  std::vector<BiquadSpec> specs;
+  std::vector<Section> sections;
+  int channels = 0;
+
+  std::atomic<int64_t> processingNs{0};
+};
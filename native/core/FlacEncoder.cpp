@@ -0,0 +1,399 @@
+#include "FlacEncoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const char *const kVendor = "native-recorder-nodejs";
+
+// Metadata block types
+const uint8_t kStreamInfoBlock = 0;
+const uint8_t kVorbisCommentBlock = 4;
+
+// Largest partition order searched, and the largest Rice parameter of the
+// 4-bit parameter coding
+const int kMaxPartitionOrder = 8;
+const uint32_t kMaxRiceParameter = 14;
+
+// CRC-8 (x^8 + x^2 + x + 1) of frame headers and CRC-16 (x^16 + x^15 + x^2
+// + 1) of whole frames, both unreflected from zero
+struct CrcTables {
+  uint8_t crc8[256];
+  uint16_t crc16[256];
+
+  CrcTables() {
+    for (int i = 0; i < 256; i++) {
+      uint8_t c8 = (uint8_t)i;
+      uint16_t c16 = (uint16_t)(i << 8);
+      for (int bit = 0; bit < 8; bit++) {
+        c8 = (uint8_t)((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+        c16 = (uint16_t)((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1);
+      }
+      crc8[i] = c8;
+      crc16[i] = c16;
+    }
+  }
+};
+
+const CrcTables &Crc() {
+  static const CrcTables tables;
+  return tables;
+}
+
+uint8_t Crc8(const uint8_t *data, size_t size) {
+  const CrcTables &tables = Crc();
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = tables.crc8[crc ^ data[i]];
+  }
+  return crc;
+}
+
+uint16_t Crc16(const uint8_t *data, size_t size) {
+  const CrcTables &tables = Crc();
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = (uint16_t)((crc << 8) ^ tables.crc16[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+// Frame header code of a sample rate; 0 refers to STREAMINFO
+uint32_t SampleRateCode(int sampleRate) {
+  switch (sampleRate) {
+  case 88200: return 1;
+  case 176400: return 2;
+  case 192000: return 3;
+  case 8000: return 4;
+  case 16000: return 5;
+  case 22050: return 6;
+  case 24000: return 7;
+  case 32000: return 8;
+  case 44100: return 9;
+  case 48000: return 10;
+  case 96000: return 11;
+  default: return 0;
+  }
+}
+
+// Residuals are coded folded to unsigned: 0, -1, 1, -2, ...
+inline uint32_t Fold(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+// Rice parameter that estimates fewest bits for count values summing to
+// sum, and that estimate
+uint32_t BestRiceParameter(uint64_t count, uint64_t sum, uint64_t &bits) {
+  uint32_t best = 0;
+  bits = UINT64_MAX;
+  for (uint32_t k = 0; k <= kMaxRiceParameter; k++) {
+    uint64_t estimate = count * (k + 1) + (sum >> k);
+    if (estimate < bits) {
+      bits = estimate;
+      best = k;
+    }
+  }
+  return best;
+}
+
+void PutLittle32(std::vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+
+void PutBlockHeader(std::vector<uint8_t> &out, bool last, uint8_t type,
+                    size_t length) {
+  out.push_back((uint8_t)((last ? 0x80 : 0) | type));
+  out.push_back((uint8_t)(length >> 16));
+  out.push_back((uint8_t)(length >> 8));
+  out.push_back((uint8_t)length);
+}
+
+std::vector<uint8_t> VorbisComment() {
+  std::vector<uint8_t> body;
+  size_t vendorLength = std::strlen(kVendor);
+  PutLittle32(body, (uint32_t)vendorLength);
+  body.insert(body.end(), kVendor, kVendor + vendorLength);
+  PutLittle32(body, 0); // No comments
+  return body;
+}
+
+} // namespace
+
+// MSB-first bit packing into a byte vector
+class FlacEncoder::BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+  // The low count (at most 32) bits of value
+  void Put(uint32_t value, int count) {
+    if (count == 0) {
+      return;
+    }
+    uint64_t mask = (count == 32) ? 0xFFFFFFFFull : ((1ull << count) - 1);
+    pending = (pending << count) | (value & mask);
+    pendingBits += count;
+    while (pendingBits >= 8) {
+      pendingBits -= 8;
+      out.push_back((uint8_t)(pending >> pendingBits));
+    }
+  }
+
+  // quotient zeros, then a one
+  void PutUnary(uint32_t quotient) {
+    while (quotient >= 31) {
+      Put(0, 31);
+      quotient -= 31;
+    }
+    Put(1, (int)quotient + 1);
+  }
+
+  void PutRice(uint32_t value, uint32_t parameter) {
+    PutUnary(value >> parameter);
+    Put(value, (int)parameter);
+  }
+
+  // Zero bits up to the next byte boundary
+  void Align() {
+    if (pendingBits > 0) {
+      Put(0, 8 - pendingBits);
+    }
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  uint64_t pending = 0;
+  int pendingBits = 0;
+};
+
+FlacEncoder::FlacEncoder(int sampleRate, int channels,
+                         uint32_t maxBlockFrames)
+    : sampleRate(sampleRate), channels(channels),
+      maxBlockFrames(std::min<uint32_t>(std::max<uint32_t>(maxBlockFrames, 16),
+                                        65535)) {
+  channel.resize(this->maxBlockFrames);
+  residual.resize(this->maxBlockFrames);
+  partitionSums.resize((size_t)1 << kMaxPartitionOrder);
+}
+
+std::vector<uint8_t> FlacEncoder::StreamInfo() const {
+  std::vector<uint8_t> info;
+  BitWriter bits(info);
+  bits.Put(16, 16); // Smallest block but the last; shorter ones follow gaps
+  bits.Put(maxBlockFrames, 16);
+  bits.Put(0, 24); // Frame sizes unknown
+  bits.Put(0, 24);
+  bits.Put((uint32_t)sampleRate, 20);
+  bits.Put((uint32_t)channels - 1, 3);
+  bits.Put(16 - 1, 5);
+  bits.Put(0, 4); // 36 bits of total samples, unknown
+  bits.Put(0, 32);
+  for (int i = 0; i < 4; i++) {
+    bits.Put(0, 32); // MD5 unknown
+  }
+  return info;
+}
+
+std::vector<uint8_t> FlacEncoder::MetadataBlocks() const {
+  std::vector<uint8_t> info = StreamInfo();
+  std::vector<uint8_t> comment = VorbisComment();
+  std::vector<uint8_t> out;
+  PutBlockHeader(out, false, kStreamInfoBlock, info.size());
+  out.insert(out.end(), info.begin(), info.end());
+  PutBlockHeader(out, true, kVorbisCommentBlock, comment.size());
+  out.insert(out.end(), comment.begin(), comment.end());
+  return out;
+}
+
+std::vector<uint8_t> FlacEncoder::OggFirstPacket() const {
+  std::vector<uint8_t> info = StreamInfo();
+  std::vector<uint8_t> packet = {0x7F, 'F', 'L', 'A', 'C', 1, 0, 0, 1,
+                                 'f', 'L', 'a', 'C'};
+  PutBlockHeader(packet, false, kStreamInfoBlock, info.size());
+  packet.insert(packet.end(), info.begin(), info.end());
+  return packet;
+}
+
+std::vector<uint8_t> FlacEncoder::OggCommentPacket() const {
+  std::vector<uint8_t> comment = VorbisComment();
+  std::vector<uint8_t> packet;
+  PutBlockHeader(packet, true, kVorbisCommentBlock, comment.size());
+  packet.insert(packet.end(), comment.begin(), comment.end());
+  return packet;
+}
+
+void FlacEncoder::EncodeFrame(const int16_t *samples, uint32_t frames,
+                              uint64_t firstSample,
+                              std::vector<uint8_t> &out) {
+  frames = std::min(std::max<uint32_t>(frames, 1), maxBlockFrames);
+  // A subframe is never larger than verbatim plus the rounding of the Rice
+  // estimate, so this is the only growth
+  out.clear();
+  out.reserve(32 + (size_t)channels * (3 + ((size_t)frames * 18 + 7) / 8));
+  BitWriter bits(out);
+
+  bits.Put(0xFFF9, 16); // Sync code, variable block size
+  bits.Put(7, 4);       // Block size follows the header, 16 bits
+  bits.Put(SampleRateCode(sampleRate), 4);
+  bits.Put((uint32_t)channels - 1, 4); // Independent channels
+  bits.Put(4, 3);                      // 16 bits per sample
+  bits.Put(0, 1);
+
+  // First sample number in the UTF-8 style coding, up to 36 bits
+  firstSample &= 0xFFFFFFFFFull;
+  if (firstSample < 0x80) {
+    bits.Put((uint32_t)firstSample, 8);
+  } else {
+    int bytes = 2;
+    while (bytes < 7 && firstSample >= (1ull << (5 * bytes + 1))) {
+      bytes++;
+    }
+    uint32_t prefix = (0xFF00u >> bytes) & 0xFF;
+    bits.Put(prefix | (uint32_t)(firstSample >> (6 * (bytes - 1))), 8);
+    for (int i = bytes - 2; i >= 0; i--) {
+      bits.Put(0x80 | (uint32_t)((firstSample >> (6 * i)) & 0x3F), 8);
+    }
+  }
+  bits.Put(frames - 1, 16);
+  bits.Put(Crc8(out.data(), out.size()), 8);
+
+  for (int c = 0; c < channels; c++) {
+    for (uint32_t i = 0; i < frames; i++) {
+      channel[i] = samples[(size_t)i * channels + c];
+    }
+    EncodeSubframe(bits, frames);
+  }
+  bits.Align();
+  bits.Put(Crc16(out.data(), out.size()), 16);
+}
+
+void FlacEncoder::EncodeSubframe(BitWriter &bits, uint32_t frames) {
+  const int32_t *x = channel.data();
+
+  bool constant = true;
+  for (uint32_t i = 1; i < frames && constant; i++) {
+    constant = x[i] == x[0];
+  }
+  if (constant) {
+    bits.Put(0x00, 8); // CONSTANT
+    bits.Put((uint32_t)x[0], 16);
+    return;
+  }
+
+  // Fixed predictor with the least absolute residual, compared over the
+  // samples every order predicts
+  int order = -1;
+  if (frames > 4) {
+    uint64_t sums[5] = {0, 0, 0, 0, 0};
+    for (uint32_t i = 4; i < frames; i++) {
+      int32_t e0 = x[i];
+      int32_t e1 = e0 - x[i - 1];
+      int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+      int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+      int32_t e4 =
+          e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+      sums[0] += (uint64_t)std::abs(e0);
+      sums[1] += (uint64_t)std::abs(e1);
+      sums[2] += (uint64_t)std::abs(e2);
+      sums[3] += (uint64_t)std::abs(e3);
+      sums[4] += (uint64_t)std::abs(e4);
+    }
+    order = (int)(std::min_element(sums, sums + 5) - sums);
+  }
+
+  uint64_t fixedBits = UINT64_MAX;
+  int partitionOrder = 0;
+  if (order >= 0) {
+    uint32_t *folded = (uint32_t *)residual.data();
+    for (uint32_t i = (uint32_t)order; i < frames; i++) {
+      int32_t e;
+      switch (order) {
+      case 0: e = x[i]; break;
+      case 1: e = x[i] - x[i - 1]; break;
+      case 2: e = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+      case 3: e = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+      default:
+        e = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+        break;
+      }
+      folded[i] = Fold(e);
+    }
+
+    // Partitions must divide the block evenly and the first must outlast
+    // the warm-up samples
+    int maxOrder = 0;
+    while (maxOrder < kMaxPartitionOrder &&
+           frames % (2u << maxOrder) == 0 &&
+           (frames >> (maxOrder + 1)) > (uint32_t)order) {
+      maxOrder++;
+    }
+    uint32_t partitions = 1u << maxOrder;
+    uint32_t size = frames >> maxOrder;
+    for (uint32_t p = 0; p < partitions; p++) {
+      uint64_t sum = 0;
+      uint32_t start = p == 0 ? (uint32_t)order : p * size;
+      for (uint32_t i = start; i < (p + 1) * size; i++) {
+        sum += folded[i];
+      }
+      partitionSums[p] = sum;
+    }
+    // Halve the partitioning until one is left, merging neighbours' sums
+    for (int porder = maxOrder;; porder--) {
+      uint32_t count = 1u << porder;
+      uint32_t length = frames >> porder;
+      uint64_t total = 0;
+      for (uint32_t p = 0; p < count; p++) {
+        uint64_t estimate = 0;
+        BestRiceParameter(p == 0 ? length - order : length, partitionSums[p],
+                          estimate);
+        total += 4 + estimate;
+      }
+      if (total < fixedBits) {
+        fixedBits = total;
+        partitionOrder = porder;
+      }
+      if (porder == 0) {
+        break;
+      }
+      for (uint32_t p = 0; p < count / 2; p++) {
+        partitionSums[p] = partitionSums[2 * p] + partitionSums[2 * p + 1];
+      }
+    }
+    fixedBits += 8 + 16 * (uint64_t)order + 6;
+  }
+
+  if (fixedBits >= 8 + 16 * (uint64_t)frames) {
+    bits.Put(0x02, 8); // VERBATIM
+    for (uint32_t i = 0; i < frames; i++) {
+      bits.Put((uint32_t)x[i], 16);
+    }
+    return;
+  }
+
+  bits.Put((uint32_t)(0x08 | order) << 1, 8); // FIXED
+  for (int i = 0; i < order; i++) {
+    bits.Put((uint32_t)x[i], 16);
+  }
+  bits.Put(0, 2); // Rice coding, 4-bit parameters
+  bits.Put((uint32_t)partitionOrder, 4);
+  const uint32_t *folded = (const uint32_t *)residual.data();
+  uint32_t count = 1u << partitionOrder;
+  uint32_t length = frames >> partitionOrder;
+  for (uint32_t p = 0; p < count; p++) {
+    uint32_t start = p == 0 ? (uint32_t)order : p * length;
+    uint32_t end = (p + 1) * length;
+    uint64_t sum = 0;
+    for (uint32_t i = start; i < end; i++) {
+      sum += folded[i];
+    }
+    uint64_t estimate = 0;
+    uint32_t parameter = BestRiceParameter(end - start, sum, estimate);
+    bits.Put(parameter, 4);
+    for (uint32_t i = start; i < end; i++) {
+      bits.PutRice(folded[i], parameter);
+    }
+  }
+}
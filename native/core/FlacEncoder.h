@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frames per FLAC block unless a stream asks for shorter ones
+static const uint32_t kFlacBlockFrames = 4096;
+
+// Lossless FLAC encoding of 16-bit PCM, one frame per call. Each channel
+// is coded on its own, as a constant, with the fixed predictor of order 0
+// to 4 that leaves the least residual, or verbatim when prediction does not
+// pay; residuals are Rice coded with the partitioning that estimates
+// smallest. Frames carry their first sample's number (the variable block
+// size strategy), so a stream may continue after a gap with a shorter frame
+// and the gap stays visible. Not thread-safe; after the first frame of the
+// largest size, encoding does not allocate.
+class FlacEncoder {
+public:
+  FlacEncoder(int sampleRate, int channels,
+              uint32_t maxBlockFrames = kFlacBlockFrames);
+
+  int SampleRate() const { return sampleRate; }
+  int Channels() const { return channels; }
+  uint32_t MaxBlockFrames() const { return maxBlockFrames; }
+
+  // The 34-byte STREAMINFO metadata block, without its block header. The
+  // total length and MD5 are left unknown, as for a live stream.
+  std::vector<uint8_t> StreamInfo() const;
+
+  // The metadata a container carries for the stream: STREAMINFO, then a
+  // VORBIS_COMMENT naming the encoder, each with its block header
+  std::vector<uint8_t> MetadataBlocks() const;
+
+  // The Ogg FLAC mapping's first packet (0x7F "FLAC", version 1.0, one
+  // header packet to follow, "fLaC" and STREAMINFO) and the packet that
+  // follows it, the VORBIS_COMMENT block
+  std::vector<uint8_t> OggFirstPacket() const;
+  std::vector<uint8_t> OggCommentPacket() const;
+
+  // Encode frames (1 to MaxBlockFrames) of interleaved samples starting at
+  // stream sample firstSample into one FLAC frame, replacing out
+  void EncodeFrame(const int16_t *samples, uint32_t frames,
+                   uint64_t firstSample, std::vector<uint8_t> &out);
+
+private:
+  class BitWriter;
+
+  void EncodeSubframe(BitWriter &bits, uint32_t frames);
+
+  int sampleRate;
+  int channels;
+  uint32_t maxBlockFrames;
+  // One channel's samples and the predictor residuals, reused per frame
+  std::vector<int32_t> channel;
+  std::vector<int32_t> residual;
+  std::vector<uint64_t> partitionSums;
+};
@@ -0,0 +1,257 @@
+#include "GainControl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Chunks quieter than this are background: the AGC holds its gain through
+// them rather than boosting the noise
+const double kGateDb = -55;
+
+// The limiter lets go of a peak over this time constant
+const double kLimiterReleaseMs = 50;
+
+double DbToGain(double db) { return std::pow(10.0, db / 20.0); }
+
+// Per-chunk smoothing factor of a one-pole filter with time constant ms
+double ChunkCoefficient(double ms, double chunkMs) {
+  return 1.0 - std::exp(-chunkMs / ms);
+}
+
+} // namespace
+
+bool ValidateGainSettings(const GainSettings &settings, std::string &error) {
+  if (!(settings.targetLevelDb >= -60 && settings.targetLevelDb <= 0)) {
+    error = "targetLevelDb must be between -60 and 0";
+    return false;
+  }
+  if (!(settings.maxGainDb >= 0 && settings.maxGainDb <= 60)) {
+    error = "maxGainDb must be between 0 and 60";
+    return false;
+  }
+  if (!(settings.attackMs >= 1 && settings.attackMs <= 10000)) {
+    error = "attackMs must be between 1 and 10000";
+    return false;
+  }
+  if (!(settings.releaseMs >= 1 && settings.releaseMs <= 10000)) {
+    error = "releaseMs must be between 1 and 10000";
+    return false;
+  }
+  if (!(settings.ceilingDb >= -20 && settings.ceilingDb <= 0)) {
+    error = "ceilingDb must be between -20 and 0";
+    return false;
+  }
+  return true;
+}
+
+GainControl::GainControl(const GainSettings &settings)
+    : settings(settings), ceiling((float)DbToGain(settings.ceilingDb)) {}
+
+void GainControl::Configure(int sampleRate, int channels) {
+  this->channels = channels;
+
+  chunkFrames = std::max(1, sampleRate / 100);
+  double chunkMs = 1000.0 * chunkFrames / sampleRate;
+  attackCoef = ChunkCoefficient(settings.attackMs, chunkMs);
+  releaseCoef = ChunkCoefficient(settings.releaseMs, chunkMs);
+  chunkFilled = 0;
+  chunkEnergy = 0;
+  gainDb = 0;
+  gainFrom = gainTo = 1.0f;
+
+  lookAhead = std::max<size_t>(1, (size_t)sampleRate * kLookAheadMs / 1000);
+  limiterRelease =
+      (float)(1.0 - std::exp(-1000.0 / (kLimiterReleaseMs * sampleRate)));
+  work.assign(lookAhead * channels, 0.0f);
+  queueFrame.assign(lookAhead + 1, 0);
+  queueGain.assign(lookAhead + 1, 1.0f);
+  queueHead = 0;
+  queueSize = 0;
+  frameCount = 0;
+  released = 1.0f;
+  history.assign(lookAhead, 1.0f);
+  historyPos = 0;
+  historySum = (double)lookAhead;
+}
+
+void GainControl::Process(AudioBlock &block) {
+  auto begin = std::chrono::steady_clock::now();
+  size_t frames = block.frames;
+  size_t ch = (size_t)channels;
+
+  ApplyAgc(block.samples, frames);
+
+  // Append the block behind the look-ahead frames still held back
+  work.resize((lookAhead + frames) * ch);
+  std::memcpy(work.data() + lookAhead * ch, block.samples,
+              frames * ch * sizeof(float));
+
+  // Gain each new frame needs to peak at the ceiling; one where under it
+  needed.resize(frames);
+  const float *in = work.data() + lookAhead * ch;
+  float *need = needed.data();
+  float limit = ceiling;
+  if (ch == 1) {
+    for (size_t i = 0; i < frames; i++)
+      need[i] = limit / std::max(std::fabs(in[i]), limit);
+  } else if (ch == 2) {
+    for (size_t i = 0; i < frames; i++) {
+      float peak = std::max(std::fabs(in[2 * i]), std::fabs(in[2 * i + 1]));
+      need[i] = limit / std::max(peak, limit);
+    }
+  } else {
+    for (size_t i = 0; i < frames; i++) {
+      float peak = limit;
+      for (size_t c = 0; c < ch; c++)
+        peak = std::max(peak, std::fabs(in[i * ch + c]));
+      need[i] = limit / peak;
+    }
+  }
+
+  LimiterEnvelope(frames);
+
+  // Delayed frames out, scaled by the envelope
+  const float *delayed = work.data();
+  const float *gain = gains.data();
+  float *out = block.samples;
+  if (ch == 1) {
+    for (size_t i = 0; i < frames; i++)
+      out[i] = delayed[i] * gain[i];
+  } else if (ch == 2) {
+    for (size_t i = 0; i < frames; i++) {
+      out[2 * i] = delayed[2 * i] * gain[i];
+      out[2 * i + 1] = delayed[2 * i + 1] * gain[i];
+    }
+  } else {
+    for (size_t i = 0; i < frames; i++)
+      for (size_t c = 0; c < ch; c++)
+        out[i * ch + c] = delayed[i * ch + c] * gain[i];
+  }
+  std::memmove(work.data(), work.data() + frames * ch,
+               lookAhead * ch * sizeof(float));
+
+  float lowest = 1.0f;
+  uint64_t limited = 0;
+  for (size_t i = 0; i < frames; i++) {
+    lowest = std::min(lowest, gain[i]);
+    limited += gain[i] < 0.9999f ? 1 : 0;
+  }
+  double reduction = lowest < 1.0f ? -20.0 * std::log10(lowest) : 0.0;
+  reductionDb.store(reduction, std::memory_order_relaxed);
+  if (reduction > maxReductionDb.load(std::memory_order_relaxed))
+    maxReductionDb.store(reduction, std::memory_order_relaxed);
+  limitedFrames.fetch_add(limited, std::memory_order_relaxed);
+
+  processingNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count(),
+                         std::memory_order_relaxed);
+}
+
+void GainControl::ApplyAgc(float *samples, size_t frames) {
+  size_t ch = (size_t)channels;
+  size_t pos = 0;
+  while (pos < frames) {
+    size_t n = std::min(frames - pos, chunkFrames - chunkFilled);
+    float *s = samples + pos * ch;
+
+    // Level is measured before the gain, so the gain follows the input
+    float energy = 0;
+    for (size_t i = 0; i < n * ch; i++)
+      energy += s[i] * s[i];
+    chunkEnergy += energy;
+
+    float step = (gainTo - gainFrom) / (float)chunkFrames;
+    float start = gainFrom + step * (float)chunkFilled;
+    if (ch == 1) {
+      for (size_t i = 0; i < n; i++)
+        s[i] *= start + step * (float)i;
+    } else if (ch == 2) {
+      for (size_t i = 0; i < n; i++) {
+        float g = start + step * (float)i;
+        s[2 * i] *= g;
+        s[2 * i + 1] *= g;
+      }
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        float g = start + step * (float)i;
+        for (size_t c = 0; c < ch; c++)
+          s[i * ch + c] *= g;
+      }
+    }
+
+    chunkFilled += n;
+    pos += n;
+    if (chunkFilled == chunkFrames) {
+      UpdateAgc(chunkEnergy / (double)(chunkFrames * ch));
+      chunkEnergy = 0;
+      chunkFilled = 0;
+    }
+  }
+}
+
+void GainControl::UpdateAgc(double meanSquare) {
+  gainFrom = gainTo;
+  double levelDb = 10.0 * std::log10(meanSquare + 1e-20);
+  if (levelDb > kGateDb) {
+    double desired = std::min(settings.maxGainDb,
+                              std::max(-settings.maxGainDb,
+                                       settings.targetLevelDb - levelDb));
+    double coef = desired < gainDb ? attackCoef : releaseCoef;
+    gainDb += (desired - gainDb) * coef;
+  }
+  gainTo = (float)DbToGain(gainDb);
+  agcGainDb.store(gainDb, std::memory_order_relaxed);
+}
+
+void GainControl::LimiterEnvelope(size_t frames) {
+  // Output frame i is frame n - lookAhead of the stream. Its gain averages
+  // lookAhead released minima, each over a window of needed gains that
+  // includes that frame, so it never exceeds what the frame needs.
+  gains.resize(frames);
+  size_t capacity = lookAhead + 1;
+  auto slot = [&](size_t k) {
+    size_t index = queueHead + k;
+    return index < capacity ? index : index - capacity;
+  };
+  for (size_t i = 0; i < frames; i++) {
+    uint64_t n = frameCount++;
+    float need = needed[i];
+
+    while (queueSize > 0 && queueGain[slot(queueSize - 1)] >= need)
+      queueSize--;
+    size_t back = slot(queueSize);
+    queueFrame[back] = n;
+    queueGain[back] = need;
+    queueSize++;
+    while (queueFrame[queueHead] + lookAhead < n) {
+      queueHead = slot(1);
+      queueSize--;
+    }
+
+    float held = queueGain[queueHead];
+    released = held < released ? held : released + (held - released) *
+                                                        limiterRelease;
+
+    historySum += (double)released - history[historyPos];
+    history[historyPos] = released;
+    if (++historyPos == lookAhead) {
+      // Re-add from scratch once per window so rounding cannot creep in
+      historyPos = 0;
+      historySum = 0;
+      for (float g : history)
+        historySum += g;
+    }
+    gains[i] = (float)(historySum / (double)lookAhead);
+  }
+}
+
+GainStats GainControl::Stats() const {
+  return {agcGainDb.load(std::memory_order_relaxed),
+          reductionDb.load(std::memory_order_relaxed),
+          maxReductionDb.load(std::memory_order_relaxed),
+          limitedFrames.load(std::memory_order_relaxed)};
+}
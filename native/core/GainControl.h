@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Settings of the gain control stage
+struct GainSettings {
+  double targetLevelDb = -18; // Speech RMS aimed for, dBFS
+  double maxGainDb = 24;      // Largest boost, and largest cut, of the AGC
+  double attackMs = 50;       // Time constant of gain decreases
+  double releaseMs = 500;     // Time constant of gain increases
+  double ceilingDb = -1;      // Limiter output peak, dBFS
+};
+
+// Checks the ranges the stage supports; false with error set otherwise
+bool ValidateGainSettings(const GainSettings &settings, std::string &error);
+
+// Gain-control telemetry, readable from any thread
+struct GainStats {
+  double agcGainDb;          // Gain the AGC applies now
+  double reductionDb;        // Limiter gain reduction in the last block
+  double maxReductionDb;     // Deepest limiter gain reduction so far
+  uint64_t limitedFrames;    // Frames the limiter turned down
+};
+
+// Automatic gain control followed by a look-ahead peak limiter, all channels
+// linked. The AGC measures the RMS level every 10 ms and moves its gain
+// towards targetLevelDb, holding it through quiet passages so noise is not
+// pumped up. The limiter looks kLookAheadMs ahead: the smallest gain any
+// frame in that window needs to stay under the ceiling is released slowly
+// and averaged over the window, so the gain is already down when a peak
+// arrives and nothing passes the ceiling. Audio comes out delayed by
+// Latency() frames.
+//
+// Gain ramps, peak detection and gain application run as separate passes
+// over the block so they vectorise; only the limiter's envelope is a
+// per-frame recurrence.
+class GainControl : public CaptureStage {
+public:
+  static const int kLookAheadMs = 5;
+
+  explicit GainControl(const GainSettings &settings = GainSettings());
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+
+  size_t Latency() const { return lookAhead; }
+
+  GainStats Stats() const;
+
+  // Thread time spent in the stage since construction
+  double ProcessingTimeMs() const {
+    return processingNs.load(std::memory_order_relaxed) / 1e6;
+  }
+
+private:
+  // Apply the AGC gain ramp to frames of samples, updating it per chunk
+  void ApplyAgc(float *samples, size_t frames);
+  void UpdateAgc(double meanSquare);
+  // Per-frame limiter gain for the current block, into gains
+  void LimiterEnvelope(size_t frames);
+
+  GainSettings settings;
+  int channels = 0;
+  float ceiling;
+
+  // AGC: level measured over chunkFrames, gain ramped linearly across the
+  // next chunk from gainFrom to gainTo (linear factors)
+  size_t chunkFrames = 0;
+  size_t chunkFilled = 0;
+  double chunkEnergy = 0;
+  double gainDb = 0;
+  float gainFrom = 1.0f;
+  float gainTo = 1.0f;
+  double attackCoef = 0;
+  double releaseCoef = 0;
+
+  // Limiter
+  size_t lookAhead = 0;
+  float limiterRelease = 0;
+  std::vector<float> work;   // Delayed frames, then the current block
+  std::vector<float> needed; // Gain each frame needs, per block
+  std::vector<float> gains;  // Applied gain per output frame
+  // Sliding minimum of needed gains: monotonic queue of (frame, gain)
+  std::vector<uint64_t> queueFrame;
+  std::vector<float> queueGain;
+  size_t queueHead = 0;
+  size_t queueSize = 0;
+  uint64_t frameCount = 0;
+  float released = 1.0f;
+  // Moving average of the released gain over the look-ahead window
+  std::vector<float> history;
+  size_t historyPos = 0;
+  double historySum = 0;
+
+  std::atomic<double> agcGainDb{0};
+  std::atomic<double> reductionDb{0};
+  std::atomic<double> maxReductionDb{0};
+  std::atomic<uint64_t> limitedFrames{0};
+  std::atomic<int64_t> processingNs{0};
+};
@@ -0,0 +1,374 @@
+#include "MappedCapture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kMagic[8] = {'N', 'R', 'C', 'A', 'P', 'M', 'A', 'P'};
+
+#ifdef _WIN32
+std::wstring WidePath(const std::string &path) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+  std::wstring wide(length > 0 ? length : 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+  return wide;
+}
+#endif
+
+} // namespace
+
+bool ValidateMappedCaptureSettings(const MappedCaptureSettings &settings,
+                                   std::string &error) {
+  if (settings.path.empty()) {
+    error = "path must not be empty";
+    return false;
+  }
+  if (settings.mode != MappedMode::Append &&
+      settings.mode != MappedMode::Ring) {
+    error = "mode must be 'append' or 'ring'";
+    return false;
+  }
+  if (!(settings.seconds > 0 && settings.seconds <= 86400)) {
+    error = "seconds must be greater than 0 and at most 86400";
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// MappedFile
+
+bool MappedFile::Create(const std::string &path, size_t size, bool populate,
+                        std::string &error) {
+  Close();
+#ifdef _WIN32
+  (void)populate;
+  // Readers open the file while it is written
+  HANDLE handle = CreateFileW(WidePath(path).c_str(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    error = "Failed to create " + path;
+    return false;
+  }
+  // Mapping a size past the end extends the file
+  HANDLE section =
+      CreateFileMappingW(handle, nullptr, PAGE_READWRITE,
+                         (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+  void *view = section ? MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, size)
+                       : nullptr;
+  if (!view) {
+    error = "Failed to map " + path;
+    if (section) {
+      CloseHandle(section);
+    }
+    CloseHandle(handle);
+    return false;
+  }
+  file = handle;
+  mapping = section;
+  data = (uint8_t *)view;
+#else
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    error = "Failed to create " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  bool sized = ftruncate(fd, (off_t)size) == 0;
+#ifdef __linux__
+  // Reserve the blocks now: running out of space later would be a SIGBUS
+  // on the capture thread. File systems without fallocate report
+  // EOPNOTSUPP and keep the sparse file.
+  int reserved = sized ? posix_fallocate(fd, 0, (off_t)size) : 0;
+  if (reserved != 0 && reserved != EOPNOTSUPP && reserved != EINVAL) {
+    errno = reserved;
+    sized = false;
+  }
+#endif
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (populate) {
+    flags |= MAP_POPULATE;
+  }
+#else
+  (void)populate;
+#endif
+  void *view = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, flags,
+                           fd, 0)
+                     : MAP_FAILED;
+  int mapError = errno;
+  close(fd);
+  if (view == MAP_FAILED) {
+    error = "Failed to map " + path + ": " + std::strerror(mapError);
+    return false;
+  }
+  data = (uint8_t *)view;
+#endif
+  this->size = size;
+  return true;
+}
+
+bool MappedFile::OpenForReading(const std::string &path, std::string &error) {
+  Close();
+#ifdef _WIN32
+  HANDLE handle = CreateFileW(WidePath(path).c_str(), GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    error = "Failed to open " + path;
+    return false;
+  }
+  LARGE_INTEGER length;
+  HANDLE section = nullptr;
+  void *view = nullptr;
+  if (GetFileSizeEx(handle, &length) && length.QuadPart > 0) {
+    section = CreateFileMappingW(handle, nullptr, PAGE_WRITECOPY, 0, 0,
+                                 nullptr);
+    view = section ? MapViewOfFile(section, FILE_MAP_COPY, 0, 0, 0)
+                   : nullptr;
+  }
+  if (!view) {
+    error = "Failed to map " + path;
+    if (section) {
+      CloseHandle(section);
+    }
+    CloseHandle(handle);
+    return false;
+  }
+  file = handle;
+  mapping = section;
+  data = (uint8_t *)view;
+  size = (size_t)length.QuadPart;
+#else
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = "Failed to open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat info;
+  void *view = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    view = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (view == MAP_FAILED) {
+    error = "Failed to map " + path;
+    return false;
+  }
+  data = (uint8_t *)view;
+  size = (size_t)info.st_size;
+#endif
+  return true;
+}
+
+void MappedFile::Close() {
+  if (!data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+  CloseHandle((HANDLE)mapping);
+  CloseHandle((HANDLE)file);
+  mapping = nullptr;
+  file = nullptr;
+#else
+  munmap(data, size);
+#endif
+  data = nullptr;
+  size = 0;
+}
+
+// ---------------------------------------------------------------------------
+// MappedCaptureWriter
+
+MappedCaptureWriter::MappedCaptureWriter(const MappedCaptureSettings &settings,
+                                         int sampleRate, int channels)
+    : settings(settings), sampleRate(sampleRate), channels(channels) {
+  capacityFrames = std::max<uint64_t>(
+      1, (uint64_t)std::llround(settings.seconds * sampleRate));
+}
+
+MappedCaptureWriter::~MappedCaptureWriter() { Close(); }
+
+bool MappedCaptureWriter::Open(std::string &error) {
+  uint64_t bytes = MappedCaptureHeader::kDataOffset +
+                   capacityFrames * channels * sizeof(int16_t);
+  if (bytes > (uint64_t)SIZE_MAX) {
+    error = "seconds is too large to map";
+    return false;
+  }
+  // A ring is touched all over within its first lap, so fault it in now
+  // rather than on the capture thread
+  if (!file.Create(settings.path, (size_t)bytes,
+                   settings.mode == MappedMode::Ring, error)) {
+    return false;
+  }
+
+  header = new (file.Data()) MappedCaptureHeader();
+  header->version = MappedCaptureHeader::kVersion;
+  header->dataOffset = MappedCaptureHeader::kDataOffset;
+  header->sampleRate = (uint32_t)sampleRate;
+  header->channels = (uint32_t)channels;
+  header->mode = (uint32_t)settings.mode;
+  header->reserved = 0;
+  header->capacityFrames = capacityFrames;
+  header->writtenFrames.store(0, std::memory_order_relaxed);
+  header->writingFrames.store(0, std::memory_order_relaxed);
+  header->droppedFrames.store(0, std::memory_order_relaxed);
+  header->closed.store(0, std::memory_order_relaxed);
+  samples = (int16_t *)(file.Data() + MappedCaptureHeader::kDataOffset);
+  // The magic goes in last, so a reader never sees a half-written header
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, kMagic, sizeof(kMagic));
+  return true;
+}
+
+void MappedCaptureWriter::Write(const int16_t *data, size_t sampleCount) {
+  if (!header) {
+    return;
+  }
+  uint64_t frames = sampleCount / channels;
+  uint64_t written = header->writtenFrames.load(std::memory_order_relaxed);
+
+  if (settings.mode == MappedMode::Append) {
+    uint64_t count = std::min(frames, capacityFrames - written);
+    if (count < frames) {
+      header->droppedFrames.fetch_add(frames - count,
+                                      std::memory_order_relaxed);
+    }
+    if (count == 0) {
+      return;
+    }
+    std::memcpy(samples + written * channels, data,
+                count * channels * sizeof(int16_t));
+    header->writtenFrames.store(written + count, std::memory_order_release);
+    return;
+  }
+
+  // Ring: only the latest capacity frames of the block can survive
+  if (frames > capacityFrames) {
+    data += (frames - capacityFrames) * channels;
+    written += frames - capacityFrames;
+    frames = capacityFrames;
+  }
+  header->writingFrames.store(written + frames, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  uint64_t position = written % capacityFrames;
+  uint64_t first = std::min(frames, capacityFrames - position);
+  std::memcpy(samples + position * channels, data,
+              first * channels * sizeof(int16_t));
+  std::memcpy(samples, data + first * channels,
+              (frames - first) * channels * sizeof(int16_t));
+  header->writtenFrames.store(written + frames, std::memory_order_release);
+}
+
+void MappedCaptureWriter::Close() {
+  if (!header) {
+    return;
+  }
+  header->closed.store(1, std::memory_order_release);
+  header = nullptr;
+  samples = nullptr;
+  file.Close();
+}
+
+uint64_t MappedCaptureWriter::WrittenFrames() const {
+  return header ? header->writtenFrames.load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t MappedCaptureWriter::DroppedFrames() const {
+  return header ? header->droppedFrames.load(std::memory_order_relaxed) : 0;
+}
+
+// ---------------------------------------------------------------------------
+// MappedCaptureReader
+
+bool MappedCaptureReader::Open(const std::string &path, std::string &error) {
+  Close();
+  auto mapped = std::make_shared<MappedFile>();
+  if (!mapped->OpenForReading(path, error)) {
+    return false;
+  }
+  const MappedCaptureHeader *mappedHeader =
+      (const MappedCaptureHeader *)mapped->Data();
+  bool valid =
+      mapped->Size() >= MappedCaptureHeader::kDataOffset &&
+      std::memcmp(mappedHeader->magic, kMagic, sizeof(kMagic)) == 0 &&
+      mappedHeader->version == MappedCaptureHeader::kVersion &&
+      mappedHeader->dataOffset == MappedCaptureHeader::kDataOffset &&
+      mappedHeader->channels > 0 && mappedHeader->capacityFrames > 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (valid) {
+    uint64_t dataBytes = mappedHeader->capacityFrames *
+                         mappedHeader->channels * sizeof(int16_t);
+    valid = dataBytes <= mapped->Size() - MappedCaptureHeader::kDataOffset;
+  }
+  if (!valid) {
+    error = path + " is not a mapped capture file";
+    return false;
+  }
+  file = mapped;
+  header = mappedHeader;
+  samples =
+      (const int16_t *)(mapped->Data() + MappedCaptureHeader::kDataOffset);
+  return true;
+}
+
+void MappedCaptureReader::Close() {
+  file.reset();
+  header = nullptr;
+  samples = nullptr;
+}
+
+size_t MappedCaptureReader::Read(uint64_t &startFrame, size_t maxFrames,
+                                 int16_t *out) const {
+  uint64_t capacity = header->capacityFrames;
+  size_t channels = header->channels;
+  bool ring = Mode() == MappedMode::Ring;
+
+  uint64_t end = header->writtenFrames.load(std::memory_order_acquire);
+  uint64_t oldest = ring && end > capacity ? end - capacity : 0;
+  startFrame = std::max(startFrame, oldest);
+  if (startFrame >= end) {
+    return 0;
+  }
+  uint64_t frames = std::min<uint64_t>(maxFrames, end - startFrame);
+  uint64_t position = startFrame % capacity;
+  uint64_t first = std::min(frames, capacity - position);
+  std::memcpy(out, samples + position * channels,
+              first * channels * sizeof(int16_t));
+  std::memcpy(out + first * channels, samples,
+              (frames - first) * channels * sizeof(int16_t));
+  if (!ring) {
+    return (size_t)frames;
+  }
+
+  // Frames the writer had started to overwrite by the end of the copy
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t writing = header->writingFrames.load(std::memory_order_relaxed);
+  uint64_t safe = writing > capacity ? writing - capacity : 0;
+  if (safe > startFrame) {
+    uint64_t lost = std::min(frames, safe - startFrame);
+    std::memmove(out, out + lost * channels,
+                 (frames - lost) * channels * sizeof(int16_t));
+    startFrame += lost;
+    frames -= lost;
+  }
+  return (size_t)frames;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// How a memory-mapped capture file uses its fixed capacity
+enum class MappedMode : uint32_t {
+  Append = 0, // Fill once, then count the frames that did not fit
+  Ring = 1,   // Wrap around, keeping the latest capacity frames
+};
+
+// Settings of a memory-mapped capture file
+struct MappedCaptureSettings {
+  std::string path; // Empty when no mapped file is written
+  MappedMode mode = MappedMode::Append;
+  double seconds = 60; // Capacity, preallocated when the file is created
+};
+
+// Checks the ranges the writer supports; false with error set otherwise
+bool ValidateMappedCaptureSettings(const MappedCaptureSettings &settings,
+                                   std::string &error);
+
+// First page of a mapped capture file, shared by the writer and any number
+// of readers in other threads or processes. Interleaved 16-bit PCM
+// follows at dataOffset; frame f of the stream is at f % capacityFrames.
+struct MappedCaptureHeader {
+  static const uint32_t kVersion = 1;
+  static const uint32_t kDataOffset = 4096;
+
+  char magic[8]; // "NRCAPMAP"
+  uint32_t version;
+  uint32_t dataOffset;
+  uint32_t sampleRate;
+  uint32_t channels;
+  uint32_t mode; // MappedMode
+  uint32_t reserved;
+  uint64_t capacityFrames;
+
+  // Frames written since the start. writingFrames moves ahead before a
+  // block is copied in, writtenFrames after it, so a ring reader can tell
+  // which of the frames it copied the writer may have overwritten.
+  alignas(64) std::atomic<uint64_t> writtenFrames;
+  alignas(64) std::atomic<uint64_t> writingFrames;
+  std::atomic<uint64_t> droppedFrames; // Append frames past the capacity
+  std::atomic<uint32_t> closed;        // Set once the writer is done
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the cursors are shared between processes");
+static_assert(sizeof(MappedCaptureHeader) <= MappedCaptureHeader::kDataOffset,
+              "the header must fit its page");
+
+// A file mapped into memory. Create makes the file at its full size up
+// front, so writes through the mapping never extend it. OpenForReading maps
+// an existing file copy-on-write: it follows the writer's changes, while a
+// stray write through a view only changes this process's copy.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool Create(const std::string &path, size_t size, bool populate,
+              std::string &error);
+  bool OpenForReading(const std::string &path, std::string &error);
+  void Close();
+
+  uint8_t *Data() const { return data; }
+  size_t Size() const { return size; }
+
+private:
+  uint8_t *data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  void *file = nullptr;    // HANDLE
+  void *mapping = nullptr; // HANDLE
+#endif
+};
+
+// Writes a stream's 16-bit PCM into a preallocated, memory-mapped file so
+// readers can follow it while it is recorded. Write() is a copy into the
+// mapping and a store of the cursor, with no system call, so it runs on the
+// capture thread.
+class MappedCaptureWriter {
+public:
+  MappedCaptureWriter(const MappedCaptureSettings &settings, int sampleRate,
+                      int channels);
+  ~MappedCaptureWriter();
+
+  bool Open(std::string &error);
+
+  // Interleaved samples, a whole number of frames
+  void Write(const int16_t *samples, size_t sampleCount);
+
+  // Mark the file finished and unmap it; the data stays on disk
+  void Close();
+
+  uint64_t WrittenFrames() const;
+  uint64_t DroppedFrames() const;
+
+private:
+  MappedCaptureSettings settings;
+  int sampleRate;
+  int channels;
+  uint64_t capacityFrames = 0;
+  MappedFile file;
+  MappedCaptureHeader *header = nullptr;
+  int16_t *samples = nullptr;
+};
+
+// Follows a mapped capture file, possibly while it is still written.
+// Nothing is locked: readers only load the cursors, and a ring reader
+// discards what the writer may have overwritten while it copied.
+class MappedCaptureReader {
+public:
+  bool Open(const std::string &path, std::string &error);
+  void Close();
+
+  int SampleRate() const { return header->sampleRate; }
+  int Channels() const { return header->channels; }
+  MappedMode Mode() const { return (MappedMode)header->mode; }
+  uint64_t CapacityFrames() const { return header->capacityFrames; }
+
+  uint64_t WrittenFrames() const {
+    return header->writtenFrames.load(std::memory_order_acquire);
+  }
+  uint64_t DroppedFrames() const {
+    return header->droppedFrames.load(std::memory_order_relaxed);
+  }
+  bool IsClosed() const {
+    return header->closed.load(std::memory_order_acquire) != 0;
+  }
+
+  // The data area, capacityFrames interleaved frames, for zero-copy access;
+  // valid while the mapping is alive
+  const int16_t *Samples() const { return samples; }
+  std::shared_ptr<MappedFile> Mapping() const { return file; }
+
+  // Copy up to maxFrames frames starting at frame startFrame into out.
+  // Frames a ring no longer holds are skipped; startFrame is moved to the
+  // first frame copied. Returns the number of frames copied.
+  size_t Read(uint64_t &startFrame, size_t maxFrames, int16_t *out) const;
+
+private:
+  std::shared_ptr<MappedFile> file;
+  const MappedCaptureHeader *header = nullptr;
+  const int16_t *samples = nullptr;
+};
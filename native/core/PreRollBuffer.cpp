@@ -0,0 +1,121 @@
+#include "PreRollBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const int MULAW_BIAS = 0x84;
+const int MULAW_CLIP = 32635;
+
+struct MuLawTable {
+  int16_t values[256];
+  MuLawTable() {
+    for (int i = 0; i < 256; i++) {
+      int v = ~i & 0xFF;
+      int exponent = (v >> 4) & 0x07;
+      int mantissa = v & 0x0F;
+      int magnitude = (((mantissa << 3) + MULAW_BIAS) << exponent) - MULAW_BIAS;
+      values[i] = (int16_t)((v & 0x80) ? -magnitude : magnitude);
+    }
+  }
+};
+
+const MuLawTable muLawTable;
+
+} // namespace
+
+PreRollBuffer::PreRollBuffer(size_t capacityFrames, int channels,
+                             Encoding encoding)
+    : channels(channels > 0 ? channels : 1), encoding(encoding),
+      capacity(capacityFrames * (channels > 0 ? channels : 1)), writePos(0),
+      sampleCount(0) {
+  if (encoding == Encoding::MuLaw) {
+    mulaw.resize(capacity);
+  } else {
+    pcm.resize(capacity);
+  }
+}
+
+uint8_t PreRollBuffer::EncodeMuLaw(int16_t sample) {
+  int sign = (sample >> 8) & 0x80;
+  int magnitude = sign ? -(int)sample : sample;
+  if (magnitude > MULAW_CLIP)
+    magnitude = MULAW_CLIP;
+  magnitude += MULAW_BIAS;
+
+  int exponent = 7;
+  for (int mask = 0x4000; (magnitude & mask) == 0 && exponent > 0;
+       mask >>= 1) {
+    exponent--;
+  }
+  int mantissa = (magnitude >> (exponent + 3)) & 0x0F;
+  return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+int16_t PreRollBuffer::DecodeMuLaw(uint8_t value) {
+  return muLawTable.values[value];
+}
+
+void PreRollBuffer::Store(size_t pos, const int16_t *samples, size_t count) {
+  if (encoding == Encoding::MuLaw) {
+    uint8_t *dst = mulaw.data() + pos;
+    for (size_t i = 0; i < count; i++) {
+      dst[i] = EncodeMuLaw(samples[i]);
+    }
+  } else {
+    memcpy(pcm.data() + pos, samples, count * sizeof(int16_t));
+  }
+}
+
+void PreRollBuffer::Load(size_t pos, int16_t *samples, size_t count) const {
+  if (encoding == Encoding::MuLaw) {
+    const uint8_t *src = mulaw.data() + pos;
+    for (size_t i = 0; i < count; i++) {
+      samples[i] = DecodeMuLaw(src[i]);
+    }
+  } else {
+    memcpy(samples, pcm.data() + pos, count * sizeof(int16_t));
+  }
+}
+
+void PreRollBuffer::Write(const int16_t *samples, size_t count) {
+  if (capacity == 0 || count == 0)
+    return;
+
+  // Only the newest `capacity` samples can survive this write
+  if (count > capacity) {
+    samples += count - capacity;
+    count = capacity;
+  }
+
+  size_t first = std::min(count, capacity - writePos);
+  Store(writePos, samples, first);
+  if (count > first) {
+    Store(0, samples + first, count - first);
+  }
+
+  writePos = (writePos + count) % capacity;
+  sampleCount = std::min(capacity, sampleCount + count);
+}
+
+size_t PreRollBuffer::ReadLatest(size_t maxFrames,
+                                 std::vector<int16_t> &out) const {
+  size_t frames = std::min(maxFrames, FrameCount());
+  size_t count = frames * channels;
+  out.resize(count);
+  if (count == 0)
+    return 0;
+
+  size_t start = (writePos + capacity - count) % capacity;
+  size_t first = std::min(count, capacity - start);
+  Load(start, out.data(), first);
+  if (count > first) {
+    Load(0, out.data() + first, count - first);
+  }
+  return frames;
+}
+
+void PreRollBuffer::Clear() {
+  writePos = 0;
+  sampleCount = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-duration history of the most recent 16-bit PCM audio, kept in native
+// memory while a prepared stream is idle. Not thread-safe: it is written and
+// drained from the capture thread only.
+class PreRollBuffer {
+public:
+  // How retained samples are stored
+  enum class Encoding {
+    Pcm16, // Lossless, 2 bytes per sample
+    MuLaw  // G.711 mu-law, 1 byte per sample
+  };
+
+  PreRollBuffer(size_t capacityFrames, int channels,
+                Encoding encoding = Encoding::Pcm16);
+
+  // Append interleaved samples, overwriting the oldest ones once full.
+  // sampleCount should be a whole number of frames.
+  void Write(const int16_t *samples, size_t sampleCount);
+
+  // Copy the newest maxFrames frames (oldest first) into out.
+  // Returns the number of frames copied.
+  size_t ReadLatest(size_t maxFrames, std::vector<int16_t> &out) const;
+
+  void Clear();
+
+  size_t FrameCount() const { return sampleCount / channels; }
+  size_t CapacityFrames() const { return capacity / channels; }
+  int Channels() const { return channels; }
+
+  static uint8_t EncodeMuLaw(int16_t sample);
+  static int16_t DecodeMuLaw(uint8_t value);
+
+private:
+  void Store(size_t pos, const int16_t *samples, size_t count);
+  void Load(size_t pos, int16_t *samples, size_t count) const;
+
+  int channels;
+  Encoding encoding;
+  size_t capacity;    // In samples, a multiple of channels
+  size_t writePos;    // Next sample slot to write
+  size_t sampleCount; // Samples currently held
+  std::vector<int16_t> pcm;
+  std::vector<uint8_t> mulaw;
+};
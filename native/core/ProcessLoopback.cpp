@@ -0,0 +1,185 @@
+#include "ProcessLoopback.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
+
+const char *const kProcessLoopbackPrefix = "process:";
+
+bool ParseProcessLoopbackId(const std::string &deviceId, int64_t &processId) {
+  const std::string prefix = kProcessLoopbackPrefix;
+  if (deviceId.compare(0, prefix.size(), prefix) != 0 ||
+      deviceId.size() == prefix.size() ||
+      deviceId.size() > prefix.size() + 10) {
+    return false;
+  }
+  int64_t value = 0;
+  for (size_t i = prefix.size(); i < deviceId.size(); i++) {
+    char c = deviceId[i];
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    value = value * 10 + (c - '0');
+  }
+  if (value <= 0 || value > 0xFFFFFFFFll) {
+    return false;
+  }
+  processId = value;
+  return true;
+}
+
+std::string ProcessLoopbackId(int64_t processId) {
+  return kProcessLoopbackPrefix + std::to_string(processId);
+}
+
+int64_t SystemParentProcessId(int64_t pid, const std::string &procRoot) {
+#ifdef __APPLE__
+  (void)procRoot;
+  struct kinfo_proc info;
+  size_t size = sizeof(info);
+  int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, (int)pid};
+  if (sysctl(mib, 4, &info, &size, NULL, 0) != 0 || size == 0) {
+    return -1;
+  }
+  return info.kp_eproc.e_ppid;
+#else
+  // "pid (comm) state ppid ...", where comm may hold spaces and parentheses
+  std::ifstream file(procRoot + "/" + std::to_string(pid) + "/stat");
+  std::string line;
+  if (!std::getline(file, line)) {
+    return -1;
+  }
+  size_t end = line.rfind(')');
+  if (end == std::string::npos) {
+    return -1;
+  }
+  std::istringstream fields(line.substr(end + 1));
+  std::string state;
+  int64_t parent = -1;
+  if (!(fields >> state >> parent)) {
+    return -1;
+  }
+  return parent;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// ProcessTree
+
+ProcessTree::ProcessTree(ParentLookup parentOf)
+    : parentOf(std::move(parentOf)) {}
+
+bool ProcessTree::Contains(int64_t root, int64_t pid) {
+  // Walk up to init; the visited set guards against a cycle from reused
+  // PIDs between two lookups
+  std::set<int64_t> visited;
+  while (pid > 0 && visited.insert(pid).second) {
+    if (pid == root) {
+      return true;
+    }
+    auto it = parents.find(pid);
+    if (it == parents.end()) {
+      it = parents.emplace(pid, parentOf(pid)).first;
+    }
+    pid = it->second;
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// SinkInputSelector
+
+void SinkInputSelector::Update(const SinkInputInfo &info, Changes &changes) {
+  auto it = monitored.find(info.index);
+  bool wanted = info.processId > 0 && tree.Contains(root, info.processId);
+  if (it != monitored.end()) {
+    if (wanted && it->second.sink == info.sink) {
+      return;
+    }
+    changes.stop.push_back(info.index);
+    monitored.erase(it);
+  }
+  if (wanted) {
+    monitored[info.index] = info;
+    changes.start.push_back(info);
+  }
+}
+
+void SinkInputSelector::Remove(uint32_t index, Changes &changes) {
+  if (monitored.erase(index) > 0) {
+    changes.stop.push_back(index);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// LoopbackMixer
+
+void LoopbackMixer::AddSource(uint32_t id) {
+  size_t waiting = 0;
+  for (const auto &entry : sources) {
+    waiting = std::max(waiting, entry.second.Frames(channels));
+  }
+  Source &source = sources[id];
+  source.samples.assign(waiting * channels, 0.0f);
+  source.removed = false;
+}
+
+void LoopbackMixer::RemoveSource(uint32_t id) {
+  auto it = sources.find(id);
+  if (it != sources.end()) {
+    it->second.removed = true;
+  }
+}
+
+void LoopbackMixer::Write(uint32_t id, const float *samples, size_t frames) {
+  auto it = sources.find(id);
+  if (it != sources.end()) {
+    it->second.samples.insert(it->second.samples.end(), samples,
+                              samples + frames * channels);
+  }
+}
+
+size_t LoopbackMixer::Read(std::vector<float> &out) {
+  // Every live source has its frames, unless one lags too far behind
+  size_t most = 0;
+  size_t ready = SIZE_MAX;
+  for (const auto &entry : sources) {
+    size_t frames = entry.second.Frames(channels);
+    most = std::max(most, frames);
+    if (!entry.second.removed) {
+      ready = std::min(ready, frames);
+    }
+  }
+  if (ready == SIZE_MAX) {
+    ready = most;
+  }
+  if (most > maxSkewFrames) {
+    ready = std::max(ready, most - maxSkewFrames);
+  }
+
+  out.assign(ready * channels, 0.0f);
+  for (auto it = sources.begin(); it != sources.end();) {
+    Source &source = it->second;
+    // A source with less is short of silence, and carries on level with
+    // the mix
+    size_t count = std::min(ready, source.Frames(channels)) * channels;
+    for (size_t i = 0; i < count; i++) {
+      out[i] += source.samples[i];
+    }
+    source.samples.erase(source.samples.begin(),
+                         source.samples.begin() + count);
+    if (source.removed && source.samples.empty()) {
+      it = sources.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return ready;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Output device IDs of the form "process:<pid>" capture only what that
+// process and its descendants play. Each platform resolves the target its
+// own way: WASAPI activates a process loopback client, ScreenCaptureKit
+// filters by application, PulseAudio monitors the matching sink inputs.
+extern const char *const kProcessLoopbackPrefix; // "process:"
+
+// The process ID of a process loopback device ID; false for any other ID
+bool ParseProcessLoopbackId(const std::string &deviceId, int64_t &processId);
+std::string ProcessLoopbackId(int64_t processId);
+
+// Parent process of pid, or -1 if it is unknown or has exited: read from
+// <procRoot>/<pid>/stat on Linux, from sysctl on macOS
+int64_t SystemParentProcessId(int64_t pid,
+                              const std::string &procRoot = "/proc");
+
+// Answers whether a process descends from another. Parents are looked up
+// once each and cached until Refresh(), since processes come and go but
+// keep their parent. Not thread-safe.
+class ProcessTree {
+public:
+  using ParentLookup = std::function<int64_t(int64_t pid)>;
+
+  explicit ProcessTree(ParentLookup parentOf);
+
+  // True if pid is root or a descendant of it
+  bool Contains(int64_t root, int64_t pid);
+  void Refresh() { parents.clear(); }
+
+private:
+  ParentLookup parentOf;
+  std::map<int64_t, int64_t> parents;
+};
+
+// What a PulseAudio sink input reports about itself
+struct SinkInputInfo {
+  uint32_t index = 0;
+  uint32_t sink = 0;         // Sink it plays to
+  int64_t processId = -1;    // application.process.id, -1 when absent
+};
+
+// Chooses the sink inputs of a process tree to monitor, from the server's
+// new, change and remove events. Each call reports the monitor streams to
+// stop and to start; a sink input that moves to another sink is restarted
+// on the new sink's monitor.
+class SinkInputSelector {
+public:
+  struct Changes {
+    std::vector<uint32_t> stop;           // Sink input indices
+    std::vector<SinkInputInfo> start;
+  };
+
+  SinkInputSelector(int64_t root, ProcessTree &tree)
+      : root(root), tree(tree) {}
+
+  void Update(const SinkInputInfo &info, Changes &changes);
+  void Remove(uint32_t index, Changes &changes);
+
+  // Sink inputs being monitored, by index
+  const std::map<uint32_t, SinkInputInfo> &Monitored() const {
+    return monitored;
+  }
+
+private:
+  int64_t root;
+  ProcessTree &tree;
+  std::map<uint32_t, SinkInputInfo> monitored;
+};
+
+// Sums interleaved float audio from sources that come and go, such as the
+// monitor streams of a process's sink inputs. A source that falls more than
+// maxSkewFrames behind the others (paused, or no longer played) stops
+// holding the mix back and is filled with silence; a new source starts level
+// with the audio already waiting. Buffers keep their capacity. Not
+// thread-safe.
+class LoopbackMixer {
+public:
+  LoopbackMixer(int channels, size_t maxSkewFrames)
+      : channels(channels), maxSkewFrames(maxSkewFrames) {}
+
+  int Channels() const { return channels; }
+
+  void AddSource(uint32_t id);
+  // The source's buffered audio is still mixed, but it no longer holds the
+  // mix back
+  void RemoveSource(uint32_t id);
+  void Write(uint32_t id, const float *samples, size_t frames);
+
+  // Replace out with every frame that can be mixed now; returns the frame
+  // count
+  size_t Read(std::vector<float> &out);
+
+  size_t SourceCount() const { return sources.size(); }
+
+private:
+  struct Source {
+    std::vector<float> samples; // Not mixed yet
+    bool removed = false;
+
+    size_t Frames(int channels) const { return samples.size() / channels; }
+  };
+
+  int channels;
+  size_t maxSkewFrames;
+  std::map<uint32_t, Source> sources;
+};
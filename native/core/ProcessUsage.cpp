@@ -0,0 +1,46 @@
+#include "ProcessUsage.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <libproc.h>
+#endif
+
+bool ReadProcessUsage(ProcessUsage &usage) {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel,
+                       &user)) {
+    return false;
+  }
+  auto ticks = [](const FILETIME &time) {
+    return ((int64_t)time.dwHighDateTime << 32) | time.dwLowDateTime;
+  };
+  // FILETIME counts 100 ns units
+  usage.cpuNs = (ticks(kernel) + ticks(user)) * 100;
+  usage.wakeups = 0;
+  return true;
+#else
+  struct rusage self;
+  if (getrusage(RUSAGE_SELF, &self) != 0) {
+    return false;
+  }
+  usage.cpuNs =
+      ((int64_t)self.ru_utime.tv_sec + self.ru_stime.tv_sec) * 1000000000 +
+      ((int64_t)self.ru_utime.tv_usec + self.ru_stime.tv_usec) * 1000;
+  usage.wakeups = (uint64_t)self.ru_nvcsw + (uint64_t)self.ru_nivcsw;
+#ifdef __APPLE__
+  rusage_info_v2 info;
+  if (proc_pid_rusage(getpid(), RUSAGE_INFO_V2, (rusage_info_t *)&info) ==
+      0) {
+    usage.wakeups = info.ri_pkg_idle_wkups + info.ri_interrupt_wkups;
+  }
+#endif
+  return true;
+#endif
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU time and wakeups of the whole process, the cost a capture path adds
+// on top of its own threads (ScreenCaptureKit and the audio server do part
+// of their work in our process). Compare two readings to measure a stream.
+struct ProcessUsage {
+  int64_t cpuNs = 0;    // User plus system time of every thread
+  uint64_t wakeups = 0; // macOS: package idle plus interrupt wakeups, the
+                        // energy impact Activity Monitor reports.
+                        // Linux: context switches. Windows: 0.
+};
+
+// Read the current totals; false if the OS refused
+bool ReadProcessUsage(ProcessUsage &usage);
@@ -0,0 +1,326 @@
+#include "RecordingJournal.h"
+#include "FileSink.h"
+#include "WavHeader.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+const char *const kJournalMagic = "native-recorder-journal";
+const int kJournalVersion = 1;
+
+#ifdef _WIN32
+std::wstring WidePath(const std::string &path) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+  std::wstring wide(length > 0 ? length : 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+  return wide;
+}
+#endif
+
+std::FILE *OpenFile(const std::string &path, const char *mode) {
+#ifdef _WIN32
+  return _wfopen(WidePath(path).c_str(), WidePath(mode).c_str());
+#else
+  return std::fopen(path.c_str(), mode);
+#endif
+}
+
+bool FileExists(const std::string &path) {
+  std::FILE *file = OpenFile(path, "rb");
+  if (file) {
+    std::fclose(file);
+  }
+  return file != nullptr;
+}
+
+uint64_t FileSize(std::FILE *file) {
+#ifdef _WIN32
+  _fseeki64(file, 0, SEEK_END);
+  return (uint64_t)_ftelli64(file);
+#else
+  fseeko(file, 0, SEEK_END);
+  return (uint64_t)ftello(file);
+#endif
+}
+
+bool ReadAt(std::FILE *file, void *data, size_t size, uint64_t offset) {
+#ifdef _WIN32
+  bool seeked = _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+  bool seeked = fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+  return seeked && std::fread(data, 1, size, file) == size;
+}
+
+bool WriteAt(std::FILE *file, const void *data, size_t size,
+             uint64_t offset) {
+#ifdef _WIN32
+  bool seeked = _fseeki64(file, (int64_t)offset, SEEK_SET) == 0;
+#else
+  bool seeked = fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+  return seeked && std::fwrite(data, 1, size, file) == size;
+}
+
+uint32_t Get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void Put32(uint8_t *p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+}
+
+// What a journal left behind by a crash says about the recording
+struct JournalState {
+  int sampleRate = 0;
+  int channels = 0;
+  std::map<uint32_t, uint64_t> syncedFrames; // By segment index
+};
+
+bool ReadJournal(const std::string &path, JournalState &state) {
+  std::FILE *file = OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  std::string text;
+  char buffer[4096];
+  size_t count;
+  while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.append(buffer, count);
+  }
+  std::fclose(file);
+
+  // Only whole lines count; a torn last line was never synced
+  size_t start = 0;
+  size_t end;
+  bool first = true;
+  while ((end = text.find('\n', start)) != std::string::npos) {
+    std::string line = text.substr(start, end - start);
+    start = end + 1;
+    char magic[32];
+    int version = 0;
+    uint32_t index = 0;
+    uint64_t frames = 0;
+    if (first) {
+      first = false;
+      if (std::sscanf(line.c_str(), "%31s %d %d %d", magic, &version,
+                      &state.sampleRate, &state.channels) != 4 ||
+          std::strcmp(magic, kJournalMagic) != 0 ||
+          version != kJournalVersion || state.sampleRate <= 0 ||
+          state.channels <= 0) {
+        return false;
+      }
+    } else if (std::sscanf(line.c_str(), "checkpoint %" SCNu32 " %" SCNu64,
+                           &index, &frames) == 2 ||
+               std::sscanf(line.c_str(), "finish %" SCNu32 " %" SCNu64,
+                           &index, &frames) == 2) {
+      uint64_t &synced = state.syncedFrames[index];
+      synced = std::max(synced, frames);
+    }
+  }
+  return !first;
+}
+
+} // namespace
+
+std::string JournalPath(const std::string &path) {
+  return SegmentPath(path, 0) + ".journal";
+}
+
+// ---------------------------------------------------------------------------
+// RecordingJournal
+
+bool RecordingJournal::Open(const std::string &journalPath, int sampleRate,
+                            int channels, std::string &error) {
+  path = journalPath;
+  size = 0;
+  if (!file.Open(path, false, error)) {
+    return false;
+  }
+  char line[96];
+  std::snprintf(line, sizeof(line), "%s %d %d %d\n", kJournalMagic,
+                kJournalVersion, sampleRate, channels);
+  if (!Append(line)) {
+    error = "Failed to write " + path;
+    Remove();
+    return false;
+  }
+  return true;
+}
+
+bool RecordingJournal::Checkpoint(uint32_t index, uint64_t frames) {
+  char line[64];
+  std::snprintf(line, sizeof(line), "checkpoint %" PRIu32 " %" PRIu64 "\n",
+                index, frames);
+  return Append(line);
+}
+
+bool RecordingJournal::Finish(uint32_t index, uint64_t frames) {
+  char line[64];
+  std::snprintf(line, sizeof(line), "finish %" PRIu32 " %" PRIu64 "\n",
+                index, frames);
+  return Append(line);
+}
+
+void RecordingJournal::Close() { file.Close(); }
+
+void RecordingJournal::Remove() {
+  if (file.IsOpen()) {
+    file.Close();
+    RemoveFile(path);
+  }
+}
+
+bool RecordingJournal::Append(const std::string &line) {
+  if (!file.WriteAt(line.data(), line.size(), size)) {
+    return false;
+  }
+  size += line.size();
+  return file.Sync();
+}
+
+// ---------------------------------------------------------------------------
+// Recovery
+
+bool RepairWavFile(const std::string &path, uint64_t &frames, bool &repaired,
+                   std::string &error) {
+  frames = 0;
+  repaired = false;
+  std::FILE *file = OpenFile(path, "r+b");
+  if (!file) {
+    error = "Failed to open " + path;
+    return false;
+  }
+  uint64_t size = FileSize(file);
+  uint8_t riff[12];
+  if (!ReadAt(file, riff, sizeof(riff), 0) ||
+      std::memcmp(riff, "RIFF", 4) != 0 ||
+      std::memcmp(riff + 8, "WAVE", 4) != 0) {
+    std::fclose(file);
+    error = path + " is not a WAV file";
+    return false;
+  }
+
+  uint32_t blockAlign = 0;
+  uint64_t dataOffset = 0;
+  uint64_t offset = 12;
+  uint8_t chunk[8];
+  while (offset + 8 <= size && ReadAt(file, chunk, sizeof(chunk), offset)) {
+    uint32_t chunkSize = Get32(chunk + 4);
+    if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16) {
+      uint8_t format[16];
+      if (ReadAt(file, format, sizeof(format), offset + 8)) {
+        blockAlign = format[12] | (format[13] << 8);
+      }
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      dataOffset = offset + 8;
+      break;
+    }
+    offset += 8 + (uint64_t)chunkSize + (chunkSize & 1);
+  }
+  if (dataOffset == 0 || blockAlign == 0) {
+    std::fclose(file);
+    error = path + " has no PCM data chunk";
+    return false;
+  }
+
+  // The tail of a crashed recording can end inside a frame
+  uint64_t dataBytes = size - dataOffset;
+  uint64_t maxDataBytes = 0xFFFFFFFFull - (dataOffset - 8);
+  dataBytes = std::min(dataBytes, maxDataBytes) / blockAlign * blockAlign;
+  frames = dataBytes / blockAlign;
+
+  uint8_t field[4];
+  bool ok = true;
+  if (Get32(riff + 4) != (uint32_t)(dataOffset - 8 + dataBytes)) {
+    Put32(field, (uint32_t)(dataOffset - 8 + dataBytes));
+    ok = WriteAt(file, field, sizeof(field), 4);
+    repaired = true;
+  }
+  if (ok && ReadAt(file, field, sizeof(field), dataOffset - 4) &&
+      Get32(field) != (uint32_t)dataBytes) {
+    Put32(field, (uint32_t)dataBytes);
+    ok = WriteAt(file, field, sizeof(field), dataOffset - 4);
+    repaired = true;
+  }
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    error = "Failed to repair " + path;
+  }
+  return ok;
+}
+
+bool RecoverRecording(const std::string &path,
+                      std::vector<RecoveredSegment> &segments,
+                      std::string &error) {
+  segments.clear();
+  std::string journalPath = JournalPath(path);
+  JournalState journal;
+  bool hasJournal = ReadJournal(journalPath, journal);
+
+  for (uint32_t index = 0;; index++) {
+    std::string segmentPath = SegmentPath(path, index);
+    std::FILE *file = OpenFile(segmentPath, "r+b");
+    if (!file) {
+      if (index > 0) {
+        break;
+      }
+      error = (FileExists(segmentPath) ? "Failed to open "
+                                       : "No recording at ") +
+              segmentPath;
+      return false;
+    }
+    uint64_t size = FileSize(file);
+    uint8_t magic[4] = {};
+    ReadAt(file, magic, sizeof(magic), 0);
+
+    // Nothing reached the file: opened ahead of a rotation, or its first
+    // block was still in memory
+    if (size < kWavHeaderSize && (hasJournal || index > 0)) {
+      std::fclose(file);
+      RemoveFile(segmentPath);
+      continue;
+    }
+    // A crash of the machine can leave the first block unwritten while
+    // later ones made it; the journal still knows the format
+    bool rebuilt = false;
+    if (hasJournal && std::memcmp(magic, "RIFF", 4) != 0) {
+      uint8_t header[kWavHeaderSize];
+      BuildWavHeader(header, journal.sampleRate, journal.channels, 0);
+      rebuilt = WriteAt(file, header, sizeof(header), 0);
+    }
+    if (std::fclose(file) != 0) {
+      rebuilt = false;
+    }
+
+    RecoveredSegment segment;
+    segment.path = segmentPath;
+    segment.index = index;
+    auto synced = journal.syncedFrames.find(index);
+    segment.checkpointFrames =
+        synced != journal.syncedFrames.end() ? synced->second : 0;
+    if (!RepairWavFile(segmentPath, segment.frames, segment.repaired,
+                       error)) {
+      return false;
+    }
+    segment.repaired = segment.repaired || rebuilt;
+    segments.push_back(segment);
+  }
+
+  if (hasJournal) {
+    RemoveFile(journalPath);
+  }
+  return true;
+}
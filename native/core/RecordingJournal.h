@@ -0,0 +1,65 @@
+#pragma once
+
+#include "DiskWriter.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sidecar journal of a recording's path, next to its first segment
+std::string JournalPath(const std::string &path);
+
+// Write-ahead index of a native recording in progress. A line is appended
+// and synced whenever frames of a segment are known to be on disk, and when
+// a segment is finished; the file is removed once the recording closes
+// cleanly. Its presence after a crash says which files to repair and how
+// much of each is durable. Not thread safe: the FileSink drives it from the
+// DiskWriter's thread.
+class RecordingJournal {
+public:
+  bool Open(const std::string &path, int sampleRate, int channels,
+            std::string &error);
+
+  // frames of segment index are synced to disk
+  bool Checkpoint(uint32_t index, uint64_t frames);
+
+  // Segment index has its final header and was closed
+  bool Finish(uint32_t index, uint64_t frames);
+
+  // Close, keeping the file for recovery
+  void Close();
+
+  // Close and delete the file, after a clean end of the recording
+  void Remove();
+
+private:
+  bool Append(const std::string &line);
+
+  DiskFile file;
+  std::string path;
+  uint64_t size = 0;
+};
+
+// A WAV file as found, or as left, by RecoverRecording
+struct RecoveredSegment {
+  std::string path;
+  uint32_t index;
+  uint64_t frames;           // Whole frames of audio in the file
+  uint64_t checkpointFrames; // Known synced by the journal, 0 without one
+  bool repaired;             // Its header was rewritten
+};
+
+// Rewrite the size fields of a WAV file from the data actually in it,
+// rounded down to whole frames. Other chunks are kept; the data chunk is
+// taken to run to the end of the file.
+bool RepairWavFile(const std::string &path, uint64_t &frames, bool &repaired,
+                   std::string &error);
+
+// Repair the segments of an interrupted recording made to path, the path
+// given to the file sink, or a single WAV file. Segments are found by
+// their numbered paths; one the writer had only opened ahead is removed.
+// With a journal the headers of files that never got one are rebuilt from
+// the recorded format, and the journal is removed afterwards.
+bool RecoverRecording(const std::string &path,
+                      std::vector<RecoveredSegment> &segments,
+                      std::string &error);
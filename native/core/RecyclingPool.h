@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Objects handed from a capture thread to another thread and back. The
+// pool starts with copies of a prototype, sized for the stream's format,
+// and only creates more when every one is in use; a stream that has warmed
+// up reuses them without touching the heap. Thread safe.
+template <typename T> class RecyclingPool {
+public:
+  RecyclingPool(size_t count, const T &prototype) : prototype(prototype) {
+    items.reserve(count);
+    free.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      items.push_back(std::make_unique<T>(prototype));
+      free.push_back(items.back().get());
+    }
+  }
+
+  // A free object, or a new copy of the prototype when none is left
+  T *Acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free.empty()) {
+      items.push_back(std::make_unique<T>(prototype));
+      // Room for every object, so Release never has to grow the list
+      free.reserve(items.size());
+      return items.back().get();
+    }
+    T *item = free.back();
+    free.pop_back();
+    return item;
+  }
+
+  void Release(T *item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free.push_back(item);
+  }
+
+  // Objects created so far
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return items.size();
+  }
+
+private:
+  T prototype;
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<T>> items;
+  std::vector<T *> free;
+};
@@ -0,0 +1,140 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// Keep the passband a little below the lower Nyquist so the transition band
+// of the short kernel stays out of the audible range it would alias into
+const double kCutoff = 0.92;
+
+} // namespace
+
+Resampler::Resampler(int channels, double inputRate, double outputRate)
+    : channels(channels), step(inputRate / outputRate),
+      table((kPhases + 1) * 2 * kHalfTaps), kernel(2 * kHalfTaps),
+      sums(channels) {
+  // Cutoff relative to the input Nyquist: below it when downsampling
+  double cutoff = kCutoff * std::min(1.0, outputRate / inputRate);
+  const int taps = 2 * kHalfTaps;
+
+  for (int p = 0; p <= kPhases; p++) {
+    double frac = (double)p / kPhases;
+    float *row = &table[p * taps];
+    double sum = 0;
+    for (int t = 0; t < taps; t++) {
+      // Tap t sits at input offset t - kHalfTaps + 1 from the integer part
+      double x = t - kHalfTaps + 1 - frac;
+      double sinc =
+          x == 0 ? 1.0 : std::sin(kPi * cutoff * x) / (kPi * cutoff * x);
+      double w = (x + kHalfTaps) / (2.0 * kHalfTaps);
+      double blackman = 0.42 - 0.5 * std::cos(2 * kPi * w) +
+                        0.08 * std::cos(4 * kPi * w);
+      double value = w <= 0 || w >= 1 ? 0.0 : sinc * blackman;
+      row[t] = (float)value;
+      sum += value;
+    }
+    // Unity gain at DC for every phase
+    for (int t = 0; t < taps; t++) {
+      row[t] = (float)(row[t] / sum);
+    }
+  }
+
+  Reset();
+}
+
+void Resampler::Reset() {
+  // Start with kHalfTaps frames of silence so the first output, centred on
+  // the first input frame, needs no earlier input
+  history.assign((size_t)2 * kHalfTaps * channels, 0.0f);
+  historyFrames = kHalfTaps;
+  position = kHalfTaps;
+}
+
+void Resampler::Reserve(size_t frames) {
+  // At most 2 * kHalfTaps + 1 frames are kept between calls
+  history.reserve((frames + 2 * kHalfTaps + 2) * channels);
+}
+
+size_t Resampler::Process(const float *input, size_t inFrames,
+                          std::vector<float> &out) {
+  const int taps = 2 * kHalfTaps;
+  size_t needed = (historyFrames + inFrames) * channels;
+  if (history.size() < needed) {
+    history.resize(needed);
+  }
+  memcpy(history.data() + historyFrames * channels, input,
+         inFrames * channels * sizeof(float));
+  historyFrames += inFrames;
+
+  // Size the output for every frame that can complete, then trim
+  size_t base = out.size();
+  size_t room = 0;
+  if (historyFrames > position + kHalfTaps) {
+    room = (size_t)((historyFrames - kHalfTaps - position) / step) + 2;
+  }
+  out.resize(base + room * channels);
+
+  float *coef = kernel.data();
+  float *acc = sums.data();
+  size_t produced = 0;
+  while (produced < room) {
+    size_t index = (size_t)position;
+    if (index + kHalfTaps >= historyFrames) {
+      break;
+    }
+    double phase = (position - index) * kPhases;
+    int p = std::min((int)phase, kPhases - 1);
+    float mix = (float)(phase - p);
+    const float *row0 = &table[p * taps];
+    const float *row1 = row0 + taps;
+    for (int t = 0; t < taps; t++) {
+      coef[t] = row0[t] + mix * (row1[t] - row0[t]);
+    }
+
+    const float *src = history.data() + (index + 1 - kHalfTaps) * channels;
+    float *dst = out.data() + base + produced * channels;
+    if (channels == 1) {
+      float sum = 0.0f;
+      for (int t = 0; t < taps; t++) {
+        sum += coef[t] * src[t];
+      }
+      dst[0] = sum;
+    } else if (channels == 2) {
+      float left = 0.0f, right = 0.0f;
+      for (int t = 0; t < taps; t++) {
+        left += coef[t] * src[2 * t];
+        right += coef[t] * src[2 * t + 1];
+      }
+      dst[0] = left;
+      dst[1] = right;
+    } else {
+      std::fill(acc, acc + channels, 0.0f);
+      for (int t = 0; t < taps; t++) {
+        const float *frame = src + t * channels;
+        for (int ch = 0; ch < channels; ch++) {
+          acc[ch] += coef[t] * frame[ch];
+        }
+      }
+      memcpy(dst, acc, channels * sizeof(float));
+    }
+    produced++;
+    position += step;
+  }
+  out.resize(base + produced * channels);
+
+  // Drop the frames no future output can reach
+  size_t index = (size_t)position;
+  if (index + 1 > (size_t)kHalfTaps) {
+    size_t drop = std::min(index + 1 - kHalfTaps, historyFrames);
+    memmove(history.data(), history.data() + drop * channels,
+            (historyFrames - drop) * channels * sizeof(float));
+    historyFrames -= drop;
+    position -= drop;
+  }
+  return produced;
+}
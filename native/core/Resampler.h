@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Streaming sample rate converter for interleaved float audio. Band-limited
+// interpolation with a Blackman-windowed sinc, tabulated at kPhases
+// fractional offsets and linearly interpolated between them, so any ratio
+// works and the ratio may change between calls. Output frame j is the input
+// at time j * Step(); it comes out once kHalfTaps more input frames have
+// arrived. Not thread-safe.
+class Resampler {
+public:
+  static const int kHalfTaps = 16; // Kernel is 2 * kHalfTaps input frames
+  static const int kPhases = 128;
+
+  Resampler(int channels, double inputRate, double outputRate);
+
+  // Consume inFrames frames and append every output frame that is now
+  // complete to out. Returns the number of frames appended.
+  size_t Process(const float *input, size_t inFrames, std::vector<float> &out);
+
+  // Input frames advanced per output frame, inputRate / outputRate. The
+  // cutoff stays where the constructor put it.
+  void SetStep(double step) { this->step = step; }
+  double Step() const { return step; }
+
+  int Channels() const { return channels; }
+
+  // Size the input history for calls of up to frames frames, so they do
+  // not allocate
+  void Reserve(size_t frames);
+
+  void Reset();
+
+private:
+  int channels;
+  double step;
+  // (kPhases + 1) rows of 2 * kHalfTaps coefficients; row p is the kernel
+  // for a fractional position of p / kPhases
+  std::vector<float> table;
+  std::vector<float> kernel; // Interpolated row for the current output
+  std::vector<float> sums;   // Per-channel accumulators
+  std::vector<float> history; // Input frames not yet fully consumed
+  size_t historyFrames = 0;
+  double position = 0; // Of the next output frame, in history frames
+};
@@ -0,0 +1,72 @@
+#include "SampleConvert.h"
+#include <cstring>
+
+size_t BytesPerSample(SampleEncoding encoding) {
+  switch (encoding) {
+  case SampleEncoding::Int16:
+    return 2;
+  case SampleEncoding::Int24:
+    return 3;
+  case SampleEncoding::Int32:
+  case SampleEncoding::Float32:
+    return 4;
+  }
+  return 0;
+}
+
+void ConvertToFloat(const uint8_t *src, SampleEncoding encoding, size_t count,
+                    float *dst) {
+  switch (encoding) {
+  case SampleEncoding::Float32:
+    memcpy(dst, src, count * sizeof(float));
+    break;
+  case SampleEncoding::Int16: {
+    const int16_t *pcmData = (const int16_t *)src;
+    for (size_t i = 0; i < count; i++) {
+      dst[i] = pcmData[i] / 32768.0f;
+    }
+    break;
+  }
+  case SampleEncoding::Int24: {
+    const uint8_t *ptr = src;
+    for (size_t i = 0; i < count; i++) {
+      int32_t sample = (int32_t)(((uint32_t)ptr[0] << 8) |
+                                 ((uint32_t)ptr[1] << 16) |
+                                 ((uint32_t)ptr[2] << 24));
+      dst[i] = sample / 2147483648.0f;
+      ptr += 3;
+    }
+    break;
+  }
+  case SampleEncoding::Int32: {
+    const int32_t *ptr = (const int32_t *)src;
+    for (size_t i = 0; i < count; i++) {
+      dst[i] = ptr[i] / 2147483648.0f;
+    }
+    break;
+  }
+  }
+}
+
+static inline int16_t ClampToInt16(float sample) {
+  if (sample > 1.0f)
+    sample = 1.0f;
+  if (sample < -1.0f)
+    sample = -1.0f;
+  return (int16_t)(sample * 32767.0f);
+}
+
+void ConvertFloatToInt16(const float *src, size_t count, int16_t *dst) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = ClampToInt16(src[i]);
+  }
+}
+
+void InterleaveFloatToInt16(const float *const *planes, int channels,
+                            size_t frames, int16_t *dst) {
+  for (size_t frame = 0; frame < frames; frame++) {
+    for (int ch = 0; ch < channels; ch++) {
+      dst[frame * channels + ch] = ClampToInt16(planes[ch][frame]);
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Sample encodings delivered by the platform capture APIs
+enum class SampleEncoding { Int16, Int24, Int32, Float32 };
+
+size_t BytesPerSample(SampleEncoding encoding);
+
+// Convert count packed little-endian samples to float in [-1, 1]
+void ConvertToFloat(const uint8_t *src, SampleEncoding encoding, size_t count,
+                    float *dst);
+
+// Clamp float samples to [-1, 1] and convert to 16-bit PCM
+void ConvertFloatToInt16(const float *src, size_t count, int16_t *dst);
+
+// Interleave planar float channels into 16-bit PCM, clamping like
+// ConvertFloatToInt16
+void InterleaveFloatToInt16(const float *const *planes, int channels,
+                            size_t frames, int16_t *dst);
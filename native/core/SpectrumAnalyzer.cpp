@@ -0,0 +1,165 @@
+#include "SpectrumAnalyzer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// The counter is published as a float, exact below 2^24
+const uint64_t kCounterWrap = 1u << 24;
+
+// Equivalent noise bandwidth of the Hann window in bins: a sine's power
+// spreads over this many bins
+const double kHannEnbw = 1.5;
+
+} // namespace
+
+bool ValidateSpectrumSettings(const SpectrumSettings &settings,
+                              std::string &error) {
+  if (!RealFft::IsValidSize(settings.fftSize) || settings.fftSize < 64 ||
+      settings.fftSize > 32768) {
+    error = "fftSize must be a power of two between 64 and 32768";
+    return false;
+  }
+  if (!(settings.overlap >= 0 && settings.overlap <= 0.95)) {
+    error = "overlap must be between 0 and 0.95";
+    return false;
+  }
+  if (settings.bands < 1 || settings.bands > 1024) {
+    error = "bands must be between 1 and 1024";
+    return false;
+  }
+  if (!(settings.minFrequency > 0) ||
+      (settings.maxFrequency != 0 &&
+       settings.maxFrequency <= settings.minFrequency)) {
+    error = "minFrequency must be positive and below maxFrequency";
+    return false;
+  }
+  if (!(settings.updateRate > 0)) {
+    error = "updateRate must be positive";
+    return false;
+  }
+  return true;
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(const SpectrumSettings &settings,
+                                   float *output)
+    : settings(settings), output(output), fft(settings.fftSize) {
+  std::fill(output, output + 1 + settings.bands, 0.0f);
+}
+
+void SpectrumAnalyzer::Configure(int sampleRate, int channels) {
+  size_t size = settings.fftSize;
+  hop = std::max<size_t>(
+      1, (size_t)std::lround(size * (1.0 - settings.overlap)));
+  publishFrames = std::max<size_t>(
+      1, (size_t)std::lround(sampleRate / settings.updateRate));
+  framesSincePublish = 0;
+
+  // Periodic Hann window
+  window.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * kPi * i / size));
+  }
+  history.assign(size, 0.0f);
+  filled = 0;
+  windowed.resize(size);
+  binRe.resize(size / 2 + 1);
+  binIm.resize(size / 2 + 1);
+
+  double nyquist = sampleRate / 2.0;
+  double maxFrequency = settings.maxFrequency > 0
+                            ? std::min(settings.maxFrequency, nyquist)
+                            : nyquist;
+  double minFrequency = std::min(settings.minFrequency, maxFrequency / 2);
+  double binHz = (double)sampleRate / size;
+  size_t lastBin = size / 2;
+
+  bandStart.resize(settings.bands);
+  bandEnd.resize(settings.bands);
+  for (uint32_t b = 0; b < settings.bands; b++) {
+    double lo = minFrequency *
+                std::pow(maxFrequency / minFrequency, (double)b / settings.bands);
+    double hi = minFrequency * std::pow(maxFrequency / minFrequency,
+                                        (double)(b + 1) / settings.bands);
+    size_t start = (size_t)std::ceil(lo / binHz);
+    size_t end = (size_t)std::ceil(hi / binHz);
+    if (end <= start) {
+      // Narrower than a bin: use the bin nearest the band centre
+      start = (size_t)std::lround(std::sqrt(lo * hi) / binHz);
+      end = start + 1;
+    }
+    bandStart[b] = std::min(start, lastBin);
+    bandEnd[b] = std::min(end, lastBin + 1);
+  }
+  bandPower.assign(settings.bands, 0.0);
+  windowsAccumulated = 0;
+}
+
+void SpectrumAnalyzer::Process(AudioBlock &block) {
+  size_t size = settings.fftSize;
+  float scale = 1.0f / block.channels;
+  const float *samples = block.samples;
+
+  for (size_t frame = 0; frame < block.frames; frame++) {
+    float mono = 0.0f;
+    for (int ch = 0; ch < block.channels; ch++) {
+      mono += samples[frame * block.channels + ch];
+    }
+    history[filled++] = mono * scale;
+    framesSincePublish++;
+
+    if (filled == size) {
+      Analyze();
+      // Keep the overlap for the next window
+      memmove(history.data(), history.data() + hop,
+              (size - hop) * sizeof(float));
+      filled = size - hop;
+    }
+    if (framesSincePublish >= publishFrames && windowsAccumulated > 0) {
+      Publish();
+      framesSincePublish = 0;
+    }
+  }
+}
+
+void SpectrumAnalyzer::Analyze() {
+  size_t size = settings.fftSize;
+  for (size_t i = 0; i < size; i++) {
+    windowed[i] = history[i] * window[i];
+  }
+  fft.Forward(windowed.data(), binRe.data(), binIm.data());
+
+  // A full-scale sine peaks at size / 4 through the Hann window
+  double norm = 16.0 / ((double)size * size) / kHannEnbw;
+  for (uint32_t b = 0; b < settings.bands; b++) {
+    double power = 0;
+    for (size_t k = bandStart[b]; k < bandEnd[b]; k++) {
+      power += (double)binRe[k] * binRe[k] + (double)binIm[k] * binIm[k];
+    }
+    bandPower[b] += power * norm;
+  }
+  windowsAccumulated++;
+}
+
+void SpectrumAnalyzer::Publish() {
+  uint64_t next = (updates * 2 + 1) % kCounterWrap;
+
+  // Seqlock: odd while the bands are being rewritten
+  output[0] = (float)next;
+  std::atomic_thread_fence(std::memory_order_release);
+  for (uint32_t b = 0; b < settings.bands; b++) {
+    double power = bandPower[b] / windowsAccumulated;
+    output[1 + b] = (float)(10.0 * std::log10(power + 1e-12));
+    bandPower[b] = 0;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  output[0] = (float)((next + 1) % kCounterWrap);
+
+  windowsAccumulated = 0;
+  updates++;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include "Fft.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Settings of the spectrum analysis stage
+struct SpectrumSettings {
+  uint32_t fftSize = 2048;   // Power of two
+  double overlap = 0.5;      // Fraction of each window shared with the next
+  uint32_t bands = 64;       // Log-spaced bands published
+  double minFrequency = 20;  // Lower edge of the first band, Hz
+  double maxFrequency = 0;   // Upper edge of the last band; 0 for Nyquist
+  double updateRate = 30;    // Publications per second of audio
+};
+
+// Checks the ranges the analyzer supports; false with error set otherwise
+bool ValidateSpectrumSettings(const SpectrumSettings &settings,
+                              std::string &error);
+
+// Analysis-only stage: windowed real FFT of the channel mix, reduced to
+// log-spaced bands and published into caller-owned memory of
+// 1 + settings.bands floats.
+//
+// output[0] is an update counter that is odd while a publication is being
+// written, so a reader on another thread can copy output[1..] and retry
+// if the counter changed. Band values are power in dB relative to a
+// full-scale sine. Window powers are averaged between publications, which
+// happen at most updateRate times per second of audio.
+class SpectrumAnalyzer : public CaptureStage {
+public:
+  SpectrumAnalyzer(const SpectrumSettings &settings, float *output);
+
+  void Configure(int sampleRate, int channels) override;
+  void Process(AudioBlock &block) override;
+  bool ModifiesAudio() const override { return false; }
+
+  const SpectrumSettings &Settings() const { return settings; }
+
+  // Publications so far
+  uint64_t Updates() const { return updates; }
+
+private:
+  void Analyze();
+  void Publish();
+
+  SpectrumSettings settings;
+  float *output;
+  RealFft fft;
+
+  size_t hop = 0;
+  size_t publishFrames = 0;
+  size_t framesSincePublish = 0;
+  uint64_t updates = 0;
+
+  std::vector<float> window;
+  std::vector<float> history; // Mono samples awaiting analysis
+  size_t filled = 0;
+  std::vector<float> windowed;
+  std::vector<float> binRe;
+  std::vector<float> binIm;
+
+  // Bins [bandStart[b], bandEnd[b]) make up band b
+  std::vector<size_t> bandStart;
+  std::vector<size_t> bandEnd;
+  std::vector<double> bandPower; // Summed over windowsAccumulated
+  size_t windowsAccumulated = 0;
+};
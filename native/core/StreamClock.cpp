@@ -0,0 +1,52 @@
+#include "StreamClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Fraction of the timestamp error corrected per block
+const double kLoopGain = 0.02;
+
+// How far a tracked rate may wander from nominal
+const double kMaxDeviation = 0.005;
+
+const double kPi = 3.14159265358979323846;
+
+} // namespace
+
+int64_t StreamClock::Update(uint64_t position, int64_t timestampNs,
+                            bool discontinuity) {
+  double error = timestampNs - (double)TimeOf((double)position);
+  if (!valid || discontinuity || std::fabs(error) > kResyncNs) {
+    anchorPosition = (double)position;
+    anchorTimeNs = (double)timestampNs;
+    valid = true;
+    anchors++;
+  } else if (bandwidthHz > 0) {
+    double frames = (double)position - anchorPosition;
+    if (frames > 0) {
+      // Damping 0.707: b = sqrt(2) w, c = w^2 for w = 2 pi B dt
+      double omega = 2 * kPi * bandwidthHz * frames / rate;
+      double period = 1e9 / rate + omega * omega * error / frames;
+      anchorTimeNs = (double)TimeOf((double)position) +
+                     std::sqrt(2.0) * omega * error;
+      anchorPosition = (double)position;
+      rate = std::min(std::max(1e9 / period,
+                               nominalRate * (1 - kMaxDeviation)),
+                      nominalRate * (1 + kMaxDeviation));
+    }
+  } else {
+    anchorTimeNs += error * kLoopGain;
+  }
+  return TimeOf((double)position);
+}
+
+int64_t StreamClock::TimeOf(double position) const {
+  return (int64_t)std::llround(anchorTimeNs +
+                               (position - anchorPosition) * 1e9 / rate);
+}
+
+double StreamClock::PositionAt(int64_t timeNs) const {
+  return anchorPosition + (timeNs - anchorTimeNs) * rate / 1e9;
+}
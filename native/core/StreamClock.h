@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// Maps a stream's frame positions to the host clock. Per-packet capture
+// timestamps jitter by a packet or more; the clock follows them through a
+// slow first-order loop, so positions convert to times that are smooth yet
+// track the device's drift. It re-anchors on a discontinuity or when the
+// timestamps jump by more than kResyncNs. Not thread-safe.
+//
+// Given a loop bandwidth, the clock also estimates the device's true rate on
+// the host clock: a second-order delay-locked loop whose gains scale with
+// the time between updates, so packet size does not change its response.
+class StreamClock {
+public:
+  static const int64_t kResyncNs = 20000000; // 20 ms
+
+  explicit StreamClock(double sampleRate)
+      : nominalRate(sampleRate), rate(sampleRate) {}
+  StreamClock(double sampleRate, double bandwidthHz)
+      : nominalRate(sampleRate), rate(sampleRate),
+        bandwidthHz(bandwidthHz) {}
+
+  // Feed the timestamp of the block starting at frame position. Returns the
+  // smoothed host time of that frame.
+  int64_t Update(uint64_t position, int64_t timestampNs, bool discontinuity);
+
+  bool IsValid() const { return valid; }
+
+  // Times the clock has (re)anchored, the first Update included
+  uint64_t Anchors() const { return anchors; }
+  double SampleRate() const { return nominalRate; }
+  // Frames per second of host time; the nominal rate unless tracked
+  double Rate() const { return rate; }
+
+  // Host time of a (fractional) frame position, and its inverse
+  int64_t TimeOf(double position) const;
+  double PositionAt(int64_t timeNs) const;
+
+  // Forget the anchor; a tracked rate is kept, as drift outlives a glitch
+  void Reset() { valid = false; }
+
+private:
+  double nominalRate;
+  double rate;
+  double bandwidthHz = 0;
+  bool valid = false;
+  uint64_t anchors = 0;
+  double anchorPosition = 0;
+  double anchorTimeNs = 0;
+};
@@ -0,0 +1,26 @@
+#include "StreamReuse.h"
+
+ReusePlan StreamReuse::Plan(const SystemAudioSettings &next) const {
+  ReusePlan plan;
+  if (!hasStream) {
+    plan.create = true;
+    return plan;
+  }
+  plan.updateFilter = next.processId != current.processId;
+  plan.replaceOutput = next.highPriority != current.highPriority;
+  return plan;
+}
+
+void StreamReuse::Started(const SystemAudioSettings &settings) {
+  if (hasStream) {
+    reuses++;
+  }
+  hasStream = true;
+  running = true;
+  current = settings;
+}
+
+void StreamReuse::Failed() {
+  hasStream = false;
+  running = false;
+}
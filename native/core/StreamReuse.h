@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// What a ScreenCaptureKit system-audio stream is built with
+struct SystemAudioSettings {
+  int64_t processId = 0;     // 0 captures every application
+  bool highPriority = false; // QoS of the sample handler queue
+
+  bool operator==(const SystemAudioSettings &other) const {
+    return processId == other.processId && highPriority == other.highPriority;
+  }
+  bool operator!=(const SystemAudioSettings &other) const {
+    return !(*this == other);
+  }
+};
+
+// What the next start has to do before the kept stream can run again
+struct ReusePlan {
+  bool create = false;        // Build a new stream; nothing else applies
+  bool updateFilter = false;  // Other applications: needs shareable content
+  bool replaceOutput = false; // Re-add the audio output on a new queue
+};
+
+// Tracks the one stream a system-audio capture keeps across stop and
+// start. Building a stream means enumerating shareable content and setting
+// up the compositor side, so a restart with the same settings only starts
+// the stopped stream again. A stream that failed is never reused. Not
+// thread-safe.
+class StreamReuse {
+public:
+  ReusePlan Plan(const SystemAudioSettings &next) const;
+
+  // The stream was built or reused and started with settings
+  void Started(const SystemAudioSettings &settings);
+  // Stopped cleanly; kept for the next start
+  void Stopped() { running = false; }
+  // Failed to build or start, or stopped with an error: discard it
+  void Failed();
+
+  bool HasStream() const { return hasStream; }
+  bool Running() const { return running; }
+  // Starts that reused a stream instead of building one
+  uint64_t Reuses() const { return reuses; }
+
+private:
+  bool hasStream = false;
+  bool running = false;
+  SystemAudioSettings current;
+  uint64_t reuses = 0;
+};
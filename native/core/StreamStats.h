@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ThreadPriority.h"
+#include <atomic>
+#include <cstdint>
+
+// Per-stream capture statistics, as reported to JS
+struct StreamStats {
+  uint64_t packets;              // Device packets processed
+  uint64_t frames;               // Frames delivered
+  double processingTimeMs;       // Thread time spent on this stream
+  double avgLatencyMs;           // Packet ready -> delivered to the sink, mean
+  double maxLatencyMs;           // Packet ready -> delivered to the sink, worst
+  int sharedStreams;             // Streams served by the same capture thread
+  ThreadPriority threadPriority; // Obtained by the capture thread
+  bool affinityApplied;          // Capture thread pinned to requested cores
+};
+
+// Lock-free accumulator for StreamStats, written from capture and worker
+// threads and read from the JS thread
+class StreamStatsRecorder {
+public:
+  void RecordPacket(uint64_t frames, int64_t processingNs, int64_t latencyNs) {
+    packets.fetch_add(1, std::memory_order_relaxed);
+    this->frames.fetch_add(frames, std::memory_order_relaxed);
+    this->processingNs.fetch_add(processingNs, std::memory_order_relaxed);
+    latencyTotalNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    int64_t max = latencyMaxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max && !latencyMaxNs.compare_exchange_weak(
+                                  max, latencyNs, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Time spent on the stream outside of RecordPacket, e.g. draining the
+  // device on a shared capture thread
+  void AddProcessingTime(int64_t ns) {
+    processingNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  void SetSharedStreams(int count) {
+    sharedStreams.store(count, std::memory_order_relaxed);
+  }
+
+  void SetThreadPriority(const ThreadPriorityResult &result) {
+    threadPriority.store((int)result.priority, std::memory_order_relaxed);
+    affinityApplied.store(result.affinityApplied, std::memory_order_relaxed);
+  }
+
+  StreamStats Snapshot() const {
+    StreamStats stats = {};
+    stats.packets = packets.load(std::memory_order_relaxed);
+    stats.frames = frames.load(std::memory_order_relaxed);
+    stats.processingTimeMs =
+        processingNs.load(std::memory_order_relaxed) / 1e6;
+    if (stats.packets > 0) {
+      stats.avgLatencyMs = latencyTotalNs.load(std::memory_order_relaxed) /
+                           1e6 / (double)stats.packets;
+    }
+    stats.maxLatencyMs = latencyMaxNs.load(std::memory_order_relaxed) / 1e6;
+    stats.sharedStreams = sharedStreams.load(std::memory_order_relaxed);
+    stats.threadPriority =
+        (ThreadPriority)threadPriority.load(std::memory_order_relaxed);
+    stats.affinityApplied = affinityApplied.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  void Reset() {
+    packets = 0;
+    frames = 0;
+    processingNs = 0;
+    latencyTotalNs = 0;
+    latencyMaxNs = 0;
+    sharedStreams = 1;
+    threadPriority = (int)ThreadPriority::Normal;
+    affinityApplied = false;
+  }
+
+private:
+  std::atomic<uint64_t> packets{0};
+  std::atomic<uint64_t> frames{0};
+  std::atomic<int64_t> processingNs{0};
+  std::atomic<int64_t> latencyTotalNs{0};
+  std::atomic<int64_t> latencyMaxNs{0};
+  std::atomic<int> sharedStreams{1};
+  std::atomic<int> threadPriority{(int)ThreadPriority::Normal};
+  std::atomic<bool> affinityApplied{false};
+};
@@ -0,0 +1,278 @@
+#include "SyncSession.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+namespace {
+
+// Frames of silence handed on per call when a realign leaves a gap
+const size_t kSilenceChunk = 4800;
+
+} // namespace
+
+bool ValidateSyncSettings(const SyncSettings &settings, std::string &error) {
+  if (settings.session.empty() || settings.session.size() > 256) {
+    error = "session must be 1 to 256 characters";
+    return false;
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// MasterClock
+
+int64_t MasterClock::TimeOf(double position) const {
+  return anchorTimeNs +
+         (int64_t)std::llround((position - anchorPosition) * 1e9 / rate);
+}
+
+double MasterClock::PositionAt(int64_t timeNs) const {
+  return anchorPosition + (double)(timeNs - anchorTimeNs) * rate / 1e9;
+}
+
+// ---------------------------------------------------------------------------
+// SyncSession
+
+std::shared_ptr<SyncSession> SyncSession::Get(const std::string &name) {
+  static std::mutex registryMutex;
+  static std::map<std::string, std::weak_ptr<SyncSession>> registry;
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  for (auto it = registry.begin(); it != registry.end();) {
+    if (it->second.expired()) {
+      it = registry.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  std::shared_ptr<SyncSession> session = registry[name].lock();
+  if (!session) {
+    session = std::make_shared<SyncSession>(name);
+    registry[name] = session;
+  }
+  return session;
+}
+
+bool SyncSession::ClaimMaster() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (hasMaster) {
+    return false;
+  }
+  hasMaster = true;
+  return true;
+}
+
+void SyncSession::ReleaseMaster() {
+  std::lock_guard<std::mutex> lock(mutex);
+  hasMaster = false;
+}
+
+void SyncSession::Publish(const MasterClock &clock) {
+  std::lock_guard<std::mutex> lock(mutex);
+  master = clock;
+  published = true;
+}
+
+bool SyncSession::Master(MasterClock &clock) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!published) {
+    return false;
+  }
+  clock = master;
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// SyncedSink
+
+SyncedSink::SyncedSink(std::shared_ptr<SyncSession> session, bool master,
+                       std::shared_ptr<CaptureSink> target)
+    : session(std::move(session)), target(std::move(target)),
+      isMaster(master), claimed(master) {}
+
+SyncedSink::~SyncedSink() { Leave(); }
+
+void SyncedSink::Leave() {
+  if (claimed.exchange(false)) {
+    session->ReleaseMaster();
+  }
+}
+
+SyncStats SyncedSink::GetStats() const {
+  SyncStats stats;
+  stats.master = isMaster;
+  stats.driftPpm = driftPpm;
+  stats.errorUs = errorUs;
+  stats.maxErrorUs = maxErrorUs;
+  stats.resyncs = resyncs;
+  stats.startFrame = startFrame;
+  return stats;
+}
+
+void SyncedSink::OnData(const PcmBlock &block) {
+  if (block.meta.timestampNs == 0) {
+    target->OnData(block);
+    return;
+  }
+  if (!clock || clock->SampleRate() != block.sampleRate) {
+    clock.reset(new StreamClock(block.sampleRate, kClockBandwidthHz));
+  }
+  clock->Update(block.meta.frameIndex, block.meta.timestampNs,
+                block.meta.discontinuity);
+
+  if (isMaster) {
+    MasterClock published;
+    published.anchorPosition = (double)block.meta.frameIndex;
+    published.anchorTimeNs = clock->TimeOf(published.anchorPosition);
+    published.rate = clock->Rate();
+    published.nominalRate = clock->SampleRate();
+    published.anchors = clock->Anchors();
+    session->Publish(published);
+    driftPpm = (clock->Rate() / clock->SampleRate() - 1) * 1e6;
+    target->OnData(block);
+    return;
+  }
+
+  // Nothing to line up with until the master runs
+  MasterClock master;
+  if (session->Master(master)) {
+    Follow(block, master);
+  }
+}
+
+double SyncedSink::MasterPosition(const MasterClock &master,
+                                  double k) const {
+  return startMaster + k * master.nominalRate / clock->SampleRate();
+}
+
+double SyncedSink::Target(const MasterClock &master, double k) const {
+  return clock->PositionAt(master.TimeOf(MasterPosition(master, k)));
+}
+
+void SyncedSink::Follow(const PcmBlock &block, const MasterClock &master) {
+  const double rate = block.sampleRate;
+  if (!aligned || resampler->Channels() != block.channels) {
+    aligned = false;
+    Align(block, master);
+  } else if (block.meta.discontinuity ||
+             std::fabs(nextInput - Target(master, (double)outputFrames)) >
+                 kResyncSeconds * rate) {
+    resyncs++;
+    Align(block, master);
+  }
+
+  const int16_t *samples = block.samples;
+  size_t frames = block.frames;
+  size_t skipped = (size_t)std::min<uint64_t>(skip, frames);
+  samples += skipped * block.channels;
+  frames -= skipped;
+  skip -= skipped;
+  if (frames == 0) {
+    return;
+  }
+
+  // Estimated ratio of the two clocks, corrected so the error is worked off
+  // over kCorrectionSeconds
+  double error = nextInput - Target(master, (double)outputFrames);
+  double estimated = (clock->Rate() / clock->SampleRate()) /
+                     (master.rate / master.nominalRate);
+  double limit = estimated * kMaxCorrectionPpm * 1e-6;
+  double correction =
+      std::min(std::max(error / (kCorrectionSeconds * rate), -limit), limit);
+  double step = estimated - correction;
+
+  double errorNow = error / rate * 1e6;
+  errorUs = errorNow;
+  if (std::fabs(errorNow) > maxErrorUs) {
+    maxErrorUs = std::fabs(errorNow);
+  }
+  driftPpm = (estimated - 1) * 1e6;
+
+  size_t sampleCount = frames * block.channels;
+  input.resize(sampleCount);
+  for (size_t i = 0; i < sampleCount; i++) {
+    input[i] = samples[i] * (1.0f / 32768.0f);
+  }
+  resampler->SetStep(step);
+  resampled.clear();
+  size_t produced = resampler->Process(input.data(), frames, resampled);
+  nextInput += (double)produced * step;
+  if (produced == 0) {
+    return;
+  }
+
+  output.resize(resampled.size());
+  for (size_t i = 0; i < resampled.size(); i++) {
+    long value = std::lrint(resampled[i] * 32768.0f);
+    output[i] = (int16_t)std::min(std::max(value, -32768L), 32767L);
+  }
+  Emit(output.data(), produced, block, master, false);
+}
+
+void SyncedSink::Align(const PcmBlock &block, const MasterClock &master) {
+  double position = (double)block.meta.frameIndex;
+  if (!aligned) {
+    resampler.reset(
+        new Resampler(block.channels, block.sampleRate, block.sampleRate));
+    // Room for blocks twice this size, so the capture path only allocates
+    // here, where the follower starts
+    Reserve(block.frames * 2, block.channels);
+    // The master frame captured with this block's first frame
+    startMaster = std::max(
+        0.0, std::ceil(master.PositionAt(clock->TimeOf(position))));
+    outputFrames = 0;
+    startFrame = (int64_t)startMaster;
+  }
+
+  pendingDiscontinuity = aligned;
+
+  // Output already due before this block's first frame is gone: fill it
+  // with silence. Less than half a frame is left to the correction.
+  double due = Target(master, (double)outputFrames);
+  if (due < position - 0.5) {
+    size_t gap = (size_t)std::ceil(position - due);
+    output.assign(std::min(gap, kSilenceChunk) * block.channels, 0);
+    while (gap > 0) {
+      size_t frames = std::min(gap, kSilenceChunk);
+      Emit(output.data(), frames, block, master, true);
+      gap -= frames;
+    }
+    due = Target(master, (double)outputFrames);
+  }
+
+  skip = due > position ? (uint64_t)(due - position) : 0;
+  nextInput = position + (double)skip;
+  resampler->Reset();
+  aligned = true;
+  maxErrorUs = 0;
+}
+
+void SyncedSink::Reserve(size_t frames, int channels) {
+  resampler->Reserve(frames);
+  input.reserve(frames * channels);
+  // The resampler sizes its output for every frame that may complete: the
+  // input plus its history, at a step down to 1 - kMaxCorrectionPpm
+  size_t outFrames = frames + frames / 50 + 2 * Resampler::kHalfTaps + 2;
+  resampled.reserve(outFrames * channels);
+  // Also holds the silence of a realign
+  output.reserve(std::max(outFrames, kSilenceChunk) * channels);
+}
+
+void SyncedSink::Emit(const int16_t *samples, size_t frames,
+                      const PcmBlock &block, const MasterClock &master,
+                      bool silent) {
+  PcmBlock out;
+  out.samples = samples;
+  out.frames = frames;
+  out.channels = block.channels;
+  out.sampleRate = block.sampleRate;
+  out.meta.frameIndex = outputFrames;
+  out.meta.timestampNs =
+      master.TimeOf(MasterPosition(master, (double)outputFrames));
+  out.meta.discontinuity = pendingDiscontinuity;
+  out.meta.silent = silent;
+  pendingDiscontinuity = false;
+  outputFrames += frames;
+  target->OnData(out);
+}
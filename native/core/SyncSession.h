@@ -0,0 +1,156 @@
+#pragma once
+
+#include "CaptureCore.h"
+#include "Resampler.h"
+#include "StreamClock.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Settings of a stream's membership in a sync session
+struct SyncSettings {
+  std::string session; // Empty when the stream is not synchronised
+  bool master = false; // Whose timeline the other streams follow
+};
+
+// Checks the ranges the session supports; false with error set otherwise
+bool ValidateSyncSettings(const SyncSettings &settings, std::string &error);
+
+// The master's clock as last published: frame positions of the master
+// stream against host time
+struct MasterClock {
+  double anchorPosition = 0;
+  int64_t anchorTimeNs = 0;
+  double rate = 0;        // Estimated frames per second of host time
+  double nominalRate = 0; // The stream's sample rate
+  uint64_t anchors = 0;   // Changes whenever the master re-anchors
+
+  int64_t TimeOf(double position) const;
+  double PositionAt(int64_t timeNs) const;
+};
+
+// Streams recorded together and kept sample-aligned. Each is captured on
+// its own device clock; one stream is the master and the rest follow its
+// timeline. Sessions are looked up by name and live as long as a stream
+// holds them. Thread-safe.
+class SyncSession {
+public:
+  // The session called name, created on first use
+  static std::shared_ptr<SyncSession> Get(const std::string &name);
+
+  explicit SyncSession(std::string name) : name(std::move(name)) {}
+
+  const std::string &Name() const { return name; }
+
+  // One master at a time; false if another stream holds the role
+  bool ClaimMaster();
+  void ReleaseMaster();
+
+  void Publish(const MasterClock &clock);
+  // The master's latest clock; false until a master has published one.
+  // After the master leaves, its last clock stays so followers carry on.
+  bool Master(MasterClock &clock) const;
+
+private:
+  std::string name;
+  mutable std::mutex mutex;
+  bool hasMaster = false;
+  bool published = false;
+  MasterClock master;
+};
+
+// Alignment of a synchronised stream, readable from any thread
+struct SyncStats {
+  bool master = false;
+  double driftPpm = 0;   // Device clock against the master (against the
+                         // host clock for the master itself)
+  double errorUs = 0;    // Current alignment error, positive when the
+                         // stream runs ahead of the master
+  double maxErrorUs = 0; // Largest error since the stream last aligned
+  uint64_t resyncs = 0;  // Times the stream had to realign at once
+  int64_t startFrame = -1; // Master frame the first output frame lines
+                           // up with; -1 until aligned
+};
+
+// Sink between an engine and a stream's own sink that keeps the stream on
+// its session's timeline.
+//
+// Every stream's clock is estimated from its capture timestamps by a
+// StreamClock with rate tracking. The master publishes its clock and passes
+// its audio through unchanged. A follower drops its audio until the master
+// has a clock, then starts at the master frame captured at the same moment
+// and resamples its audio onto the master's timeline: the step is the ratio
+// of the two clocks' drift, nudged by the alignment error so that output
+// frame k stays on master frame startFrame + k (scaled by the ratio of the
+// nominal rates, when they differ). The output keeps the stream's own
+// nominal rate. An error beyond kResyncSeconds, or a discontinuity,
+// realigns the stream at once by inserting silence or skipping input.
+// Blocks without timestamps pass through untouched.
+class SyncedSink : public CaptureSink {
+public:
+  // Loop bandwidth of the stream clocks, and how quickly a follower works
+  // off its alignment error
+  static constexpr double kClockBandwidthHz = 0.05;
+  static constexpr double kCorrectionSeconds = 1.0;
+  // Largest correction applied on top of the estimated ratio
+  static constexpr double kMaxCorrectionPpm = 1000;
+  // Errors beyond this realign instead of being resampled away
+  static constexpr double kResyncSeconds = 0.02;
+
+  // A master must have claimed the session's master role; the sink gives it
+  // up in Leave() or when destroyed
+  SyncedSink(std::shared_ptr<SyncSession> session, bool master,
+             std::shared_ptr<CaptureSink> target);
+  ~SyncedSink();
+
+  void OnData(const PcmBlock &block) override;
+  void OnError(const std::string &error) override { target->OnError(error); }
+
+  // Give up the master role, so another stream can take it while the
+  // engine still holds this sink
+  void Leave();
+
+  SyncStats GetStats() const;
+
+private:
+  void Follow(const PcmBlock &block, const MasterClock &master);
+  // Master frame that output frame k lines up with
+  double MasterPosition(const MasterClock &master, double k) const;
+  // Position on this stream's input where output frame k belongs
+  double Target(const MasterClock &master, double k) const;
+  // Start or restart output at this block; frames of input to skip are
+  // left in skip
+  void Align(const PcmBlock &block, const MasterClock &master);
+  void Emit(const int16_t *samples, size_t frames, const PcmBlock &block,
+            const MasterClock &master, bool silent);
+  // Size the follower's buffers for blocks of up to frames frames
+  void Reserve(size_t frames, int channels);
+
+  std::shared_ptr<SyncSession> session;
+  std::shared_ptr<CaptureSink> target;
+  const bool isMaster;
+  std::atomic<bool> claimed;
+  std::unique_ptr<StreamClock> clock;
+
+  // Follower state
+  std::unique_ptr<Resampler> resampler;
+  bool aligned = false;
+  double startMaster = 0;   // Master frame of output frame 0
+  uint64_t outputFrames = 0;
+  double nextInput = 0;     // Input position of the next output frame
+  uint64_t skip = 0;        // Input frames still to drop after a realign
+  bool pendingDiscontinuity = false;
+  std::vector<float> input;
+  std::vector<float> resampled;
+  std::vector<int16_t> output;
+
+  std::atomic<double> driftPpm{0};
+  std::atomic<double> errorUs{0};
+  std::atomic<double> maxErrorUs{0};
+  std::atomic<uint64_t> resyncs{0};
+  std::atomic<int64_t> startFrame{-1};
+};
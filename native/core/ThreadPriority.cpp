@@ -0,0 +1,291 @@
+#include "ThreadPriority.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <cstdint>
+#include <dlfcn.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+#ifndef _WIN32
+// Modest SCHED_FIFO priority: above every normal thread but below the
+// kernel's own real-time threads, and within rtkit's default maximum of 20
+const int kRealtimePriority = 10;
+#endif
+
+#ifdef __linux__
+const int kElevatedNice = -10;
+
+// rtkit only serves processes that cap the CPU time a real-time thread may
+// use without blocking, at most its RTTimeUSecMax (200 ms by default). A
+// capture thread blocks every period, far below it. Only the soft limit is
+// lowered: a process cannot raise its hard limit again, and rtkit versions
+// that check the hard limit are left to hosts that cap it themselves.
+const rlim_t kRtkitRtTimeUsec = 200000;
+const int kRtkitTimeoutMs = 500;
+
+// The few libdbus calls rtkit needs. The library is loaded at run time, so
+// it is not a build dependency and systems without it fall back to nice.
+struct DBusApi {
+  void *(*busGetPrivate)(int type, void *error);
+  void (*setExitOnDisconnect)(void *connection, uint32_t exit);
+  void *(*newMethodCall)(const char *destination, const char *path,
+                         const char *interface, const char *method);
+  uint32_t (*appendArgs)(void *message, int firstType, ...);
+  void *(*sendWithReplyAndBlock)(void *connection, void *message,
+                                 int timeoutMs, void *error);
+  void (*messageUnref)(void *message);
+  void (*connectionClose)(void *connection);
+  void (*connectionUnref)(void *connection);
+};
+
+const int kDBusBusSystem = 1;
+const int kDBusTypeInvalid = 0;
+const int kDBusTypeUint32 = 'u';
+const int kDBusTypeUint64 = 't';
+
+template <typename F> bool Bind(void *library, const char *name, F &function) {
+  function = reinterpret_cast<F>(dlsym(library, name));
+  return function != nullptr;
+}
+
+const DBusApi *LoadDBus() {
+  static const DBusApi *api = []() -> const DBusApi * {
+    void *library = dlopen("libdbus-1.so.3", RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+      return nullptr;
+    static DBusApi loaded;
+    if (Bind(library, "dbus_bus_get_private", loaded.busGetPrivate) &&
+        Bind(library, "dbus_connection_set_exit_on_disconnect",
+             loaded.setExitOnDisconnect) &&
+        Bind(library, "dbus_message_new_method_call",
+             loaded.newMethodCall) &&
+        Bind(library, "dbus_message_append_args", loaded.appendArgs) &&
+        Bind(library, "dbus_connection_send_with_reply_and_block",
+             loaded.sendWithReplyAndBlock) &&
+        Bind(library, "dbus_message_unref", loaded.messageUnref) &&
+        Bind(library, "dbus_connection_close", loaded.connectionClose) &&
+        Bind(library, "dbus_connection_unref", loaded.connectionUnref))
+      return &loaded;
+    dlclose(library);
+    return nullptr;
+  }();
+  return api;
+}
+
+// Desktop sessions leave RLIMIT_RTPRIO at 0 and grant real-time scheduling
+// through rtkit instead: ask it over the system bus to make the thread
+// SCHED_FIFO at the given priority
+bool RequestRtkit(pid_t tid, int priority) {
+  const DBusApi *dbus = LoadDBus();
+  if (!dbus)
+    return false;
+
+  void *connection = dbus->busGetPrivate(kDBusBusSystem, nullptr);
+  if (!connection)
+    return false;
+  // libdbus would otherwise exit the process when the bus goes away
+  dbus->setExitOnDisconnect(connection, 0);
+
+  // Only lowered once there is a bus to ask, and put back unless granted
+  bool granted = false;
+  rlimit saved = {};
+  bool limited = getrlimit(RLIMIT_RTTIME, &saved) == 0;
+  bool lowered = false;
+  if (limited && (saved.rlim_cur == RLIM_INFINITY ||
+                  saved.rlim_cur > kRtkitRtTimeUsec)) {
+    rlimit limit = saved;
+    limit.rlim_cur = kRtkitRtTimeUsec;
+    limited = lowered = setrlimit(RLIMIT_RTTIME, &limit) == 0;
+  }
+  void *call = nullptr;
+  if (limited)
+    call = dbus->newMethodCall(
+        "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+        "org.freedesktop.RealtimeKit1", "MakeThreadRealtime");
+  uint64_t thread = (uint64_t)tid;
+  uint32_t value = (uint32_t)priority;
+  if (call && dbus->appendArgs(call, kDBusTypeUint64, &thread,
+                               kDBusTypeUint32, &value, kDBusTypeInvalid)) {
+    void *reply = dbus->sendWithReplyAndBlock(connection, call,
+                                              kRtkitTimeoutMs, nullptr);
+    if (reply) {
+      granted = true;
+      dbus->messageUnref(reply);
+    }
+  }
+  if (call)
+    dbus->messageUnref(call);
+  dbus->connectionClose(connection);
+  dbus->connectionUnref(connection);
+  if (lowered && !granted)
+    setrlimit(RLIMIT_RTTIME, &saved);
+  return granted;
+}
+
+bool IsRealtimePolicy(pid_t tid) {
+  int policy = sched_getscheduler(tid);
+  return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+#endif
+
+#ifdef _WIN32
+// MMCSS registration of the current thread, reverted when it exits
+struct MmcssRegistration {
+  HANDLE handle = NULL;
+  ~MmcssRegistration() {
+    if (handle)
+      AvRevertMmThreadCharacteristics(handle);
+  }
+};
+thread_local MmcssRegistration mmcss;
+
+ThreadPriority RaisePriority() {
+  if (mmcss.handle)
+    return ThreadPriority::Realtime;
+
+  DWORD taskIndex = 0;
+  mmcss.handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+  if (mmcss.handle) {
+    AvSetMmThreadPriority(mmcss.handle, AVRT_PRIORITY_HIGH);
+    return ThreadPriority::Realtime;
+  }
+
+  // MMCSS service unavailable (e.g. stopped or Server Core)
+  if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+    return ThreadPriority::Elevated;
+  return ThreadPriority::Normal;
+}
+
+bool PinToCores(const std::vector<int> &cores) {
+  DWORD_PTR mask = 0;
+  for (int core : cores) {
+    if (core >= 0 && core < (int)(sizeof(DWORD_PTR) * 8))
+      mask |= (DWORD_PTR)1 << core;
+  }
+  return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+#else
+bool IsRealtimePolicy() {
+  int policy = 0;
+  sched_param param = {};
+  if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+    return false;
+  return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+ThreadPriority RaisePriority() {
+  if (IsRealtimePolicy())
+    return ThreadPriority::Realtime;
+
+#ifdef __APPLE__
+  // Capture callbacks are driven by the HAL's own real-time threads; the
+  // highest QoS class keeps ours from being throttled behind them
+  if (pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) == 0)
+    return ThreadPriority::Elevated;
+  return ThreadPriority::Normal;
+#else
+  sched_param param = {};
+  param.sched_priority =
+      std::min(kRealtimePriority, sched_get_priority_max(SCHED_FIFO));
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+    return ThreadPriority::Realtime;
+
+#ifdef __linux__
+  // rtkit is not asked from here: RequestRealtimeThread() does that before
+  // the thread starts capturing, as it may block on D-Bus
+  pid_t tid = (pid_t)syscall(SYS_gettid);
+
+  // No real-time budget: settle for a higher share of the normal scheduler.
+  // On Linux, setpriority() with a thread id affects only that thread.
+  if (getpriority(PRIO_PROCESS, tid) <= kElevatedNice ||
+      setpriority(PRIO_PROCESS, tid, kElevatedNice) == 0)
+    return ThreadPriority::Elevated;
+#endif
+  return ThreadPriority::Normal;
+#endif
+}
+
+bool PinToCores(const std::vector<int> &cores) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  bool any = false;
+  for (int core : cores) {
+    if (core >= 0 && core < CPU_SETSIZE) {
+      CPU_SET(core, &set);
+      any = true;
+    }
+  }
+  return any &&
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  // macOS only offers affinity tags as scheduler hints
+  return false;
+#endif
+}
+#endif
+
+} // namespace
+
+ThreadPriorityResult PromoteCurrentThread(const ThreadPriorityRequest &request) {
+  ThreadPriorityResult result;
+  if (request.realtime) {
+    result.priority = RaisePriority();
+  }
+  if (!request.cpuCores.empty()) {
+    result.affinityApplied = PinToCores(request.cpuCores);
+  }
+  return result;
+}
+
+int64_t CurrentThreadId() {
+#ifdef __linux__
+  return (int64_t)syscall(SYS_gettid);
+#else
+  return 0;
+#endif
+}
+
+bool RequestRealtimeThread(int64_t threadId) {
+#ifdef __linux__
+  pid_t tid = (pid_t)threadId;
+  if (tid <= 0)
+    return false;
+  if (IsRealtimePolicy(tid))
+    return true;
+  sched_param param = {};
+  param.sched_priority =
+      std::min(kRealtimePriority, sched_get_priority_max(SCHED_FIFO));
+  if (sched_setscheduler(tid, SCHED_FIFO, &param) == 0)
+    return true;
+  return RequestRtkit(tid, param.sched_priority) && IsRealtimePolicy(tid);
+#else
+  (void)threadId;
+  return false;
+#endif
+}
+
+const char *ThreadPriorityName(ThreadPriority priority) {
+  switch (priority) {
+  case ThreadPriority::Elevated:
+    return "elevated";
+  case ThreadPriority::Realtime:
+    return "realtime";
+  default:
+    return "normal";
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Scheduling class a capture thread ended up with
+enum class ThreadPriority {
+  Normal,   // Unchanged
+  Elevated, // Raised within the normal scheduler (priority, nice, QoS)
+  Realtime  // MMCSS "Pro Audio" on Windows, SCHED_FIFO on Linux
+};
+
+struct ThreadPriorityRequest {
+  bool realtime = false;
+  // Cores to pin the thread to; empty leaves the affinity alone
+  std::vector<int> cpuCores;
+};
+
+struct ThreadPriorityResult {
+  ThreadPriority priority = ThreadPriority::Normal;
+  bool affinityApplied = false;
+};
+
+// Raise the calling thread for audio capture and pin it to the requested
+// cores, falling back step by step when the OS refuses:
+//   Windows: MMCSS "Pro Audio", then THREAD_PRIORITY_TIME_CRITICAL
+//   Linux:   SCHED_FIFO (where RLIMIT_RTPRIO or CAP_SYS_NICE allows it),
+//            then a negative nice value; a thread RequestRealtimeThread()
+//            already made real-time stays so
+//   macOS:   QOS_CLASS_USER_INTERACTIVE; affinity is not supported
+// Returns what was actually obtained. Calling it again on the same thread
+// keeps the highest priority reached; an MMCSS registration is reverted
+// when the thread exits.
+ThreadPriorityResult PromoteCurrentThread(const ThreadPriorityRequest &request);
+
+// Id of the calling thread for RequestRealtimeThread(); 0 where that is
+// not supported
+int64_t CurrentThreadId();
+
+// Linux: make another thread of this process SCHED_FIFO, directly or, on a
+// desktop without RLIMIT_RTPRIO, granted by rtkit over D-Bus. The D-Bus
+// call blocks for up to 500 ms, so make it before the capture thread
+// starts capturing, from a thread that is not capturing. rtkit needs the
+// soft RLIMIT_RTTIME at 200 ms or less; it is lowered for the call and
+// restored unless granted. Returns whether the thread is real-time; false
+// elsewhere.
+bool RequestRealtimeThread(int64_t threadId);
+
+const char *ThreadPriorityName(ThreadPriority priority);
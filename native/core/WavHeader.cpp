@@ -0,0 +1,37 @@
+#include "WavHeader.h"
+
+#include <cstring>
+
+namespace {
+
+void Put16(uint8_t *p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+void Put32(uint8_t *p, uint32_t value) {
+  Put16(p, value & 0xFFFF);
+  Put16(p + 2, value >> 16);
+}
+
+} // namespace
+
+void BuildWavHeader(uint8_t *header, int sampleRate, int channels,
+                    uint64_t dataBytes) {
+  if (dataBytes > kWavMaxDataBytes) {
+    dataBytes = kWavMaxDataBytes;
+  }
+  uint32_t blockAlign = (uint32_t)channels * 2;
+  std::memcpy(header, "RIFF", 4);
+  Put32(header + 4, (uint32_t)(36 + dataBytes));
+  std::memcpy(header + 8, "WAVEfmt ", 8);
+  Put32(header + 16, 16);
+  Put16(header + 20, 1); // PCM
+  Put16(header + 22, (uint32_t)channels);
+  Put32(header + 24, (uint32_t)sampleRate);
+  Put32(header + 28, (uint32_t)sampleRate * blockAlign);
+  Put16(header + 32, blockAlign);
+  Put16(header + 34, 16);
+  std::memcpy(header + 36, "data", 4);
+  Put32(header + 40, (uint32_t)dataBytes);
+}
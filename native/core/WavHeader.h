@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Canonical 44-byte header of a 16-bit PCM WAV file
+static const size_t kWavHeaderSize = 44;
+
+// Largest data chunk a RIFF file can describe, in bytes
+static const uint64_t kWavMaxDataBytes = 0xFFFFFFFFull - 36;
+
+// Fill header for dataBytes of interleaved 16-bit PCM
+void BuildWavHeader(uint8_t *header, int sampleRate, int channels,
+                    uint64_t dataBytes);
@@ -0,0 +1,113 @@
+#include "WorkerPool.h"
+#include <algorithm>
+#include <iterator>
+
+WorkerPool::WorkerPool(size_t threadCount) {
+  threadCount = std::max<size_t>(1, threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    threads.emplace_back(&WorkerPool::WorkerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    isStopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+WorkerPool &WorkerPool::Shared() {
+  // Half the cores, capped: capture work is light, the pool only has to
+  // keep up with many streams without oversubscribing the machine
+  static WorkerPool pool(
+      std::min<size_t>(4, std::max<size_t>(
+                              1, std::thread::hardware_concurrency() / 2)));
+  return pool;
+}
+
+std::shared_ptr<WorkerPool::Strand> WorkerPool::CreateStrand() {
+  return std::make_shared<Strand>(*this);
+}
+
+void WorkerPool::Schedule(std::shared_ptr<Strand> strand) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(std::move(strand));
+  }
+  wake.notify_one();
+}
+
+void WorkerPool::WorkerLoop() {
+  while (true) {
+    std::shared_ptr<Strand> strand;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this]() {
+        return isStopping || readyHead < ready.size();
+      });
+      if (readyHead == ready.size()) {
+        return;
+      }
+      strand = std::move(ready[readyHead++]);
+      // Drop the taken entries once they are half the queue; erasing
+      // moves the rest down without allocating
+      if (readyHead * 2 >= ready.size()) {
+        ready.erase(ready.begin(), ready.begin() + readyHead);
+        readyHead = 0;
+      }
+    }
+
+    // Let other strands in between batches so one busy stream cannot
+    // starve the rest
+    if (strand->RunPending()) {
+      Schedule(strand);
+    }
+  }
+}
+
+void WorkerPool::Strand::Post(Task task) {
+  bool needsSchedule = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+    if (!isScheduled) {
+      isScheduled = true;
+      needsSchedule = true;
+    }
+  }
+  if (needsSchedule) {
+    pool.Schedule(shared_from_this());
+  }
+}
+
+bool WorkerPool::Strand::RunPending() {
+  // Only one thread runs a strand at a time, so running is ours
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running.insert(running.end(), std::make_move_iterator(tasks.begin()),
+                   std::make_move_iterator(tasks.end()));
+    tasks.clear();
+  }
+
+  for (auto &task : running) {
+    task();
+  }
+  running.clear();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (tasks.empty()) {
+    isScheduled = false;
+    idle.notify_all();
+    return false;
+  }
+  return true;
+}
+
+void WorkerPool::Strand::Flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this]() { return !isScheduled; });
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fixed pool of threads for conversion and encoding work shared by
+// all capture streams. Work is posted to a Strand; tasks on one strand run
+// in order and never concurrently, while different strands run in parallel.
+// The queues keep their capacity, so once warmed up, posting a task whose
+// captures fit std::function's inline storage does not allocate.
+class WorkerPool {
+public:
+  using Task = std::function<void()>;
+
+  class Strand : public std::enable_shared_from_this<Strand> {
+  public:
+    explicit Strand(WorkerPool &pool) : pool(pool) {}
+
+    // Queue a task behind all earlier tasks on this strand
+    void Post(Task task);
+
+    // Block until every task posted so far has run. Must not be called
+    // from a task on the same strand.
+    void Flush();
+
+  private:
+    friend class WorkerPool;
+
+    // Run queued tasks; returns true if more were posted meanwhile
+    bool RunPending();
+
+    WorkerPool &pool;
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<Task> tasks;
+    std::vector<Task> running; // Taken from tasks by RunPending
+    bool isScheduled = false;
+  };
+
+  explicit WorkerPool(size_t threadCount);
+  ~WorkerPool();
+
+  std::shared_ptr<Strand> CreateStrand();
+  size_t ThreadCount() const { return threads.size(); }
+
+  // Process-wide pool sized from the number of cores
+  static WorkerPool &Shared();
+
+private:
+  void Schedule(std::shared_ptr<Strand> strand);
+  void WorkerLoop();
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  // Strands waiting for a thread, from readyHead on
+  std::vector<std::shared_ptr<Strand>> ready;
+  size_t readyHead = 0;
+  bool isStopping = false;
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,674 @@
+#ifdef HAVE_PULSEAUDIO
+
+#include "PulseEngine.h"
+#include "../core/CaptureCore.h"
+#include "../core/ProcessLoopback.h"
+#include "../core/ThreadPriority.h"
+#include <pulse/pulseaudio.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace {
+
+// Process loopback records every sink input in this format; the server
+// converts, so the mixer only has to add
+const int kLoopbackRate = 48000;
+const int kLoopbackChannels = 2;
+
+// Requested fragment: one read callback per 10 ms
+const pa_usec_t kFragmentUsec = 10000;
+
+// How far one sink input may lag the others before it is mixed as silence
+const size_t kMaxSkewFrames = kLoopbackRate / 10;
+
+int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+struct PulseEngine::Impl {
+  // One sink input's monitor stream, for process loopback
+  struct Monitor {
+    Impl *impl;
+    uint32_t index;
+    pa_operation *lookup = nullptr; // Finding the sink's monitor source
+    pa_stream *stream = nullptr;
+  };
+
+  pa_threaded_mainloop *loop = nullptr;
+  pa_context *context = nullptr;
+
+  StreamOptions options;
+  StreamStatsRecorder stats;
+  std::shared_ptr<CaptureSink> sink;
+  std::unique_ptr<CaptureCore> core;
+  bool priorityApplied = false;
+  // The main loop thread, which runs the capture callbacks; seen from its
+  // first context callback
+  int64_t loopThreadId = 0;
+  bool loopRealtimeRequested = false;
+  // Set while a capture runs, so losing the server is reported, once
+  bool capturing = false;
+  bool failed = false;
+
+  // Device capture
+  pa_stream *stream = nullptr;
+  size_t frameBytes = 0;
+
+  // Process loopback
+  std::unique_ptr<ProcessTree> tree;
+  std::unique_ptr<SinkInputSelector> selector;
+  std::unique_ptr<LoopbackMixer> mixer;
+  std::map<uint32_t, std::unique_ptr<Monitor>> monitors;
+  std::vector<float> mixed;
+
+  ~Impl() {
+    if (context) {
+      pa_threaded_mainloop_lock(loop);
+      pa_context_set_state_callback(context, nullptr, nullptr);
+      pa_context_disconnect(context);
+      pa_context_unref(context);
+      pa_threaded_mainloop_unlock(loop);
+    }
+    if (loop) {
+      pa_threaded_mainloop_stop(loop);
+      pa_threaded_mainloop_free(loop);
+    }
+  }
+
+  // Connect on first use, so an engine can exist without a server. Call
+  // with the loop locked.
+  bool Connect(std::string &error) {
+    if (context && pa_context_get_state(context) == PA_CONTEXT_READY) {
+      return true;
+    }
+    if (context) {
+      pa_context_set_state_callback(context, nullptr, nullptr);
+      pa_context_disconnect(context);
+      pa_context_unref(context);
+      context = nullptr;
+    }
+    context = pa_context_new(pa_threaded_mainloop_get_api(loop),
+                             "native-recorder");
+    if (!context) {
+      error = "Failed to create PulseAudio context";
+      return false;
+    }
+    pa_context_set_state_callback(context, OnContextState, this);
+    if (pa_context_connect(context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) <
+        0) {
+      error = std::string("Failed to connect to PulseAudio: ") +
+              pa_strerror(pa_context_errno(context));
+      return false;
+    }
+    for (;;) {
+      pa_context_state_t state = pa_context_get_state(context);
+      if (state == PA_CONTEXT_READY) {
+        return true;
+      }
+      if (!PA_CONTEXT_IS_GOOD(state)) {
+        error = std::string("Failed to connect to PulseAudio: ") +
+                pa_strerror(pa_context_errno(context));
+        return false;
+      }
+      pa_threaded_mainloop_wait(loop);
+    }
+  }
+
+  // Wait with the loop locked for an operation whose callback signals
+  void Wait(pa_operation *operation) {
+    if (!operation) {
+      return;
+    }
+    while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING) {
+      pa_threaded_mainloop_wait(loop);
+    }
+    pa_operation_unref(operation);
+  }
+
+  void Fail(const std::string &message) {
+    if (sink) {
+      sink->OnError(message);
+    }
+  }
+
+  // The server going away (a restart, or PipeWire's pulse server exiting)
+  // ends the capture; report it like a lost device
+  void FailCapture(const std::string &message) {
+    if (capturing && !failed) {
+      failed = true;
+      Fail(message);
+    }
+  }
+
+  static void OnContextState(pa_context *c, void *userdata) {
+    Impl *impl = (Impl *)userdata;
+    impl->loopThreadId = CurrentThreadId();
+    if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(c))) {
+      impl->FailCapture(std::string("Lost the PulseAudio server: ") +
+                        pa_strerror(pa_context_errno(c)));
+    }
+    pa_threaded_mainloop_signal(impl->loop, 0);
+  }
+
+  static void OnStreamState(pa_stream *s, void *userdata) {
+    Impl *impl = (Impl *)userdata;
+    if (!PA_STREAM_IS_GOOD(pa_stream_get_state(s))) {
+      impl->FailCapture(
+          std::string("PulseAudio stopped the recording: ") +
+          pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+    }
+  }
+
+  pa_stream *OpenRecord(const pa_sample_spec &spec, const char *device,
+                        pa_stream_request_cb_t onRead, void *userdata,
+                        int64_t monitorOf) {
+    pa_stream *s = pa_stream_new(context, "Native Recorder", &spec, nullptr);
+    if (!s) {
+      return nullptr;
+    }
+    pa_stream_set_read_callback(s, onRead, userdata);
+    if (monitorOf >= 0) {
+      pa_stream_set_monitor_stream(s, (uint32_t)monitorOf);
+    } else {
+      // A sink input's monitor ends with the sink input, which the
+      // selector handles; a device stream ending is an error
+      pa_stream_set_state_callback(s, OnStreamState, this);
+    }
+    pa_buffer_attr attr;
+    memset(&attr, 0xff, sizeof(attr));
+    attr.fragsize = (uint32_t)pa_usec_to_bytes(kFragmentUsec, &spec);
+    int flags = PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING |
+                PA_STREAM_AUTO_TIMING_UPDATE;
+    if (monitorOf >= 0) {
+      // When the sink input moves, the selector restarts the stream on the
+      // new sink's monitor
+      flags |= PA_STREAM_DONT_MOVE;
+    }
+    if (pa_stream_connect_record(s, device, &attr,
+                                 (pa_stream_flags_t)flags) < 0) {
+      pa_stream_unref(s);
+      return nullptr;
+    }
+    return s;
+  }
+
+  static void CloseRecord(pa_stream *s) {
+    pa_stream_set_read_callback(s, nullptr, nullptr);
+    pa_stream_set_state_callback(s, nullptr, nullptr);
+    pa_stream_disconnect(s);
+    pa_stream_unref(s);
+  }
+
+  // Capture time of the oldest unread frame of s
+  static int64_t Timestamp(pa_stream *s) {
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (pa_stream_get_latency(s, &latency, &negative) < 0) {
+      return 0;
+    }
+    int64_t latencyNs = (int64_t)latency * 1000;
+    return SteadyNowNs() - (negative ? -latencyNs : latencyNs);
+  }
+
+  void ApplyPriority() {
+    if (!priorityApplied) {
+      stats.SetThreadPriority(PromoteCurrentThread(options.threadPriority));
+      priorityApplied = true;
+    }
+  }
+
+  void Push(const void *data, size_t frames, const CaptureMetadata &meta) {
+    ApplyPriority();
+    auto start = std::chrono::steady_clock::now();
+    core->Push((const uint8_t *)data, frames, meta);
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    stats.RecordPacket(frames, elapsed, elapsed);
+  }
+
+  // ---- Device capture ----
+
+  static void OnDeviceRead(pa_stream *s, size_t, void *userdata) {
+    Impl *impl = (Impl *)userdata;
+    while (pa_stream_readable_size(s) > 0) {
+      const void *data = nullptr;
+      size_t bytes = 0;
+      if (pa_stream_peek(s, &data, &bytes) < 0) {
+        impl->Fail("Failed to read from PulseAudio stream");
+        return;
+      }
+      if (bytes == 0) {
+        break;
+      }
+      CaptureMetadata meta;
+      meta.timestampNs = Timestamp(s);
+      // A hole in the buffer: frames the server dropped, pushed as silence
+      meta.discontinuity = data == nullptr;
+      impl->Push(data, bytes / impl->frameBytes, meta);
+      pa_stream_drop(s);
+    }
+  }
+
+  // ---- Process loopback ----
+
+  static void OnMonitorRead(pa_stream *s, size_t, void *userdata) {
+    Monitor *monitor = (Monitor *)userdata;
+    Impl *impl = monitor->impl;
+    int64_t timestampNs = Timestamp(s);
+    while (pa_stream_readable_size(s) > 0) {
+      const void *data = nullptr;
+      size_t bytes = 0;
+      if (pa_stream_peek(s, &data, &bytes) < 0) {
+        impl->Fail("Failed to read from PulseAudio stream");
+        return;
+      }
+      if (bytes == 0) {
+        break;
+      }
+      if (data) {
+        impl->mixer->Write(monitor->index, (const float *)data,
+                           bytes / (sizeof(float) * kLoopbackChannels));
+      }
+      pa_stream_drop(s);
+    }
+
+    size_t frames = impl->mixer->Read(impl->mixed);
+    if (frames > 0) {
+      CaptureMetadata meta;
+      meta.timestampNs = timestampNs;
+      impl->Push(impl->mixed.data(), frames, meta);
+    }
+  }
+
+  // The sink a monitored sink input plays to: record its monitor source
+  static void OnMonitorSink(pa_context *, const pa_sink_info *info, int eol,
+                            void *userdata) {
+    Monitor *monitor = (Monitor *)userdata;
+    Impl *impl = monitor->impl;
+    if (eol || !info) {
+      pa_operation_unref(monitor->lookup);
+      monitor->lookup = nullptr;
+      return;
+    }
+    pa_sample_spec spec = {PA_SAMPLE_FLOAT32LE, kLoopbackRate,
+                           kLoopbackChannels};
+    std::string source = std::to_string(info->monitor_source);
+    monitor->stream = impl->OpenRecord(spec, source.c_str(), OnMonitorRead,
+                                       monitor, monitor->index);
+    if (!monitor->stream) {
+      impl->Fail("Failed to record sink input " +
+                 std::to_string(monitor->index));
+    }
+  }
+
+  static void OnSinkInput(pa_context *, const pa_sink_input_info *info,
+                          int eol, void *userdata) {
+    Impl *impl = (Impl *)userdata;
+    if (eol || !info || !impl->selector) {
+      pa_threaded_mainloop_signal(impl->loop, 0);
+      return;
+    }
+    SinkInputInfo input;
+    input.index = info->index;
+    input.sink = info->sink;
+    const char *pid =
+        pa_proplist_gets(info->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+    if (pid) {
+      input.processId = strtoll(pid, nullptr, 10);
+    }
+    SinkInputSelector::Changes changes;
+    impl->selector->Update(input, changes);
+    impl->Apply(changes);
+  }
+
+  static void OnEvent(pa_context *c, pa_subscription_event_type_t type,
+                      uint32_t index, void *userdata) {
+    Impl *impl = (Impl *)userdata;
+    if ((type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) !=
+            PA_SUBSCRIPTION_EVENT_SINK_INPUT ||
+        !impl->selector) {
+      return;
+    }
+    if ((type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) ==
+        PA_SUBSCRIPTION_EVENT_REMOVE) {
+      SinkInputSelector::Changes changes;
+      impl->selector->Remove(index, changes);
+      impl->Apply(changes);
+      return;
+    }
+    // A new process may reuse the PID of one that has exited
+    impl->tree->Refresh();
+    pa_operation *operation =
+        pa_context_get_sink_input_info(c, index, OnSinkInput, impl);
+    if (operation) {
+      pa_operation_unref(operation);
+    }
+  }
+
+  void StopMonitor(Monitor &monitor) {
+    if (monitor.lookup) {
+      pa_operation_cancel(monitor.lookup);
+      pa_operation_unref(monitor.lookup);
+    }
+    if (monitor.stream) {
+      CloseRecord(monitor.stream);
+    }
+  }
+
+  void Apply(const SinkInputSelector::Changes &changes) {
+    for (uint32_t index : changes.stop) {
+      auto it = monitors.find(index);
+      if (it != monitors.end()) {
+        StopMonitor(*it->second);
+        monitors.erase(it);
+      }
+      mixer->RemoveSource(index);
+    }
+    for (const SinkInputInfo &input : changes.start) {
+      auto monitor = std::make_unique<Monitor>();
+      monitor->impl = this;
+      monitor->index = input.index;
+      monitor->lookup = pa_context_get_sink_info_by_index(
+          context, input.sink, OnMonitorSink, monitor.get());
+      mixer->AddSource(input.index);
+      monitors[input.index] = std::move(monitor);
+    }
+  }
+
+  void Close() {
+    if (!loop) {
+      return;
+    }
+    pa_threaded_mainloop_lock(loop);
+    capturing = false;
+    if (stream) {
+      CloseRecord(stream);
+      stream = nullptr;
+    }
+    for (auto &entry : monitors) {
+      StopMonitor(*entry.second);
+    }
+    monitors.clear();
+    if (context && selector) {
+      pa_context_set_subscribe_callback(context, nullptr, nullptr);
+      pa_operation *operation = pa_context_subscribe(
+          context, PA_SUBSCRIPTION_MASK_NULL, nullptr, nullptr);
+      if (operation) {
+        pa_operation_unref(operation);
+      }
+    }
+    selector.reset();
+    pa_threaded_mainloop_unlock(loop);
+    // No callback can run any more
+    mixer.reset();
+    tree.reset();
+    core.reset();
+  }
+};
+
+PulseEngine::PulseEngine() : impl(std::make_unique<Impl>()) {
+  impl->loop = pa_threaded_mainloop_new();
+  if (impl->loop && pa_threaded_mainloop_start(impl->loop) < 0) {
+    pa_threaded_mainloop_free(impl->loop);
+    impl->loop = nullptr;
+  }
+}
+
+PulseEngine::~PulseEngine() { Stop(); }
+
+void PulseEngine::Start(const std::string &deviceType,
+                        const std::string &deviceId,
+                        std::shared_ptr<CaptureSink> sink) {
+  impl->Close();
+  impl->sink = sink;
+  impl->stats.Reset();
+  impl->priorityApplied = false;
+  impl->failed = false;
+  if (!impl->loop) {
+    sink->OnError("Failed to start the PulseAudio main loop");
+    return;
+  }
+
+  pa_threaded_mainloop_lock(impl->loop);
+  std::string error;
+  if (!impl->Connect(error)) {
+    pa_threaded_mainloop_unlock(impl->loop);
+    sink->OnError(error);
+    return;
+  }
+
+  // Asking rtkit blocks on D-Bus, so it is done here, before any stream
+  // exists, rather than from the first callback; the loop thread keeps
+  // what it was granted for later streams
+  if (impl->options.threadPriority.realtime && !impl->loopRealtimeRequested) {
+    int64_t threadId = impl->loopThreadId;
+    pa_threaded_mainloop_unlock(impl->loop);
+    RequestRealtimeThread(threadId);
+    pa_threaded_mainloop_lock(impl->loop);
+    impl->loopRealtimeRequested = true;
+  }
+
+  int64_t processId = 0;
+  if (deviceType == AudioEngine::DEVICE_TYPE_OUTPUT &&
+      ParseProcessLoopbackId(deviceId, processId)) {
+    InputDescriptor input = {kLoopbackRate, kLoopbackChannels,
+                             SampleEncoding::Float32, false};
+    impl->core = std::make_unique<CaptureCore>(input, *sink,
+                                               impl->options.stages,
+                                               impl->options.dither);
+    impl->core->Reserve(kMaxSkewFrames * 2);
+    impl->tree = std::make_unique<ProcessTree>(
+        [](int64_t pid) { return SystemParentProcessId(pid); });
+    impl->selector =
+        std::make_unique<SinkInputSelector>(processId, *impl->tree);
+    impl->mixer =
+        std::make_unique<LoopbackMixer>(kLoopbackChannels, kMaxSkewFrames);
+
+    // Follow sink inputs as they appear, then pick up those playing now
+    pa_context_set_subscribe_callback(impl->context, Impl::OnEvent,
+                                      impl.get());
+    pa_operation *operation = pa_context_subscribe(
+        impl->context, PA_SUBSCRIPTION_MASK_SINK_INPUT, nullptr, nullptr);
+    if (operation) {
+      pa_operation_unref(operation);
+    }
+    impl->Wait(pa_context_get_sink_input_info_list(
+        impl->context, Impl::OnSinkInput, impl.get()));
+    impl->capturing = true;
+    pa_threaded_mainloop_unlock(impl->loop);
+    return;
+  }
+
+  pa_threaded_mainloop_unlock(impl->loop);
+
+  AudioFormat format = GetDeviceFormat(deviceId);
+  if (format.sampleRate == 0) {
+    sink->OnError("Failed to get audio device: " + deviceId);
+    return;
+  }
+
+  // Sources record as they are; sinks through their monitor. The server
+  // converts to float at the device's own rate and channel count.
+  bool isOutput = deviceType == AudioEngine::DEVICE_TYPE_OUTPUT;
+  std::string device = isOutput ? deviceId + ".monitor" : deviceId;
+  pa_sample_spec spec = {PA_SAMPLE_FLOAT32LE, (uint32_t)format.sampleRate,
+                         (uint8_t)format.channels};
+  InputDescriptor input = {format.sampleRate, format.channels,
+                           SampleEncoding::Float32, false};
+  impl->core = std::make_unique<CaptureCore>(input, *sink,
+                                             impl->options.stages,
+                                             impl->options.dither);
+  impl->frameBytes = pa_frame_size(&spec);
+  impl->core->Reserve(pa_usec_to_bytes(kFragmentUsec * 4, &spec) /
+                      impl->frameBytes);
+
+  pa_threaded_mainloop_lock(impl->loop);
+  impl->stream = impl->OpenRecord(spec, device.c_str(), Impl::OnDeviceRead,
+                                  impl.get(), -1);
+  impl->capturing = impl->stream != nullptr;
+  pa_threaded_mainloop_unlock(impl->loop);
+  if (!impl->stream) {
+    sink->OnError("Failed to record from " + device);
+  }
+}
+
+void PulseEngine::Stop() { impl->Close(); }
+
+void PulseEngine::SetOptions(const StreamOptions &options) {
+  // sharedScheduler is not supported here: each recorder has its own
+  // engine and so its own main loop thread, and sharedStreams stays 1
+  impl->options = options;
+}
+
+StreamStats PulseEngine::GetStats() { return impl->stats.Snapshot(); }
+
+std::vector<AudioDevice> PulseEngine::GetDevices() {
+  struct Listing {
+    pa_threaded_mainloop *loop;
+    std::string defaultSource;
+    std::string defaultSink;
+    std::vector<AudioDevice> devices;
+  } listing = {impl->loop, "", "", {}};
+  if (!impl->loop) {
+    return listing.devices;
+  }
+
+  pa_threaded_mainloop_lock(impl->loop);
+  std::string error;
+  if (impl->Connect(error)) {
+    impl->Wait(pa_context_get_server_info(
+        impl->context,
+        [](pa_context *, const pa_server_info *info, void *userdata) {
+          Listing *listing = (Listing *)userdata;
+          if (info) {
+            listing->defaultSource =
+                info->default_source_name ? info->default_source_name : "";
+            listing->defaultSink =
+                info->default_sink_name ? info->default_sink_name : "";
+          }
+          pa_threaded_mainloop_signal(listing->loop, 0);
+        },
+        &listing));
+    impl->Wait(pa_context_get_source_info_list(
+        impl->context,
+        [](pa_context *, const pa_source_info *info, int eol,
+           void *userdata) {
+          Listing *listing = (Listing *)userdata;
+          if (eol || !info) {
+            pa_threaded_mainloop_signal(listing->loop, 0);
+            return;
+          }
+          // Monitors are offered as output devices instead
+          if (info->monitor_of_sink != PA_INVALID_INDEX) {
+            return;
+          }
+          AudioDevice device;
+          device.id = info->name;
+          device.name = info->description ? info->description : info->name;
+          device.type = AudioEngine::DEVICE_TYPE_INPUT;
+          device.isDefault = device.id == listing->defaultSource;
+          listing->devices.push_back(device);
+        },
+        &listing));
+    impl->Wait(pa_context_get_sink_info_list(
+        impl->context,
+        [](pa_context *, const pa_sink_info *info, int eol, void *userdata) {
+          Listing *listing = (Listing *)userdata;
+          if (eol || !info) {
+            pa_threaded_mainloop_signal(listing->loop, 0);
+            return;
+          }
+          AudioDevice device;
+          device.id = info->name;
+          device.name = info->description ? info->description : info->name;
+          device.type = AudioEngine::DEVICE_TYPE_OUTPUT;
+          device.isDefault = device.id == listing->defaultSink;
+          listing->devices.push_back(device);
+        },
+        &listing));
+  }
+  pa_threaded_mainloop_unlock(impl->loop);
+  return listing.devices;
+}
+
+AudioFormat PulseEngine::GetDeviceFormat(const std::string &deviceId) {
+  AudioFormat format = {0, 0, 0, 0};
+  int64_t processId = 0;
+  if (ParseProcessLoopbackId(deviceId, processId)) {
+    format.sampleRate = kLoopbackRate;
+    format.channels = kLoopbackChannels;
+    format.bitDepth = 16;
+    format.rawBitDepth = 32;
+    return format;
+  }
+  if (!impl->loop) {
+    return format;
+  }
+
+  struct Query {
+    pa_threaded_mainloop *loop;
+    pa_sample_spec spec;
+    bool found;
+  } query = {impl->loop, {}, false};
+  pa_threaded_mainloop_lock(impl->loop);
+  std::string error;
+  if (impl->Connect(error)) {
+    // Sources first, then sinks of the same name
+    impl->Wait(pa_context_get_source_info_by_name(
+        impl->context, deviceId.c_str(),
+        [](pa_context *, const pa_source_info *info, int eol,
+           void *userdata) {
+          Query *query = (Query *)userdata;
+          if (!eol && info) {
+            query->spec = info->sample_spec;
+            query->found = true;
+          }
+          pa_threaded_mainloop_signal(query->loop, 0);
+        },
+        &query));
+    if (!query.found) {
+      impl->Wait(pa_context_get_sink_info_by_name(
+          impl->context, deviceId.c_str(),
+          [](pa_context *, const pa_sink_info *info, int eol,
+             void *userdata) {
+            Query *query = (Query *)userdata;
+            if (!eol && info) {
+              query->spec = info->sample_spec;
+              query->found = true;
+            }
+            pa_threaded_mainloop_signal(query->loop, 0);
+          },
+          &query));
+    }
+  }
+  pa_threaded_mainloop_unlock(impl->loop);
+
+  if (query.found) {
+    format.sampleRate = (int)query.spec.rate;
+    format.channels = query.spec.channels;
+    format.bitDepth = 16; // We always convert to 16-bit PCM
+    format.rawBitDepth = (int)pa_sample_size(&query.spec) * 8;
+    format.periodFrames = (int)((uint64_t)query.spec.rate * kFragmentUsec /
+                                1000000);
+  }
+  return format;
+}
+
+PermissionStatus PulseEngine::CheckPermission() {
+  PermissionStatus status;
+  status.mic = true;
+  status.system = true;
+  return status;
+}
+
+bool PulseEngine::RequestPermission(PermissionType type) { return true; }
+
+#endif
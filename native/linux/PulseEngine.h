@@ -0,0 +1,35 @@
+#pragma once
+
+#ifdef HAVE_PULSEAUDIO
+
+#include "../AudioEngine.h"
+#include <memory>
+
+// Linux engine on the PulseAudio client API, which PipeWire's pulse server
+// also speaks. Input devices are sources; output devices are sinks,
+// recorded through their monitor sources. "process:<pid>" records only the
+// sink inputs of that process tree. Callbacks run on the threaded main
+// loop's thread.
+class PulseEngine : public AudioEngine {
+public:
+  PulseEngine();
+  ~PulseEngine();
+
+  void Start(const std::string &deviceType, const std::string &deviceId,
+             std::shared_ptr<CaptureSink> sink) override;
+  void Stop() override;
+  void SetOptions(const StreamOptions &options) override;
+  StreamStats GetStats() override;
+  std::vector<AudioDevice> GetDevices() override;
+  AudioFormat GetDeviceFormat(const std::string &deviceId) override;
+
+  // No permission prompts on Linux
+  PermissionStatus CheckPermission() override;
+  bool RequestPermission(PermissionType type) override;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+#endif
@@ -9,8 +9,10 @@ public:
   ~AVFEngine();
 
   void Start(const std::string &deviceType, const std::string &deviceId,
-             DataCallback dataCb, ErrorCallback errorCb) override;
+             std::shared_ptr<CaptureSink> sink) override;
   void Stop() override;
+  void SetOptions(const StreamOptions &options) override;
+  StreamStats GetStats() override;
   std::vector<AudioDevice> GetDevices() override;
   AudioFormat GetDeviceFormat(const std::string &deviceId) override;
 
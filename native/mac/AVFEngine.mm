@@ -1,17 +1,20 @@
 #import "AVFEngine.h"
 #import "SCKAudioCapture.h"
+#import "SampleBufferMetadata.h"
 #import <AVFoundation/AVFoundation.h>
 #import <CoreMedia/CoreMedia.h>
 #import <ScreenCaptureKit/ScreenCaptureKit.h>
+#include "../core/ProcessLoopback.h"
+#include <chrono>
 
 @interface AVFRecorderDelegate : NSObject <AVCaptureAudioDataOutputSampleBufferDelegate>
-@property (nonatomic, assign) AudioEngine::DataCallback dataCallback;
-@property (nonatomic, assign) AudioEngine::ErrorCallback errorCallback;
+@property (nonatomic, assign) CaptureCore *core;
+@property (nonatomic, assign) StreamStatsRecorder *stats;
 @end
 
 @implementation AVFRecorderDelegate
 - (void)captureOutput:(AVCaptureOutput *)output didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection *)connection {
-    if (!self.dataCallback) return;
+    if (!self.core) return;
 
     CMBlockBufferRef blockBuffer = CMSampleBufferGetDataBuffer(sampleBuffer);
     if (!blockBuffer) return;
@@ -21,7 +24,16 @@
     OSStatus status = CMBlockBufferGetDataPointer(blockBuffer, 0, &lengthAtOffset, &totalLength, &dataPointer);
     
     if (status == kCMBlockBufferNoErr) {
-        self.dataCallback((const uint8_t*)dataPointer, totalLength);
+        auto begin = std::chrono::steady_clock::now();
+        const InputDescriptor &input = self.core->Input();
+        size_t frames = totalLength / (input.channels * BytesPerSample(input.encoding));
+        self.core->Push((const uint8_t*)dataPointer, frames, SampleBufferMetadata(sampleBuffer));
+        if (self.stats) {
+            int64_t processingNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+            self.stats->RecordPacket(CMSampleBufferGetNumSamples(sampleBuffer), processingNs,
+                                     SampleBufferLatencyNs(sampleBuffer));
+        }
     }
 }
 @end
@@ -31,6 +43,11 @@ struct AVFEngine::Impl {
     AVFRecorderDelegate *delegate;
     SCKAudioCapture *sckCapture;
     dispatch_queue_t queue;
+    std::unique_ptr<CaptureCore> core;
+    // Receives the core's output and every error, held until the next start
+    std::shared_ptr<CaptureSink> sink;
+    StreamOptions options;
+    StreamStatsRecorder stats;
     
     Impl() {
         session = nil;
@@ -53,8 +70,13 @@ struct AVFEngine::Impl {
         if (sckCapture) {
             [sckCapture stop];
         }
+        if (queue) {
+            // Let a callback already in flight finish with the core
+            dispatch_sync(queue, ^{});
+        }
         delegate = nil;
         queue = nil;
+        core = nullptr;
     }
 };
 
@@ -62,25 +84,41 @@ AVFEngine::AVFEngine() : impl(std::make_unique<Impl>()) {}
 
 AVFEngine::~AVFEngine() = default;
 
-void AVFEngine::Start(const std::string &deviceType, const std::string &deviceId, 
-                      DataCallback dataCb, ErrorCallback errorCb) {
+void AVFEngine::Start(const std::string &deviceType, const std::string &deviceId,
+                      std::shared_ptr<CaptureSink> sink) {
     impl->Stop();
+    impl->sink = sink;
+    impl->stats.Reset();
+    impl->sckCapture.stats = &impl->stats;
+
+    // Capture callbacks run on our GCD queues, whose threads can't be moved
+    // to a real-time policy or pinned; the highest QoS class is the closest
+    // equivalent
+    bool highPriority = impl->options.threadPriority.realtime;
+    impl->sckCapture.highPriority = highPriority;
+    ThreadPriorityResult priority;
+    priority.priority = highPriority ? ThreadPriority::Elevated : ThreadPriority::Normal;
+    impl->stats.SetThreadPriority(priority);
 
     // Determine if this is output (system audio) or input (microphone)
     bool isOutputDevice = (deviceType == AudioEngine::DEVICE_TYPE_OUTPUT);
 
     if (isOutputDevice) {
-        // Output device: use ScreenCaptureKit for system audio
-        // On macOS, we only support system-wide capture (deviceId should be "system")
-        if (deviceId != AudioEngine::SYSTEM_AUDIO_DEVICE_ID) {
-            if (errorCb) errorCb("macOS only supports system-wide audio capture for output devices. Use deviceId='system'.");
+        // Output device: use ScreenCaptureKit for system audio, either
+        // system-wide ("system") or one application ("process:<pid>")
+        int64_t processId = 0;
+        if (deviceId != AudioEngine::SYSTEM_AUDIO_DEVICE_ID &&
+            !ParseProcessLoopbackId(deviceId, processId)) {
+            sink->OnError("macOS only supports system-wide or per-process audio capture for output devices. Use deviceId='system' or 'process:<pid>'.");
             return;
         }
         
         if (@available(macOS 13.0, *)) {
-            [impl->sckCapture startWithCallback:dataCb errorCallback:errorCb];
+            impl->sckCapture.processId = (pid_t)processId;
+            [impl->sckCapture setStages:impl->options.stages dither:impl->options.dither];
+            [impl->sckCapture startWithSink:sink];
         } else {
-            if (errorCb) errorCb("System audio recording requires macOS 13.0 or later.");
+            sink->OnError("System audio recording requires macOS 13.0 or later.");
         }
         return;
     }
@@ -88,29 +126,36 @@ void AVFEngine::Start(const std::string &deviceType, const std::string &deviceId
     // Input device: use AVFoundation for microphone
     impl->session = [[AVCaptureSession alloc] init];
     impl->delegate = [[AVFRecorderDelegate alloc] init];
-    impl->delegate.dataCallback = dataCb;
-    impl->delegate.errorCallback = errorCb;
-    impl->queue = dispatch_queue_create("com.native-recorder.audio", DISPATCH_QUEUE_SERIAL);
+    // The output settings below fix the device format
+    InputDescriptor inputFormat = {48000, 2, SampleEncoding::Int16, false};
+    impl->core = std::make_unique<CaptureCore>(
+        inputFormat, *sink, impl->options.stages, impl->options.dither);
+    impl->delegate.core = impl->core.get();
+    impl->delegate.stats = &impl->stats;
+    dispatch_queue_attr_t queueAttr = highPriority
+        ? dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0)
+        : DISPATCH_QUEUE_SERIAL;
+    impl->queue = dispatch_queue_create("com.native-recorder.audio", queueAttr);
 
     // Find device by ID
     AVCaptureDevice *device = [AVCaptureDevice deviceWithUniqueID:[NSString stringWithUTF8String:deviceId.c_str()]];
 
     if (!device) {
-        if (errorCb) errorCb("Device not found: " + deviceId);
+        sink->OnError("Device not found: " + deviceId);
         return;
     }
 
     NSError *error = nil;
     AVCaptureDeviceInput *input = [AVCaptureDeviceInput deviceInputWithDevice:device error:&error];
     if (error || !input) {
-        if (errorCb) errorCb("Could not create device input: " + std::string([error.localizedDescription UTF8String]));
+        sink->OnError("Could not create device input: " + std::string([error.localizedDescription UTF8String]));
         return;
     }
 
     if ([impl->session canAddInput:input]) {
         [impl->session addInput:input];
     } else {
-        if (errorCb) errorCb("Cannot add input to session");
+        sink->OnError("Cannot add input to session");
         return;
     }
 
@@ -133,7 +178,7 @@ void AVFEngine::Start(const std::string &deviceType, const std::string &deviceId
     if ([impl->session canAddOutput:output]) {
         [impl->session addOutput:output];
     } else {
-        if (errorCb) errorCb("Cannot add output to session");
+        sink->OnError("Cannot add output to session");
         return;
     }
 
@@ -144,6 +189,17 @@ void AVFEngine::Stop() {
     impl->Stop();
 }
 
+void AVFEngine::SetOptions(const StreamOptions &options) {
+    // Capture callbacks already run on per-stream GCD queues, which share
+    // the system's thread pool, so sharedScheduler needs no extra work here.
+    // threadPriority.realtime maps to the queue QoS in Start().
+    impl->options = options;
+}
+
+StreamStats AVFEngine::GetStats() {
+    return impl->stats.Snapshot();
+}
+
 std::vector<AudioDevice> AVFEngine::GetDevices() {
     std::vector<AudioDevice> devices;
     
@@ -181,7 +237,9 @@ std::vector<AudioDevice> AVFEngine::GetDevices() {
 AudioFormat AVFEngine::GetDeviceFormat(const std::string &deviceId) {
     AudioFormat format = {0, 0, 0, 0};
     
-    if (deviceId == AudioEngine::SYSTEM_AUDIO_DEVICE_ID) {
+    int64_t processId = 0;
+    if (deviceId == AudioEngine::SYSTEM_AUDIO_DEVICE_ID ||
+        ParseProcessLoopbackId(deviceId, processId)) {
         format.sampleRate = 48000;
         format.channels = 2;
         format.bitDepth = 16;
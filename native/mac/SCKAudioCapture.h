@@ -1,13 +1,26 @@
 #import <Foundation/Foundation.h>
 #import <ScreenCaptureKit/ScreenCaptureKit.h>
-#include <functional>
+#include "../core/CaptureCore.h"
+#include "../core/StreamStats.h"
+#include <memory>
 #include <string>
+#include <vector>
 
-typedef std::function<void(const uint8_t *, size_t)> SCKDataCallback;
-typedef std::function<void(std::string)> SCKErrorCallback;
-
+// System audio through one ScreenCaptureKit stream, kept across stop and
+// start: a restart with the same settings only starts it again
 @interface SCKAudioCapture : NSObject
-- (void)startWithCallback:(SCKDataCallback)dataCb
-            errorCallback:(SCKErrorCallback)errorCb;
+// Optional, owned by the engine; updated for every delivered buffer
+@property (nonatomic, assign) StreamStatsRecorder *stats;
+// Deliver on a QOS_CLASS_USER_INTERACTIVE queue; applied by the next start
+@property (nonatomic, assign) BOOL highPriority;
+// Capture only the applications in this process tree; 0 for all system
+// audio. Applied by the next start.
+@property (nonatomic, assign) pid_t processId;
+// Processing stages and requantisation for the next start
+- (void)setStages:(const std::vector<std::shared_ptr<CaptureStage>> &)stages
+           dither:(DitherMode)dither;
+// sink receives the converted audio and errors; held until the stream has
+// stopped
+- (void)startWithSink:(std::shared_ptr<CaptureSink>)sink;
 - (void)stop;
 @end
@@ -1,96 +1,304 @@
 #import "SCKAudioCapture.h"
+#import "SampleBufferMetadata.h"
 #import <CoreMedia/CoreMedia.h>
+#include "../core/ProcessLoopback.h"
+#include "../core/StreamReuse.h"
+#include <algorithm>
+#include <cstddef>
+#include <chrono>
 #include <vector>
 
+// The video side ScreenCaptureKit insists on: the smallest frame, at most
+// once a minute, as few frames in flight as it allows
+static const int kVideoSize = 2;
+static const int kVideoFrameIntervalSeconds = 60;
+static const int kVideoQueueDepth = 3;
+
 @interface SCKAudioCapture () <SCStreamOutput, SCStreamDelegate>
 @property (nonatomic, strong) SCStream *stream;
-@property (nonatomic, assign) SCKDataCallback dataCallback;
-@property (nonatomic, assign) SCKErrorCallback errorCallback;
 @property (nonatomic, strong) dispatch_queue_t captureQueue;
+// Orders starts and stops; the stream and its reuse state are only
+// touched here
+@property (nonatomic, strong) dispatch_queue_t controlQueue;
+// Video frames we have to take, dropped at once
+@property (nonatomic, strong) dispatch_queue_t videoQueue;
+// Entered while a stop is completing, so the next start waits for it
+@property (nonatomic, strong) dispatch_group_t stopping;
 @end
 
-@implementation SCKAudioCapture
+@implementation SCKAudioCapture {
+    // Only touched on the capture queue, rebuilt when the format changes
+    std::unique_ptr<CaptureCore> _core;
+    std::shared_ptr<CaptureSink> _sink;
+    // Buffer list and plane pointers for planar audio, sized with the core
+    // so a packet does not allocate
+    std::vector<uint8_t> _bufferList;
+    std::vector<const uint8_t *> _planes;
+    std::vector<std::shared_ptr<CaptureStage>> _stages;
+    DitherMode _dither;
+    // For the next start; only touched by the engine's thread
+    std::vector<std::shared_ptr<CaptureStage>> _nextStages;
+    DitherMode _nextDither;
+    // Only touched on the control queue. Every start and stop bumps the
+    // generation, so a start still waiting on the system when stop() comes
+    // gives up.
+    StreamReuse _reuse;
+    uint64_t _generation;
+}
 
 - (instancetype)init {
     self = [super init];
     if (self) {
         // Create a dedicated serial queue for audio capture callbacks
         // This is crucial because Node.js doesn't run the Cocoa main run loop
-        _captureQueue = dispatch_queue_create("com.native-recorder.sck-audio", DISPATCH_QUEUE_SERIAL);
+        _captureQueue = [SCKAudioCapture newCaptureQueue:NO];
+        _controlQueue = dispatch_queue_create("com.native-recorder.sck-control", DISPATCH_QUEUE_SERIAL);
+        _videoQueue = dispatch_queue_create("com.native-recorder.sck-video",
+            dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_BACKGROUND, 0));
+        _stopping = dispatch_group_create();
+        _dither = DitherMode::Tpdf;
+        _nextDither = DitherMode::Tpdf;
+        _generation = 0;
     }
     return self;
 }
 
 - (void)dealloc {
-    [self stop];
+    // Blocks on the control queue hold self, so none is pending here
+    if (@available(macOS 13.0, *)) {
+        if (_stream && _reuse.Running()) {
+            [_stream stopCaptureWithCompletionHandler:nil];
+        }
+    }
+}
+
++ (dispatch_queue_t)newCaptureQueue:(BOOL)highPriority {
+    if (highPriority) {
+        dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(
+            DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0);
+        return dispatch_queue_create("com.native-recorder.sck-audio", attr);
+    }
+    return dispatch_queue_create("com.native-recorder.sck-audio", DISPATCH_QUEUE_SERIAL);
+}
+
+- (void)setStages:(const std::vector<std::shared_ptr<CaptureStage>> &)stages
+           dither:(DitherMode)dither {
+    _nextStages = stages;
+    _nextDither = dither;
 }
 
-- (void)startWithCallback:(SCKDataCallback)dataCb errorCallback:(SCKErrorCallback)errorCb {
-    self.dataCallback = dataCb;
-    self.errorCallback = errorCb;
+- (void)startWithSink:(std::shared_ptr<CaptureSink>)sink {
+    SystemAudioSettings settings;
+    settings.processId = self.processId;
+    settings.highPriority = self.highPriority;
+    std::vector<std::shared_ptr<CaptureStage>> stages = _nextStages;
+    DitherMode dither = _nextDither;
 
     if (@available(macOS 13.0, *)) {
-        [SCShareableContent getShareableContentExcludingDesktopWindows:YES
-                                                  onScreenWindowsOnly:NO
-                                                    completionHandler:^(SCShareableContent *content, NSError *error) {
-            dispatch_async(self.captureQueue, ^{
-                if (error) {
-                    if (self.errorCallback) self.errorCallback("Failed to get shareable content: " + std::string(error.localizedDescription.UTF8String));
-                    return;
-                }
+        // Behind any stop still completing
+        dispatch_async(self.controlQueue, ^{
+            dispatch_group_notify(self.stopping, self.controlQueue, ^{
+                [self beginWithSink:sink stages:stages dither:dither
+                           settings:settings generation:++_generation];
+            });
+        });
+    } else {
+        sink->OnError("ScreenCaptureKit audio capture requires macOS 13.0+");
+    }
+}
 
-                SCDisplay *display = content.displays.firstObject;
-                if (!display) {
-                    if (self.errorCallback) self.errorCallback("No display found");
-                    return;
-                }
+// On the control queue, with the stream stopped (or never built)
+- (void)beginWithSink:(std::shared_ptr<CaptureSink>)sink
+               stages:(std::vector<std::shared_ptr<CaptureStage>>)stages
+               dither:(DitherMode)dither
+             settings:(SystemAudioSettings)settings
+           generation:(uint64_t)generation API_AVAILABLE(macos(13.0)) {
+    // Nothing of the last run is still being delivered
+    dispatch_sync(self.captureQueue, ^{
+        _core = nullptr;
+        _sink = sink;
+        _stages = stages;
+        _dither = dither;
+    });
 
-                SCContentFilter *filter = [[SCContentFilter alloc] initWithDisplay:display excludingWindows:@[]];
-                
-                SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
-                config.capturesAudio = YES;
-                config.sampleRate = 48000;
-                config.channelCount = 2;
-                config.excludesCurrentProcessAudio = NO;
-                
-                // Minimize video overhead since we only need audio
-                config.width = 2;
-                config.height = 2;
-                config.minimumFrameInterval = CMTimeMake(1, 1); // 1 fps for video
-                config.showsCursor = NO;
-
-                self.stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:self];
-                
-                NSError *addError = nil;
-                [self.stream addStreamOutput:self type:SCStreamOutputTypeAudio sampleHandlerQueue:self.captureQueue error:&addError];
-                if (addError) {
-                    if (self.errorCallback) self.errorCallback("Failed to add stream output: " + std::string(addError.localizedDescription.UTF8String));
-                    return;
-                }
+    ReusePlan plan = _reuse.Plan(settings);
+    if (plan.create || plan.replaceOutput) {
+        self.captureQueue = [SCKAudioCapture newCaptureQueue:settings.highPriority];
+    }
+    if (!plan.create && !plan.updateFilter) {
+        if (!plan.replaceOutput || [self replaceAudioOutputForSink:sink]) {
+            [self startStreamForSink:sink settings:settings generation:generation];
+        }
+        return;
+    }
+
+    // Building or refiltering the stream needs the current applications
+    [SCShareableContent getShareableContentExcludingDesktopWindows:YES
+                                              onScreenWindowsOnly:NO
+                                                completionHandler:^(SCShareableContent *content, NSError *error) {
+        dispatch_async(self.controlQueue, ^{
+            if (generation != _generation) return; // Stopped meanwhile
+            if (error) {
+                sink->OnError("Failed to get shareable content: " + std::string(error.localizedDescription.UTF8String));
+                return;
+            }
+            SCContentFilter *filter = [self filterForContent:content settings:settings sink:sink];
+            if (!filter) return;
 
-                [self.stream startCaptureWithCompletionHandler:^(NSError *startError) {
-                    if (startError) {
-                        if (self.errorCallback) self.errorCallback("Failed to start capture: " + std::string(startError.localizedDescription.UTF8String));
+            if (plan.create) {
+                if ([self createStreamWithFilter:filter sink:sink]) {
+                    [self startStreamForSink:sink settings:settings generation:generation];
+                }
+                return;
+            }
+            [self.stream updateContentFilter:filter completionHandler:^(NSError *updateError) {
+                dispatch_async(self.controlQueue, ^{
+                    if (updateError) {
+                        [self discardStream];
+                        sink->OnError("Failed to update content filter: " + std::string(updateError.localizedDescription.UTF8String));
+                        return;
                     }
-                }];
-            });
-        }];
-    } else {
-        if (self.errorCallback) self.errorCallback("ScreenCaptureKit audio capture requires macOS 13.0+");
+                    if (generation != _generation) return;
+                    if (!plan.replaceOutput || [self replaceAudioOutputForSink:sink]) {
+                        [self startStreamForSink:sink settings:settings generation:generation];
+                    }
+                });
+            }];
+        });
+    }];
+}
+
+- (SCContentFilter *)filterForContent:(SCShareableContent *)content
+                             settings:(const SystemAudioSettings &)settings
+                                 sink:(const std::shared_ptr<CaptureSink> &)sink API_AVAILABLE(macos(13.0)) {
+    SCDisplay *display = content.displays.firstObject;
+    if (!display) {
+        sink->OnError("No display found");
+        return nil;
+    }
+    if (settings.processId <= 0) {
+        return [[SCContentFilter alloc] initWithDisplay:display excludingWindows:@[]];
+    }
+
+    // The target and its helpers, which often do the playing
+    ProcessTree tree([](int64_t pid) { return SystemParentProcessId(pid); });
+    NSMutableArray<SCRunningApplication *> *apps = [NSMutableArray array];
+    for (SCRunningApplication *app in content.applications) {
+        if (tree.Contains(settings.processId, app.processID)) {
+            [apps addObject:app];
+        }
+    }
+    if (apps.count == 0) {
+        sink->OnError("No application found for process " + std::to_string(settings.processId));
+        return nil;
+    }
+    return [[SCContentFilter alloc] initWithDisplay:display includingApplications:apps exceptingWindows:@[]];
+}
+
+- (BOOL)createStreamWithFilter:(SCContentFilter *)filter
+                          sink:(const std::shared_ptr<CaptureSink> &)sink API_AVAILABLE(macos(13.0)) {
+    SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
+    config.capturesAudio = YES;
+    config.sampleRate = 48000;
+    config.channelCount = 2;
+    config.excludesCurrentProcessAudio = NO;
+
+    // Keep the video we cannot turn off as cheap as it gets
+    config.width = kVideoSize;
+    config.height = kVideoSize;
+    config.minimumFrameInterval = CMTimeMake(kVideoFrameIntervalSeconds, 1);
+    config.queueDepth = kVideoQueueDepth;
+    config.showsCursor = NO;
+
+    self.stream = [[SCStream alloc] initWithFilter:filter configuration:config delegate:self];
+
+    // Without a screen output, SCK logs every frame it has to drop
+    NSError *addError = nil;
+    [self.stream addStreamOutput:self type:SCStreamOutputTypeScreen sampleHandlerQueue:self.videoQueue error:&addError];
+    if (!addError) {
+        [self.stream addStreamOutput:self type:SCStreamOutputTypeAudio sampleHandlerQueue:self.captureQueue error:&addError];
+    }
+    if (addError) {
+        [self discardStream];
+        sink->OnError("Failed to add stream output: " + std::string(addError.localizedDescription.UTF8String));
+        return NO;
+    }
+    return YES;
+}
+
+// Move the audio output to the current capture queue
+- (BOOL)replaceAudioOutputForSink:(const std::shared_ptr<CaptureSink> &)sink API_AVAILABLE(macos(13.0)) {
+    NSError *error = nil;
+    [self.stream removeStreamOutput:self type:SCStreamOutputTypeAudio error:&error];
+    if (!error) {
+        [self.stream addStreamOutput:self type:SCStreamOutputTypeAudio sampleHandlerQueue:self.captureQueue error:&error];
+    }
+    if (error) {
+        [self discardStream];
+        sink->OnError("Failed to add stream output: " + std::string(error.localizedDescription.UTF8String));
+        return NO;
     }
+    return YES;
+}
+
+- (void)startStreamForSink:(std::shared_ptr<CaptureSink>)sink
+                  settings:(SystemAudioSettings)settings
+                generation:(uint64_t)generation API_AVAILABLE(macos(13.0)) {
+    [self.stream startCaptureWithCompletionHandler:^(NSError *startError) {
+        dispatch_async(self.controlQueue, ^{
+            if (startError) {
+                [self discardStream];
+                sink->OnError("Failed to start capture: " + std::string(startError.localizedDescription.UTF8String));
+                return;
+            }
+            _reuse.Started(settings);
+            if (generation != _generation) {
+                // stop() came while it was starting
+                [self stopStream];
+            }
+        });
+    }];
+}
+
+- (void)discardStream {
+    _reuse.Failed();
+    self.stream = nil;
 }
 
 - (void)stop {
     if (@available(macOS 13.0, *)) {
-        if (self.stream) {
-            [self.stream stopCaptureWithCompletionHandler:nil];
-            self.stream = nil;
-        }
+        dispatch_async(self.controlQueue, ^{
+            _generation++;
+            [self stopStream];
+        });
     }
 }
 
+// On the control queue. The stream is kept for the next start.
+- (void)stopStream API_AVAILABLE(macos(13.0)) {
+    if (!_reuse.Running()) return;
+    _reuse.Stopped();
+    dispatch_group_enter(self.stopping);
+    dispatch_queue_t captureQueue = self.captureQueue;
+    [self.stream stopCaptureWithCompletionHandler:^(NSError *error) {
+        // Done delivering: let go of the recording's sink and core
+        dispatch_async(captureQueue, ^{
+            _core = nullptr;
+            _sink = nullptr;
+        });
+        dispatch_async(self.controlQueue, ^{
+            if (error) {
+                [self discardStream];
+            }
+            dispatch_group_leave(self.stopping);
+        });
+    }];
+}
+
 - (void)stream:(SCStream *)stream didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer ofType:(SCStreamOutputType)type {
-    if (type != SCStreamOutputTypeAudio || !self.dataCallback) return;
+    if (type != SCStreamOutputTypeAudio || !_sink) return;
+
+    auto begin = std::chrono::steady_clock::now();
 
     if (@available(macOS 13.0, *)) {
         CMFormatDescriptionRef formatDesc = CMSampleBufferGetFormatDescription(sampleBuffer);
@@ -98,78 +306,84 @@
         
         if (!asbd) return;
 
-        // Check if audio is non-interleaved (planar)
-        bool isNonInterleaved = (asbd->mFormatFlags & kAudioFormatFlagIsNonInterleaved) != 0;
+        // Describe the buffer for the capture core
+        InputDescriptor input;
+        input.sampleRate = (int)asbd->mSampleRate;
+        input.channels = (int)asbd->mChannelsPerFrame;
+        input.planar = (asbd->mFormatFlags & kAudioFormatFlagIsNonInterleaved) != 0;
         bool isFloat = (asbd->mFormatFlags & kAudioFormatFlagIsFloat) != 0;
-        int channels = asbd->mChannelsPerFrame;
+        if (isFloat && asbd->mBitsPerChannel == 32) {
+            input.encoding = SampleEncoding::Float32;
+        } else if (!isFloat && asbd->mBitsPerChannel == 16) {
+            input.encoding = SampleEncoding::Int16;
+        } else if (!isFloat && asbd->mBitsPerChannel == 32) {
+            input.encoding = SampleEncoding::Int32;
+        } else {
+            return;
+        }
+        if (input.channels <= 0) return;
+
+        if (!_core || _core->Input().sampleRate != input.sampleRate ||
+            _core->Input().channels != input.channels ||
+            _core->Input().encoding != input.encoding ||
+            _core->Input().planar != input.planar) {
+            _core = std::make_unique<CaptureCore>(input, *_sink, _stages, _dither);
+            _bufferList.resize(offsetof(AudioBufferList, mBuffers) +
+                               input.channels * sizeof(AudioBuffer));
+            _planes.resize(input.channels);
+            _core->Reserve(CMSampleBufferGetNumSamples(sampleBuffer));
+        }
 
-        if (isNonInterleaved) {
-            // Non-interleaved audio: each channel is in a separate buffer
-            // We need to use CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer
+        CaptureMetadata meta = SampleBufferMetadata(sampleBuffer);
+        CMItemCount numFrames = CMSampleBufferGetNumSamples(sampleBuffer);
+
+        if (input.planar) {
+            // Non-interleaved audio: each channel is in a separate buffer,
+            // listed in the buffer list sized for the format
             CMBlockBufferRef blockBuffer = NULL;
-            
-            // First, get the required buffer list size
             size_t bufferListSizeNeeded = 0;
+            AudioBufferList *audioBufferList = (AudioBufferList *)_bufferList.data();
             OSStatus status = CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer(
                 sampleBuffer,
                 &bufferListSizeNeeded,
-                NULL,
-                0,
-                NULL,
-                NULL,
-                0,
-                &blockBuffer
-            );
-            
-            if (bufferListSizeNeeded == 0) {
-                // Fallback: estimate size based on channel count
-                bufferListSizeNeeded = sizeof(AudioBufferList) + (channels - 1) * sizeof(AudioBuffer);
-            }
-            
-            AudioBufferList *audioBufferList = (AudioBufferList *)malloc(bufferListSizeNeeded);
-            status = CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer(
-                sampleBuffer,
-                NULL,
                 audioBufferList,
-                bufferListSizeNeeded,
+                _bufferList.size(),
                 NULL,
                 NULL,
                 kCMSampleBufferFlag_AudioBufferList_Assure16ByteAlignment,
                 &blockBuffer
             );
-            
-            if (status != noErr || !audioBufferList) {
-                if (audioBufferList) free(audioBufferList);
+            if (status == kCMSampleBufferError_ArrayTooSmall && bufferListSizeNeeded > 0) {
+                // More buffers than channels; grow once and retry
+                _bufferList.resize(bufferListSizeNeeded);
+                audioBufferList = (AudioBufferList *)_bufferList.data();
+                status = CMSampleBufferGetAudioBufferListWithRetainedBlockBuffer(
+                    sampleBuffer,
+                    NULL,
+                    audioBufferList,
+                    _bufferList.size(),
+                    NULL,
+                    NULL,
+                    kCMSampleBufferFlag_AudioBufferList_Assure16ByteAlignment,
+                    &blockBuffer
+                );
+            }
+
+            if (status != noErr) {
                 if (blockBuffer) CFRelease(blockBuffer);
                 return;
             }
-            
-            // Get the number of frames
-            CMItemCount numFrames = CMSampleBufferGetNumSamples(sampleBuffer);
-            
-            if (isFloat && asbd->mBitsPerChannel == 32) {
-                // Interleave channels and convert float to int16
-                std::vector<int16_t> outputBuffer(numFrames * channels);
-                
-                for (CMItemCount frame = 0; frame < numFrames; frame++) {
-                    for (int ch = 0; ch < channels && ch < (int)audioBufferList->mNumberBuffers; ch++) {
-                        const float *channelData = (const float *)audioBufferList->mBuffers[ch].mData;
-                        float sample = channelData[frame];
-                        // Clamp to [-1.0, 1.0]
-                        if (sample > 1.0f) sample = 1.0f;
-                        if (sample < -1.0f) sample = -1.0f;
-                        // Convert to 16-bit and interleave
-                        outputBuffer[frame * channels + ch] = (int16_t)(sample * 32767.0f);
-                    }
-                }
-                
-                self.dataCallback((const uint8_t*)outputBuffer.data(), outputBuffer.size() * sizeof(int16_t));
+
+            // Missing planes are left silent by the core
+            int planeCount = std::min(input.channels, (int)audioBufferList->mNumberBuffers);
+            for (int ch = 0; ch < planeCount; ch++) {
+                _planes[ch] = (const uint8_t *)audioBufferList->mBuffers[ch].mData;
             }
-            
-            free(audioBufferList);
+            _core->PushPlanar(_planes.data(), planeCount, numFrames, meta);
+            [self recordPacket:sampleBuffer frames:numFrames since:begin];
+
             if (blockBuffer) CFRelease(blockBuffer);
         } else {
-            // Interleaved audio: original code path
             CMBlockBufferRef blockBuffer = CMSampleBufferGetDataBuffer(sampleBuffer);
             if (!blockBuffer) return;
 
@@ -179,34 +393,34 @@
             
             if (status != kCMBlockBufferNoErr || !dataPointer) return;
 
-            // ScreenCaptureKit outputs 32-bit float audio
-            // Convert to 16-bit signed integer PCM for consistency with other sources
-            if (isFloat && asbd->mBitsPerChannel == 32) {
-                size_t numSamples = totalLength / sizeof(float);
-                std::vector<int16_t> outputBuffer(numSamples);
-                
-                const float *floatData = (const float *)dataPointer;
-                for (size_t i = 0; i < numSamples; i++) {
-                    float sample = floatData[i];
-                    // Clamp to [-1.0, 1.0]
-                    if (sample > 1.0f) sample = 1.0f;
-                    if (sample < -1.0f) sample = -1.0f;
-                    // Convert to 16-bit
-                    outputBuffer[i] = (int16_t)(sample * 32767.0f);
-                }
-                
-                self.dataCallback((const uint8_t*)outputBuffer.data(), numSamples * sizeof(int16_t));
-            }
+            size_t frames = totalLength / (input.channels * BytesPerSample(input.encoding));
+            _core->Push((const uint8_t *)dataPointer, frames, meta);
+            [self recordPacket:sampleBuffer frames:frames since:begin];
         }
     }
 }
 
+- (void)recordPacket:(CMSampleBufferRef)sampleBuffer
+              frames:(uint64_t)frames
+               since:(std::chrono::steady_clock::time_point)begin {
+    if (!self.stats) return;
+    int64_t processingNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    self.stats->RecordPacket(frames, processingNs, SampleBufferLatencyNs(sampleBuffer));
+}
+
 // SCStreamDelegate method
 - (void)stream:(SCStream *)stream didStopWithError:(NSError *)error {
     if (@available(macOS 13.0, *)) {
-        if (error && self.errorCallback) {
-            self.errorCallback("Stream stopped with error: " + std::string(error.localizedDescription.UTF8String));
+        if (error && _sink) {
+            _sink->OnError("Stream stopped with error: " + std::string(error.localizedDescription.UTF8String));
         }
+        // Never reuse a stream the system stopped
+        dispatch_async(self.controlQueue, ^{
+            if (stream == self.stream) {
+                [self discardStream];
+            }
+        });
     }
 }
 
@@ -0,0 +1,25 @@
+#pragma once
+
+#import <CoreMedia/CoreMedia.h>
+#include "../core/CaptureCore.h"
+#include <algorithm>
+
+// Capture buffers are stamped on the host time clock, which is also what
+// std::chrono::steady_clock reads on macOS
+inline CaptureMetadata SampleBufferMetadata(CMSampleBufferRef sampleBuffer) {
+    CaptureMetadata meta;
+    CMTime pts = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (CMTIME_IS_VALID(pts)) {
+        meta.timestampNs = CMTimeConvertScale(pts, 1000000000, kCMTimeRoundingMethod_Default).value;
+    }
+    meta.discontinuity = CMGetAttachment(sampleBuffer, kCMSampleBufferAttachmentKey_Discontinuity, NULL) != NULL;
+    return meta;
+}
+
+// Host clock time elapsed since the buffer's presentation timestamp
+inline int64_t SampleBufferLatencyNs(CMSampleBufferRef sampleBuffer) {
+    CMTime pts = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (!CMTIME_IS_VALID(pts)) return 0;
+    CMTime now = CMClockGetTime(CMClockGetHostTimeClock());
+    return std::max<int64_t>(0, (int64_t)(CMTimeGetSeconds(CMTimeSubtract(now, pts)) * 1e9));
+}
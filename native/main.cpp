@@ -1,9 +1,11 @@
 #include "AudioController.h"
+#include "CaptureFileReader.h"
 #include <napi.h>
 
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
-  return AudioController::Init(env, exports);
+  AudioController::Init(env, exports);
+  return CaptureFileReader::Init(env, exports);
 }
 
 NODE_API_MODULE(native_audio_sdk, Init)
@@ -1,16 +1,567 @@
 #ifdef _WIN32
 
 #include "WASAPIEngine.h"
+#include "../core/BufferSizing.h"
+#include "../core/CaptureCore.h"
+#include "../core/CaptureScheduler.h"
+#include "../core/ProcessLoopback.h"
+#include "../core/RecyclingPool.h"
+#include "../core/SampleConvert.h"
+#include "../core/ThreadPriority.h"
+#include "../core/WorkerPool.h"
 #include <algorithm>
+#include <audioclientactivationparams.h>
+#include <chrono>
+#include <cstring>
 #include <functiondiscoverykeys_devpkey.h>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <vector>
+#include <wrl/implements.h>
 
 const CLSID CLSID_MMDeviceEnumerator = __uuidof(MMDeviceEnumerator);
 const IID IID_IMMDeviceEnumerator = __uuidof(IMMDeviceEnumerator);
 const IID IID_IAudioClient = __uuidof(IAudioClient);
 const IID IID_IAudioCaptureClient = __uuidof(IAudioCaptureClient);
 
+// Describe a WASAPI format; false if the converter can't handle it
+static bool FromWaveFormat(const WAVEFORMATEX *pwfx, StreamFormat &format) {
+  format.sampleRate = pwfx->nSamplesPerSec;
+  format.channels = pwfx->nChannels;
+  format.validBits = pwfx->wBitsPerSample;
+
+  bool isFloat = false;
+  if (pwfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+    WAVEFORMATEXTENSIBLE *pEx = (WAVEFORMATEXTENSIBLE *)pwfx;
+    if (IsEqualGUID(pEx->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)) {
+      isFloat = true;
+    }
+    if (pEx->Samples.wValidBitsPerSample > 0) {
+      format.validBits = pEx->Samples.wValidBitsPerSample;
+    }
+  } else if (pwfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT) {
+    isFloat = true;
+  }
+
+  if (isFloat) {
+    format.encoding = SampleEncoding::Float32;
+  } else if (pwfx->wBitsPerSample == 16) {
+    format.encoding = SampleEncoding::Int16;
+  } else if (pwfx->wBitsPerSample == 24) {
+    format.encoding = SampleEncoding::Int24;
+  } else if (pwfx->wBitsPerSample == 32) {
+    format.encoding = SampleEncoding::Int32;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static WAVEFORMATEXTENSIBLE ToWaveFormat(const StreamFormat &format) {
+  WAVEFORMATEXTENSIBLE wfx = {};
+  WORD containerBits = (WORD)(BytesPerSample(format.encoding) * 8);
+  wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+  wfx.Format.nChannels = (WORD)format.channels;
+  wfx.Format.nSamplesPerSec = format.sampleRate;
+  wfx.Format.wBitsPerSample = containerBits;
+  wfx.Format.nBlockAlign = (WORD)(format.channels * containerBits / 8);
+  wfx.Format.nAvgBytesPerSec = format.sampleRate * wfx.Format.nBlockAlign;
+  wfx.Format.cbSize =
+      sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+  wfx.Samples.wValidBitsPerSample = (WORD)format.validBits;
+  wfx.dwChannelMask = format.channels == 1   ? KSAUDIO_SPEAKER_MONO
+                      : format.channels == 2 ? KSAUDIO_SPEAKER_STEREO
+                                             : 0;
+  wfx.SubFormat = format.encoding == SampleEncoding::Float32
+                      ? KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+                      : KSDATAFORMAT_SUBTYPE_PCM;
+  return wfx;
+}
+
+// BufferClient over an activated, not yet initialised IAudioClient
+class WasapiBufferClient : public BufferClient {
+public:
+  explicit WasapiBufferClient(IAudioClient *client) : client(client) {
+    client->QueryInterface(__uuidof(IAudioClient3), (void **)&client3);
+  }
+
+  bool GetDevicePeriods(int64_t &defaultHns, int64_t &minimumHns) override {
+    REFERENCE_TIME defaultPeriod = 0;
+    REFERENCE_TIME minimumPeriod = 0;
+    if (FAILED(client->GetDevicePeriod(&defaultPeriod, &minimumPeriod)))
+      return false;
+    defaultHns = defaultPeriod;
+    minimumHns = minimumPeriod;
+    return true;
+  }
+
+  bool GetSharedEnginePeriods(const StreamFormat &format,
+                              SharedEnginePeriods &periods) override {
+    if (!client3)
+      return false;
+    WAVEFORMATEXTENSIBLE wfx = ToWaveFormat(format);
+    return SUCCEEDED(client3->GetSharedModeEnginePeriod(
+        &wfx.Format, &periods.defaultFrames, &periods.fundamentalFrames,
+        &periods.minFrames, &periods.maxFrames));
+  }
+
+  bool IsExclusiveFormatSupported(const StreamFormat &format) override {
+    WAVEFORMATEXTENSIBLE wfx = ToWaveFormat(format);
+    return client->IsFormatSupported(AUDCLNT_SHAREMODE_EXCLUSIVE, &wfx.Format,
+                                     NULL) == S_OK;
+  }
+
+  IAudioClient3 *Client3() { return client3.Get(); }
+
+private:
+  IAudioClient *client;
+  ComPtr<IAudioClient3> client3;
+};
+
+// Process loopback clients convert to whatever format they are given;
+// 16-bit stereo at 48 kHz needs no conversion on our side
+static const StreamFormat kProcessLoopbackFormat = {48000, 2,
+                                                    SampleEncoding::Int16, 16};
+// The audio engine's usual period; the client does not report one
+static const int64_t kProcessLoopbackPeriodHns = 100000; // 10 ms
+
+// Completion of ActivateAudioInterfaceAsync, signalled through an event
+class ActivationHandler
+    : public Microsoft::WRL::RuntimeClass<
+          Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>,
+          Microsoft::WRL::FtmBase, IActivateAudioInterfaceCompletionHandler> {
+public:
+  ActivationHandler() { done = CreateEvent(NULL, TRUE, FALSE, NULL); }
+  ~ActivationHandler() {
+    if (done)
+      CloseHandle(done);
+  }
+
+  STDMETHOD(ActivateCompleted)
+  (IActivateAudioInterfaceAsyncOperation *operation) override {
+    HRESULT activateResult = E_FAIL;
+    ComPtr<IUnknown> unknown;
+    result = operation->GetActivateResult(&activateResult, &unknown);
+    if (SUCCEEDED(result))
+      result = activateResult;
+    if (SUCCEEDED(result))
+      result = unknown.As(&client);
+    SetEvent(done);
+    return S_OK;
+  }
+
+  HANDLE done;
+  HRESULT result = E_FAIL;
+  ComPtr<IAudioClient> client;
+};
+
+// Activate a loopback client for a process and its children. Needs
+// Windows 10 build 20348 or later.
+static HRESULT ActivateProcessLoopback(DWORD processId,
+                                       ComPtr<IAudioClient> &client) {
+  AUDIOCLIENT_ACTIVATION_PARAMS params = {};
+  params.ActivationType = AUDIOCLIENT_ACTIVATION_TYPE_PROCESS_LOOPBACK;
+  params.ProcessLoopbackParams.TargetProcessId = processId;
+  params.ProcessLoopbackParams.ProcessLoopbackMode =
+      PROCESS_LOOPBACK_MODE_INCLUDE_TARGET_PROCESS_TREE;
+
+  PROPVARIANT activation = {};
+  activation.vt = VT_BLOB;
+  activation.blob.cbSize = sizeof(params);
+  activation.blob.pBlobData = (BYTE *)&params;
+
+  auto handler = Microsoft::WRL::Make<ActivationHandler>();
+  if (!handler || !handler->done)
+    return E_OUTOFMEMORY;
+  ComPtr<IActivateAudioInterfaceAsyncOperation> operation;
+  HRESULT hr = ActivateAudioInterfaceAsync(
+      VIRTUAL_AUDIO_DEVICE_PROCESS_LOOPBACK, __uuidof(IAudioClient),
+      &activation, handler.Get(), &operation);
+  if (FAILED(hr))
+    return hr;
+  WaitForSingleObject(handler->done, INFINITE);
+  if (SUCCEEDED(handler->result))
+    client = handler->client;
+  return handler->result;
+}
+
+// Format and period of running streams by device, so GetDeviceFormat()
+// reports what a stream actually negotiated
+struct ActiveFormat {
+  const void *owner;
+  int sampleRate;
+  int channels;
+  int periodFrames;
+};
+static std::mutex activeFormatsMutex;
+static std::map<std::string, ActiveFormat> activeFormats;
+
+// Device state for one recording. Driven either by the engine's own
+// recording thread or by a shared CaptureScheduler thread; with a strand,
+// only the copy out of the device buffer happens on the capture thread and
+// conversion plus delivery run on the worker pool. Scratch and packet
+// buffers are sized from the device buffer at Open(), so a running stream
+// does not allocate.
+class WASAPIEngine::CaptureStream : public CaptureSource {
+public:
+  CaptureStream(const std::string &deviceType, const std::string &deviceId,
+                std::shared_ptr<CaptureSink> sink, StreamStatsRecorder &stats,
+                const StreamOptions &options,
+                std::shared_ptr<WorkerPool::Strand> strand)
+      : deviceType(deviceType), deviceId(deviceId), sink(sink), stats(stats),
+        priority(options.threadPriority), buffer(options.buffer),
+        stages(options.stages), dither(options.dither), strand(strand) {}
+
+  ~CaptureStream() { Close(); }
+
+  bool Open(WaitHandle &handle) override {
+    HRESULT hr;
+
+    // Runs on the thread that will service the device
+    stats.SetThreadPriority(PromoteCurrentThread(priority));
+
+    // Determine if this is output (loopback) or input based on deviceType
+    bool isLoopback = (deviceType == AudioEngine::DEVICE_TYPE_OUTPUT);
+
+    // "process:<pid>" is a virtual device with a fixed format of our choice
+    int64_t processId = 0;
+    bool isProcess = isLoopback && ParseProcessLoopbackId(deviceId, processId);
+
+    if (isProcess) {
+      hr = ActivateProcessLoopback((DWORD)processId, pAudioClient);
+      if (FAILED(hr)) {
+        return Fail("Failed to activate process loopback for " + deviceId);
+      }
+      WAVEFORMATEXTENSIBLE wfx = ToWaveFormat(kProcessLoopbackFormat);
+      pwfx = (WAVEFORMATEX *)CoTaskMemAlloc(sizeof(wfx));
+      if (!pwfx) {
+        return Fail("Failed to allocate process loopback format");
+      }
+      std::memcpy(pwfx, &wfx, sizeof(wfx));
+    } else {
+      hr = CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL,
+                            IID_IMMDeviceEnumerator, (void **)&pEnumerator);
+      if (FAILED(hr)) {
+        return Fail(
+            "Failed to create IMMDeviceEnumerator in recording thread");
+      }
+
+      // Get device by ID
+      std::wstring wsId(deviceId.begin(), deviceId.end());
+      hr = pEnumerator->GetDevice(wsId.c_str(), &pDevice);
+      if (FAILED(hr)) {
+        return Fail("Failed to get audio device: " + deviceId);
+      }
+
+      hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL,
+                             (void **)&pAudioClient);
+      if (FAILED(hr)) {
+        return Fail("Failed to activate audio client");
+      }
+
+      hr = pAudioClient->GetMixFormat(&pwfx);
+      if (FAILED(hr)) {
+        return Fail("Failed to get mix format");
+      }
+    }
+
+    StreamFormat mixFormat = {};
+    isSupportedFormat = FromWaveFormat(pwfx, mixFormat);
+
+    WasapiBufferClient bufferClient(pAudioClient.Get());
+    BufferPlan plan;
+    std::string planError;
+    if (isProcess) {
+      // The virtual device answers no period queries: classic shared mode
+      plan.format = mixFormat;
+      plan.bufferHns = kDefaultSharedBufferHns;
+      plan.periodFrames = HnsToFrames(kProcessLoopbackPeriodHns,
+                                      mixFormat.sampleRate);
+    } else if (!PlanBuffer(buffer, mixFormat, isLoopback, bufferClient, plan,
+                           planError)) {
+      return Fail(planError);
+    }
+
+    // Initialize Audio Client
+    DWORD streamFlags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+    if (isLoopback) {
+      streamFlags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
+    }
+    if (isProcess) {
+      streamFlags |= AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM |
+                     AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY;
+    }
+
+    uint32_t periodFrames = plan.periodFrames;
+    if (plan.mode == BufferMode::Exclusive) {
+      WAVEFORMATEXTENSIBLE wfx = ToWaveFormat(plan.format);
+      hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, streamFlags,
+                                    plan.bufferHns, plan.periodHns,
+                                    &wfx.Format, NULL);
+      if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
+        // Retry with the aligned size on a fresh client, as documented
+        UINT32 alignedFrames = 0;
+        pAudioClient->GetBufferSize(&alignedFrames);
+        RealignExclusivePlan(alignedFrames, plan);
+        pAudioClient.Reset();
+        hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL,
+                               (void **)&pAudioClient);
+        if (SUCCEEDED(hr)) {
+          hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE,
+                                        streamFlags, plan.bufferHns,
+                                        plan.periodHns, &wfx.Format, NULL);
+        }
+      }
+      if (FAILED(hr)) {
+        return Fail("Failed to initialize audio client in exclusive mode");
+      }
+      periodFrames = plan.periodFrames;
+      isSupportedFormat = true;
+    } else if (plan.mode == BufferMode::SharedLowLatency) {
+      hr = bufferClient.Client3()->InitializeSharedAudioStream(
+          streamFlags, plan.periodFrames, pwfx, NULL);
+      if (FAILED(hr)) {
+        return Fail("Failed to initialize low-latency audio client");
+      }
+      WAVEFORMATEX *pCurrent = NULL;
+      UINT32 currentFrames = 0;
+      if (SUCCEEDED(bufferClient.Client3()->GetCurrentSharedModeEnginePeriod(
+              &pCurrent, &currentFrames))) {
+        periodFrames = currentFrames;
+        CoTaskMemFree(pCurrent);
+      }
+    } else {
+      hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, streamFlags,
+                                    plan.bufferHns, 0, pwfx, NULL);
+      if (FAILED(hr)) {
+        return Fail("Failed to initialize audio client");
+      }
+    }
+
+    hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    hr = pAudioClient->SetEventHandle(hEvent);
+    if (FAILED(hr)) {
+      return Fail("Failed to set event handle");
+    }
+
+    hr = pAudioClient->GetService(IID_IAudioCaptureClient,
+                                  (void **)&pCaptureClient);
+    if (FAILED(hr)) {
+      return Fail("Failed to get capture client");
+    }
+
+    // Conversion runs on the format the client was initialised with
+    channels = plan.format.channels;
+    blockAlign = (size_t)channels * BytesPerSample(plan.format.encoding);
+    if (!isSupportedFormat) {
+      blockAlign = pwfx->nBlockAlign;
+    }
+
+    InputDescriptor input = {plan.format.sampleRate, channels,
+                             plan.format.encoding, false};
+    core = std::make_unique<CaptureCore>(input, *sink, stages, dither);
+
+    // No packet is larger than the device buffer
+    UINT32 bufferFrames = 0;
+    pAudioClient->GetBufferSize(&bufferFrames);
+    core->Reserve(bufferFrames);
+    if (strand) {
+      RawPacket prototype;
+      prototype.bytes.resize((size_t)bufferFrames * blockAlign);
+      packets = std::make_unique<RecyclingPool<RawPacket>>(kPooledPackets,
+                                                           prototype);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(activeFormatsMutex);
+      activeFormats[deviceId] = {this, plan.format.sampleRate, channels,
+                                 (int)periodFrames};
+    }
+
+    hr = pAudioClient->Start();
+    if (FAILED(hr)) {
+      return Fail("Failed to start recording");
+    }
+    isStarted = true;
+
+    handle = hEvent;
+    return true;
+  }
+
+  // Drain every packet the device has ready
+  bool OnReady() override {
+    auto readyTime = std::chrono::steady_clock::now();
+    UINT32 packetLength = 0;
+    UINT32 numFramesAvailable;
+    BYTE *pData;
+    DWORD flags;
+    UINT64 devicePosition;
+    UINT64 qpcPosition;
+
+    HRESULT hr = pCaptureClient->GetNextPacketSize(&packetLength);
+    if (FAILED(hr)) {
+      return Fail("Failed to get next packet size");
+    }
+
+    while (packetLength != 0) {
+      hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags,
+                                     &devicePosition, &qpcPosition);
+      if (FAILED(hr)) {
+        return Fail("Failed to get buffer");
+      }
+
+      if (numFramesAvailable > 0) {
+        bool isSilent =
+            (flags & AUDCLNT_BUFFERFLAGS_SILENT) || !isSupportedFormat;
+        CaptureMetadata meta;
+        // QPC positions are in 100 ns units, the steady clock's time base
+        if (!(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR)) {
+          meta.timestampNs = (int64_t)qpcPosition * 100;
+        }
+        meta.discontinuity =
+            (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) != 0;
+        if (strand) {
+          // Copy out so the device buffer is released right away
+          RawPacket *packet = packets->Acquire();
+          packet->frames = numFramesAvailable;
+          packet->isSilent = isSilent;
+          packet->meta = meta;
+          packet->readyTime = readyTime;
+          if (!isSilent) {
+            size_t size = (size_t)numFramesAvailable * blockAlign;
+            if (packet->bytes.size() < size) {
+              packet->bytes.resize(size);
+            }
+            std::memcpy(packet->bytes.data(), pData, size);
+          }
+          strand->Post([this, packet]() {
+            Deliver(packet->isSilent ? nullptr : packet->bytes.data(),
+                    packet->frames, packet->meta, packet->readyTime);
+            packets->Release(packet);
+          });
+        } else {
+          Deliver(isSilent ? nullptr : pData, numFramesAvailable, meta,
+                  readyTime);
+        }
+      }
+
+      hr = pCaptureClient->ReleaseBuffer(numFramesAvailable);
+      if (FAILED(hr)) {
+        return Fail("Failed to release buffer");
+      }
+
+      hr = pCaptureClient->GetNextPacketSize(&packetLength);
+      if (FAILED(hr)) {
+        return Fail("Failed to get next packet size loop");
+      }
+    }
+
+    stats.AddProcessingTime(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - readyTime)
+            .count());
+    return true;
+  }
+
+  void Close() override {
+    {
+      std::lock_guard<std::mutex> lock(activeFormatsMutex);
+      auto it = activeFormats.find(deviceId);
+      if (it != activeFormats.end() && it->second.owner == this)
+        activeFormats.erase(it);
+    }
+    if (pAudioClient && isStarted)
+      pAudioClient->Stop();
+    isStarted = false;
+    pCaptureClient.Reset();
+    pAudioClient.Reset();
+    pDevice.Reset();
+    pEnumerator.Reset();
+    if (pwfx) {
+      CoTaskMemFree(pwfx);
+      pwfx = NULL;
+    }
+    if (hEvent) {
+      CloseHandle(hEvent);
+      hEvent = NULL;
+    }
+  }
+
+  // Wait for conversion tasks still queued on the worker pool
+  void FlushPending() {
+    if (strand)
+      strand->Flush();
+  }
+
+private:
+  // A packet copied out of the device buffer for the worker pool
+  struct RawPacket {
+    std::vector<uint8_t> bytes;
+    UINT32 frames = 0;
+    bool isSilent = false;
+    CaptureMetadata meta;
+    std::chrono::steady_clock::time_point readyTime;
+  };
+
+  // Enough for the worker pool to fall a few periods behind before the
+  // pool has to grow
+  static const size_t kPooledPackets = 8;
+
+  bool Fail(const std::string &message) {
+    sink->OnError(message);
+    return false;
+  }
+
+  // Run one packet (nullptr data means silence) through the capture core.
+  // Only uses state fixed at Open(), so it may run on a worker thread after
+  // Close().
+  void Deliver(const BYTE *data, UINT32 frames, const CaptureMetadata &meta,
+               std::chrono::steady_clock::time_point readyTime) {
+    auto start = std::chrono::steady_clock::now();
+
+    core->Push(data, frames, meta);
+
+    auto end = std::chrono::steady_clock::now();
+    // Inline conversion is already part of the OnReady() processing time
+    int64_t processingNs =
+        strand ? std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                      start)
+                     .count()
+               : 0;
+    stats.RecordPacket(
+        frames, processingNs,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - readyTime)
+            .count());
+  }
+
+  std::string deviceType;
+  std::string deviceId;
+  // Held by the stream, so a task still queued on the strand after Close()
+  // delivers into a live sink
+  std::shared_ptr<CaptureSink> sink;
+  StreamStatsRecorder &stats;
+  ThreadPriorityRequest priority;
+  BufferRequest buffer;
+  std::vector<std::shared_ptr<CaptureStage>> stages;
+  DitherMode dither;
+  std::shared_ptr<WorkerPool::Strand> strand;
+  std::unique_ptr<CaptureCore> core;
+  std::unique_ptr<RecyclingPool<RawPacket>> packets;
+
+  ComPtr<IMMDeviceEnumerator> pEnumerator;
+  ComPtr<IMMDevice> pDevice;
+  ComPtr<IAudioClient> pAudioClient;
+  ComPtr<IAudioCaptureClient> pCaptureClient;
+  WAVEFORMATEX *pwfx = NULL;
+  HANDLE hEvent = NULL;
+  bool isStarted = false;
+
+  bool isSupportedFormat = true;
+  int channels = 0;
+  size_t blockAlign = 0;
+};
+
 WASAPIEngine::WASAPIEngine() : isRecording(false) {
   CoInitialize(NULL);
   HRESULT hr = CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL,
@@ -28,29 +579,61 @@ WASAPIEngine::~WASAPIEngine() {
 }
 
 void WASAPIEngine::Start(const std::string &deviceType,
-                         const std::string &deviceId, DataCallback dataCb,
-                         ErrorCallback errorCb) {
+                         const std::string &deviceId,
+                         std::shared_ptr<CaptureSink> sink) {
   if (isRecording) {
     return;
   }
 
-  this->dataCallback = dataCb;
-  this->errorCallback = errorCb;
+  this->sink = sink;
   this->currentDeviceId = deviceId;
   this->currentDeviceType = deviceType;
+  this->stats.Reset();
   this->isRecording = true;
+
+  if (options.sharedScheduler) {
+    // Opened on a shared capture thread; conversion runs on the worker pool
+    sharedStream = std::make_shared<CaptureStream>(
+        deviceType, deviceId, sink, stats, options,
+        WorkerPool::Shared().CreateStrand());
+    if (!CaptureScheduler::Shared().Add(sharedStream)) {
+      // Open() already reported the error
+      sharedStream = nullptr;
+      isRecording = false;
+    }
+    return;
+  }
+
   this->recordingThread = std::thread(&WASAPIEngine::RecordingThread, this);
 }
 
 void WASAPIEngine::Stop() {
   if (isRecording) {
     isRecording = false;
+    if (sharedStream) {
+      CaptureScheduler::Shared().Remove(sharedStream);
+      sharedStream->FlushPending();
+      sharedStream = nullptr;
+    }
     if (recordingThread.joinable()) {
       recordingThread.join();
     }
   }
 }
 
+void WASAPIEngine::SetOptions(const StreamOptions &options) {
+  this->options = options;
+}
+
+StreamStats WASAPIEngine::GetStats() {
+  StreamStats result = stats.Snapshot();
+  if (sharedStream) {
+    result.sharedStreams =
+        (int)CaptureScheduler::Shared().SharedStreamCount(sharedStream.get());
+  }
+  return result;
+}
+
 std::vector<AudioDevice> WASAPIEngine::GetDevices() {
   std::vector<AudioDevice> devices;
   if (!enumerator)
@@ -184,6 +767,17 @@ AudioFormat WASAPIEngine::GetDeviceFormat(const std::string &deviceId) {
   ComPtr<IAudioClient> pAudioClient;
   WAVEFORMATEX *pwfx = NULL;
 
+  int64_t processId = 0;
+  if (ParseProcessLoopbackId(deviceId, processId)) {
+    format.sampleRate = kProcessLoopbackFormat.sampleRate;
+    format.channels = kProcessLoopbackFormat.channels;
+    format.bitDepth = 16;
+    format.rawBitDepth = kProcessLoopbackFormat.validBits;
+    format.periodFrames = HnsToFrames(kProcessLoopbackPeriodHns,
+                                      format.sampleRate);
+    return format;
+  }
+
   if (!enumerator)
     return format;
 
@@ -214,221 +808,91 @@ AudioFormat WASAPIEngine::GetDeviceFormat(const std::string &deviceId) {
     }
   }
 
+  // Period limits: the shared engine's when IAudioClient3 is available,
+  // otherwise the device's default and minimum periods
+  StreamFormat mixFormat = {};
+  WasapiBufferClient bufferClient(pAudioClient.Get());
+  SharedEnginePeriods periods = {};
+  int64_t defaultHns = 0;
+  int64_t minimumHns = 0;
+  if (FromWaveFormat(pwfx, mixFormat) &&
+      bufferClient.GetSharedEnginePeriods(mixFormat, periods)) {
+    format.periodFrames = periods.defaultFrames;
+    format.minPeriodFrames = periods.minFrames;
+  } else if (bufferClient.GetDevicePeriods(defaultHns, minimumHns)) {
+    format.periodFrames = HnsToFrames(defaultHns, format.sampleRate);
+    format.minPeriodFrames = HnsToFrames(minimumHns, format.sampleRate);
+  }
+
   CoTaskMemFree(pwfx);
+
+  // A running stream may have negotiated a different format and period
+  std::lock_guard<std::mutex> lock(activeFormatsMutex);
+  auto it = activeFormats.find(deviceId);
+  if (it != activeFormats.end()) {
+    format.sampleRate = it->second.sampleRate;
+    format.channels = it->second.channels;
+    format.periodFrames = it->second.periodFrames;
+  }
   return format;
 }
 
-void WASAPIEngine::RecordingThread() {
-  CoInitialize(NULL);
+AudioFormat WASAPIEngine::GetStreamFormat(const std::string &deviceType,
+                                          const std::string &deviceId) {
+  AudioFormat format = GetDeviceFormat(deviceId);
+  // Only exclusive mode picks a format other than the mix format; plan it
+  // as CaptureStream::Open() will
+  if (!options.buffer.exclusive ||
+      deviceType != AudioEngine::DEVICE_TYPE_INPUT || format.sampleRate == 0 ||
+      !enumerator)
+    return format;
 
-  HRESULT hr;
-  ComPtr<IMMDeviceEnumerator> pEnumerator;
   ComPtr<IMMDevice> pDevice;
   ComPtr<IAudioClient> pAudioClient;
-  ComPtr<IAudioCaptureClient> pCaptureClient;
   WAVEFORMATEX *pwfx = NULL;
-  UINT32 bufferFrameCount;
-  UINT32 numFramesAvailable;
-  UINT32 packetLength = 0;
-  BYTE *pData;
-  DWORD flags;
-  HANDLE hEvent = NULL;
-
-  // Determine if this is output (loopback) or input based on deviceType
-  bool isLoopback = (currentDeviceType == AudioEngine::DEVICE_TYPE_OUTPUT);
-
-  do {
-    hr = CoCreateInstance(CLSID_MMDeviceEnumerator, NULL, CLSCTX_ALL,
-                          IID_IMMDeviceEnumerator, (void **)&pEnumerator);
-
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback(
-            "Failed to create IMMDeviceEnumerator in recording thread");
-      break;
-    }
-
-    // Get device by ID
-    std::wstring wsId(currentDeviceId.begin(), currentDeviceId.end());
-    hr = pEnumerator->GetDevice(wsId.c_str(), &pDevice);
-
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to get audio device: " + currentDeviceId);
-      break;
-    }
-
-    hr = pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL,
-                           (void **)&pAudioClient);
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to activate audio client");
-      break;
-    }
-
-    hr = pAudioClient->GetMixFormat(&pwfx);
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to get mix format");
-      break;
-    }
-
-    // Initialize Audio Client
-    DWORD streamFlags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
-    if (isLoopback) {
-      streamFlags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
-    }
-
-    hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, streamFlags,
-                                  10000000, 0, pwfx, NULL);
-
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to initialize audio client");
-      break;
-    }
-
-    hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-    hr = pAudioClient->SetEventHandle(hEvent);
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to set event handle");
-      break;
-    }
-
-    hr = pAudioClient->GetService(IID_IAudioCaptureClient,
-                                  (void **)&pCaptureClient);
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to get capture client");
-      break;
-    }
-
-    hr = pAudioClient->Start();
-    if (FAILED(hr)) {
-      if (errorCallback)
-        errorCallback("Failed to start recording");
-      break;
-    }
-
-    while (isRecording) {
-      DWORD retval = WaitForSingleObject(hEvent, 2000);
-      if (retval != WAIT_OBJECT_0) {
-        continue;
-      }
-
-      hr = pCaptureClient->GetNextPacketSize(&packetLength);
-      if (FAILED(hr)) {
-        if (errorCallback)
-          errorCallback("Failed to get next packet size");
-        break;
-      }
-
-      while (packetLength != 0) {
-        hr = pCaptureClient->GetBuffer(&pData, &numFramesAvailable, &flags,
-                                       NULL, NULL);
-
-        if (FAILED(hr)) {
-          if (errorCallback)
-            errorCallback("Failed to get buffer");
-          break;
-        }
-
-        if (numFramesAvailable > 0) {
-          // Convert to Float32
-          std::vector<float> inputFloats;
-          size_t numSamples = numFramesAvailable * pwfx->nChannels;
-          inputFloats.resize(numSamples);
-
-          if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
-            std::fill(inputFloats.begin(), inputFloats.end(), 0.0f);
-          } else {
-            bool isFloat = false;
-            if (pwfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
-              WAVEFORMATEXTENSIBLE *pEx = (WAVEFORMATEXTENSIBLE *)pwfx;
-              if (IsEqualGUID(pEx->SubFormat,
-                              KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)) {
-                isFloat = true;
-              }
-            } else if (pwfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT) {
-              isFloat = true;
-            }
-
-            if (isFloat) {
-              float *floatData = (float *)pData;
-              std::copy(floatData, floatData + numSamples, inputFloats.begin());
-            } else {
-              if (pwfx->wBitsPerSample == 16) {
-                int16_t *pcmData = (int16_t *)pData;
-                for (size_t i = 0; i < numSamples; i++) {
-                  inputFloats[i] = pcmData[i] / 32768.0f;
-                }
-              } else if (pwfx->wBitsPerSample == 24) {
-                uint8_t *ptr = (uint8_t *)pData;
-                for (size_t i = 0; i < numSamples; i++) {
-                  int32_t sample =
-                      (ptr[0] << 8) | (ptr[1] << 16) | (ptr[2] << 24);
-                  inputFloats[i] = sample / 2147483648.0f;
-                  ptr += 3;
-                }
-              } else if (pwfx->wBitsPerSample == 32) {
-                int32_t *ptr = (int32_t *)pData;
-                for (size_t i = 0; i < numSamples; i++) {
-                  inputFloats[i] = ptr[i] / 2147483648.0f;
-                }
-              } else {
-                std::fill(inputFloats.begin(), inputFloats.end(), 0.0f);
-              }
-            }
-          }
+  std::wstring wsId(deviceId.begin(), deviceId.end());
+  if (FAILED(enumerator->GetDevice(wsId.c_str(), &pDevice)) ||
+      FAILED(pDevice->Activate(IID_IAudioClient, CLSCTX_ALL, NULL,
+                               (void **)&pAudioClient)) ||
+      FAILED(pAudioClient->GetMixFormat(&pwfx)))
+    return format;
 
-          // Convert to Int16 and Callback
-          if (!inputFloats.empty()) {
-            std::vector<int16_t> pcmData;
-            pcmData.reserve(inputFloats.size());
-
-            for (float sample : inputFloats) {
-              if (sample > 1.0f)
-                sample = 1.0f;
-              if (sample < -1.0f)
-                sample = -1.0f;
-              pcmData.push_back((int16_t)(sample * 32767.0f));
-            }
+  StreamFormat mixFormat = {};
+  FromWaveFormat(pwfx, mixFormat);
+  CoTaskMemFree(pwfx);
+  WasapiBufferClient bufferClient(pAudioClient.Get());
+  BufferPlan plan;
+  std::string error;
+  if (PlanBuffer(options.buffer, mixFormat, false, bufferClient, plan,
+                 error)) {
+    format.sampleRate = plan.format.sampleRate;
+    format.channels = plan.format.channels;
+    format.rawBitDepth = plan.format.validBits;
+  }
+  return format;
+}
 
-            if (dataCallback) {
-              dataCallback((uint8_t *)pcmData.data(),
-                           pcmData.size() * sizeof(int16_t));
-            }
-          }
-        }
+void WASAPIEngine::RecordingThread() {
+  CoInitialize(NULL);
 
-        hr = pCaptureClient->ReleaseBuffer(numFramesAvailable);
-        if (FAILED(hr)) {
-          if (errorCallback)
-            errorCallback("Failed to release buffer");
-          break;
+  {
+    CaptureStream stream(currentDeviceType, currentDeviceId, sink, stats,
+                         options, nullptr);
+    WaitHandle hEvent;
+    if (stream.Open(hEvent)) {
+      while (isRecording) {
+        DWORD retval = WaitForSingleObject((HANDLE)hEvent, 2000);
+        if (retval != WAIT_OBJECT_0) {
+          continue;
         }
-
-        hr = pCaptureClient->GetNextPacketSize(&packetLength);
-        if (FAILED(hr)) {
-          if (errorCallback)
-            errorCallback("Failed to get next packet size loop");
+        if (!stream.OnReady()) {
           break;
         }
       }
-      if (FAILED(hr))
-        break;
     }
+    stream.Close();
+  }
 
-    if (pAudioClient)
-      pAudioClient->Stop();
-
-  } while (false);
-
-  if (pwfx)
-    CoTaskMemFree(pwfx);
-  if (hEvent)
-    CloseHandle(hEvent);
   CoUninitialize();
 }
 
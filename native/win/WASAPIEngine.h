@@ -5,6 +5,7 @@
 #include "../AudioEngine.h"
 #include <atomic>
 #include <audioclient.h>
+#include <memory>
 #include <mmdeviceapi.h>
 #include <thread>
 #include <windows.h>
@@ -18,16 +19,23 @@ public:
   ~WASAPIEngine();
 
   void Start(const std::string &deviceType, const std::string &deviceId,
-             DataCallback dataCb, ErrorCallback errorCb) override;
+             std::shared_ptr<CaptureSink> sink) override;
   void Stop() override;
+  void SetOptions(const StreamOptions &options) override;
+  StreamStats GetStats() override;
   std::vector<AudioDevice> GetDevices() override;
   AudioFormat GetDeviceFormat(const std::string &deviceId) override;
+  AudioFormat GetStreamFormat(const std::string &deviceType,
+                              const std::string &deviceId) override;
 
   // Permission handling (Windows doesn't require explicit permissions)
   PermissionStatus CheckPermission() override;
   bool RequestPermission(PermissionType type) override;
 
 private:
+  // Device state for one recording, defined in WASAPIEngine.cpp
+  class CaptureStream;
+
   void RecordingThread();
   std::string GetDeviceName(IMMDevice *device);
 
@@ -35,8 +43,13 @@ private:
   std::atomic<bool> isRecording;
   std::thread recordingThread;
 
-  DataCallback dataCallback;
-  ErrorCallback errorCallback;
+  // Set while the stream runs on the shared CaptureScheduler
+  std::shared_ptr<CaptureStream> sharedStream;
+
+  StreamOptions options;
+  StreamStatsRecorder stats;
+
+  std::shared_ptr<CaptureSink> sink;
   std::string currentDeviceId;
   std::string currentDeviceType;
 };
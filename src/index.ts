@@ -6,6 +6,19 @@ import { EventEmitter } from "events";
  */
 export const SYSTEM_AUDIO_DEVICE_ID = "system";
 
+/**
+ * Output device ID that records only what one process and its child
+ * processes play: WASAPI process loopback on Windows (build 20348+),
+ * ScreenCaptureKit application capture on macOS, and the process's sink
+ * inputs on PulseAudio / PipeWire. Not listed by getDevices().
+ */
+export function processLoopbackDeviceId(pid: number): string {
+  if (!Number.isInteger(pid) || pid <= 0 || pid > 0xffffffff) {
+    throw new RangeError("pid must be a positive integer");
+  }
+  return `process:${pid}`;
+}
+
 /**
  * Device type classification
  */
@@ -52,6 +65,13 @@ export interface AudioFormat {
   bitDepth: number;
   /** Native device bit depth */
   rawBitDepth: number;
+  /**
+   * Device period in frames: the achieved one while a stream is running on
+   * the device, otherwise the engine default (0 if unknown)
+   */
+  periodFrames: number;
+  /** Smallest period a low-latency stream can get (0 if unknown) */
+  minPeriodFrames: number;
 }
 
 /**
@@ -71,30 +91,490 @@ export interface RecordingConfig {
    * Every device has a valid ID - use the ID from the device list.
    */
   deviceId: string;
+
+  /**
+   * Serve the stream from a small pool of shared capture threads instead of
+   * a dedicated thread. Recommended when recording many devices at once.
+   * Defaults to false. Only affects Windows; macOS always uses GCD queues.
+   */
+  sharedScheduler?: boolean;
+
+  /**
+   * Run the capture thread in the OS real-time class: MMCSS "Pro Audio" on
+   * Windows, SCHED_FIFO on Linux, user-interactive QoS on macOS. Falls back
+   * to a raised normal priority when the OS refuses; see
+   * StreamStats.threadPriority for what was obtained. Defaults to false.
+   */
+  realtimePriority?: boolean;
+
+  /**
+   * Core indices to pin the capture thread to (Windows and Linux).
+   * Defaults to no pinning.
+   */
+  cpuAffinity?: number[];
+
+  /**
+   * Target device period in milliseconds (Windows). Without exclusive mode
+   * this uses the low-latency shared engine where available, snapped to a
+   * period the engine supports. Defaults to the engine default.
+   */
+  latencyMs?: number;
+
+  /** Target device period in frames; takes precedence over latencyMs */
+  bufferFrames?: number;
+
+  /**
+   * Open input devices in WASAPI exclusive mode (Windows), negotiating the
+   * closest format the device supports. Not available for output devices.
+   */
+  exclusive?: boolean;
+
+  /**
+   * Requantisation of float and 24/32-bit device audio to 16-bit PCM.
+   * 'tpdf' rounds with triangular dither, 'shaped' additionally moves the
+   * dither noise to high frequencies, 'none' truncates as earlier versions
+   * did. 16-bit devices are delivered unchanged. Defaults to 'tpdf'.
+   */
+  dither?: DitherMode;
+
+  /**
+   * Biquad filters applied natively to the captured audio, in order, before
+   * every other processing stage, e.g. a high-pass against DC offset and
+   * rumble or notches against mains hum. At most 16. None by default.
+   */
+  filters?: FilterConfig[];
+
+  /**
+   * Cancel the echo of what the system plays from an input stream. A second
+   * native stream captures the output device as the reference. true uses
+   * the defaults. Off by default.
+   */
+  echoCancellation?: boolean | EchoCancellationConfig;
+
+  /**
+   * Run native noise suppression on the captured audio before it is
+   * delivered or analysed. true uses the defaults. Off by default.
+   */
+  denoise?: boolean | DenoiseConfig;
+
+  /**
+   * Run native automatic gain control and a look-ahead limiter on the
+   * captured audio, before it is quantised to 16-bit. true uses the
+   * defaults. Off by default.
+   */
+  gainControl?: boolean | GainControlConfig;
+
+  /**
+   * Run native spectrum analysis on the captured audio and publish it into
+   * the array returned by getSpectrum(). Off by default.
+   */
+  analysis?: AnalysisConfig;
+
+  /**
+   * Emit 'data' events with the PCM audio. Set to false when only the
+   * analysis output is needed. Defaults to true.
+   */
+  deliverPcm?: boolean;
+
+  /**
+   * Write the audio natively to a WAV file (or a series of them), off the
+   * JS thread. A path, or settings that also rotate the file by duration
+   * or size; each finished file is reported by a 'segment' event.
+   */
+  file?: string | FileConfig;
+
+  /**
+   * Also write the audio into a preallocated, memory-mapped file that other
+   * threads or processes can read while it is recorded, e.g. with
+   * CaptureFileReader. A path, or settings for the capacity and whether it
+   * fills once or wraps around.
+   */
+  mappedFile?: string | MappedFileConfig;
+
+  /**
+   * Keep this stream sample-aligned with the other streams of a session,
+   * across recorders in this process. A session name joins as a follower.
+   * Followers are resampled onto the master's timeline to cancel the drift
+   * between device clocks and deliver nothing until the master runs.
+   */
+  sync?: string | SyncConfig;
+
+  /**
+   * Encode the audio natively (lossless FLAC) and deliver it in a streaming
+   * container instead of PCM: every 'data' Buffer is then one whole Ogg
+   * page, or the Matroska header or one cluster, ready for a chunked HTTP
+   * upload or a MediaSource. With file, the file holds the same container
+   * and takes only path and direct. A format name, or settings.
+   */
+  container?: ContainerFormat | ContainerConfig;
+}
+
+/**
+ * Containers for encoded streams. 'webm' is written as Matroska with FLAC,
+ * which WebM does not admit.
+ */
+export type ContainerFormat = "ogg" | "webm";
+
+/**
+ * Settings of an encoded, containerised stream
+ */
+export interface ContainerConfig {
+  format: ContainerFormat;
+  /** Codec of the packets. Defaults to 'flac', the only one for now. */
+  codec?: "flac";
+  /**
+   * Duration of each page or cluster, and so of each 'data' Buffer; at most
+   * 30. Defaults to 0.5.
+   */
+  chunkSeconds?: number;
+}
+
+/**
+ * Settings of the native WAV file output
+ */
+export interface FileConfig {
+  /**
+   * Output path. "{index}" is replaced by the zero-padded segment number;
+   * without it, files after the first get "-00001" and so on before the
+   * extension.
+   */
+  path: string;
+  /** Start a new file after this many seconds. Defaults to 0 (never). */
+  segmentSeconds?: number;
+  /** Start a new file before one would exceed this many bytes, at least 4096. Defaults to 0 (never). */
+  segmentBytes?: number;
+  /**
+   * Write with O_DIRECT (F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING on
+   * Windows) so the recording does not fill the page cache. File systems
+   * without support get buffered writes. Defaults to false.
+   */
+  direct?: boolean;
+  /**
+   * Every this many seconds, sync the file and note how much of it is on
+   * disk in a journal next to the first file ("<file>.journal"), so
+   * recoverRecording() can repair the recording after a crash. The capture
+   * thread only queues the checkpoint. Defaults to 0 (no journal).
+   */
+  checkpointSeconds?: number;
+}
+
+/**
+ * Settings of the memory-mapped capture file
+ */
+export interface MappedFileConfig {
+  path: string;
+  /**
+   * 'append' fills the file once and counts the frames that did not fit;
+   * 'ring' wraps around and keeps the latest audio. Defaults to 'append'.
+   */
+  mode?: MappedFileMode;
+  /** Capacity, preallocated when the stream opens. Defaults to 60. */
+  seconds?: number;
+}
+
+export type MappedFileMode = "append" | "ring";
+
+/**
+ * Membership of a sync session
+ */
+export interface SyncConfig {
+  /** Name shared by the streams kept aligned */
+  session: string;
+  /**
+   * Whether the other streams follow this one. A session has one master at
+   * a time. Defaults to false.
+   */
+  master?: boolean;
+}
+
+/**
+ * Layout of a memory-mapped capture file
+ */
+export interface CaptureFileInfo {
+  sampleRate: number;
+  channels: number;
+  mode: MappedFileMode;
+  /** Frames the file holds; frame f is at index f % capacityFrames */
+  capacityFrames: number;
+}
+
+/**
+ * A file of an interrupted recording, as left by recoverRecording()
+ */
+export interface RecoveredSegment {
+  path: string;
+  /** Position of the file in the recording, from 0 */
+  index: number;
+  /** Whole frames of audio in the file */
+  frames: number;
+  /** Frames the journal knew were synced to disk, 0 without a journal */
+  checkpointFrames: number;
+  /** Whether the header had to be rewritten */
+  repaired: boolean;
+}
+
+/**
+ * A finished file of a native recording, emitted as a 'segment' event
+ */
+export interface SegmentInfo {
+  path: string;
+  /** Position of the file in the recording, from 0 */
+  index: number;
+  /** Frame of the recording the file starts at */
+  startFrame: number;
+  /** Frames in the file */
+  frames: number;
+  /** Wall-clock time of the first frame, in ms since the epoch */
+  startTime: number;
+  /** Wall-clock time just after the last frame, in ms since the epoch */
+  endTime: number;
+}
+
+/**
+ * Settings of the native spectrum analysis
+ */
+export interface AnalysisConfig {
+  /** FFT size, a power of two from 64 to 32768. Defaults to 2048. */
+  fftSize?: number;
+  /** Fraction of each FFT window shared with the next, 0 to 0.95. Defaults to 0.5. */
+  overlap?: number;
+  /** Number of log-spaced bands, 1 to 1024. Defaults to 64. */
+  bands?: number;
+  /** Lower edge of the first band in Hz. Defaults to 20. */
+  minFrequency?: number;
+  /** Upper edge of the last band in Hz. Defaults to the Nyquist frequency. */
+  maxFrequency?: number;
+  /** Publications per second. Defaults to 30. */
+  updateRate?: number;
+}
+
+/**
+ * Response of a native biquad filter section
+ */
+export type FilterType = "highpass" | "lowpass" | "lowshelf" | "highshelf" | "notch";
+
+/**
+ * One native biquad filter section
+ */
+export interface FilterConfig {
+  type: FilterType;
+  /** Corner, shelf midpoint or notch centre in Hz, 1 to 96000; capped at 0.45 of the sample rate */
+  frequency: number;
+  /** Resonance, 0.1 to 50; a notch is frequency / q wide. Defaults to 0.7071, or 10 for a notch. */
+  q?: number;
+  /** Shelf gain in dB, -24 to 24. Defaults to 0. */
+  gainDb?: number;
+}
+
+/**
+ * Settings of the native echo cancellation
+ */
+export interface EchoCancellationConfig {
+  /** Output device whose loopback is the echo reference. Defaults to the default output device. */
+  referenceDeviceId?: string;
+  /** Longest echo path cancelled, in ms from 10 to 500. Defaults to 128. */
+  tailMs?: number;
+}
+
+/**
+ * Settings of the native noise suppression
+ */
+export interface DenoiseConfig {
+  /** Deepest cut applied to noise, in dB from 0 to 60. Defaults to 24. */
+  maxAttenuationDb?: number;
+}
+
+/**
+ * Settings of the native gain control
+ */
+export interface GainControlConfig {
+  /** RMS level the AGC aims for, in dBFS from -60 to 0. Defaults to -18. */
+  targetLevelDb?: number;
+  /** Largest boost or cut of the AGC, in dB from 0 to 60; 0 leaves only the limiter. Defaults to 24. */
+  maxGainDb?: number;
+  /** Time constant of gain decreases, in ms from 1 to 10000. Defaults to 50. */
+  attackMs?: number;
+  /** Time constant of gain increases, in ms from 1 to 10000. Defaults to 500. */
+  releaseMs?: number;
+  /** Peak level the limiter holds the output under, in dBFS from -20 to 0. Defaults to -1. */
+  ceilingDb?: number;
+}
+
+/**
+ * Requantisation applied when converting to 16-bit PCM
+ */
+export type DitherMode = "none" | "tpdf" | "shaped";
+
+/**
+ * Scheduling class obtained by a capture thread
+ */
+export type ThreadPriority = "normal" | "elevated" | "realtime";
+
+/**
+ * Capture statistics for the current (or most recent) stream
+ */
+export interface StreamStats {
+  /** Device packets processed */
+  packets: number;
+  /** Audio frames delivered */
+  frames: number;
+  /** Native thread time spent on this stream, in milliseconds */
+  processingTimeMs: number;
+  /** Mean time from packet ready to delivery, in milliseconds */
+  avgLatencyMs: number;
+  /** Worst time from packet ready to delivery, in milliseconds */
+  maxLatencyMs: number;
+  /** Streams served by the same capture thread (1 for a dedicated thread) */
+  sharedStreams: number;
+  /** Scheduling class the capture thread actually obtained */
+  threadPriority: ThreadPriority;
+  /** Whether the capture thread was pinned to cpuAffinity */
+  affinityApplied: boolean;
+  /** CPU time of the whole process since start, in milliseconds */
+  processCpuMs?: number;
+  /**
+   * Process wakeups since start: idle and interrupt wakeups on macOS (the
+   * energy impact measure), context switches on Linux, 0 on Windows
+   */
+  processWakeups?: number;
+  /** Native thread time spent on filtering, in milliseconds; only with filters */
+  filterTimeMs?: number;
+  /** Native thread time spent on noise suppression, in milliseconds; only with denoise */
+  denoiseTimeMs?: number;
+  /** Native thread time spent on echo cancellation, in milliseconds; only with echoCancellation */
+  echoTimeMs?: number;
+  /** Echo return loss enhancement while the reference plays, in dB; only with echoCancellation */
+  erleDb?: number;
+  /** Native thread time spent on gain control, in milliseconds; only with gainControl */
+  gainTimeMs?: number;
+  /** Gain the AGC currently applies, in dB; only with gainControl */
+  agcGainDb?: number;
+  /** Limiter gain reduction in the latest block, in dB; only with gainControl */
+  gainReductionDb?: number;
+  /** Deepest limiter gain reduction so far, in dB; only with gainControl */
+  maxGainReductionDb?: number;
+  /** Frames the limiter has turned down; only with gainControl */
+  limitedFrames?: number;
+  /** How file writes are issued; only with file */
+  fileBackend?: 'io_uring' | 'thread';
+  /** File writes queued or in flight; only with file */
+  fileQueueDepth?: number;
+  /** Most file writes outstanding at once; only with file */
+  fileMaxQueueDepth?: number;
+  /** Average time from queueing a file write to its completion; only with file */
+  fileWriteLatencyMs?: number;
+  /** Longest time from queueing a file write to its completion; only with file */
+  fileMaxWriteLatencyMs?: number;
+  /** Frames written to the mapped file; only with mappedFile */
+  mappedFrames?: number;
+  /** Frames that did not fit an 'append' mapped file; only with mappedFile */
+  mappedDroppedFrames?: number;
+  /**
+   * Calls from the native side into JS. Chunks that queue up while the
+   * event loop is busy share one call, so this stays below jsChunks.
+   */
+  jsCalls?: number;
+  /** Audio chunks delivered to JS, one 'data' event each */
+  jsChunks?: number;
+  /** The stream's part in its sync session; only with sync */
+  syncRole?: 'master' | 'follower';
+  /**
+   * Device clock against the master's, in ppm (against the host clock for
+   * the master); only with sync
+   */
+  syncDriftPpm?: number;
+  /** Current alignment error in microseconds, positive when ahead; only with sync */
+  syncErrorUs?: number;
+  /** Largest alignment error since the stream last aligned; only with sync */
+  syncMaxErrorUs?: number;
+  /** Times the stream realigned at once after a glitch; only with sync */
+  syncResyncs?: number;
+  /**
+   * Master frame the follower's first frame lines up with, -1 until
+   * aligned; only with sync
+   */
+  syncStartFrame?: number;
+}
+
+/**
+ * Configuration for prepare()
+ */
+export interface PrepareConfig extends RecordingConfig {
+  /**
+   * Seconds of audio to retain natively while the stream is idle, so that
+   * commit() can deliver audio from before it was called. Defaults to 0 (off);
+   * at most 600.
+   */
+  preRollSeconds?: number;
+
+  /**
+   * How retained audio is stored.
+   * - 'pcm': 16-bit PCM, lossless (default)
+   * - 'mulaw': G.711 mu-law, half the memory, lossy
+   */
+  preRollEncoding?: "pcm" | "mulaw";
 }
 
+// Receives errors, PCM chunks and finished file segments
+// Audio that piled up while the event loop was busy arrives in one call,
+// as an array of chunks in place of data
+type NativeCallback = (
+  error: Error | null,
+  data: Buffer | null,
+  segment?: SegmentInfo,
+  chunks?: Buffer[]
+) => void;
+
 // Define the native controller interface
 interface NativeAudioController {
   start(
     config: RecordingConfig,
-    callback: (error: Error | null, data: Buffer | null) => void
+    callback: NativeCallback
   ): void;
   stop(): void;
+  prepare(
+    config: PrepareConfig,
+    callback: NativeCallback
+  ): void;
+  unprepare(): void;
+  commit(secondsBack: number): void;
+  getStats(): StreamStats;
+  getSpectrum(): Float32Array | null;
+}
+
+// Native reader of a memory-mapped capture file
+interface NativeCaptureFileReader {
+  info(): CaptureFileInfo;
+  writtenFrames(): number;
+  droppedFrames(): number;
+  isClosed(): boolean;
+  read(startFrame: number, maxFrames: number): {
+    startFrame: number;
+    samples: Int16Array;
+  };
+  samples(): Int16Array | null;
+  close(): void;
 }
 
 // Define the native module interface
 interface NativeModule {
+  CaptureFileReader: new (path: string) => NativeCaptureFileReader;
   AudioController: {
     new (): NativeAudioController;
     getDevices(): AudioDevice[];
     getDeviceFormat(deviceId: string): AudioFormat;
     checkPermission(): PermissionStatus;
     requestPermission(type: PermissionType): boolean;
+    recoverRecording(path: string): RecoveredSegment[];
   };
 }
 
 const native = bindings as NativeModule;
 
+// A publication takes microseconds, so a counter that stays odd this long
+// means the writer stalled mid-update
+const SPECTRUM_READ_ATTEMPTS = 1000;
+
 export class AudioRecorder extends EventEmitter {
   private controller: NativeAudioController;
   private isRecording: boolean = false;
@@ -106,6 +586,9 @@ export class AudioRecorder extends EventEmitter {
 
   /**
    * Starts the recording session.
+   * If the same device was opened with prepare(), this only enables delivery
+   * and the first chunk arrives within one device period. Options may then
+   * be left out or repeated, but not changed.
    * @param config Configuration object with deviceType and deviceId (both required)
    */
   async start(config: RecordingConfig): Promise<void> {
@@ -113,27 +596,11 @@ export class AudioRecorder extends EventEmitter {
       throw new Error("Already recording");
     }
 
-    // Validate config
-    if (!config.deviceType || !config.deviceId) {
-      throw new Error("Both deviceType and deviceId are required");
-    }
-
-    if (config.deviceType !== "input" && config.deviceType !== "output") {
-      throw new Error("deviceType must be 'input' or 'output'");
-    }
+    this.validateConfig(config);
 
     return new Promise((resolve, reject) => {
       try {
-        this.controller.start(
-          config,
-          (error: Error | null, data: Buffer | null) => {
-            if (error) {
-              this.emit("error", error);
-            } else if (data) {
-              this.emit("data", data);
-            }
-          }
-        );
+        this.controller.start(config, this.onNativeEvent);
         this.isRecording = true;
         resolve();
       } catch (error) {
@@ -142,6 +609,11 @@ export class AudioRecorder extends EventEmitter {
     });
   }
 
+  /**
+   * Stops the recording session.
+   * A prepared device stays open so it can be started again instantly;
+   * call unprepare() to release it.
+   */
   async stop(): Promise<void> {
     if (!this.isRecording) {
       return;
@@ -158,6 +630,136 @@ export class AudioRecorder extends EventEmitter {
     });
   }
 
+  /**
+   * Opens and initialises a device ahead of time without delivering data.
+   * A following start() with the same config skips all device setup.
+   * Errors raised while the device is prepared are emitted as 'error' events.
+   * With preRollSeconds set, the most recent audio is kept in native memory
+   * for commit().
+   * @param config Configuration object with deviceType and deviceId (both required)
+   */
+  async prepare(config: PrepareConfig): Promise<void> {
+    if (this.isRecording) {
+      throw new Error("Already recording");
+    }
+
+    this.validateConfig(config);
+
+    return new Promise((resolve, reject) => {
+      try {
+        this.controller.prepare(config, this.onNativeEvent);
+        resolve();
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * Starts delivery on a stream prepared with preRollSeconds, beginning with
+   * up to secondsBack seconds of audio captured before this call, followed
+   * seamlessly by the live stream. Both arrive as regular 'data' events.
+   * @param secondsBack Seconds of retained audio to deliver first
+   */
+  async commit(secondsBack: number): Promise<void> {
+    if (this.isRecording) {
+      throw new Error("Already recording");
+    }
+
+    return new Promise((resolve, reject) => {
+      try {
+        this.controller.commit(secondsBack);
+        this.isRecording = true;
+        resolve();
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * Releases a device opened with prepare(), stopping any active recording.
+   */
+  async unprepare(): Promise<void> {
+    return new Promise((resolve, reject) => {
+      try {
+        this.controller.unprepare();
+        this.isRecording = false;
+        resolve();
+      } catch (error) {
+        reject(error);
+      }
+    });
+  }
+
+  /**
+   * Returns capture statistics for the current (or most recent) stream.
+   */
+  getStats(): StreamStats {
+    return this.controller.getStats();
+  }
+
+  /**
+   * Returns the live spectrum array of a stream started with `analysis`, or
+   * null. Element 0 is an update counter, odd while the capture thread is
+   * writing; elements 1..bands hold band levels in dB relative to a
+   * full-scale sine. Keep the array and read it whenever needed; use
+   * readSpectrum() for a consistent copy.
+   */
+  getSpectrum(): Float32Array | null {
+    return this.controller.getSpectrum();
+  }
+
+  /**
+   * Copies the latest complete set of band levels into target (allocated if
+   * omitted) and returns it, or null without analysis. Also null when no
+   * consistent copy was had within SPECTRUM_READ_ATTEMPTS tries, e.g. when
+   * the capture thread stalled mid-update; target is then left unspecified.
+   */
+  readSpectrum(target?: Float32Array): Float32Array | null {
+    const spectrum = this.controller.getSpectrum();
+    if (!spectrum) {
+      return null;
+    }
+    const bands = spectrum.subarray(1);
+    const out = target ?? new Float32Array(bands.length);
+    for (let attempt = 0; attempt < SPECTRUM_READ_ATTEMPTS; attempt++) {
+      const before = spectrum[0];
+      if (before % 2 === 0) {
+        out.set(bands);
+        if (spectrum[0] === before) {
+          return out;
+        }
+      }
+    }
+    return null;
+  }
+
+  private validateConfig(config: RecordingConfig): void {
+    if (!config.deviceType || !config.deviceId) {
+      throw new Error("Both deviceType and deviceId are required");
+    }
+
+    if (config.deviceType !== "input" && config.deviceType !== "output") {
+      throw new Error("deviceType must be 'input' or 'output'");
+    }
+  }
+
+  private onNativeEvent: NativeCallback = (error, data, segment, chunks) => {
+    if (error) {
+      this.emit("error", error);
+    } else if (chunks) {
+      // Still one 'data' event per chunk
+      for (const chunk of chunks) {
+        this.emit("data", chunk);
+      }
+    } else if (data) {
+      this.emit("data", data);
+    } else if (segment) {
+      this.emit("segment", segment);
+    }
+  };
+
   /**
    * Lists available audio devices.
    * @param type Optional filter by device type
@@ -200,6 +802,84 @@ export class AudioRecorder extends EventEmitter {
   static requestPermission(type: PermissionType): boolean {
     return native.AudioController.requestPermission(type);
   }
+
+  /**
+   * Repairs the WAV headers of a recording that was cut off by a crash.
+   * Takes the file path the recording was started with, or any PCM WAV
+   * file whose writer never filled in its sizes; each file's size fields are
+   * set from the audio actually in it. A journal left by
+   * FileConfig.checkpointSeconds is used and then removed. Runs
+   * synchronously.
+   * @param path The recording's file path
+   * @returns The recording's files, in order
+   */
+  static recoverRecording(path: string): RecoveredSegment[] {
+    return native.AudioController.recoverRecording(path);
+  }
+}
+
+/**
+ * Follows a memory-mapped capture file (see RecordingConfig.mappedFile),
+ * from this or another process, while it is being written. Nothing here
+ * blocks or waits for the writer.
+ */
+export class CaptureFileReader {
+  private reader: NativeCaptureFileReader;
+
+  /**
+   * Maps the file. Throws if it does not exist or is not a capture file.
+   */
+  constructor(path: string) {
+    this.reader = new native.CaptureFileReader(path);
+  }
+
+  /** Rate, channels, mode and capacity of the file */
+  get info(): CaptureFileInfo {
+    return this.reader.info();
+  }
+
+  /** Frames written since the recording started */
+  get writtenFrames(): number {
+    return this.reader.writtenFrames();
+  }
+
+  /** Frames an 'append' file had no room for */
+  get droppedFrames(): number {
+    return this.reader.droppedFrames();
+  }
+
+  /** Whether the writer has finished */
+  get isClosed(): boolean {
+    return this.reader.isClosed();
+  }
+
+  /**
+   * Copies up to maxFrames frames from startFrame on. A ring no longer
+   * holds frames more than capacityFrames behind writtenFrames; those are
+   * skipped and startFrame in the result says where the copy begins.
+   */
+  read(
+    startFrame: number,
+    maxFrames: number
+  ): { startFrame: number; samples: Int16Array } {
+    return this.reader.read(startFrame, maxFrames);
+  }
+
+  /**
+   * The file's sample area without copying: capacityFrames interleaved
+   * frames, frame f at (f % capacityFrames) * channels. In a ring the
+   * writer may overwrite frames while they are read; use read() where that
+   * matters. null where the runtime does not allow external buffers
+   * (Electron).
+   */
+  samples(): Int16Array | null {
+    return this.reader.samples();
+  }
+
+  /** Releases the mapping once no samples() view is left */
+  close(): void {
+    this.reader.close();
+  }
 }
 
 // Export raw bindings for testing if needed
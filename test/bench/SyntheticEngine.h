@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../../native/AudioEngine.h"
+#include "../../native/core/CaptureCore.h"
+#include "../../native/core/SampleConvert.h"
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Deterministic AudioEngine for benchmarks. Produces a sine wave in a
+// device-native encoding and runs it through the same CaptureCore as the
+// platform engines, without any audio hardware.
+class SyntheticEngine : public AudioEngine {
+public:
+  static constexpr const char *DEVICE_ID = "synthetic";
+
+  SyntheticEngine(int sampleRate = 48000, int channels = 2,
+                  SampleEncoding encoding = SampleEncoding::Float32,
+                  size_t packetFrames = 480)
+      : sampleRate(sampleRate), channels(channels), encoding(encoding),
+        packetFrames(packetFrames), isRecording(false) {
+    // One packet of device data, converted from a 440 Hz sine
+    size_t numSamples = packetFrames * channels;
+    std::vector<float> sine(numSamples);
+    for (size_t frame = 0; frame < packetFrames; frame++) {
+      float value = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * frame /
+                                    (float)sampleRate);
+      for (int ch = 0; ch < channels; ch++) {
+        sine[frame * channels + ch] = value;
+      }
+    }
+    packet.resize(numSamples * BytesPerSample(encoding));
+    for (size_t i = 0; i < numSamples; i++) {
+      uint8_t *dst = packet.data() + i * BytesPerSample(encoding);
+      if (encoding == SampleEncoding::Float32) {
+        memcpy(dst, &sine[i], sizeof(float));
+      } else {
+        int32_t value = (int32_t)(sine[i] * 2147483647.0f);
+        memcpy(dst, (uint8_t *)&value + (4 - BytesPerSample(encoding)),
+               BytesPerSample(encoding));
+      }
+    }
+  }
+
+  ~SyntheticEngine() { Stop(); }
+
+  void Start(const std::string &deviceType, const std::string &deviceId,
+             std::shared_ptr<CaptureSink> sink) override {
+    if (isRecording)
+      return;
+    SetSink(sink);
+    isRecording = true;
+    thread = std::thread([this]() {
+      auto period = std::chrono::microseconds(
+          (int64_t)(packetFrames * 1000000 / sampleRate));
+      auto next = std::chrono::steady_clock::now();
+      while (isRecording) {
+        Pump(1);
+        next += period;
+        std::this_thread::sleep_until(next);
+      }
+    });
+  }
+
+  void Stop() override {
+    if (isRecording) {
+      isRecording = false;
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+  void SetOptions(const StreamOptions &options) override {
+    this->options = options;
+    core.reset();
+  }
+
+  StreamStats GetStats() override { return stats.Snapshot(); }
+
+  // Convert and deliver `packets` packets on the calling thread, the same
+  // way the platform engines hand one device packet to their CaptureCore
+  void Pump(size_t packets) {
+    if (!core) {
+      InputDescriptor input = {sampleRate, channels, encoding, false};
+      core = sink ? std::make_unique<CaptureCore>(input, *sink, options.stages,
+                                                  options.dither)
+                  : std::make_unique<CaptureCore>(input, CaptureCore::Sink(),
+                                                  options.stages,
+                                                  options.dither);
+    }
+    for (size_t p = 0; p < packets; p++) {
+      core->Push(packet.data(), packetFrames, CaptureMetadata());
+      stats.RecordPacket(packetFrames, 0, 0);
+    }
+  }
+
+  void SetSink(std::shared_ptr<CaptureSink> sink) {
+    this->sink = sink;
+    core.reset();
+  }
+
+  std::vector<AudioDevice> GetDevices() override {
+    return {{DEVICE_ID, "Synthetic Sine", AudioEngine::DEVICE_TYPE_INPUT,
+             true}};
+  }
+
+  AudioFormat GetDeviceFormat(const std::string &deviceId) override {
+    return {sampleRate, channels, 16, (int)BytesPerSample(encoding) * 8};
+  }
+
+  PermissionStatus CheckPermission() override { return {true, true}; }
+
+  bool RequestPermission(PermissionType type) override { return true; }
+
+  size_t PacketBytes() const { return packet.size(); }
+
+private:
+  int sampleRate;
+  int channels;
+  SampleEncoding encoding;
+  size_t packetFrames;
+  std::vector<uint8_t> packet;
+  StreamOptions options;
+  std::unique_ptr<CaptureCore> core;
+
+  std::atomic<bool> isRecording;
+  std::thread thread;
+  StreamStatsRecorder stats;
+  std::shared_ptr<CaptureSink> sink;
+};
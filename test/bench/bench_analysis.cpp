@@ -0,0 +1,184 @@
+#include "../../native/core/Denoiser.h"
+#include "../../native/core/EchoCanceller.h"
+#include "../../native/core/Fft.h"
+#include "../../native/core/FilterBank.h"
+#include "../../native/core/GainControl.h"
+#include "../../native/core/SpectrumAnalyzer.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+static void BM_RealFft(benchmark::State &state) {
+  size_t size = (size_t)state.range(0);
+  std::vector<float> input(size);
+  for (size_t i = 0; i < size; i++) {
+    input[i] = std::sin(0.05f * i);
+  }
+  std::vector<float> re(size / 2 + 1), im(size / 2 + 1);
+  RealFft fft(size);
+
+  for (auto _ : state) {
+    fft.Forward(input.data(), re.data(), im.data());
+    benchmark::DoNotOptimize(re.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_RealFft)->Arg(512)->Arg(2048)->Arg(8192);
+
+// Analysis cost per 10 ms stereo packet at 48 kHz, by FFT size and overlap
+// in percent
+static void BM_SpectrumStage(benchmark::State &state) {
+  SpectrumSettings settings;
+  settings.fftSize = (uint32_t)state.range(0);
+  settings.overlap = state.range(1) / 100.0;
+  std::vector<float> output(1 + settings.bands);
+  SpectrumAnalyzer analyzer(settings, output.data());
+  analyzer.Configure(48000, 2);
+
+  size_t frames = 480;
+  std::vector<float> audio(frames * 2);
+  for (size_t i = 0; i < audio.size(); i++) {
+    audio[i] = 0.5f * std::sin(0.03f * i);
+  }
+
+  for (auto _ : state) {
+    AudioBlock block = {audio.data(), frames, 2, 48000, CaptureMetadata()};
+    analyzer.Process(block);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_SpectrumStage)
+    ->Args({1024, 50})
+    ->Args({2048, 50})
+    ->Args({2048, 75})
+    ->Args({8192, 50});
+
+// Noise suppression cost per 10 ms packet, by device rate and channels;
+// 44.1 kHz adds the conversion to 48 kHz and back
+static void BM_DenoiseStage(benchmark::State &state) {
+  int sampleRate = (int)state.range(0);
+  int channels = (int)state.range(1);
+  Denoiser denoiser;
+  denoiser.Configure(sampleRate, channels);
+
+  size_t frames = (size_t)sampleRate / 100;
+  std::vector<float> audio(frames * channels);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < audio.size(); i++) {
+    seed = seed * 1664525u + 1013904223u;
+    audio[i] = 0.3f * std::sin(0.03f * i) + (seed >> 8) / 1.6e8f;
+  }
+
+  // The stage works in place: feed it fresh input every packet
+  std::vector<float> work(audio.size());
+  for (auto _ : state) {
+    std::copy(audio.begin(), audio.end(), work.begin());
+    AudioBlock block = {work.data(), frames, channels, sampleRate,
+                        CaptureMetadata()};
+    denoiser.Process(block);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_DenoiseStage)
+    ->Args({48000, 1})
+    ->Args({48000, 2})
+    ->Args({44100, 1})
+    ->Args({44100, 2});
+
+// Echo cancellation cost per 10 ms mono packet at 48 kHz, by tail length in
+// ms, with the reference written alongside
+static void BM_EchoCanceller(benchmark::State &state) {
+  auto reference = std::make_shared<EchoReference>();
+  EchoSettings settings;
+  settings.tailMs = (double)state.range(0);
+  EchoCanceller canceller(reference, settings);
+  EchoReferenceTap tap(reference);
+  canceller.Configure(48000, 1);
+  tap.Configure(48000, 1);
+
+  size_t frames = 480;
+  std::vector<float> farEnd(frames), mic(frames), work(frames);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < frames; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    farEnd[i] = (seed >> 8) / 3.3e7f - 0.25f;
+    mic[i] = 0.5f * farEnd[(i + frames - 40) % frames];
+  }
+
+  uint64_t position = 0;
+  for (auto _ : state) {
+    CaptureMetadata meta;
+    meta.frameIndex = position;
+    meta.timestampNs = 1000000000 + (int64_t)(position * 1e9 / 48000);
+    AudioBlock ref = {farEnd.data(), frames, 1, 48000, meta};
+    tap.Process(ref);
+    std::copy(mic.begin(), mic.end(), work.begin());
+    AudioBlock block = {work.data(), frames, 1, 48000, meta};
+    canceller.Process(block);
+    benchmark::ClobberMemory();
+    position += frames;
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_EchoCanceller)->Arg(64)->Arg(128)->Arg(256);
+
+// AGC and limiter cost per 10 ms packet at 48 kHz, by channel count, on
+// audio loud enough to keep the limiter working
+static void BM_GainControl(benchmark::State &state) {
+  int channels = (int)state.range(0);
+  GainControl gain;
+  gain.Configure(48000, channels);
+
+  size_t frames = 480;
+  std::vector<float> audio(frames * channels);
+  for (size_t i = 0; i < audio.size(); i++) {
+    audio[i] = 1.5f * std::sin(0.03f * (i / channels));
+  }
+
+  std::vector<float> work(audio.size());
+  for (auto _ : state) {
+    std::copy(audio.begin(), audio.end(), work.begin());
+    AudioBlock block = {work.data(), frames, channels, 48000,
+                        CaptureMetadata()};
+    gain.Process(block);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_GainControl)->Arg(1)->Arg(2)->Arg(6);
+
+// High-pass plus two hum notches per 10 ms packet at 48 kHz, by channel
+// count
+static void BM_FilterBank(benchmark::State &state) {
+  int channels = (int)state.range(0);
+  std::vector<BiquadSpec> specs(3);
+  specs[0].frequency = 80;
+  specs[1].type = FilterType::Notch;
+  specs[1].frequency = 50;
+  specs[2].type = FilterType::Notch;
+  specs[2].frequency = 100;
+  FilterBank bank(specs);
+  bank.Configure(48000, channels);
+
+  size_t frames = 480;
+  std::vector<float> audio(frames * channels);
+  for (size_t i = 0; i < audio.size(); i++) {
+    audio[i] = 0.1f + 0.5f * std::sin(0.03f * (i / channels));
+  }
+
+  std::vector<float> work(audio.size());
+  for (auto _ : state) {
+    std::copy(audio.begin(), audio.end(), work.begin());
+    AudioBlock block = {work.data(), frames, channels, 48000,
+                        CaptureMetadata()};
+    bank.Process(block);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_FilterBank)->Arg(1)->Arg(2)->Arg(8)->Arg(16);
@@ -0,0 +1,199 @@
+#include "../../native/core/ConvertKernels.h"
+#include "../../native/core/Dither.h"
+#include "../../native/core/SampleConvert.h"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <vector>
+
+// Packet sizes in frames: 10 ms at 48 kHz, and the larger packets WASAPI
+// shared mode hands out under load
+static void PacketSizes(benchmark::internal::Benchmark *b) {
+  for (int frames : {480, 1024, 4800}) {
+    b->Args({frames, 2});
+  }
+  b->Args({480, 8});
+}
+
+static void BM_ConvertToFloat(benchmark::State &state,
+                              SampleEncoding encoding) {
+  size_t numSamples = (size_t)(state.range(0) * state.range(1));
+  std::vector<uint8_t> input(numSamples * BytesPerSample(encoding));
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = (uint8_t)(i * 31);
+  }
+  if (encoding == SampleEncoding::Float32) {
+    // Keep the float input in range
+    std::vector<float> floats(numSamples, 0.25f);
+    memcpy(input.data(), floats.data(), input.size());
+  }
+  std::vector<float> output(numSamples);
+
+  for (auto _ : state) {
+    ConvertToFloat(input.data(), encoding, numSamples, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK_CAPTURE(BM_ConvertToFloat, Int16, SampleEncoding::Int16)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_ConvertToFloat, Int24, SampleEncoding::Int24)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_ConvertToFloat, Int32, SampleEncoding::Int32)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_ConvertToFloat, Float32, SampleEncoding::Float32)
+    ->Apply(PacketSizes);
+
+static void BM_ConvertFloatToInt16(benchmark::State &state) {
+  size_t numSamples = (size_t)(state.range(0) * state.range(1));
+  std::vector<float> input(numSamples);
+  for (size_t i = 0; i < numSamples; i++) {
+    // Include out-of-range samples so the clamp is exercised
+    input[i] = ((float)(i % 200) - 100.0f) / 80.0f;
+  }
+  std::vector<int16_t> output(numSamples);
+
+  for (auto _ : state) {
+    ConvertFloatToInt16(input.data(), numSamples, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK(BM_ConvertFloatToInt16)->Apply(PacketSizes);
+
+static void BM_InterleaveFloatToInt16(benchmark::State &state) {
+  size_t frames = (size_t)state.range(0);
+  int channels = (int)state.range(1);
+  std::vector<std::vector<float>> planes(channels,
+                                         std::vector<float>(frames, 0.25f));
+  std::vector<const float *> planePtrs;
+  for (auto &plane : planes) {
+    planePtrs.push_back(plane.data());
+  }
+  std::vector<int16_t> output(frames * channels);
+
+  for (auto _ : state) {
+    InterleaveFloatToInt16(planePtrs.data(), channels, frames, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames * channels);
+}
+BENCHMARK(BM_InterleaveFloatToInt16)->Apply(PacketSizes);
+
+static std::vector<uint8_t> DeviceInput(SampleEncoding encoding,
+                                        size_t numSamples) {
+  std::vector<uint8_t> input(numSamples * BytesPerSample(encoding));
+  for (size_t i = 0; i < input.size(); i++) {
+    input[i] = (uint8_t)(i * 31);
+  }
+  if (encoding == SampleEncoding::Float32) {
+    std::vector<float> floats(numSamples, 0.25f);
+    memcpy(input.data(), floats.data(), input.size());
+  }
+  return input;
+}
+
+// Device packet to 16-bit PCM through a float scratch buffer, the way the
+// engines converted before the kernels
+static void BM_DeviceToPcm_Generic(benchmark::State &state,
+                                   SampleEncoding encoding) {
+  size_t numSamples = (size_t)(state.range(0) * state.range(1));
+  auto input = DeviceInput(encoding, numSamples);
+  std::vector<float> floats(numSamples);
+  std::vector<int16_t> output(numSamples);
+
+  for (auto _ : state) {
+    ConvertToFloat(input.data(), encoding, numSamples, floats.data());
+    ConvertFloatToInt16(floats.data(), numSamples, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Generic, Int16, SampleEncoding::Int16)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Generic, Int24, SampleEncoding::Int24)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Generic, Int32, SampleEncoding::Int32)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Generic, Float32, SampleEncoding::Float32)
+    ->Apply(PacketSizes);
+
+// Same conversion through the kernel selected for the format
+static void BM_DeviceToPcm_Kernel(benchmark::State &state,
+                                  SampleEncoding encoding) {
+  size_t frames = (size_t)state.range(0);
+  int channels = (int)state.range(1);
+  size_t numSamples = frames * channels;
+  auto input = DeviceInput(encoding, numSamples);
+  std::vector<int16_t> output(numSamples);
+  PcmKernel toPcm = SelectKernels(encoding, channels).toPcm;
+
+  for (auto _ : state) {
+    toPcm(input.data(), frames, channels, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Kernel, Int16, SampleEncoding::Int16)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Kernel, Int24, SampleEncoding::Int24)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Kernel, Int32, SampleEncoding::Int32)
+    ->Apply(PacketSizes);
+BENCHMARK_CAPTURE(BM_DeviceToPcm_Kernel, Float32, SampleEncoding::Float32)
+    ->Apply(PacketSizes);
+
+static void BM_PlanarToPcm_Kernel(benchmark::State &state) {
+  size_t frames = (size_t)state.range(0);
+  int channels = (int)state.range(1);
+  std::vector<std::vector<float>> planes(channels,
+                                         std::vector<float>(frames, 0.25f));
+  std::vector<const uint8_t *> planePtrs;
+  for (auto &plane : planes) {
+    planePtrs.push_back((const uint8_t *)plane.data());
+  }
+  std::vector<int16_t> output(frames * channels);
+  PlanarPcmKernel planarToPcm =
+      SelectKernels(SampleEncoding::Float32, channels).planarToPcm;
+
+  for (auto _ : state) {
+    planarToPcm(planePtrs.data(), channels, frames, channels, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames * channels);
+}
+BENCHMARK(BM_PlanarToPcm_Kernel)->Apply(PacketSizes);
+
+// Float to 16-bit PCM per dither mode, including high channel counts
+static void BM_Requantize(benchmark::State &state, DitherMode mode) {
+  size_t frames = (size_t)state.range(0);
+  int channels = (int)state.range(1);
+  size_t numSamples = frames * channels;
+  std::vector<float> input(numSamples);
+  for (size_t i = 0; i < numSamples; i++) {
+    input[i] = ((float)(i % 200) - 100.0f) / 80.0f;
+  }
+  std::vector<int16_t> output(numSamples);
+  Requantizer requantizer(mode, channels);
+
+  for (auto _ : state) {
+    requantizer.Process(input.data(), frames, output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+static void DitherSizes(benchmark::internal::Benchmark *b) {
+  PacketSizes(b);
+  b->Args({480, 32});
+}
+BENCHMARK_CAPTURE(BM_Requantize, None, DitherMode::None)->Apply(DitherSizes);
+BENCHMARK_CAPTURE(BM_Requantize, Tpdf, DitherMode::Tpdf)->Apply(DitherSizes);
+BENCHMARK_CAPTURE(BM_Requantize, Shaped, DitherMode::Shaped)
+    ->Apply(DitherSizes);
@@ -0,0 +1,244 @@
+#include "../../native/core/FileSink.h"
+#include "../../native/core/SampleConvert.h"
+#include "SyntheticEngine.h"
+#include <benchmark/benchmark.h>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// The per-packet allocations made by the engines today: a float scratch
+// vector and an int16 output vector for every device packet
+static void BM_PacketAllocation_PerPacket(benchmark::State &state) {
+  size_t numSamples = (size_t)state.range(0) * 2;
+  std::vector<float> device(numSamples, 0.25f);
+
+  for (auto _ : state) {
+    std::vector<float> inputFloats(numSamples);
+    ConvertToFloat((const uint8_t *)device.data(), SampleEncoding::Float32,
+                   numSamples, inputFloats.data());
+    std::vector<int16_t> pcmData(numSamples);
+    ConvertFloatToInt16(inputFloats.data(), numSamples, pcmData.data());
+    benchmark::DoNotOptimize(pcmData.data());
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK(BM_PacketAllocation_PerPacket)->Arg(480)->Arg(4800);
+
+// Same work with scratch buffers sized once and reused
+static void BM_PacketAllocation_Reused(benchmark::State &state) {
+  size_t numSamples = (size_t)state.range(0) * 2;
+  std::vector<float> device(numSamples, 0.25f);
+  std::vector<float> inputFloats(numSamples);
+  std::vector<int16_t> pcmData(numSamples);
+
+  for (auto _ : state) {
+    ConvertToFloat((const uint8_t *)device.data(), SampleEncoding::Float32,
+                   numSamples, inputFloats.data());
+    ConvertFloatToInt16(inputFloats.data(), numSamples, pcmData.data());
+    benchmark::DoNotOptimize(pcmData.data());
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK(BM_PacketAllocation_Reused)->Arg(480)->Arg(4800);
+
+// Stand-in for Napi::ThreadSafeFunction, which needs a live Node
+// environment: a mutex-protected queue drained by a consumer thread, the
+// same structure node uses underneath (queue + uv_async wake-up)
+class CallQueue {
+public:
+  CallQueue() : consumer([this]() { Drain(); }) {}
+
+  ~CallQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      isClosing = true;
+    }
+    wake.notify_one();
+    consumer.join();
+  }
+
+  void BlockingCall(std::vector<uint8_t> *data) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(data);
+    }
+    wake.notify_one();
+  }
+
+private:
+  void Drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [this]() { return isClosing || !queue.empty(); });
+      while (!queue.empty()) {
+        std::vector<uint8_t> *data = queue.front();
+        queue.pop_front();
+        lock.unlock();
+        // The JS side copies into a Buffer and frees the native chunk
+        std::vector<uint8_t> buffer(data->begin(), data->end());
+        benchmark::DoNotOptimize(buffer.data());
+        delete data;
+        lock.lock();
+      }
+      if (isClosing)
+        return;
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::vector<uint8_t> *> queue;
+  bool isClosing = false;
+  std::thread consumer;
+};
+
+// AudioController's data callback: heap copy of the chunk plus an enqueue
+// onto the thread-safe function's queue
+static void BM_ControllerEnqueue(benchmark::State &state) {
+  std::vector<uint8_t> chunk((size_t)state.range(0) * 2 * sizeof(int16_t));
+  CallQueue tsfn;
+
+  for (auto _ : state) {
+    auto dataVec = new std::vector<uint8_t>(chunk.data(),
+                                            chunk.data() + chunk.size());
+    tsfn.BlockingCall(dataVec);
+  }
+  state.SetBytesProcessed(state.iterations() * chunk.size());
+}
+BENCHMARK(BM_ControllerEnqueue)->Arg(480)->Arg(4800);
+
+// What the controller's sink does with a packet in these benchmarks:
+// count it, standing in for state kept alive by shared pointers
+struct DispatchState {
+  uint64_t bytes = 0;
+};
+
+// Per-packet dispatch as it was: the core's std::function sink wrapping
+// the engine's std::function data callback, which captured the controller's
+// shared pointers
+static void BM_SinkDispatch_Function(benchmark::State &state) {
+  auto tsfn = std::make_shared<int>(0);
+  auto stream = std::make_shared<DispatchState>();
+  std::function<void(const uint8_t *, size_t)> dataCallback =
+      [tsfn, stream](const uint8_t *data, size_t size) {
+        stream->bytes += size;
+      };
+  CaptureCore::Sink coreSink = [dataCallback](const int16_t *samples,
+                                              size_t sampleCount,
+                                              const CaptureMetadata &) {
+    dataCallback((const uint8_t *)samples, sampleCount * sizeof(int16_t));
+  };
+  std::vector<int16_t> packet((size_t)state.range(0) * 2);
+  CaptureMetadata meta;
+
+  for (auto _ : state) {
+    coreSink(packet.data(), packet.size(), meta);
+    benchmark::ClobberMemory();
+  }
+  benchmark::DoNotOptimize(stream->bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SinkDispatch_Function)->Arg(480);
+
+// The same through a final CaptureSink: one virtual call, nothing copied
+class CountingSink final : public CaptureSink {
+public:
+  explicit CountingSink(std::shared_ptr<DispatchState> stream)
+      : stream(std::move(stream)) {}
+  void OnData(const PcmBlock &block) override {
+    stream->bytes += block.frames * block.channels * sizeof(int16_t);
+  }
+  void OnError(const std::string &) override {}
+  std::shared_ptr<DispatchState> stream;
+};
+
+static void BM_SinkDispatch_Interface(benchmark::State &state) {
+  auto stream = std::make_shared<DispatchState>();
+  CountingSink counting(stream);
+  // Hidden from the optimiser, as the engines only see the interface
+  CaptureSink *sink = &counting;
+  benchmark::DoNotOptimize(sink);
+  std::vector<int16_t> packet((size_t)state.range(0) * 2);
+  PcmBlock block = {packet.data(), (size_t)state.range(0), 2, 48000,
+                    CaptureMetadata()};
+
+  for (auto _ : state) {
+    sink->OnData(block);
+    benchmark::ClobberMemory();
+  }
+  benchmark::DoNotOptimize(stream->bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SinkDispatch_Interface)->Arg(480);
+
+// Device packet to delivered int16 chunk through a synthetic engine
+static void BM_EndToEnd_SyntheticEngine(benchmark::State &state) {
+  SampleEncoding encoding = (SampleEncoding)state.range(1);
+  SyntheticEngine engine(48000, 2, encoding, (size_t)state.range(0));
+
+  auto delivered = std::make_shared<DispatchState>();
+  engine.SetSink(std::make_shared<CountingSink>(delivered));
+
+  for (auto _ : state) {
+    engine.Pump(1);
+  }
+  benchmark::DoNotOptimize(delivered->bytes);
+  state.SetBytesProcessed(state.iterations() * engine.PacketBytes());
+  // Seconds of audio processed per second of wall time
+  state.counters["realtime_x"] = benchmark::Counter(
+      (double)state.iterations() * state.range(0) / 48000.0,
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_EndToEnd_SyntheticEngine)
+    ->ArgsProduct({{480, 4800},
+                   {(int64_t)SampleEncoding::Int16,
+                    (int64_t)SampleEncoding::Int24,
+                    (int64_t)SampleEncoding::Float32}});
+
+// Capture-side cost of recording many streams to disk at once: one 10 ms
+// stereo packet into each of range(0) sinks, through a private writer with
+// the thread (0) or io_uring (1) backend. The disk side shows in the
+// latency counter.
+static void BM_FileSinks(benchmark::State &state) {
+  size_t sinkCount = (size_t)state.range(0);
+  DiskWriter writer(state.range(1) ? DiskWriter::Backend::IoUring
+                                   : DiskWriter::Backend::Thread);
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "native_recorder_bench_files";
+  std::filesystem::create_directories(dir);
+
+  std::vector<std::unique_ptr<FileSink>> sinks;
+  for (size_t i = 0; i < sinkCount; i++) {
+    FileSinkSettings settings;
+    settings.path = (dir / ("stream" + std::to_string(i) + ".wav")).string();
+    sinks.emplace_back(new FileSink(settings, 48000, 2, nullptr, nullptr,
+                                    writer));
+    std::string error;
+    if (!sinks.back()->Open(error)) {
+      state.SkipWithError(error.c_str());
+      return;
+    }
+  }
+  std::vector<int16_t> packet(480 * 2, 1000);
+
+  for (auto _ : state) {
+    for (auto &sink : sinks) {
+      sink->Write(packet.data(), packet.size());
+    }
+  }
+  double maxLatencyMs = 0;
+  for (auto &sink : sinks) {
+    sink->Close();
+    maxLatencyMs = std::max(maxLatencyMs, sink->GetWriteStats().maxLatencyMs);
+  }
+  state.SetBytesProcessed(state.iterations() * sinkCount * packet.size() *
+                          sizeof(int16_t));
+  state.counters["maxWriteLatencyMs"] = maxLatencyMs;
+  state.SetLabel(DiskBackendName(writer.ActiveBackend()));
+  sinks.clear();
+  std::filesystem::remove_all(dir);
+}
+BENCHMARK(BM_FileSinks)->ArgsProduct({{1, 32}, {0, 1}});
@@ -0,0 +1,439 @@
+#include "../../native/core/BatchQueue.h"
+#include "../../native/core/CaptureCore.h"
+#include "../../native/core/ContainerStream.h"
+#include "../../native/core/Denoiser.h"
+#include "../../native/core/DiskWriter.h"
+#include "../../native/core/EchoCanceller.h"
+#include "../../native/core/FileSink.h"
+#include "../../native/core/FilterBank.h"
+#include "../../native/core/GainControl.h"
+#include "../../native/core/MappedCapture.h"
+#include "../../native/core/PreRollBuffer.h"
+#include "../../native/core/RecyclingPool.h"
+#include "../../native/core/SpectrumAnalyzer.h"
+#include "../../native/core/SyncSession.h"
+#include "../../native/core/WorkerPool.h"
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Every operator new of the test binary goes through here; allocations are
+// counted on the thread that armed the counter, so the writer and worker
+// threads may allocate freely
+namespace {
+
+thread_local bool countAllocations = false;
+std::atomic<size_t> allocations{0};
+
+void *Allocate(size_t size) {
+  if (countAllocations) {
+    allocations++;
+  }
+  return std::malloc(size > 0 ? size : 1);
+}
+
+// Through a pointer, so GCC does not see operator new's pointers reach free
+// and warn about a mismatch
+void (*volatile const Free)(void *) = std::free;
+
+} // namespace
+
+void *operator new(size_t size) {
+  if (void *p = Allocate(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return Allocate(size);
+}
+
+void operator delete(void *p) noexcept { Free(p); }
+void operator delete[](void *p) noexcept { Free(p); }
+void operator delete(void *p, size_t) noexcept { Free(p); }
+void operator delete[](void *p, size_t) noexcept { Free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { Free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  Free(p);
+}
+
+namespace {
+
+// Holds a strand or the disk writer until released, so the warm-up sees
+// the largest backlog the measured run can build up
+struct Gate {
+  std::mutex mutex;
+  std::condition_variable opened;
+  bool isOpen = false;
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    opened.wait(lock, [this] { return isOpen; });
+  }
+  void Open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    isOpen = true;
+    opened.notify_all();
+  }
+};
+
+// What a stream's consumer thread gets: a copy of the packet's PCM
+struct Packet {
+  std::vector<int16_t> samples;
+  size_t size = 0;
+};
+
+// Operator news made by run on this thread
+template <typename Run> size_t CountAllocations(Run run) {
+  allocations = 0;
+  countAllocations = true;
+  run();
+  countAllocations = false;
+  return allocations;
+}
+
+// Host time of the first packet, well away from zero
+const int64_t kEpochNs = 5000000000;
+
+// A device on its own clock, delivering 10 ms packets of a stereo tone
+struct Device {
+  double trueRate;
+  int64_t startNs;
+  uint64_t position = 0;
+  std::vector<int16_t> samples = std::vector<int16_t>(480 * 2);
+
+  PcmBlock Next(uint64_t lostFrames = 0) {
+    position += lostFrames;
+    for (size_t i = 0; i < samples.size(); i++) {
+      double t = (double)(position + i / 2);
+      samples[i] = (int16_t)(8000 * std::sin(0.05 * t));
+    }
+    PcmBlock block;
+    block.samples = samples.data();
+    block.frames = 480;
+    block.channels = 2;
+    block.sampleRate = 48000;
+    block.meta.frameIndex = position;
+    block.meta.timestampNs = startNs + (int64_t)(position * 1e9 / trueRate);
+    block.meta.discontinuity = lostFrames > 0;
+    position += block.frames;
+    return block;
+  }
+};
+
+} // namespace
+
+TEST_CASE("The capture path does not allocate once warmed up", "[alloc]") {
+  fs::path dir = fs::temp_directory_path() / "native_recorder_alloc";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  const size_t kFrames = 480;
+  const size_t kWarmUpPackets = 400;
+  const int kChannels = 2;
+
+  {
+    DiskWriter writer;
+    FileSinkSettings fileSettings;
+    fileSettings.path = (dir / "rec.wav").string();
+    fileSettings.checkpointSeconds = 0.5;
+    std::atomic<int> errors{0};
+    FileSink file(fileSettings, 48000, kChannels, nullptr,
+                  [&](const std::string &) { errors++; }, writer);
+    MappedCaptureSettings mappedSettings;
+    mappedSettings.path = (dir / "rec.pcm").string();
+    mappedSettings.mode = MappedMode::Ring;
+    mappedSettings.seconds = 1;
+    MappedCaptureWriter mapped(mappedSettings, 48000, kChannels);
+    std::string error;
+    REQUIRE(file.Open(error));
+    REQUIRE(mapped.Open(error));
+
+    PreRollBuffer preRoll(48000, kChannels, PreRollBuffer::Encoding::MuLaw);
+    WorkerPool pool(1);
+    std::shared_ptr<WorkerPool::Strand> strand = pool.CreateStrand();
+    Packet prototype;
+    prototype.samples.resize(kFrames * kChannels);
+    RecyclingPool<Packet> packets(8, prototype);
+    std::atomic<uint64_t> consumed{0};
+
+    std::vector<float> spectrum(1 + SpectrumSettings().bands);
+    CaptureCore core(
+        {48000, kChannels, SampleEncoding::Float32, false},
+        [&](const int16_t *samples, size_t sampleCount,
+            const CaptureMetadata &) {
+          file.Write(samples, sampleCount);
+          mapped.Write(samples, sampleCount);
+          preRoll.Write(samples, sampleCount);
+          Packet *packet = packets.Acquire();
+          std::copy(samples, samples + sampleCount, packet->samples.begin());
+          packet->size = sampleCount;
+          RecyclingPool<Packet> *owner = &packets;
+          strand->Post([owner, packet] { owner->Release(packet); });
+          consumed++;
+        },
+        {std::make_shared<FilterBank>(std::vector<BiquadSpec>{BiquadSpec()}),
+         std::make_shared<Denoiser>(), std::make_shared<GainControl>(),
+         std::make_shared<SpectrumAnalyzer>(SpectrumSettings(),
+                                            spectrum.data())},
+        DitherMode::Tpdf);
+    core.Reserve(kFrames);
+
+    std::vector<float> input(kFrames * kChannels);
+    uint64_t position = 0;
+    auto push = [&](size_t count) {
+      for (size_t p = 0; p < count; p++) {
+        for (size_t i = 0; i < input.size(); i++, position++) {
+          input[i] = 0.25f * (float)std::sin(0.01 * (double)position);
+        }
+        core.Push((const uint8_t *)input.data(), kFrames, CaptureMetadata());
+      }
+    };
+
+    // Warm up with the writer and the consumer stalled, then let them catch
+    // up: every queue, pool and block list reaches its largest size here
+    Gate writerGate;
+    Gate strandGate;
+    DiskRequest stall;
+    stall.file = std::make_shared<DiskFile>();
+    stall.task = [&] { writerGate.Wait(); };
+    writer.Submit(std::move(stall));
+    strand->Post([&] { strandGate.Wait(); });
+    push(kWarmUpPackets);
+    writerGate.Open();
+    strandGate.Open();
+    strand->Flush();
+    while (file.GetWriteStats().queueDepth > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Half as much again, with the counter armed on this thread only
+    allocations = 0;
+    countAllocations = true;
+    push(kWarmUpPackets / 2);
+    countAllocations = false;
+    REQUIRE(allocations == 0);
+
+    strand->Flush();
+    REQUIRE(consumed == kWarmUpPackets * 3 / 2);
+    REQUIRE(packets.Size() <= kWarmUpPackets + 8);
+    file.Close();
+    mapped.Close();
+    REQUIRE(errors == 0);
+  }
+  fs::remove_all(dir);
+}
+
+TEST_CASE("A synchronised follower does not allocate once aligned",
+          "[alloc]") {
+  std::shared_ptr<SyncSession> session = SyncSession::Get("alloc");
+  REQUIRE(session->ClaimMaster());
+  uint64_t delivered = 0;
+  auto count = std::make_shared<CallbackSink>(
+      [&delivered](const PcmBlock &block) { delivered += block.frames; });
+  SyncedSink master(session, true, count);
+  SyncedSink follower(session, false, count);
+
+  Device masterDevice{48000 * (1 - 20e-6), kEpochNs};
+  Device followerDevice{48000 * (1 + 50e-6), kEpochNs + 3000000};
+  auto run = [&](size_t packets, uint64_t lostFrames) {
+    for (size_t p = 0; p < packets; p++) {
+      master.OnData(masterDevice.Next());
+      follower.OnData(followerDevice.Next(p == 0 ? lostFrames : 0));
+    }
+  };
+  run(200, 0);
+  REQUIRE(follower.GetStats().startFrame >= 0);
+
+  // Including a realign over 100 ms of lost frames, filled with silence
+  uint64_t before = delivered;
+  REQUIRE(CountAllocations([&] { run(100, 4800); }) == 0);
+  REQUIRE(follower.GetStats().resyncs == 1);
+  REQUIRE(delivered - before >= 2 * 100 * 480);
+}
+
+TEST_CASE("Echo cancellation does not allocate once warmed up", "[alloc]") {
+  auto reference = std::make_shared<EchoReference>();
+  EchoReferenceTap tap(reference);
+  EchoCanceller canceller(reference);
+  // Reference resampled from 44.1 kHz, stereo mic
+  reference->SetRate(48000);
+  tap.Configure(44100, 2);
+  canceller.Configure(48000, 2);
+
+  std::vector<float> far(441 * 2);
+  std::vector<float> mic(480 * 2);
+  uint64_t packet = 0;
+  auto run = [&](size_t packets) {
+    for (size_t p = 0; p < packets; p++, packet++) {
+      int64_t timeNs = kEpochNs + (int64_t)packet * 10000000;
+      for (size_t i = 0; i < far.size(); i++) {
+        far[i] = 0.3f * (float)std::sin(0.03 * (double)(packet * 441 + i / 2));
+      }
+      for (size_t i = 0; i < mic.size(); i++) {
+        mic[i] = 0.2f * (float)std::sin(0.03 * (double)(packet * 480 + i / 2));
+      }
+      AudioBlock ref = {far.data(), 441, 2, 44100, CaptureMetadata()};
+      ref.meta.frameIndex = packet * 441;
+      ref.meta.timestampNs = timeNs;
+      tap.Process(ref);
+      AudioBlock block = {mic.data(), 480, 2, 48000, CaptureMetadata()};
+      block.meta.frameIndex = packet * 480;
+      block.meta.timestampNs = timeNs;
+      canceller.Process(block);
+    }
+  };
+  run(300);
+  REQUIRE(CountAllocations([&] { run(150); }) == 0);
+}
+
+TEST_CASE("Container streams do not allocate once warmed up", "[alloc]") {
+  fs::path dir = fs::temp_directory_path() / "native_recorder_alloc_container";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  for (ContainerFormat format : {ContainerFormat::Ogg, ContainerFormat::WebM}) {
+    DiskWriter writer;
+    std::atomic<int> errors{0};
+    fs::path path =
+        dir / (format == ContainerFormat::Ogg ? "rec.ogg" : "rec.webm");
+    ContainerFile file(path.string(), false,
+                       [&](const std::string &) { errors++; }, writer);
+    std::string error;
+    REQUIRE(file.Open(error));
+    ContainerSettings settings;
+    settings.format = format;
+    ContainerStream stream(settings, 48000, 2, 7,
+                           [&file](const uint8_t *data, size_t size) {
+                             file.Write(data, size);
+                           });
+
+    Device device{48000, kEpochNs};
+    auto run = [&](size_t packets) {
+      for (size_t p = 0; p < packets; p++) {
+        PcmBlock block = device.Next();
+        stream.Write(block.samples, block.frames * block.channels,
+                     block.meta);
+      }
+    };
+
+    // Warm up with the writer stalled, so the file's block pool reaches
+    // the largest backlog the measured run can build up
+    Gate writerGate;
+    DiskRequest stall;
+    stall.file = std::make_shared<DiskFile>();
+    stall.task = [&] { writerGate.Wait(); };
+    writer.Submit(std::move(stall));
+    run(400);
+    writerGate.Open();
+    while (file.GetWriteStats().queueDepth > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint64_t chunks = stream.Chunks();
+    REQUIRE(CountAllocations([&] { run(200); }) == 0);
+    REQUIRE(stream.Chunks() > chunks);
+    stream.Finish();
+    file.Close();
+    REQUIRE(errors == 0);
+  }
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Chunks are batched to the consumer without allocating",
+          "[alloc]") {
+  // The hand-off StreamSink makes through QueueBytes: pooled messages,
+  // queued in batches for one consumer that returns them to the pool
+  struct Message {
+    std::vector<uint8_t> data;
+    size_t size = 0;
+  };
+  RecyclingPool<Message> messages(16, Message());
+  BatchQueue<Message *> queue(64);
+  std::mutex mutex;
+  std::condition_variable woken;
+  bool pending = false;
+  bool stopping = false;
+  std::atomic<uint64_t> received{0};
+  Gate consumerGate;
+
+  std::thread consumer([&] {
+    std::vector<Message *> batch;
+    batch.reserve(64);
+    consumerGate.Wait();
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        woken.wait(lock, [&] { return pending || stopping; });
+        if (!pending) {
+          return;
+        }
+        pending = false;
+      }
+      queue.Take(batch);
+      for (Message *message : batch) {
+        received += message->size;
+        messages.Release(message);
+      }
+      batch.clear();
+    }
+  });
+
+  std::vector<int16_t> samples(480 * 2, 100);
+  uint64_t sent = 0;
+  auto run = [&](size_t packets) {
+    for (size_t p = 0; p < packets; p++) {
+      size_t size = samples.size() * sizeof(int16_t);
+      Message *message = messages.Acquire();
+      if (message->data.size() < size) {
+        message->data.resize(size);
+      }
+      std::memcpy(message->data.data(), samples.data(), size);
+      message->size = size;
+      sent += size;
+      if (queue.Push(message)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+        woken.notify_one();
+      }
+    }
+  };
+
+  // Warm up with the consumer stalled: the pool and both batch lists reach
+  // their largest size
+  run(200);
+  consumerGate.Open();
+  while (received < sent) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  REQUIRE(CountAllocations([&] { run(100); }) == 0);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    woken.notify_one();
+  }
+  consumer.join();
+  REQUIRE(received == sent);
+  REQUIRE(messages.Size() <= 200 + 16);
+}
@@ -107,13 +107,14 @@ TEST_CASE("AVFEngine Start/Stop Microphone", "[avf]") {
   };
 
   bool dataReceived = false;
-  auto dataCb = [&](const uint8_t *data, size_t size) {
-    if (size > 0)
+  auto dataCb = [&](const PcmBlock &block) {
+    if (block.frames > 0)
       dataReceived = true;
   };
 
   // Start microphone with deviceType and deviceId
-  engine->Start(AudioEngine::DEVICE_TYPE_INPUT, inputDeviceId, dataCb, errorCb);
+  engine->Start(AudioEngine::DEVICE_TYPE_INPUT, inputDeviceId,
+                std::make_shared<CallbackSink>(dataCb, errorCb));
 
   std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -132,14 +133,15 @@ TEST_CASE("AVFEngine Start/Stop System Audio (SCK)", "[avf]") {
   };
 
   bool dataReceived = false;
-  auto dataCb = [&](const uint8_t *data, size_t size) {
-    if (size > 0)
+  auto dataCb = [&](const PcmBlock &block) {
+    if (block.frames > 0)
       dataReceived = true;
   };
 
   // Start system audio with deviceType=output and deviceId=system
   engine->Start(AudioEngine::DEVICE_TYPE_OUTPUT,
-                AudioEngine::SYSTEM_AUDIO_DEVICE_ID, dataCb, errorCb);
+                AudioEngine::SYSTEM_AUDIO_DEVICE_ID,
+                std::make_shared<CallbackSink>(dataCb, errorCb));
 
   std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -0,0 +1,86 @@
+#include "../../native/core/BatchQueue.h"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST_CASE("BatchQueue wakes once per batch", "[batch]") {
+  BatchQueue<int> queue(4);
+  std::vector<int> batch{42};
+  queue.Take(batch);
+  REQUIRE(batch.empty());
+
+  REQUIRE(queue.Push(1));
+  REQUIRE_FALSE(queue.Push(2));
+  REQUIRE_FALSE(queue.Push(3));
+  REQUIRE(queue.Size() == 3);
+  queue.Take(batch);
+  REQUIRE(batch == std::vector<int>{1, 2, 3});
+  REQUIRE(queue.Size() == 0);
+
+  // Taken: the next item needs another wake-up
+  REQUIRE(queue.Push(4));
+  queue.Take(batch);
+  REQUIRE(batch == std::vector<int>{4});
+}
+
+TEST_CASE("BatchQueue keeps each producer's order", "[batch]") {
+  const int producers = 4;
+  const int count = 20000;
+  BatchQueue<int> queue(64);
+
+  // A consumer woken like a thread-safe function's callback: one pending
+  // wake-up per Push() that returned true
+  std::mutex mutex;
+  std::condition_variable cv;
+  int wakes = 0;
+  std::vector<int> last(producers, -1);
+  std::atomic<int> received{0};
+  int batches = 0;
+  bool ordered = true;
+
+  std::thread consumer([&] {
+    std::vector<int> batch;
+    while (received.load() < producers * count) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return wakes > 0; });
+        wakes--;
+      }
+      queue.Take(batch);
+      batches++;
+      for (int item : batch) {
+        int producer = item / count;
+        ordered = ordered && item % count == last[producer] + 1;
+        last[producer] = item % count;
+      }
+      received += (int)batch.size();
+    }
+  });
+
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < count; i++) {
+        if (queue.Push(p * count + i)) {
+          std::lock_guard<std::mutex> lock(mutex);
+          wakes++;
+          cv.notify_one();
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  consumer.join();
+
+  REQUIRE(ordered);
+  REQUIRE(received.load() == producers * count);
+  // No wake-up is left over or lost
+  REQUIRE(wakes == 0);
+  REQUIRE(queue.Size() == 0);
+  REQUIRE(batches <= producers * count);
+}
@@ -0,0 +1,108 @@
+#include "../../native/core/BlockWriter.h"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+} // namespace
+
+TEST_CASE("BlockWriter writes, counts and recycles blocks", "[blocks]") {
+  fs::path path = fs::temp_directory_path() / "native_recorder_blocks.bin";
+  fs::remove(path);
+  const size_t blockBytes = BlockWriter::kBlockBytes;
+
+  DiskWriter writer(DiskWriter::Backend::Thread);
+  std::vector<std::string> errors;
+  BlockWriter blocks(
+      [&](const std::string &error) { errors.push_back(error); },
+      [&](uint32_t) { return path.string(); }, writer);
+  auto file = std::make_shared<DiskFile>();
+  std::string error;
+  REQUIRE(file->Open(path.string(), false, error));
+
+  std::vector<uint8_t> expected;
+  std::vector<BlockWriter::Block *> used;
+  for (int i = 0; i < 4; i++) {
+    BlockWriter::Block *block = blocks.TakeBlock();
+    for (size_t j = 0; j < blockBytes; j++) {
+      block->data[j] = (uint8_t)(i * 31 + j);
+    }
+    block->used = blockBytes;
+    block->dataBytes = blockBytes - 16; // As if it held a header
+    expected.insert(expected.end(), block->data, block->data + blockBytes);
+    used.push_back(block);
+    blocks.WriteBlock(file, block, i * blockBytes);
+  }
+
+  // A partial write leaves the block with its filler
+  BlockWriter::Block *partial = blocks.TakeBlock();
+  for (size_t j = 0; j < 100; j++) {
+    partial->data[j] = (uint8_t)(255 - j);
+  }
+  partial->used = 100;
+  partial->dataBytes = 100;
+  blocks.WritePartial(file, partial, 100, 4 * blockBytes);
+  expected.insert(expected.end(), partial->data, partial->data + 100);
+  blocks.Drain();
+  REQUIRE(partial->users == 1);
+  blocks.ReleaseBlock(partial);
+  REQUIRE(file->Close());
+
+  REQUIRE(errors.empty());
+  REQUIRE_FALSE(blocks.Failed());
+  REQUIRE(blocks.BytesWritten() == 4 * (blockBytes - 16));
+  REQUIRE(ReadFile(path.string()) == expected);
+  BlockWriter::WriteStats stats = blocks.GetWriteStats();
+  REQUIRE(stats.queueDepth == 0);
+  REQUIRE(stats.maxQueueDepth >= 1);
+  REQUIRE(stats.maxLatencyMs >= stats.avgLatencyMs);
+
+  // Written blocks come back from the pool
+  BlockWriter::Block *again = blocks.TakeBlock();
+  REQUIRE((std::find(used.begin(), used.end(), again) != used.end() ||
+           again == partial));
+  REQUIRE(again->used == 0);
+  REQUIRE(again->dataBytes == 0);
+  blocks.ReleaseBlock(again);
+  fs::remove(path);
+}
+
+TEST_CASE("BlockWriter reports the first failure once", "[blocks]") {
+  DiskWriter writer(DiskWriter::Backend::Thread);
+  std::vector<std::string> errors;
+  BlockWriter blocks(
+      [&](const std::string &error) { errors.push_back(error); },
+      [](uint32_t index) { return "file" + std::to_string(index); }, writer);
+
+  // Never opened, so every write fails
+  auto file = std::make_shared<DiskFile>();
+  for (uint32_t i = 0; i < 3; i++) {
+    BlockWriter::Block *block = blocks.TakeBlock();
+    block->fileIndex = 7;
+    block->dataBytes = BlockWriter::kBlockBytes;
+    blocks.WriteBlock(file, block, i * BlockWriter::kBlockBytes);
+  }
+  bool ran = false;
+  blocks.SubmitTask(file, [&] {
+    ran = true;
+    blocks.EndRequest(-1);
+  });
+  blocks.Drain();
+
+  REQUIRE(ran);
+  REQUIRE(blocks.Failed());
+  REQUIRE(errors == std::vector<std::string>{"Failed to write file7"});
+  REQUIRE(blocks.BytesWritten() == 0);
+}
@@ -0,0 +1,211 @@
+#include "../../native/core/BufferSizing.h"
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+// Scriptable stand-in for IAudioClient/IAudioClient3
+class MockBufferClient : public BufferClient {
+public:
+  int64_t defaultHns = 100000; // 10 ms
+  int64_t minimumHns = 30000;  // 3 ms
+  bool hasClient3 = true;
+  SharedEnginePeriods periods = {480, 48, 144, 480};
+  std::vector<StreamFormat> exclusiveFormats;
+  int exclusiveQueries = 0;
+
+  bool GetDevicePeriods(int64_t &defaultOut, int64_t &minimumOut) override {
+    defaultOut = defaultHns;
+    minimumOut = minimumHns;
+    return true;
+  }
+
+  bool GetSharedEnginePeriods(const StreamFormat &format,
+                              SharedEnginePeriods &out) override {
+    out = periods;
+    return hasClient3;
+  }
+
+  bool IsExclusiveFormatSupported(const StreamFormat &format) override {
+    exclusiveQueries++;
+    for (const StreamFormat &f : exclusiveFormats) {
+      if (f.sampleRate == format.sampleRate && f.channels == format.channels &&
+          f.encoding == format.encoding && f.validBits == format.validBits)
+        return true;
+    }
+    return false;
+  }
+};
+
+static const StreamFormat kMix = {48000, 2, SampleEncoding::Float32, 32};
+
+TEST_CASE("Frame and 100 ns conversions round to nearest", "[buffer]") {
+  REQUIRE(FramesToHns(480, 48000) == 100000);
+  REQUIRE(FramesToHns(441, 44100) == 100000);
+  REQUIRE(HnsToFrames(100000, 48000) == 480);
+  REQUIRE(HnsToFrames(29025, 44100) == 128);
+  REQUIRE(HnsToFrames(0, 48000) == 0);
+}
+
+TEST_CASE("Requested period prefers bufferFrames over latencyMs",
+          "[buffer]") {
+  BufferRequest request;
+  REQUIRE(RequestedPeriodFrames(request, 48000) == 0);
+
+  request.latencyMs = 5;
+  REQUIRE(RequestedPeriodFrames(request, 48000) == 240);
+
+  request.bufferFrames = 128;
+  REQUIRE(RequestedPeriodFrames(request, 48000) == 128);
+}
+
+TEST_CASE("Shared periods snap to the engine's fundamental", "[buffer]") {
+  SharedEnginePeriods periods = {480, 48, 144, 480};
+  REQUIRE(AlignSharedPeriod(1, periods) == 144);
+  REQUIRE(AlignSharedPeriod(144, periods) == 144);
+  REQUIRE(AlignSharedPeriod(145, periods) == 192);
+  REQUIRE(AlignSharedPeriod(240, periods) == 240);
+  REQUIRE(AlignSharedPeriod(10000, periods) == 480);
+}
+
+TEST_CASE("No request keeps the classic 1 second shared buffer",
+          "[buffer]") {
+  MockBufferClient client;
+  BufferPlan plan;
+  std::string error;
+  REQUIRE(PlanBuffer({}, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Shared);
+  REQUIRE(plan.bufferHns == kDefaultSharedBufferHns);
+  REQUIRE(plan.periodFrames == 480);
+}
+
+TEST_CASE("Low latency requests use IAudioClient3 when available",
+          "[buffer]") {
+  MockBufferClient client;
+  BufferRequest request;
+  request.latencyMs = 3;
+  BufferPlan plan;
+  std::string error;
+
+  REQUIRE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::SharedLowLatency);
+  REQUIRE(plan.periodFrames == 144);
+
+  // Loopback and older systems fall back to a shorter classic buffer
+  REQUIRE(PlanBuffer(request, kMix, true, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Shared);
+  REQUIRE(plan.bufferHns == client.defaultHns);
+
+  client.hasClient3 = false;
+  request.latencyMs = 50;
+  REQUIRE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Shared);
+  REQUIRE(plan.bufferHns == 500000);
+  REQUIRE(plan.periodFrames == 480);
+}
+
+TEST_CASE("Requests at or above the engine period keep the classic path",
+          "[buffer]") {
+  MockBufferClient client;
+  BufferRequest request;
+  request.latencyMs = 200; // Well past the 480 frame maxFrames
+  BufferPlan plan;
+  std::string error;
+
+  REQUIRE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Shared);
+  REQUIRE(plan.bufferHns == 2000000);
+  REQUIRE(plan.periodFrames == 480);
+
+  request.latencyMs = 0;
+  request.bufferFrames = 480; // Exactly the default period
+  REQUIRE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Shared);
+  REQUIRE(plan.bufferHns == client.defaultHns);
+}
+
+TEST_CASE("Exclusive mode negotiates the first supported format",
+          "[buffer]") {
+  MockBufferClient client;
+  client.exclusiveFormats = {{44100, 2, SampleEncoding::Int16, 16},
+                             {48000, 2, SampleEncoding::Int32, 24}};
+  BufferRequest request;
+  request.exclusive = true;
+  request.bufferFrames = 96; // Below the 3 ms device minimum
+  BufferPlan plan;
+  std::string error;
+
+  REQUIRE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(plan.mode == BufferMode::Exclusive);
+  // Same rate and channels as the mix format wins over other rates
+  REQUIRE(plan.format.sampleRate == 48000);
+  REQUIRE(plan.format.encoding == SampleEncoding::Int32);
+  REQUIRE(plan.format.validBits == 24);
+  REQUIRE(plan.periodHns == client.minimumHns);
+  REQUIRE(plan.bufferHns == plan.periodHns);
+  REQUIRE(plan.periodFrames == 144);
+
+  // The device asked for an aligned buffer
+  RealignExclusivePlan(160, plan);
+  REQUIRE(plan.periodFrames == 160);
+  REQUIRE(plan.periodHns == FramesToHns(160, 48000));
+  REQUIRE(plan.bufferHns == plan.periodHns);
+}
+
+TEST_CASE("Exclusive mode can open a format other than the mix format",
+          "[buffer]") {
+  // The device only takes 48 kHz stereo 16-bit exclusively; the outputs
+  // have to be sized for that, not for the 44.1 kHz 6 channel mix format.
+  // GetStreamFormat() plans the same way before CaptureStream::Open().
+  StreamFormat mix = {44100, 6, SampleEncoding::Float32, 32};
+  MockBufferClient client;
+  client.exclusiveFormats = {{48000, 2, SampleEncoding::Int16, 16}};
+  BufferRequest request;
+  request.exclusive = true;
+  BufferPlan plan;
+  std::string error;
+
+  REQUIRE(PlanBuffer(request, mix, false, client, plan, error));
+  REQUIRE(plan.format.sampleRate == 48000);
+  REQUIRE(plan.format.channels == 2);
+  REQUIRE(plan.format.encoding == SampleEncoding::Int16);
+
+  // Planning again lands on the same format
+  BufferPlan again;
+  REQUIRE(PlanBuffer(request, mix, false, client, again, error));
+  REQUIRE(again.format.sampleRate == plan.format.sampleRate);
+  REQUIRE(again.format.channels == plan.format.channels);
+  REQUIRE(again.format.encoding == plan.format.encoding);
+}
+
+TEST_CASE("Exclusive mode reports why it is unavailable", "[buffer]") {
+  MockBufferClient client;
+  BufferRequest request;
+  request.exclusive = true;
+  BufferPlan plan;
+  std::string error;
+
+  REQUIRE_FALSE(PlanBuffer(request, kMix, false, client, plan, error));
+  REQUIRE(error.find("format") != std::string::npos);
+  REQUIRE(client.exclusiveQueries ==
+          (int)ExclusiveFormatCandidates(kMix).size());
+
+  error.clear();
+  client.exclusiveQueries = 0;
+  REQUIRE_FALSE(PlanBuffer(request, kMix, true, client, plan, error));
+  REQUIRE(error.find("loopback") != std::string::npos);
+  REQUIRE(client.exclusiveQueries == 0);
+}
+
+TEST_CASE("Exclusive candidates start from the mix format", "[buffer]") {
+  StreamFormat mix = {44100, 6, SampleEncoding::Float32, 32};
+  auto candidates = ExclusiveFormatCandidates(mix);
+  REQUIRE(candidates.front().sampleRate == 44100);
+  REQUIRE(candidates.front().channels == 6);
+  REQUIRE(candidates.front().encoding == SampleEncoding::Int32);
+  REQUIRE(candidates.front().validBits == 32);
+  REQUIRE(candidates[3].encoding == SampleEncoding::Int16);
+  REQUIRE(candidates[4].encoding == SampleEncoding::Float32);
+  REQUIRE(candidates.back().channels == 1);
+  REQUIRE(candidates.back().encoding == SampleEncoding::Float32);
+  // 3 channel counts x 2 rates (44100 listed once) x 5 encodings
+  REQUIRE(candidates.size() == 3 * 2 * 5);
+}
@@ -0,0 +1,159 @@
+#include "../../native/core/CaptureCore.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <vector>
+
+// Collects everything the core delivers
+struct Collector {
+  std::vector<int16_t> samples;
+  std::vector<CaptureMetadata> blocks;
+
+  CaptureCore::Sink Sink() {
+    return [this](const int16_t *data, size_t count,
+                  const CaptureMetadata &meta) {
+      samples.insert(samples.end(), data, data + count);
+      blocks.push_back(meta);
+    };
+  }
+};
+
+// Records what it saw and scales the audio
+class GainStage : public CaptureStage {
+public:
+  GainStage(float gain, std::vector<int> *order, int id)
+      : gain(gain), order(order), id(id) {}
+
+  void Configure(int sampleRate, int channels) override {
+    configuredRate = sampleRate;
+    configuredChannels = channels;
+  }
+
+  void Process(AudioBlock &block) override {
+    order->push_back(id);
+    for (size_t i = 0; i < block.frames * block.channels; i++)
+      block.samples[i] *= gain;
+  }
+
+  float gain;
+  std::vector<int> *order;
+  int id;
+  int configuredRate = 0;
+  int configuredChannels = 0;
+};
+
+TEST_CASE("CaptureCore passes 16-bit input through unchanged", "[core]") {
+  Collector out;
+  CaptureCore core({48000, 2, SampleEncoding::Int16, false}, out.Sink());
+
+  std::vector<int16_t> input = {-32768, 32767, -1, 1, 12345, -12345};
+  core.Push((const uint8_t *)input.data(), 3, CaptureMetadata());
+
+  REQUIRE(out.samples == input);
+  REQUIRE(core.FramePosition() == 3);
+}
+
+TEST_CASE("CaptureCore converts and clamps float input", "[core]") {
+  Collector out;
+  CaptureCore core({48000, 1, SampleEncoding::Float32, false}, out.Sink());
+
+  std::vector<float> input = {0.0f, 0.5f, -1.0f, 2.0f, -2.0f};
+  core.Push((const uint8_t *)input.data(), input.size(), CaptureMetadata());
+
+  REQUIRE(out.samples.size() == 5);
+  REQUIRE(out.samples[0] == 0);
+  REQUIRE(out.samples[1] == 16383);
+  REQUIRE(out.samples[2] == -32767);
+  REQUIRE(out.samples[3] == 32767);
+  REQUIRE(out.samples[4] == -32767);
+}
+
+TEST_CASE("CaptureCore interleaves planar input", "[core]") {
+  Collector out;
+  CaptureCore core({48000, 3, SampleEncoding::Float32, true}, out.Sink());
+
+  std::vector<float> left = {1.0f, 0.5f};
+  std::vector<float> right = {-1.0f, -0.5f};
+  const uint8_t *planes[] = {(const uint8_t *)left.data(),
+                             (const uint8_t *)right.data()};
+  // Third channel has no plane and comes out silent
+  core.PushPlanar(planes, 2, 2, CaptureMetadata());
+
+  REQUIRE(out.samples ==
+          std::vector<int16_t>{32767, -32767, 0, 16383, -16383, 0});
+}
+
+TEST_CASE("CaptureCore runs stages in order on float audio", "[core]") {
+  std::vector<int> order;
+  auto first = std::make_shared<GainStage>(0.5f, &order, 1);
+  auto second = std::make_shared<GainStage>(0.5f, &order, 2);
+
+  Collector out;
+  CaptureCore core({44100, 2, SampleEncoding::Int16, false}, out.Sink(),
+                   {first, second});
+  REQUIRE(first->configuredRate == 44100);
+  REQUIRE(second->configuredChannels == 2);
+
+  std::vector<int16_t> input = {32767, -32767};
+  core.Push((const uint8_t *)input.data(), 1, CaptureMetadata());
+
+  REQUIRE(order == std::vector<int>{1, 2});
+  REQUIRE(out.samples.size() == 2);
+  REQUIRE(out.samples[0] >= 8190);
+  REQUIRE(out.samples[0] <= 8192);
+  REQUIRE(out.samples[1] == -out.samples[0]);
+}
+
+TEST_CASE("CaptureCore numbers frames and keeps device metadata", "[core]") {
+  Collector out;
+  CaptureCore core({48000, 2, SampleEncoding::Float32, false}, out.Sink());
+
+  std::vector<float> input(8, 0.25f);
+  CaptureMetadata meta;
+  meta.timestampNs = 1000;
+  core.Push((const uint8_t *)input.data(), 4, meta);
+
+  meta.timestampNs = 2000;
+  meta.discontinuity = true;
+  core.Push(nullptr, 3, meta);
+
+  REQUIRE(out.blocks.size() == 2);
+  REQUIRE(out.blocks[0].frameIndex == 0);
+  REQUIRE(out.blocks[0].timestampNs == 1000);
+  REQUIRE_FALSE(out.blocks[0].silent);
+  REQUIRE(out.blocks[1].frameIndex == 4);
+  REQUIRE(out.blocks[1].timestampNs == 2000);
+  REQUIRE(out.blocks[1].discontinuity);
+  REQUIRE(out.blocks[1].silent);
+  REQUIRE(core.FramePosition() == 7);
+
+  // Silence is delivered as zeros
+  REQUIRE(out.samples.size() == 14);
+  for (size_t i = 8; i < 14; i++)
+    REQUIRE(out.samples[i] == 0);
+}
+
+TEST_CASE("CaptureCore hands each packet to a CaptureSink in one call",
+          "[core]") {
+  std::vector<PcmBlock> blocks;
+  std::vector<std::string> errors;
+  CallbackSink sink([&](const PcmBlock &block) { blocks.push_back(block); },
+                    [&](const std::string &error) { errors.push_back(error); });
+  CaptureCore core({44100, 2, SampleEncoding::Float32, false}, sink);
+
+  std::vector<float> input(960, 0.5f);
+  CaptureMetadata meta;
+  meta.timestampNs = 5000;
+  core.Push((const uint8_t *)input.data(), 480, meta);
+  core.Push((const uint8_t *)input.data(), 240, meta);
+
+  REQUIRE(blocks.size() == 2);
+  REQUIRE(blocks[0].frames == 480);
+  REQUIRE(blocks[0].channels == 2);
+  REQUIRE(blocks[0].sampleRate == 44100);
+  REQUIRE(blocks[0].meta.timestampNs == 5000);
+  REQUIRE(blocks[1].frames == 240);
+  REQUIRE(blocks[1].meta.frameIndex == 480);
+
+  sink.OnError("lost device");
+  REQUIRE(errors == std::vector<std::string>{"lost device"});
+}
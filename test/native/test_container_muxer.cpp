@@ -0,0 +1,326 @@
+#include "../../native/core/ContainerMuxer.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+struct Collector {
+  std::vector<Bytes> chunks;
+  ContainerMuxer::ChunkCallback Callback() {
+    return [this](const uint8_t *data, size_t size) {
+      chunks.emplace_back(data, data + size);
+    };
+  }
+};
+
+ContainerTrack Track() {
+  ContainerTrack track;
+  track.sampleRate = 48000;
+  track.channels = 2;
+  track.oggHeaders = {Bytes(51, 1), Bytes(30, 2)};
+  track.codecId = "A_FLAC";
+  track.codecPrivate = Bytes(10, 3);
+  return track;
+}
+
+Bytes Packet(size_t size, uint8_t fill) { return Bytes(size, fill); }
+
+// ---------------------------------------------------------------------------
+// Ogg
+
+uint64_t GetLittle(const uint8_t *p, int bytes) {
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+uint32_t BitwiseCrc(Bytes page) {
+  std::memset(page.data() + 22, 0, 4);
+  uint32_t crc = 0;
+  for (uint8_t byte : page) {
+    crc ^= (uint32_t)byte << 24;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+    }
+  }
+  return crc;
+}
+
+struct OggPage {
+  uint8_t flags;
+  uint64_t granule;
+  uint32_t sequence;
+  std::vector<Bytes> packets; // Complete or continued parts, in order
+  bool lastPacketOpen = false;
+};
+
+// One page per chunk, checked as it is parsed
+OggPage ParsePage(const Bytes &chunk, uint32_t serial) {
+  REQUIRE(chunk.size() >= 27);
+  REQUIRE(std::memcmp(chunk.data(), "OggS", 4) == 0);
+  REQUIRE(chunk[4] == 0);
+  OggPage page;
+  page.flags = chunk[5];
+  page.granule = GetLittle(&chunk[6], 8);
+  REQUIRE(GetLittle(&chunk[14], 4) == serial);
+  page.sequence = (uint32_t)GetLittle(&chunk[18], 4);
+  REQUIRE(GetLittle(&chunk[22], 4) == BitwiseCrc(chunk));
+  int segments = chunk[26];
+  size_t offset = 27 + segments;
+  bool open = false;
+  for (int i = 0; i < segments; i++) {
+    if (!open) {
+      page.packets.emplace_back();
+    }
+    size_t length = chunk[27 + i];
+    REQUIRE(offset + length <= chunk.size());
+    page.packets.back().insert(page.packets.back().end(),
+                               chunk.begin() + offset,
+                               chunk.begin() + offset + length);
+    offset += length;
+    open = length == 255;
+  }
+  REQUIRE(offset == chunk.size());
+  page.lastPacketOpen = open;
+  return page;
+}
+
+// ---------------------------------------------------------------------------
+// EBML
+
+struct Element {
+  uint32_t id;
+  uint64_t size; // ~0 when unknown
+  size_t data;   // Offset of the content
+};
+
+uint64_t ReadVint(const Bytes &bytes, size_t &pos, bool keepMarker) {
+  uint8_t first = bytes[pos];
+  int length = 1;
+  while (length <= 8 && !(first & (0x80 >> (length - 1)))) {
+    length++;
+  }
+  REQUIRE(length <= 8);
+  uint64_t value = keepMarker ? first : first & (0xFF >> length);
+  bool allOnes = value == (0xFFu >> length);
+  for (int i = 1; i < length; i++) {
+    allOnes = allOnes && bytes[pos + i] == 0xFF;
+    value = (value << 8) | bytes[pos + i];
+  }
+  pos += length;
+  return !keepMarker && allOnes ? ~0ull : value;
+}
+
+Element ReadElement(const Bytes &bytes, size_t &pos) {
+  Element element;
+  element.id = (uint32_t)ReadVint(bytes, pos, true);
+  element.size = ReadVint(bytes, pos, false);
+  element.data = pos;
+  return element;
+}
+
+uint64_t ReadUint(const Bytes &bytes, const Element &element) {
+  uint64_t value = 0;
+  for (uint64_t i = 0; i < element.size; i++) {
+    value = (value << 8) | bytes[element.data + i];
+  }
+  return value;
+}
+
+// Child elements of a master, by ID, failing on anything that overruns it
+std::vector<Element> Children(const Bytes &bytes, const Element &parent) {
+  std::vector<Element> children;
+  size_t pos = parent.data;
+  size_t end = parent.data + parent.size;
+  while (pos < end) {
+    Element child = ReadElement(bytes, pos);
+    REQUIRE(child.data + child.size <= end);
+    children.push_back(child);
+    pos = child.data + child.size;
+  }
+  REQUIRE(pos == end);
+  return children;
+}
+
+const Element *Find(const std::vector<Element> &elements, uint32_t id) {
+  for (const Element &element : elements) {
+    if (element.id == id) {
+      return &element;
+    }
+  }
+  return nullptr;
+}
+
+struct Cluster {
+  uint64_t timecode;
+  std::vector<int16_t> offsets;
+  std::vector<size_t> sizes;
+};
+
+Cluster ParseCluster(const Bytes &chunk) {
+  size_t pos = 0;
+  Element cluster = ReadElement(chunk, pos);
+  REQUIRE(cluster.id == 0x1F43B675);
+  REQUIRE(cluster.data + cluster.size == chunk.size());
+  Cluster parsed;
+  std::vector<Element> children = Children(chunk, cluster);
+  REQUIRE(children[0].id == 0xE7);
+  parsed.timecode = ReadUint(chunk, children[0]);
+  for (size_t i = 1; i < children.size(); i++) {
+    REQUIRE(children[i].id == 0xA3);
+    const uint8_t *block = &chunk[children[i].data];
+    REQUIRE(block[0] == 0x81);
+    REQUIRE(block[3] == 0x80);
+    parsed.offsets.push_back((int16_t)((block[1] << 8) | block[2]));
+    parsed.sizes.push_back(children[i].size - 4);
+  }
+  return parsed;
+}
+
+} // namespace
+
+TEST_CASE("Ogg pages carry packets, granules and CRCs", "[container]") {
+  Collector out;
+  OggMuxer muxer(Track(), 0x1234, 4800, out.Callback());
+  muxer.Begin();
+  REQUIRE(out.chunks.size() == 2);
+
+  // Headers: the first alone on the first page, granule 0
+  OggPage first = ParsePage(out.chunks[0], 0x1234);
+  REQUIRE(first.flags == 0x02);
+  REQUIRE(first.granule == 0);
+  REQUIRE(first.sequence == 0);
+  REQUIRE(first.packets == std::vector<Bytes>{Bytes(51, 1)});
+  OggPage second = ParsePage(out.chunks[1], 0x1234);
+  REQUIRE(second.flags == 0);
+  REQUIRE(second.packets == std::vector<Bytes>{Bytes(30, 2)});
+
+  // 2048-sample packets: a page once 4800 samples have ended on it
+  muxer.Add(Packet(300, 4).data(), 300, 0, 2048);
+  muxer.Add(Packet(510, 5).data(), 510, 2048, 2048);
+  REQUIRE(out.chunks.size() == 2);
+  muxer.Add(Packet(100, 6).data(), 100, 4096, 2048);
+  REQUIRE(out.chunks.size() == 3);
+  OggPage audio = ParsePage(out.chunks[2], 0x1234);
+  REQUIRE(audio.granule == 6144);
+  REQUIRE(audio.sequence == 2);
+  // A multiple of 255 ends with an empty segment
+  REQUIRE(audio.packets ==
+          std::vector<Bytes>{Packet(300, 4), Packet(510, 5), Packet(100, 6)});
+  REQUIRE_FALSE(audio.lastPacketOpen);
+
+  // After a gap, granules follow the packets' positions. A packet of more
+  // than 255 segments continues on the next page.
+  size_t large = 255 * 300;
+  muxer.Add(Packet(large, 7).data(), large, 20000, 2048);
+  REQUIRE(out.chunks.size() == 4);
+  OggPage cut = ParsePage(out.chunks[3], 0x1234);
+  REQUIRE(cut.granule == ~0ull);
+  REQUIRE(cut.lastPacketOpen);
+  REQUIRE(cut.packets[0].size() == 255 * 255);
+
+  // The stream ends on an end-of-stream page
+  muxer.Add(Packet(50, 8).data(), 50, 22048, 100);
+  muxer.Finish();
+  muxer.Finish();
+  REQUIRE(out.chunks.size() == 5);
+  OggPage last = ParsePage(out.chunks[4], 0x1234);
+  REQUIRE(last.flags == 0x05);
+  REQUIRE(last.granule == 22148);
+  REQUIRE(last.sequence == 4);
+  REQUIRE(last.packets.size() == 2);
+  REQUIRE(cut.packets[0].size() + last.packets[0].size() == large);
+  REQUIRE(last.packets[1] == Packet(50, 8));
+  REQUIRE(muxer.Chunks() == 5);
+
+  // Ending right after a page still marks the end of the stream
+  Collector empty;
+  OggMuxer ended(Track(), 1, 100, empty.Callback());
+  ended.Begin();
+  ended.Add(Packet(10, 1).data(), 10, 0, 100);
+  ended.Finish();
+  OggPage eos = ParsePage(empty.chunks.back(), 1);
+  REQUIRE(eos.flags == 0x04);
+  REQUIRE(eos.packets.empty());
+  REQUIRE(eos.granule == 100);
+}
+
+TEST_CASE("Matroska streams a header, then whole clusters", "[container]") {
+  Collector out;
+  MatroskaMuxer muxer(Track(), 24000, out.Callback());
+  muxer.Begin();
+  REQUIRE(out.chunks.size() == 1);
+
+  const Bytes &header = out.chunks[0];
+  size_t pos = 0;
+  Element ebml = ReadElement(header, pos);
+  REQUIRE(ebml.id == 0x1A45DFA3);
+  std::vector<Element> fields = Children(header, ebml);
+  const Element *docType = Find(fields, 0x4282);
+  REQUIRE(docType);
+  REQUIRE(std::string(header.begin() + docType->data,
+                      header.begin() + docType->data + docType->size) ==
+          "matroska");
+  pos = ebml.data + ebml.size;
+  Element segment = ReadElement(header, pos);
+  REQUIRE(segment.id == 0x18538067);
+  REQUIRE(segment.size == ~0ull);
+  Element info = ReadElement(header, pos);
+  REQUIRE(info.id == 0x1549A966);
+  std::vector<Element> infoFields = Children(header, info);
+  const Element *scale = Find(infoFields, 0x2AD7B1);
+  REQUIRE(scale);
+  REQUIRE(ReadUint(header, *scale) == 1000000);
+  pos = info.data + info.size;
+  Element tracks = ReadElement(header, pos);
+  REQUIRE(tracks.id == 0x1654AE6B);
+  REQUIRE(tracks.data + tracks.size == header.size());
+  std::vector<Element> entry = Children(header, Children(header, tracks)[0]);
+  const Element *codec = Find(entry, 0x86);
+  REQUIRE(codec);
+  REQUIRE(std::string(header.begin() + codec->data,
+                      header.begin() + codec->data + codec->size) ==
+          "A_FLAC");
+  REQUIRE(Find(entry, 0x63A2)->size == 10);
+  std::vector<Element> audio = Children(header, *Find(entry, 0xE1));
+  REQUIRE(ReadUint(header, *Find(audio, 0x9F)) == 2);
+
+  // 4800-sample (100 ms) packets: a cluster per 24000 samples
+  for (uint64_t i = 0; i < 5; i++) {
+    muxer.Add(Packet(200 + i, 1).data(), 200 + i, i * 4800, 4800);
+  }
+  REQUIRE(out.chunks.size() == 2);
+  Cluster first = ParseCluster(out.chunks[1]);
+  REQUIRE(first.timecode == 0);
+  REQUIRE(first.offsets == std::vector<int16_t>{0, 100, 200, 300, 400});
+  REQUIRE(first.sizes == std::vector<size_t>{200, 201, 202, 203, 204});
+
+  // A gap shows in the timecodes; one that overflows the block offsets
+  // closes the cluster
+  muxer.Add(Packet(10, 1).data(), 10, 24000, 4800);
+  muxer.Add(Packet(10, 1).data(), 10, 30000, 4800);
+  muxer.Add(Packet(10, 1).data(), 10, 48000 * 40, 4800);
+  muxer.Finish();
+  REQUIRE(out.chunks.size() == 4);
+  Cluster second = ParseCluster(out.chunks[2]);
+  REQUIRE(second.timecode == 500);
+  REQUIRE(second.offsets == std::vector<int16_t>{0, 125});
+  Cluster third = ParseCluster(out.chunks[3]);
+  REQUIRE(third.timecode == 40000);
+  REQUIRE(third.offsets == std::vector<int16_t>{0});
+  REQUIRE(muxer.Chunks() == 4);
+
+  // Codecs WebM admits keep its DocType
+  ContainerTrack opus = Track();
+  opus.webm = true;
+  Collector webm;
+  MatroskaMuxer(opus, 1, webm.Callback()).Begin();
+  std::string text(webm.chunks[0].begin(), webm.chunks[0].end());
+  REQUIRE(text.find("webm") != std::string::npos);
+}
@@ -0,0 +1,185 @@
+#include "../../native/core/ContainerStream.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+CaptureMetadata Meta(int64_t timestampNs, bool discontinuity = false) {
+  CaptureMetadata meta;
+  meta.timestampNs = timestampNs;
+  meta.discontinuity = discontinuity;
+  return meta;
+}
+
+// Sample number in the header of a FLAC frame with the variable block
+// size strategy, and its block size
+void FrameHeader(const uint8_t *frame, uint64_t &firstSample,
+                 uint32_t &frames) {
+  REQUIRE(frame[0] == 0xFF);
+  REQUIRE(frame[1] == 0xF9);
+  const uint8_t *p = frame + 4;
+  int extra = 0;
+  while (extra < 7 && (p[0] & (0x80 >> extra))) {
+    extra++;
+  }
+  firstSample = p[0] & (0x7F >> extra);
+  for (int i = 1; i < extra; i++) {
+    firstSample = (firstSample << 6) | (p[i] & 0x3F);
+  }
+  p += extra == 0 ? 1 : extra;
+  frames = ((p[0] << 8) | p[1]) + 1u;
+}
+
+struct OggPacket {
+  Bytes data;
+  uint64_t pageGranule;
+};
+
+// Audio packets of single-page Ogg chunks, after the two header pages
+std::vector<OggPacket> OggPackets(const std::vector<Bytes> &chunks) {
+  std::vector<OggPacket> packets;
+  for (size_t c = 2; c < chunks.size(); c++) {
+    const Bytes &page = chunks[c];
+    REQUIRE(std::memcmp(page.data(), "OggS", 4) == 0);
+    uint64_t granule = 0;
+    std::memcpy(&granule, &page[6], 8);
+    int segments = page[26];
+    size_t offset = 27 + segments;
+    bool open = false;
+    for (int i = 0; i < segments; i++) {
+      if (!open) {
+        packets.push_back({Bytes(), granule});
+      }
+      size_t length = page[27 + i];
+      packets.back().data.insert(packets.back().data.end(),
+                                 page.begin() + offset,
+                                 page.begin() + offset + length);
+      offset += length;
+      open = length == 255;
+    }
+  }
+  return packets;
+}
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+} // namespace
+
+TEST_CASE("GranuleClock skips ahead over lost audio only", "[container]") {
+  const int64_t ms = 1000000;
+
+  // 10 ms blocks with a few ms of jitter follow on
+  GranuleClock jitter(48000);
+  REQUIRE(jitter.Place(480, 1000 * ms, false) == 0);
+  REQUIRE(jitter.Place(480, 1013 * ms, false) == 480);
+  REQUIRE(jitter.Place(480, 1018 * ms, false) == 960);
+  REQUIRE(jitter.Place(480, 1030 * ms, false) == 1440);
+  REQUIRE(jitter.SkippedFrames() == 0);
+
+  GranuleClock clock(48000);
+  REQUIRE(clock.Place(480, 1000 * ms, false) == 0);
+  REQUIRE(clock.Place(480, 1010 * ms, false) == 480);
+  // A flagged discontinuity skips the time that went by
+  REQUIRE(clock.Place(480, 1070 * ms, true) == 48 * 70);
+  // An unflagged gap only beyond kMaxGapNs
+  REQUIRE(clock.Place(480, 1140 * ms, false) == 48 * 80);
+  REQUIRE(clock.Place(480, 1350 * ms, false) == 48 * 290);
+  REQUIRE(clock.SkippedFrames() == 48 * 250);
+
+  // Blocks arriving early or without a timestamp never go back
+  REQUIRE(clock.Place(480, 1300 * ms, true) == 48 * 300);
+  REQUIRE(clock.Place(480, 0, true) == 48 * 310);
+}
+
+TEST_CASE("ContainerStream packs FLAC into Ogg pages", "[container]") {
+  const int64_t ms = 1000000;
+  ContainerSettings settings;
+  settings.format = ContainerFormat::Ogg;
+  settings.chunkSeconds = 0.2;
+  std::string error;
+  REQUIRE(ValidateContainerSettings(settings, error));
+
+  std::vector<Bytes> chunks;
+  ContainerStream stream(settings, 16000, 1, 99,
+                         [&chunks](const uint8_t *data, size_t size) {
+                           chunks.emplace_back(data, data + size);
+                         });
+  // 0.2 s at 16 kHz: blocks of 3200 frames, a page each
+  std::vector<int16_t> block(1600);
+  for (size_t i = 0; i < block.size(); i++) {
+    block[i] = (int16_t)(i * 7);
+  }
+  stream.Write(block.data(), 1600, Meta(5000 * ms));
+  REQUIRE(chunks.size() == 2); // Header pages
+  stream.Write(block.data(), 1600, Meta(5100 * ms));
+  REQUIRE(chunks.size() == 3);
+  stream.Write(block.data(), 1600, Meta(5200 * ms));
+  // Frames lost: the half block so far becomes a packet of its own
+  stream.Write(block.data(), 1600, Meta(5600 * ms, true));
+  stream.Finish();
+
+  std::vector<OggPacket> packets = OggPackets(chunks);
+  REQUIRE(packets.size() == 3);
+  uint64_t firstSample = 0;
+  uint32_t frames = 0;
+  FrameHeader(packets[0].data.data(), firstSample, frames);
+  REQUIRE(firstSample == 0);
+  REQUIRE(frames == 3200);
+  REQUIRE(packets[0].pageGranule == 3200);
+  FrameHeader(packets[1].data.data(), firstSample, frames);
+  REQUIRE(firstSample == 3200);
+  REQUIRE(frames == 1600);
+  FrameHeader(packets[2].data.data(), firstSample, frames);
+  REQUIRE(firstSample == 16 * 600);
+  REQUIRE(frames == 1600);
+  REQUIRE(packets[2].pageGranule == 16 * 600 + 1600);
+  REQUIRE(chunks.back()[5] == 0x04); // End of stream
+  REQUIRE(stream.SkippedFrames() == 16 * 600 - 4800);
+  REQUIRE(stream.Chunks() == chunks.size());
+
+  settings.chunkSeconds = 0;
+  REQUIRE_FALSE(ValidateContainerSettings(settings, error));
+  settings.chunkSeconds = 31;
+  REQUIRE_FALSE(ValidateContainerSettings(settings, error));
+}
+
+TEST_CASE("ContainerFile appends every chunk", "[container]") {
+  fs::path path = fs::temp_directory_path() / "native_recorder_chunks.ogg";
+  for (bool direct : {false, true}) {
+    fs::remove(path);
+    ContainerFile file(path.string(), direct, nullptr);
+    std::string error;
+    REQUIRE(file.Open(error));
+    Bytes expected;
+    for (int i = 0; i < 300; i++) {
+      Bytes chunk((size_t)(i * 37 % 3000) + 1, (uint8_t)i);
+      file.Write(chunk.data(), chunk.size());
+      expected.insert(expected.end(), chunk.begin(), chunk.end());
+    }
+    file.Close();
+    REQUIRE(expected.size() > 3 * 65536);
+    REQUIRE(file.BytesWritten() == expected.size());
+    REQUIRE(ReadFile(path.string()) == expected);
+    ContainerFile::WriteStats stats = file.GetWriteStats();
+    REQUIRE(stats.queueDepth == 0);
+    REQUIRE(stats.maxQueueDepth >= 1);
+  }
+  fs::remove(path);
+
+  std::string error;
+  ContainerFile missing((fs::temp_directory_path() / "missing" / "a.ogg")
+                            .string(),
+                        false, nullptr);
+  REQUIRE_FALSE(missing.Open(error));
+}
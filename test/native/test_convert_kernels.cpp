@@ -0,0 +1,112 @@
+#include "../../native/core/ConvertKernels.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <vector>
+
+static const SampleEncoding kEncodings[] = {
+    SampleEncoding::Int16, SampleEncoding::Int24, SampleEncoding::Int32,
+    SampleEncoding::Float32};
+
+// Device bytes covering the full range of each encoding
+static std::vector<uint8_t> DeviceSamples(SampleEncoding encoding,
+                                          size_t count) {
+  std::vector<uint8_t> bytes(count * BytesPerSample(encoding));
+  if (encoding == SampleEncoding::Float32) {
+    for (size_t i = 0; i < count; i++) {
+      float value = ((float)(i % 50) - 25.0f) / 20.0f; // Includes overs
+      memcpy(bytes.data() + i * 4, &value, 4);
+    }
+  } else {
+    for (size_t i = 0; i < bytes.size(); i++)
+      bytes[i] = (uint8_t)(i * 37 + 11);
+  }
+  return bytes;
+}
+
+TEST_CASE("Float kernels match the generic conversion", "[kernels]") {
+  for (SampleEncoding encoding : kEncodings) {
+    for (int channels : {1, 2, 6}) {
+      size_t frames = 33;
+      size_t count = frames * channels;
+      auto input = DeviceSamples(encoding, count);
+
+      std::vector<float> expected(count);
+      ConvertToFloat(input.data(), encoding, count, expected.data());
+
+      std::vector<float> actual(count);
+      SelectKernels(encoding, channels)
+          .toFloat(input.data(), frames, channels, actual.data());
+      REQUIRE(actual == expected);
+    }
+  }
+}
+
+TEST_CASE("PCM kernels convert without a float round trip", "[kernels]") {
+  // 16-bit input is copied exactly
+  std::vector<int16_t> pcm = {-32768, -1, 0, 1, 32767, 1234};
+  std::vector<int16_t> out(pcm.size());
+  SelectKernels(SampleEncoding::Int16, 2)
+      .toPcm((const uint8_t *)pcm.data(), 3, 2, out.data());
+  REQUIRE(out == pcm);
+
+  // Wider integers keep their top 16 bits
+  std::vector<int32_t> wide = {INT32_MIN, -65536, -1, 0, 65535, INT32_MAX};
+  SelectKernels(SampleEncoding::Int32, 1)
+      .toPcm((const uint8_t *)wide.data(), 6, 1, out.data());
+  REQUIRE(out == std::vector<int16_t>{-32768, -1, -1, 0, 0, 32767});
+
+  const uint8_t packed[] = {0x00, 0x00, 0x80, 0xff, 0xff, 0x7f,
+                            0xff, 0xff, 0xff, 0x00, 0x34, 0x12};
+  SelectKernels(SampleEncoding::Int24, 4).toPcm(packed, 1, 4, out.data());
+  REQUIRE(out[0] == -32768);
+  REQUIRE(out[1] == 32767);
+  REQUIRE(out[2] == -1);
+  REQUIRE(out[3] == 0x1234);
+
+  // Float input is clamped like ConvertFloatToInt16
+  size_t count = 100;
+  auto floats = DeviceSamples(SampleEncoding::Float32, count);
+  std::vector<int16_t> expected(count);
+  ConvertFloatToInt16((const float *)floats.data(), count, expected.data());
+  std::vector<int16_t> actual(count);
+  SelectKernels(SampleEncoding::Float32, 2)
+      .toPcm(floats.data(), count / 2, 2, actual.data());
+  REQUIRE(actual == expected);
+}
+
+TEST_CASE("Planar kernels interleave and silence missing planes",
+          "[kernels]") {
+  for (int channels : {1, 2, 3}) {
+    size_t frames = 5;
+    std::vector<std::vector<float>> planes(channels);
+    std::vector<const uint8_t *> pointers;
+    for (int ch = 0; ch < channels; ch++) {
+      for (size_t frame = 0; frame < frames; frame++)
+        planes[ch].push_back(0.1f * (ch + 1) * (frame % 2 ? -1.0f : 1.0f));
+      pointers.push_back((const uint8_t *)planes[ch].data());
+    }
+    ConversionKernels kernels =
+        SelectKernels(SampleEncoding::Float32, channels);
+
+    std::vector<float> floats(frames * channels);
+    kernels.planarToFloat(pointers.data(), channels, frames, channels,
+                          floats.data());
+    std::vector<int16_t> pcm(frames * channels);
+    kernels.planarToPcm(pointers.data(), channels, frames, channels,
+                        pcm.data());
+    for (size_t frame = 0; frame < frames; frame++) {
+      for (int ch = 0; ch < channels; ch++) {
+        REQUIRE(floats[frame * channels + ch] == planes[ch][frame]);
+        REQUIRE(pcm[frame * channels + ch] ==
+                (int16_t)(planes[ch][frame] * 32767.0f));
+      }
+    }
+
+    // Only the first plane present
+    kernels.planarToPcm(pointers.data(), 1, frames, channels, pcm.data());
+    for (size_t frame = 0; frame < frames; frame++) {
+      for (int ch = 1; ch < channels; ch++)
+        REQUIRE(pcm[frame * channels + ch] == 0);
+    }
+  }
+}
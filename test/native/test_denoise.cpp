@@ -0,0 +1,148 @@
+#include "../../native/core/Denoiser.h"
+#include "../../native/core/Resampler.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+namespace {
+
+// Deterministic white noise in [-amplitude, amplitude)
+struct Noise {
+  uint32_t state = 12345;
+  float Next(float amplitude) {
+    state = state * 1664525u + 1013904223u;
+    return amplitude * ((state >> 8) / 8388608.0f - 1.0f);
+  }
+};
+
+double MeanSquare(const std::vector<float> &audio, size_t begin, size_t end) {
+  double sum = 0;
+  for (size_t i = begin; i < end; i++)
+    sum += (double)audio[i] * audio[i];
+  return sum / (end - begin);
+}
+
+// Run audio through the stage in blocks of blockFrames, in place
+void RunStage(CaptureStage &stage, std::vector<float> &audio, int sampleRate,
+              int channels, size_t blockFrames) {
+  size_t frames = audio.size() / channels;
+  for (size_t start = 0; start < frames; start += blockFrames) {
+    AudioBlock block = {};
+    block.samples = audio.data() + start * channels;
+    block.frames = std::min(blockFrames, frames - start);
+    block.channels = channels;
+    block.sampleRate = sampleRate;
+    stage.Process(block);
+  }
+}
+
+} // namespace
+
+TEST_CASE("Resampler keeps level and pitch across rates", "[denoise]") {
+  Resampler resampler(1, 44100, 48000);
+
+  // One second of a 1 kHz sine, in uneven chunks
+  std::vector<float> input(44100);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = 0.5f * (float)std::sin(2 * kPi * 1000 * i / 44100);
+  std::vector<float> output;
+  for (size_t start = 0; start < input.size(); start += 441 + start % 7) {
+    size_t count = std::min<size_t>(441 + start % 7, input.size() - start);
+    resampler.Process(input.data() + start, count, output);
+  }
+
+  // All but the kernel delay comes out
+  REQUIRE(output.size() > 48000 - 40);
+  REQUIRE(output.size() <= 48000);
+
+  // Output frames sit on the input timeline with no delay
+  double maxError = 0;
+  for (size_t i = 1000; i < output.size() - 1000; i++) {
+    double t = (double)i / 48000;
+    double expected = 0.5 * std::sin(2 * kPi * 1000 * t);
+    maxError = std::max(maxError, std::fabs(output[i] - expected));
+  }
+  REQUIRE(maxError < 0.01);
+}
+
+TEST_CASE("Denoise settings are validated", "[denoise]") {
+  std::string error;
+  DenoiseSettings settings;
+  REQUIRE(ValidateDenoiseSettings(settings, error));
+
+  settings.maxAttenuationDb = -1;
+  REQUIRE_FALSE(ValidateDenoiseSettings(settings, error));
+  REQUIRE(error.find("maxAttenuationDb") != std::string::npos);
+}
+
+TEST_CASE("Denoiser removes steady noise and keeps tone bursts",
+          "[denoise]") {
+  for (int sampleRate : {48000, 44100}) {
+    // Four seconds of 1 kHz bursts, 300 ms on and 300 ms off, over white
+    // noise 25 dB below them
+    size_t frames = (size_t)sampleRate * 4;
+    size_t segment = (size_t)sampleRate * 3 / 10;
+    std::vector<float> clean(frames), noisy(frames);
+    Noise noise;
+    for (size_t i = 0; i < frames; i++) {
+      bool on = (i / segment) % 2 == 1;
+      clean[i] = on ? 0.3f * (float)std::sin(2 * kPi * 1000 * i / sampleRate)
+                    : 0.0f;
+      noisy[i] = clean[i] + noise.Next(0.03f);
+    }
+
+    Denoiser denoiser;
+    denoiser.Configure(sampleRate, 1);
+    std::vector<float> output = noisy;
+    RunStage(denoiser, output, sampleRate, 1, 441);
+    REQUIRE(output.size() == frames);
+    size_t latency = denoiser.Latency();
+
+    // Judge the last segments, once the noise floor has settled, skipping
+    // 50 ms either side of each edge
+    size_t margin = (size_t)sampleRate / 20;
+    for (size_t s = 8; s < 12; s++) {
+      size_t begin = s * segment + margin;
+      size_t end = (s + 1) * segment - margin;
+      double before = MeanSquare(noisy, begin, end);
+      double after = MeanSquare(output, begin + latency, end + latency);
+      double target = MeanSquare(clean, begin, end);
+      if (s % 2 == 0) {
+        // Noise alone: at least 15 dB quieter
+        REQUIRE(after < before * 0.03);
+      } else {
+        // Tone: within 1 dB of the clean level
+        REQUIRE(std::fabs(10 * std::log10(after / target)) < 1.0);
+      }
+    }
+    REQUIRE(denoiser.ProcessingTimeMs() > 0);
+  }
+}
+
+TEST_CASE("Denoiser keeps stereo channels apart", "[denoise]") {
+  const int sampleRate = 48000;
+  size_t frames = sampleRate;
+  std::vector<float> audio(frames * 2);
+  Noise noise;
+  for (size_t i = 0; i < frames; i++) {
+    // Loud noise on the left only
+    audio[i * 2] = noise.Next(0.5f);
+    audio[i * 2 + 1] = 0.0f;
+  }
+
+  Denoiser denoiser;
+  denoiser.Configure(sampleRate, 2);
+  RunStage(denoiser, audio, sampleRate, 2, 480);
+
+  double left = 0, right = 0;
+  for (size_t i = frames / 2; i < frames; i++) {
+    left += audio[i * 2] * audio[i * 2];
+    right += audio[i * 2 + 1] * audio[i * 2 + 1];
+  }
+  // Attenuated by at most maxAttenuationDb, not silenced by its neighbour
+  REQUIRE(left > 1);
+  REQUIRE(right < 1e-6);
+}
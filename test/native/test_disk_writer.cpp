@@ -0,0 +1,149 @@
+#include "../../native/core/BlockWriter.h"
+#include "../../native/core/DiskWriter.h"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+// Writes 64 aligned blocks, a task that must see all of them done, then a
+// header through the task ordering
+void CheckWriter(DiskWriter &writer, bool direct) {
+  fs::path dir = fs::temp_directory_path() / "native_recorder_disk_writer";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::string path = (dir / "blocks.bin").string();
+
+  const size_t blockBytes = 16 * kDiskAlignment;
+  const size_t blockCount = 64;
+  uint8_t *buffer = (uint8_t *)AllocateAligned(blockBytes * blockCount);
+  REQUIRE(buffer != nullptr);
+  for (size_t i = 0; i < blockBytes * blockCount; i++)
+    buffer[i] = (uint8_t)(i * 7 + i / blockBytes);
+
+  auto file = std::make_shared<DiskFile>();
+  std::string error;
+  REQUIRE(file->Open(path, direct, error));
+
+  std::atomic<size_t> completed{0};
+  std::atomic<bool> allOk{true};
+  std::atomic<size_t> seenByTask{0};
+  std::atomic<bool> finished{false};
+  for (size_t i = 0; i < blockCount; i++) {
+    DiskRequest request;
+    request.file = file;
+    request.data = buffer + i * blockBytes;
+    request.size = blockBytes;
+    request.offset = i * blockBytes;
+    request.done = [&](bool ok, int64_t latencyNs) {
+      if (!ok || latencyNs < 0)
+        allOk = false;
+      completed++;
+    };
+    writer.Submit(std::move(request));
+  }
+  DiskRequest task;
+  task.file = file;
+  task.task = [&] {
+    seenByTask = completed.load();
+    const char tag[] = "HEAD";
+    file->DisableDirect();
+    file->WriteAt(tag, 4, 0);
+    file->Close();
+    finished = true;
+  };
+  writer.Submit(std::move(task));
+  while (!finished)
+    std::this_thread::yield();
+
+  REQUIRE(allOk);
+  REQUIRE(seenByTask == blockCount);
+  std::vector<uint8_t> bytes = ReadFile(path);
+  REQUIRE(bytes.size() == blockBytes * blockCount);
+  REQUIRE(std::equal(bytes.begin(), bytes.begin() + 4, "HEAD"));
+  REQUIRE(std::equal(bytes.begin() + 4, bytes.end(), buffer + 4));
+
+  DiskWriter::Stats stats = writer.GetStats();
+  REQUIRE(stats.writes >= blockCount);
+  REQUIRE(stats.maxQueueDepth >= 1);
+  REQUIRE(stats.maxLatencyMs >= stats.avgLatencyMs);
+  FreeAligned(buffer);
+  fs::remove_all(dir);
+}
+
+} // namespace
+
+TEST_CASE("Thread backend writes and orders tasks", "[disk]") {
+  DiskWriter writer(DiskWriter::Backend::Thread);
+  REQUIRE(writer.ActiveBackend() == DiskWriter::Backend::Thread);
+  CheckWriter(writer, false);
+  CheckWriter(writer, true);
+}
+
+TEST_CASE("io_uring backend writes and orders tasks", "[disk]") {
+  DiskWriter writer(DiskWriter::Backend::IoUring);
+  if (writer.ActiveBackend() != DiskWriter::Backend::IoUring) {
+    WARN("io_uring is not available here");
+    return;
+  }
+  CheckWriter(writer, false);
+  CheckWriter(writer, true);
+  REQUIRE(writer.GetStats().queueDepth == 0);
+}
+
+TEST_CASE("io_uring failure fails its writes and falls back to thread",
+          "[disk]") {
+  DiskWriter writer(DiskWriter::Backend::IoUring);
+  if (writer.ActiveBackend() != DiskWriter::Backend::IoUring) {
+    WARN("io_uring is not available here");
+    return;
+  }
+  fs::path path = fs::temp_directory_path() / "native_recorder_broken.bin";
+  fs::remove(path);
+  std::vector<std::string> errors;
+  BlockWriter blocks(
+      [&](const std::string &error) { errors.push_back(error); },
+      [&](uint32_t) { return path.string(); }, writer);
+  auto file = std::make_shared<DiskFile>();
+  std::string error;
+  REQUIRE(file->Open(path.string(), false, error));
+
+  auto writeBlocks = [&](size_t first, size_t count) {
+    for (size_t i = first; i < first + count; i++) {
+      BlockWriter::Block *block = blocks.TakeBlock();
+      std::fill(block->data, block->data + BlockWriter::kBlockBytes,
+                (uint8_t)i);
+      block->used = block->dataBytes = BlockWriter::kBlockBytes;
+      blocks.WriteBlock(file, block, i * BlockWriter::kBlockBytes);
+    }
+  };
+  // Some of these are in the ring when it fails, the rest come after
+  writeBlocks(0, 32);
+  writer.BreakRingForTesting();
+  writeBlocks(32, 32);
+  blocks.Drain();
+  REQUIRE(writer.ActiveBackend() == DiskWriter::Backend::Thread);
+  REQUIRE(blocks.GetWriteStats().queueDepth == 0);
+
+  // Writes after the switch go through the thread backend
+  size_t before = blocks.BytesWritten();
+  writeBlocks(64, 4);
+  blocks.Drain();
+  REQUIRE(blocks.BytesWritten() == before + 4 * BlockWriter::kBlockBytes);
+  REQUIRE(writer.GetStats().queueDepth == 0);
+  REQUIRE(file->Close());
+  fs::remove(path);
+}
@@ -0,0 +1,101 @@
+#include "../../native/core/CaptureCore.h"
+#include "../../native/core/Dither.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <vector>
+
+TEST_CASE("Requantizer without dither matches the old truncation",
+          "[dither]") {
+  std::vector<float> input = {0.0f, 0.5f, -0.5f, 1.5f, -1.5f, 0.999f};
+  std::vector<int16_t> expected(input.size());
+  ConvertFloatToInt16(input.data(), input.size(), expected.data());
+
+  Requantizer requantizer(DitherMode::None, 2);
+  std::vector<int16_t> out(input.size());
+  requantizer.Process(input.data(), 3, out.data());
+  REQUIRE(out == expected);
+}
+
+TEST_CASE("TPDF dither stays within 1.5 LSB of the input", "[dither]") {
+  size_t count = 4096;
+  std::vector<float> input(count);
+  for (size_t i = 0; i < count; i++)
+    input[i] = std::sin(i * 0.01f) * 0.8f;
+
+  Requantizer requantizer(DitherMode::Tpdf, 2);
+  std::vector<int16_t> out(count);
+  requantizer.Process(input.data(), count / 2, out.data());
+
+  for (size_t i = 0; i < count; i++)
+    REQUIRE(std::fabs(out[i] - input[i] * 32768.0f) <= 1.5f);
+}
+
+TEST_CASE("TPDF dither uses the full symmetric range", "[dither]") {
+  std::vector<float> input = {1.0f, -1.0f, 2.0f, -2.0f};
+  Requantizer requantizer(DitherMode::Tpdf, 1);
+  std::vector<int16_t> out(input.size());
+  requantizer.Process(input.data(), input.size(), out.data());
+
+  REQUIRE(out[0] >= 32766);
+  REQUIRE(out[1] <= -32767);
+  REQUIRE(out[2] >= 32766);
+  REQUIRE(out[3] <= -32767);
+}
+
+TEST_CASE("TPDF dither linearises signals below one LSB", "[dither]") {
+  // A quarter LSB truncates to silence, but averages back out with dither
+  size_t count = 65536;
+  std::vector<float> input(count, 0.25f / 32768.0f);
+  Requantizer requantizer(DitherMode::Tpdf, 1);
+  std::vector<int16_t> out(count);
+  requantizer.Process(input.data(), count, out.data());
+
+  double sum = 0;
+  for (int16_t sample : out) {
+    REQUIRE(sample >= -1);
+    REQUIRE(sample <= 1);
+    sum += sample;
+  }
+  REQUIRE(std::fabs(sum / count - 0.25) < 0.02);
+}
+
+TEST_CASE("Noise shaping keeps little error at low frequencies",
+          "[dither]") {
+  size_t count = 8192;
+  std::vector<float> input(count, 0.3f / 32768.0f);
+  std::vector<int16_t> out(count);
+
+  // With (1 - z^-1)^2 shaping the running sum of the error telescopes,
+  // so its DC content stays bounded instead of growing like a random walk
+  Requantizer shaped(DitherMode::Shaped, 1);
+  shaped.Process(input.data(), count, out.data());
+  double error = 0;
+  for (size_t i = 0; i < count; i++)
+    error += out[i] - 0.3;
+  REQUIRE(std::fabs(error) < 4.0);
+}
+
+TEST_CASE("Requantizer is deterministic for a seed", "[dither]") {
+  std::vector<float> input(1000, 0.1234f);
+  std::vector<int16_t> first(input.size());
+  std::vector<int16_t> second(input.size());
+  Requantizer a(DitherMode::Shaped, 2, 42);
+  Requantizer b(DitherMode::Shaped, 2, 42);
+  a.Process(input.data(), 500, first.data());
+  b.Process(input.data(), 500, second.data());
+  REQUIRE(first == second);
+}
+
+TEST_CASE("CaptureCore leaves 16-bit input undithered", "[dither]") {
+  std::vector<int16_t> delivered;
+  CaptureCore core({48000, 1, SampleEncoding::Int16, false},
+                   [&delivered](const int16_t *data, size_t count,
+                                const CaptureMetadata &) {
+                     delivered.assign(data, data + count);
+                   },
+                   {}, DitherMode::Tpdf);
+
+  std::vector<int16_t> input = {0, 1, -1, 32767, -32768};
+  core.Push((const uint8_t *)input.data(), input.size(), CaptureMetadata());
+  REQUIRE(delivered == input);
+}
@@ -0,0 +1,244 @@
+#include "../../native/core/EchoCanceller.h"
+#include "../../native/core/Resampler.h"
+#include "../../native/core/StreamClock.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+namespace {
+
+struct Noise {
+  uint32_t state = 987654321;
+  float Next(float amplitude) {
+    state = state * 1664525u + 1013904223u;
+    return amplitude * ((state >> 8) / 8388608.0f - 1.0f);
+  }
+};
+
+// Host time of the session start, well away from zero
+const int64_t kEpochNs = 5000000000;
+
+// Timestamp of a packet at frame position, with a few hundred microseconds
+// of scheduling jitter
+int64_t Stamp(uint64_t position, int sampleRate, Noise &jitter) {
+  return kEpochNs + (int64_t)(position * 1e9 / sampleRate) +
+         (int64_t)(jitter.Next(1.0f) * 400000);
+}
+
+// Far-end audio played in the room, the echo it makes at the mic, and what
+// the canceller leaves of the mic
+struct EchoScene {
+  int micRate;
+  int referenceRate;
+  std::vector<float> farEnd; // At referenceRate
+  std::vector<float> mic;    // At micRate
+};
+
+// Speech-like far end: noise shaped by a slow envelope, played at micRate
+// and captured by the reference stream at referenceRate. The mic hears it
+// through a room and, when nearEndTone is set, a talker in 500 ms bursts.
+EchoScene MakeScene(int micRate, int referenceRate, double seconds,
+                    double delayMs, float nearEndTone) {
+  EchoScene scene{micRate, referenceRate, {}, {}};
+  Noise noise;
+  size_t frames = (size_t)(seconds * micRate);
+  std::vector<float> played(frames);
+  float lowpass = 0;
+  for (size_t i = 0; i < frames; i++) {
+    lowpass = 0.7f * lowpass + 0.3f * noise.Next(1.0f);
+    float envelope = 0.6f + 0.4f * (float)std::sin(2 * kPi * 1.5 * i / micRate);
+    played[i] = 0.5f * envelope * lowpass;
+  }
+
+  if (referenceRate == micRate) {
+    scene.farEnd = played;
+  } else {
+    Resampler resampler(1, micRate, referenceRate);
+    resampler.Process(played.data(), frames, scene.farEnd);
+    scene.farEnd.resize((size_t)(seconds * referenceRate));
+  }
+
+  // Room: the direct path after delayMs and a decaying tail of reflections
+  std::vector<float> impulse((size_t)(0.03 * micRate));
+  Noise room;
+  for (size_t i = 0; i < impulse.size(); i++) {
+    impulse[i] = 0.3f * room.Next(1.0f) *
+                 (float)std::exp(-(double)i / (0.006 * micRate));
+  }
+  impulse[0] = 0.6f;
+
+  size_t delay = (size_t)(delayMs * micRate / 1000);
+  size_t burst = (size_t)micRate / 2;
+  scene.mic.assign(frames, 0.0f);
+  for (size_t i = delay; i < frames; i++) {
+    double sum = 0;
+    for (size_t k = 0; k < impulse.size() && k <= i - delay; k++)
+      sum += impulse[k] * played[i - delay - k];
+    scene.mic[i] = (float)sum;
+  }
+  for (size_t i = 0; i < frames; i++) {
+    if (nearEndTone > 0 && (i / burst) % 2 == 1)
+      scene.mic[i] +=
+          nearEndTone * (float)std::sin(2 * kPi * 440 * i / micRate);
+  }
+  return scene;
+}
+
+// Run both streams in 10 ms packets, the reference packet sometimes
+// arriving after the mic one. Returns the canceller output.
+std::vector<float> RunScene(const EchoScene &scene, EchoCanceller &canceller,
+                            std::shared_ptr<EchoReference> reference) {
+  EchoReferenceTap tap(reference);
+  tap.Configure(scene.referenceRate, 1);
+  canceller.Configure(scene.micRate, 1);
+
+  std::vector<float> output = scene.mic;
+  std::vector<float> farEnd = scene.farEnd;
+  size_t micPacket = scene.micRate / 100;
+  size_t refPacket = scene.referenceRate / 100;
+  size_t packets = output.size() / micPacket;
+  Noise jitter;
+  for (size_t p = 0; p < packets; p++) {
+    AudioBlock ref = {farEnd.data() + p * refPacket, refPacket, 1,
+                      scene.referenceRate, CaptureMetadata()};
+    ref.meta.frameIndex = p * refPacket;
+    ref.meta.timestampNs =
+        Stamp(ref.meta.frameIndex, scene.referenceRate, jitter);
+    AudioBlock mic = {output.data() + p * micPacket, micPacket, 1,
+                      scene.micRate, CaptureMetadata()};
+    mic.meta.frameIndex = p * micPacket;
+    mic.meta.timestampNs = Stamp(mic.meta.frameIndex, scene.micRate, jitter);
+
+    if (p % 3 == 0) {
+      canceller.Process(mic);
+      tap.Process(ref);
+    } else {
+      tap.Process(ref);
+      canceller.Process(mic);
+    }
+  }
+  return output;
+}
+
+double MeanSquare(const std::vector<float> &audio, size_t begin, size_t end) {
+  double sum = 0;
+  for (size_t i = begin; i < end; i++)
+    sum += (double)audio[i] * audio[i];
+  return sum / (end - begin);
+}
+
+} // namespace
+
+TEST_CASE("StreamClock smooths jitter and re-anchors on jumps", "[echo]") {
+  StreamClock clock(48000);
+  Noise jitter;
+  for (uint64_t p = 0; p < 500; p++) {
+    clock.Update(p * 480, Stamp(p * 480, 48000, jitter), false);
+  }
+  // Within 100 us of the true time despite 400 us of jitter
+  int64_t expected = kEpochNs + (int64_t)(500 * 480 * 1e9 / 48000);
+  REQUIRE(std::llabs(clock.TimeOf(500 * 480) - expected) < 100000);
+  REQUIRE(clock.Anchors() == 1);
+
+  // A 100 ms jump is taken at once
+  clock.Update(500 * 480, expected + 100000000, false);
+  REQUIRE(clock.Anchors() == 2);
+  REQUIRE(clock.TimeOf(500 * 480) == expected + 100000000);
+}
+
+TEST_CASE("EchoReference reads back by host time", "[echo]") {
+  EchoReference reference;
+  reference.SetRate(48000);
+
+  std::vector<float> ramp(4800);
+  for (size_t i = 0; i < ramp.size(); i++)
+    ramp[i] = (float)i;
+  for (size_t p = 0; p < 10; p++) {
+    reference.Write(ramp.data() + p * 480, 480, 48000, p * 480,
+                    kEpochNs + (int64_t)p * 10000000, false);
+  }
+  REQUIRE(reference.EndTimeNs() == kEpochNs + 100000000);
+
+  // 25 ms in is sample 1200; the span past the end reads as silence
+  std::vector<float> out(480);
+  REQUIRE(reference.IndexAt(kEpochNs + 25000000) == 1200);
+  reference.Read(1200, 480, out.data());
+  REQUIRE(out[0] == 1200.0f);
+  REQUIRE(out[479] == 1679.0f);
+  reference.Read(reference.IndexAt(kEpochNs + 95000000), 480, out.data());
+  REQUIRE(out[239] == 4799.0f);
+  REQUIRE(out[240] == 0.0f);
+
+  // Lost frames start a new timeline: the old samples are gone
+  reference.Write(ramp.data(), 480, 48000, 6000,
+                  kEpochNs + 125000000, true);
+  REQUIRE(reference.IndexAt(kEpochNs + 125000000) == 4800);
+  reference.Read(4790, 20, out.data());
+  REQUIRE(out[9] == 0.0f);
+  REQUIRE(out[10] == 0.0f);
+  REQUIRE(out[11] == 1.0f);
+}
+
+TEST_CASE("Echo settings are validated", "[echo]") {
+  std::string error;
+  EchoSettings settings;
+  REQUIRE(ValidateEchoSettings(settings, error));
+  settings.tailMs = 2000;
+  REQUIRE_FALSE(ValidateEchoSettings(settings, error));
+  REQUIRE(error.find("tailMs") != std::string::npos);
+}
+
+TEST_CASE("EchoCanceller removes the echo of the reference", "[echo]") {
+  for (int referenceRate : {48000, 44100}) {
+    EchoScene scene = MakeScene(48000, referenceRate, 6.0, 40, 0.0f);
+    auto reference = std::make_shared<EchoReference>();
+    EchoCanceller canceller(reference);
+    std::vector<float> output = RunScene(scene, canceller, reference);
+
+    // Last two seconds, aligned for the canceller's latency. A resampled
+    // reference leaves the band above its cutoff uncancelled.
+    size_t latency = canceller.Latency();
+    size_t begin = 4 * 48000, end = scene.mic.size() - latency;
+    double echo = MeanSquare(scene.mic, begin, end);
+    double residual = MeanSquare(output, begin + latency, end + latency);
+    double erle = 10 * std::log10(echo / residual);
+    INFO("reference rate " << referenceRate << ", ERLE " << erle);
+    REQUIRE(erle > (referenceRate == 48000 ? 18 : 12));
+    REQUIRE(canceller.ErleDb() > 10);
+    REQUIRE(canceller.ProcessingTimeMs() > 0);
+  }
+}
+
+TEST_CASE("EchoCanceller keeps near-end speech during double talk",
+          "[echo]") {
+  EchoScene echoOnly = MakeScene(48000, 48000, 6.0, 40, 0.0f);
+  EchoScene doubleTalk = MakeScene(48000, 48000, 6.0, 40, 0.2f);
+  auto reference = std::make_shared<EchoReference>();
+  EchoCanceller canceller(reference);
+  std::vector<float> output = RunScene(doubleTalk, canceller, reference);
+
+  // Subtracting the echo-only mic leaves the near-end tone, which should
+  // come through at its own level
+  size_t latency = canceller.Latency();
+  size_t begin = 4 * 48000, end = doubleTalk.mic.size() - latency;
+  std::vector<float> nearEnd(doubleTalk.mic.size());
+  for (size_t i = 0; i < nearEnd.size(); i++)
+    nearEnd[i] = doubleTalk.mic[i] - echoOnly.mic[i];
+
+  double error = 0;
+  for (size_t i = begin; i < end; i++) {
+    double diff = output[i + latency] - nearEnd[i];
+    error += diff * diff;
+  }
+  error /= end - begin;
+  double tone = MeanSquare(nearEnd, begin, end);
+  double echo = MeanSquare(echoOnly.mic, begin, end);
+  // Echo left plus tone lost: at least 10 dB below the echo
+  INFO("residual " << 10 * std::log10(error / echo) << " dB");
+  REQUIRE(error < echo * 0.1);
+  REQUIRE(error < tone * 0.5);
+}
@@ -1,6 +1,8 @@
 #include "../../native/AudioEngine.h"
+#include "../../native/core/CaptureCore.h"
 #include <catch2/catch_test_macros.hpp>
 #include <memory>
+#include <string>
 
 
 // Forward declaration
@@ -10,3 +12,21 @@ TEST_CASE("Factory Creates Engine", "[factory]") {
   auto engine = CreatePlatformAudioEngine();
   REQUIRE(engine != nullptr);
 }
+
+#if !defined(_WIN32) && !defined(__APPLE__) && !defined(HAVE_PULSEAUDIO)
+TEST_CASE("Without an audio API the factory returns the stub engine",
+          "[factory]") {
+  auto engine = CreatePlatformAudioEngine();
+  REQUIRE(engine != nullptr);
+  CHECK(engine->GetDevices().empty());
+  CHECK(engine->GetDeviceFormat("default").sampleRate == 0);
+
+  std::string error;
+  auto sink = std::make_shared<CallbackSink>(
+      [](const PcmBlock &) {},
+      [&](const std::string &message) { error = message; });
+  engine->Start(AudioEngine::DEVICE_TYPE_INPUT, "default", sink);
+  CHECK_FALSE(error.empty());
+  engine->Stop();
+}
+#endif
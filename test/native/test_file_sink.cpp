@@ -0,0 +1,227 @@
+#include "../../native/core/FileSink.h"
+#include "../../native/core/WavHeader.h"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Fresh directory under the system temp dir, removed afterwards
+struct TempDir {
+  fs::path path;
+  explicit TempDir(const char *name)
+      : path(fs::temp_directory_path() / name) {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+  ~TempDir() { fs::remove_all(path); }
+  std::string File(const char *name) const { return (path / name).string(); }
+};
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+uint32_t Get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Samples of a WAV file written by the sink, checking its header
+std::vector<int16_t> ReadWav(const std::string &path, int channels) {
+  std::vector<uint8_t> bytes = ReadFile(path);
+  REQUIRE(bytes.size() >= kWavHeaderSize);
+  REQUIRE(std::memcmp(bytes.data(), "RIFF", 4) == 0);
+  REQUIRE(Get32(bytes.data() + 4) == bytes.size() - 8);
+  REQUIRE(bytes[22] == channels);
+  REQUIRE(Get32(bytes.data() + 40) == bytes.size() - kWavHeaderSize);
+  std::vector<int16_t> samples((bytes.size() - kWavHeaderSize) / 2);
+  std::memcpy(samples.data(), bytes.data() + kWavHeaderSize,
+              samples.size() * 2);
+  return samples;
+}
+
+} // namespace
+
+TEST_CASE("Segment paths number the files", "[file]") {
+  REQUIRE(SegmentPath("/rec/loop.wav", 0) == "/rec/loop.wav");
+  REQUIRE(SegmentPath("/rec/loop.wav", 3) == "/rec/loop-00003.wav");
+  REQUIRE(SegmentPath("/rec.d/loop", 1) == "/rec.d/loop-00001");
+  REQUIRE(SegmentPath("/rec/{index}-loop.wav", 0) == "/rec/00000-loop.wav");
+
+  std::string error;
+  FileSinkSettings settings;
+  REQUIRE_FALSE(ValidateFileSinkSettings(settings, error));
+  settings.path = "/rec/loop.wav";
+  settings.segmentBytes = 100;
+  REQUIRE_FALSE(ValidateFileSinkSettings(settings, error));
+  REQUIRE(error.find("segmentBytes") == 0);
+}
+
+TEST_CASE("FileSink splits segments on exact frames", "[file]") {
+  TempDir dir("native_recorder_file_sink");
+  FileSinkSettings settings;
+  settings.path = dir.File("rec.wav");
+  settings.segmentSeconds = 0.25; // 12000 frames at 48 kHz
+
+  std::vector<SegmentInfo> segments;
+  std::vector<std::string> errors;
+  FileSink sink(
+      settings, 48000, 2,
+      [&](const SegmentInfo &segment) { segments.push_back(segment); },
+      [&](const std::string &error) { errors.push_back(error); });
+  std::string error;
+  REQUIRE(sink.Open(error));
+  REQUIRE(sink.SegmentFrames() == 12000);
+
+  // 0.6 s in odd-sized packets, a ramp so any lost or repeated frame shows
+  std::vector<int16_t> input(28800 * 2);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = (int16_t)(i % 65536 - 32768);
+  for (size_t pos = 0; pos < 28800;) {
+    size_t frames = std::min<size_t>(441, 28800 - pos);
+    sink.Write(input.data() + pos * 2, frames * 2);
+    pos += frames;
+  }
+  sink.Close();
+
+  REQUIRE(errors.empty());
+  REQUIRE(sink.FramesWritten() == 28800);
+  REQUIRE(segments.size() == 3);
+  std::vector<int16_t> joined;
+  for (size_t s = 0; s < segments.size(); s++) {
+    REQUIRE(segments[s].index == s);
+    REQUIRE(segments[s].path == SegmentPath(settings.path, (uint32_t)s));
+    REQUIRE(segments[s].startFrame == s * 12000);
+    REQUIRE(segments[s].frames == (s < 2 ? 12000u : 4800u));
+    REQUIRE(segments[s].endTimeNs > segments[s].startTimeNs);
+    if (s > 0)
+      REQUIRE(segments[s].startTimeNs == segments[s - 1].endTimeNs);
+    std::vector<int16_t> samples = ReadWav(segments[s].path, 2);
+    REQUIRE(samples.size() == segments[s].frames * 2);
+    joined.insert(joined.end(), samples.begin(), samples.end());
+  }
+  REQUIRE(joined == input);
+
+  // The file opened ahead for a fourth segment is gone
+  REQUIRE_FALSE(fs::exists(SegmentPath(settings.path, 3)));
+}
+
+TEST_CASE("FileSink times segments from the capture timestamps", "[file]") {
+  TempDir dir("native_recorder_file_sink_times");
+  FileSinkSettings settings;
+  settings.path = dir.File("timed.wav");
+  settings.segmentSeconds = 0.25; // 4000 mono frames
+
+  std::vector<SegmentInfo> segments;
+  FileSink sink(
+      settings, 16000, 1,
+      [&](const SegmentInfo &segment) { segments.push_back(segment); },
+      nullptr);
+  std::string error;
+  REQUIRE(sink.Open(error));
+  int64_t wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+  int64_t steadyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+
+  // Captured an hour ago, as a delayed writer would see it; 320 frames are
+  // 20 ms at 16 kHz. The last two packets come after a 1 s gap.
+  const int64_t hourNs = 3600ll * 1000000000;
+  const int64_t packetNs = 20000000;
+  std::vector<int16_t> input(320, 3);
+  for (int i = 0; i < 27; i++) {
+    CaptureMetadata meta;
+    meta.timestampNs = steadyNs - hourNs + i * packetNs +
+                       (i >= 25 ? 1000000000 : 0);
+    sink.Write(input.data(), input.size(), meta);
+  }
+  sink.Close();
+
+  REQUIRE(segments.size() == 3);
+  int64_t startNs = wallNs - hourNs;
+  // Within the few ms between Open() and reading the clocks above
+  REQUIRE(std::llabs(segments[0].startTimeNs - startNs) < 50000000);
+  REQUIRE(segments[0].endTimeNs - segments[0].startTimeNs == 250000000);
+  REQUIRE(segments[1].startTimeNs == segments[0].endTimeNs);
+  // The gap shows in the segment that spans it
+  REQUIRE(segments[2].startTimeNs == segments[1].endTimeNs + 1000000000);
+  REQUIRE(segments[2].endTimeNs - segments[2].startTimeNs == 40000000);
+}
+
+TEST_CASE("FileSink rotates by size and reports open failures", "[file]") {
+  TempDir dir("native_recorder_file_sink_size");
+  FileSinkSettings settings;
+  settings.path = dir.File("part-{index}.wav");
+  settings.segmentBytes = kWavHeaderSize + 10000; // 5000 mono frames
+
+  std::vector<SegmentInfo> segments;
+  FileSink sink(
+      settings, 16000, 1,
+      [&](const SegmentInfo &segment) { segments.push_back(segment); },
+      nullptr);
+  std::string error;
+  REQUIRE(sink.Open(error));
+  std::vector<int16_t> input(10000, 7);
+  sink.Write(input.data(), input.size());
+  sink.Close();
+
+  // Exactly two full files, no empty third
+  REQUIRE(segments.size() == 2);
+  REQUIRE(fs::file_size(segments[0].path) == settings.segmentBytes);
+  REQUIRE(fs::file_size(segments[1].path) == settings.segmentBytes);
+  REQUIRE_FALSE(fs::exists(SegmentPath(settings.path, 2)));
+
+  settings.path = dir.File("missing/rec.wav");
+  FileSink broken(settings, 16000, 1, nullptr, nullptr);
+  REQUIRE_FALSE(broken.Open(error));
+  REQUIRE(error.find("missing") != std::string::npos);
+}
+
+TEST_CASE("FileSink writes direct blocks through either backend", "[file]") {
+  TempDir dir("native_recorder_file_sink_direct");
+  for (DiskWriter::Backend backend :
+       {DiskWriter::Backend::Thread, DiskWriter::Backend::IoUring}) {
+    DiskWriter writer(backend);
+    FileSinkSettings settings;
+    settings.path = dir.File("direct.wav");
+    settings.segmentSeconds = 1;
+    settings.direct = true;
+
+    // Three channels, so frames straddle the 64 KB blocks
+    std::vector<SegmentInfo> segments;
+    FileSink sink(
+        settings, 44100, 3,
+        [&](const SegmentInfo &segment) { segments.push_back(segment); },
+        nullptr, writer);
+    std::string error;
+    REQUIRE(sink.Open(error));
+    std::vector<int16_t> input(60000 * 3);
+    for (size_t i = 0; i < input.size(); i++)
+      input[i] = (int16_t)(i * 31);
+    for (size_t pos = 0; pos < 60000; pos += 500)
+      sink.Write(input.data() + pos * 3, 500 * 3);
+    sink.Close();
+
+    REQUIRE(segments.size() == 2);
+    REQUIRE(segments[0].frames == 44100);
+    std::vector<int16_t> joined = ReadWav(segments[0].path, 3);
+    std::vector<int16_t> second = ReadWav(segments[1].path, 3);
+    joined.insert(joined.end(), second.begin(), second.end());
+    REQUIRE(joined == input);
+
+    FileSink::WriteStats stats = sink.GetWriteStats();
+    REQUIRE(stats.queueDepth == 0);
+    REQUIRE(stats.maxQueueDepth >= 1);
+    REQUIRE(stats.maxLatencyMs >= stats.avgLatencyMs);
+  }
+}
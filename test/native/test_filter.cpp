@@ -0,0 +1,132 @@
+#include "../../native/core/FilterBank.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+namespace {
+
+std::vector<float> Sine(size_t frames, double frequency, double amplitude) {
+  std::vector<float> audio(frames);
+  for (size_t i = 0; i < frames; i++)
+    audio[i] = (float)(amplitude * std::sin(2 * kPi * frequency * i / 48000));
+  return audio;
+}
+
+// Filter interleaved audio in 10 ms blocks
+void Run(FilterBank &bank, std::vector<float> &audio, int channels) {
+  bank.Configure(48000, channels);
+  size_t frames = audio.size() / channels;
+  for (size_t pos = 0; pos < frames; pos += 480) {
+    size_t n = std::min<size_t>(480, frames - pos);
+    AudioBlock block = {audio.data() + pos * channels, n, channels, 48000,
+                        CaptureMetadata()};
+    bank.Process(block);
+  }
+}
+
+// Gain in dB of a single section at frequency, from the last half second
+// of a filtered two-second sine
+double ResponseDb(const BiquadSpec &spec, double frequency) {
+  std::vector<float> audio = Sine(96000, frequency, 0.5);
+  FilterBank bank({spec});
+  Run(bank, audio, 1);
+  double in = 0, out = 0;
+  for (size_t i = 72000; i < 96000; i++) {
+    double x = 0.5 * std::sin(2 * kPi * frequency * i / 48000);
+    in += x * x;
+    out += (double)audio[i] * audio[i];
+  }
+  return 10 * std::log10(out / in);
+}
+
+} // namespace
+
+TEST_CASE("Biquad specs are validated", "[filter]") {
+  std::string error;
+  BiquadSpec spec;
+  REQUIRE(ValidateBiquadSpec(spec, error));
+  spec.q = 0;
+  REQUIRE_FALSE(ValidateBiquadSpec(spec, error));
+  REQUIRE(error.find("q ") == 0);
+  spec = BiquadSpec();
+  spec.gainDb = 30;
+  REQUIRE_FALSE(ValidateBiquadSpec(spec, error));
+  REQUIRE(error.find("gainDb") == 0);
+}
+
+TEST_CASE("High-pass removes DC offset and keeps speech", "[filter]") {
+  std::vector<float> audio = Sine(48000, 1000, 0.5);
+  for (float &s : audio)
+    s += 0.2f;
+  BiquadSpec highPass;
+  highPass.frequency = 80;
+  FilterBank bank({highPass});
+  Run(bank, audio, 1);
+
+  double mean = 0;
+  for (size_t i = 24000; i < 48000; i++)
+    mean += audio[i];
+  REQUIRE(std::fabs(mean / 24000) < 1e-4);
+  REQUIRE(std::fabs(ResponseDb(highPass, 1000)) < 0.1);
+  REQUIRE(ResponseDb(highPass, 20) < -20);
+  REQUIRE(bank.ProcessingTimeMs() > 0);
+}
+
+TEST_CASE("Filter designs have the expected response", "[filter]") {
+  BiquadSpec notch;
+  notch.type = FilterType::Notch;
+  notch.frequency = 50;
+  notch.q = 10;
+  REQUIRE(ResponseDb(notch, 50) < -30);
+  REQUIRE(std::fabs(ResponseDb(notch, 200)) < 0.5);
+
+  BiquadSpec lowPass;
+  lowPass.type = FilterType::LowPass;
+  lowPass.frequency = 4000;
+  REQUIRE(std::fabs(ResponseDb(lowPass, 4000) + 3) < 0.2);
+  REQUIRE(ResponseDb(lowPass, 16000) < -18);
+
+  BiquadSpec lowShelf;
+  lowShelf.type = FilterType::LowShelf;
+  lowShelf.frequency = 300;
+  lowShelf.gainDb = 6;
+  REQUIRE(std::fabs(ResponseDb(lowShelf, 30) - 6) < 0.2);
+  REQUIRE(std::fabs(ResponseDb(lowShelf, 300) - 3) < 0.2);
+  REQUIRE(std::fabs(ResponseDb(lowShelf, 10000)) < 0.2);
+
+  BiquadSpec highShelf;
+  highShelf.type = FilterType::HighShelf;
+  highShelf.frequency = 3000;
+  highShelf.gainDb = -6;
+  REQUIRE(std::fabs(ResponseDb(highShelf, 20000) + 6) < 0.3);
+  REQUIRE(std::fabs(ResponseDb(highShelf, 100)) < 0.2);
+}
+
+TEST_CASE("Filter lanes match channel-by-channel filtering", "[filter]") {
+  // 11 channels: a group of eight and a group of three
+  const int channels = 11;
+  const size_t frames = 4800;
+  std::vector<BiquadSpec> specs(2);
+  specs[0].frequency = 60;
+  specs[1].type = FilterType::Notch;
+  specs[1].frequency = 60;
+  specs[1].q = 5;
+
+  std::vector<float> interleaved(frames * channels);
+  std::vector<std::vector<float>> mono(channels);
+  for (int c = 0; c < channels; c++) {
+    mono[c] = Sine(frames, 100.0 * (c + 1), 0.1 * (c + 1));
+    for (size_t i = 0; i < frames; i++)
+      interleaved[i * channels + c] = mono[c][i];
+    FilterBank single(specs);
+    Run(single, mono[c], 1);
+  }
+  FilterBank bank(specs);
+  Run(bank, interleaved, channels);
+
+  for (int c = 0; c < channels; c++)
+    for (size_t i = 0; i < frames; i++)
+      REQUIRE(std::fabs(interleaved[i * channels + c] - mono[c][i]) < 1e-6f);
+}
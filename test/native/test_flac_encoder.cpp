@@ -0,0 +1,242 @@
+#include "../../native/core/FlacEncoder.h"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct BitReader {
+  const uint8_t *data;
+  size_t bit = 0;
+
+  uint32_t Get(int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++, bit++) {
+      value = (value << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+    }
+    return value;
+  }
+  int32_t GetSigned(int count) {
+    uint32_t value = Get(count);
+    if (value >> (count - 1)) {
+      value |= ~0u << count;
+    }
+    return (int32_t)value;
+  }
+  uint32_t Unary() {
+    uint32_t zeros = 0;
+    while (Get(1) == 0) {
+      zeros++;
+    }
+    return zeros;
+  }
+  size_t Bytes() const { return (bit + 7) / 8; }
+};
+
+uint8_t Crc8(const uint8_t *data, size_t size) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+uint16_t Crc16(const uint8_t *data, size_t size) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= (uint16_t)(data[i] << 8);
+    for (int b = 0; b < 8; b++) {
+      crc = (uint16_t)((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+// Decodes the subset of FLAC the encoder writes, checking both CRCs
+struct Frame {
+  uint64_t firstSample = 0;
+  uint32_t rateCode = 0;
+  std::vector<int16_t> samples; // Interleaved
+  std::vector<int> types;       // Subframe type of each channel
+};
+
+Frame Decode(const std::vector<uint8_t> &bytes, int channels) {
+  Frame frame;
+  BitReader bits{bytes.data()};
+  REQUIRE(bits.Get(16) == 0xFFF9);
+  REQUIRE(bits.Get(4) == 7);
+  frame.rateCode = bits.Get(4);
+  REQUIRE(bits.Get(4) == (uint32_t)channels - 1);
+  REQUIRE(bits.Get(3) == 4);
+  REQUIRE(bits.Get(1) == 0);
+  uint32_t lead = bits.Get(8);
+  int extra = 0;
+  while (extra < 7 && (lead & (0x80 >> extra))) {
+    extra++;
+  }
+  frame.firstSample = lead & (0x7F >> extra);
+  for (int i = 1; i < extra; i++) {
+    uint32_t next = bits.Get(8);
+    REQUIRE((next & 0xC0) == 0x80);
+    frame.firstSample = (frame.firstSample << 6) | (next & 0x3F);
+  }
+  uint32_t frames = bits.Get(16) + 1;
+  size_t headerBytes = bits.Bytes();
+  REQUIRE(bits.Get(8) == Crc8(bytes.data(), headerBytes));
+
+  std::vector<std::vector<int32_t>> decoded(channels);
+  for (int c = 0; c < channels; c++) {
+    std::vector<int32_t> &x = decoded[c];
+    REQUIRE(bits.Get(1) == 0);
+    uint32_t type = bits.Get(6);
+    REQUIRE(bits.Get(1) == 0);
+    frame.types.push_back((int)type);
+    if (type == 0) {
+      x.assign(frames, bits.GetSigned(16));
+    } else if (type == 1) {
+      for (uint32_t i = 0; i < frames; i++) {
+        x.push_back(bits.GetSigned(16));
+      }
+    } else {
+      REQUIRE(type >= 8);
+      REQUIRE(type <= 12);
+      uint32_t order = type - 8;
+      for (uint32_t i = 0; i < order; i++) {
+        x.push_back(bits.GetSigned(16));
+      }
+      REQUIRE(bits.Get(2) == 0);
+      uint32_t partitionOrder = bits.Get(4);
+      uint32_t length = frames >> partitionOrder;
+      for (uint32_t p = 0; p < (1u << partitionOrder); p++) {
+        uint32_t parameter = bits.Get(4);
+        REQUIRE(parameter < 15);
+        for (uint32_t i = p == 0 ? order : 0; i < length; i++) {
+          uint32_t folded = (bits.Unary() << parameter) | bits.Get(parameter);
+          int32_t e = (int32_t)(folded >> 1) ^ -(int32_t)(folded & 1);
+          size_t n = x.size();
+          int32_t prediction = 0;
+          switch (order) {
+          case 1: prediction = x[n - 1]; break;
+          case 2: prediction = 2 * x[n - 1] - x[n - 2]; break;
+          case 3:
+            prediction = 3 * x[n - 1] - 3 * x[n - 2] + x[n - 3];
+            break;
+          case 4:
+            prediction =
+                4 * x[n - 1] - 6 * x[n - 2] + 4 * x[n - 3] - x[n - 4];
+            break;
+          }
+          x.push_back(prediction + e);
+        }
+      }
+    }
+    REQUIRE(x.size() == frames);
+  }
+  size_t bodyBytes = bits.Bytes();
+  bits.bit = bodyBytes * 8;
+  REQUIRE(bits.Get(16) == Crc16(bytes.data(), bodyBytes));
+  REQUIRE(bits.Bytes() == bytes.size());
+
+  for (uint32_t i = 0; i < frames; i++) {
+    for (int c = 0; c < channels; c++) {
+      frame.samples.push_back((int16_t)decoded[c][i]);
+    }
+  }
+  return frame;
+}
+
+} // namespace
+
+TEST_CASE("FLAC frames decode to the samples they were given", "[flac]") {
+  const int channels = 2;
+  FlacEncoder encoder(48000, channels);
+  REQUIRE(encoder.MaxBlockFrames() == kFlacBlockFrames);
+
+  // Left: a loud tone with noise; right: full-scale noise, which only
+  // verbatim coding keeps small
+  std::mt19937 random(7);
+  std::uniform_int_distribution<int> full(-32768, 32767);
+  std::uniform_int_distribution<int> noise(-200, 200);
+  std::vector<int16_t> samples(kFlacBlockFrames * channels);
+  for (size_t i = 0; i < kFlacBlockFrames; i++) {
+    double tone = 30000 * std::sin(i * 0.05);
+    samples[i * 2] = (int16_t)std::max(
+        -32768.0, std::min(32767.0, tone + noise(random)));
+    samples[i * 2 + 1] = (int16_t)full(random);
+  }
+
+  std::vector<uint8_t> packet;
+  const uint32_t sizes[] = {kFlacBlockFrames, 1000, 17, 3, 1};
+  const uint64_t starts[] = {0, 100, 4096, 1ull << 20, (1ull << 36) - 1};
+  for (size_t k = 0; k < 5; k++) {
+    encoder.EncodeFrame(samples.data(), sizes[k], starts[k], packet);
+    Frame frame = Decode(packet, channels);
+    REQUIRE(frame.firstSample == starts[k]);
+    REQUIRE(frame.rateCode == 10);
+    REQUIRE(frame.samples ==
+            std::vector<int16_t>(samples.begin(),
+                                 samples.begin() + sizes[k] * channels));
+  }
+
+  encoder.EncodeFrame(samples.data(), kFlacBlockFrames, 0, packet);
+  Frame frame = Decode(packet, channels);
+  REQUIRE(frame.types[0] >= 8); // Predicted
+  REQUIRE(frame.types[1] == 1); // Verbatim
+}
+
+TEST_CASE("FLAC coding shrinks predictable audio", "[flac]") {
+  FlacEncoder encoder(44100, 1, 1024);
+  std::vector<int16_t> tone(1024);
+  for (size_t i = 0; i < tone.size(); i++) {
+    tone[i] = (int16_t)std::lround(12000 * std::sin(i * 0.01));
+  }
+  std::vector<uint8_t> packet;
+  encoder.EncodeFrame(tone.data(), 1024, 0, packet);
+  REQUIRE(packet.size() < tone.size() * 2 / 3);
+  REQUIRE(Decode(packet, 1).samples == tone);
+
+  // Silence is one value per channel
+  std::vector<int16_t> silence(1024, 0);
+  encoder.EncodeFrame(silence.data(), 1024, 1024, packet);
+  REQUIRE(packet.size() < 16);
+  Frame frame = Decode(packet, 1);
+  REQUIRE(frame.types[0] == 0);
+  REQUIRE(frame.samples == silence);
+  REQUIRE(frame.rateCode == 9);
+}
+
+TEST_CASE("FLAC metadata describes the stream", "[flac]") {
+  FlacEncoder encoder(44100, 2, 2048);
+  std::vector<uint8_t> info = encoder.StreamInfo();
+  REQUIRE(info.size() == 34);
+  REQUIRE(((info[0] << 8) | info[1]) == 16);
+  REQUIRE(((info[2] << 8) | info[3]) == 2048);
+  // 20 bits of rate, 3 of channels - 1, 5 of bits - 1
+  uint32_t rate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+  REQUIRE(rate == 44100);
+  REQUIRE(((info[12] >> 1) & 7) == 1);
+  REQUIRE((((info[12] & 1) << 4) | (info[13] >> 4)) == 15);
+
+  std::vector<uint8_t> first = encoder.OggFirstPacket();
+  REQUIRE(first.size() == 51);
+  REQUIRE(std::memcmp(first.data(), "\x7F" "FLAC\x01\x00\x00\x01" "fLaC", 13) ==
+          0);
+  REQUIRE(first[13] == 0); // STREAMINFO, more blocks follow
+  REQUIRE(std::memcmp(first.data() + 17, info.data(), 34) == 0);
+
+  std::vector<uint8_t> comment = encoder.OggCommentPacket();
+  REQUIRE(comment[0] == 0x84); // Last block, VORBIS_COMMENT
+  REQUIRE(((comment[1] << 16) | (comment[2] << 8) | comment[3]) ==
+          (int)comment.size() - 4);
+
+  std::vector<uint8_t> blocks = encoder.MetadataBlocks();
+  REQUIRE(blocks.size() == 4 + 34 + comment.size());
+  REQUIRE(std::memcmp(blocks.data() + 38, comment.data(), comment.size()) ==
+          0);
+}
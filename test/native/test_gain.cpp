@@ -0,0 +1,120 @@
+#include "../../native/core/GainControl.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+namespace {
+
+// Interleaved sine at amplitude, every channel alike
+std::vector<float> Tone(size_t frames, int channels, double amplitude) {
+  std::vector<float> audio(frames * channels);
+  for (size_t i = 0; i < frames; i++)
+    for (int c = 0; c < channels; c++)
+      audio[i * channels + c] =
+          (float)(amplitude * std::sin(2 * kPi * 440 * i / 48000.0));
+  return audio;
+}
+
+// Feed audio through the stage in 10 ms blocks
+void Run(GainControl &gain, std::vector<float> &audio, int channels) {
+  gain.Configure(48000, channels);
+  size_t frames = audio.size() / channels;
+  for (size_t pos = 0; pos < frames; pos += 480) {
+    size_t n = std::min<size_t>(480, frames - pos);
+    AudioBlock block = {audio.data() + pos * channels, n, channels, 48000,
+                        CaptureMetadata()};
+    gain.Process(block);
+  }
+}
+
+double RmsDb(const std::vector<float> &audio, size_t begin, size_t end) {
+  double sum = 0;
+  for (size_t i = begin; i < end; i++)
+    sum += (double)audio[i] * audio[i];
+  return 10 * std::log10(sum / (end - begin));
+}
+
+float Peak(const std::vector<float> &audio) {
+  float peak = 0;
+  for (float s : audio)
+    peak = std::max(peak, std::fabs(s));
+  return peak;
+}
+
+} // namespace
+
+TEST_CASE("Gain settings are validated", "[gain]") {
+  std::string error;
+  GainSettings settings;
+  REQUIRE(ValidateGainSettings(settings, error));
+  settings.maxGainDb = 80;
+  REQUIRE_FALSE(ValidateGainSettings(settings, error));
+  REQUIRE(error.find("maxGainDb") != std::string::npos);
+  settings = GainSettings();
+  settings.ceilingDb = 3;
+  REQUIRE_FALSE(ValidateGainSettings(settings, error));
+  REQUIRE(error.find("ceilingDb") != std::string::npos);
+}
+
+TEST_CASE("GainControl brings quiet and loud talkers to the target",
+          "[gain]") {
+  // -40 and -6 dBFS RMS tones, both within reach of the default 24 dB
+  for (double levelDb : {-40.0, -6.0}) {
+    std::vector<float> audio =
+        Tone(48000 * 4, 1, std::sqrt(2.0) * std::pow(10, levelDb / 20));
+    GainControl gain;
+    Run(gain, audio, 1);
+    double outDb = RmsDb(audio, 48000 * 3, audio.size());
+    INFO("input " << levelDb << " dBFS, output " << outDb << " dBFS");
+    REQUIRE(std::fabs(outDb - (-18)) < 1.0);
+    REQUIRE(std::fabs(gain.Stats().agcGainDb - (-18 - levelDb)) < 1.0);
+    REQUIRE(Peak(audio) <= std::pow(10, -1 / 20.0) + 1e-6);
+  }
+}
+
+TEST_CASE("GainControl holds its gain through background noise", "[gain]") {
+  std::vector<float> audio = Tone(48000 * 2, 1, 0.0003); // About -73 dBFS
+  GainControl gain;
+  Run(gain, audio, 1);
+  REQUIRE(gain.Stats().agcGainDb == 0.0);
+}
+
+TEST_CASE("Look-ahead limiter keeps peaks under the ceiling", "[gain]") {
+  // AGC off: a -20 dBFS tone with a burst 12 dB over full scale
+  GainSettings settings;
+  settings.maxGainDb = 0;
+  std::vector<float> input = Tone(48000, 2, 0.1);
+  for (size_t i = 24000 * 2; i < 26400 * 2; i++)
+    input[i] *= 40.0f;
+  std::vector<float> audio = input;
+  GainControl gain(settings);
+  Run(gain, audio, 2);
+
+  float ceiling = (float)std::pow(10, -1 / 20.0);
+  REQUIRE(Peak(audio) <= ceiling * 1.0001f);
+
+  // Untouched, only delayed, before the burst comes into view and once the
+  // limiter has let go after it
+  size_t latency = gain.Latency();
+  REQUIRE(latency == 240);
+  for (size_t i = 0; i < 23000 * 2; i++)
+    REQUIRE(audio[i + latency * 2] == input[i]);
+  for (size_t i = 44000 * 2; i < 47000 * 2; i++)
+    REQUIRE(std::fabs(audio[i + latency * 2] - input[i]) < 1e-4f);
+
+  // The channels are turned down together
+  for (size_t i = 24000; i < 26400; i++) {
+    float left = audio[(i + latency) * 2], right = audio[(i + latency) * 2 + 1];
+    REQUIRE(left == right);
+  }
+
+  GainStats stats = gain.Stats();
+  REQUIRE(stats.maxReductionDb > 12.0);
+  REQUIRE(stats.maxReductionDb < 14.0);
+  REQUIRE(stats.limitedFrames > 2400);
+  REQUIRE(stats.reductionDb < 0.01);
+  REQUIRE(gain.ProcessingTimeMs() > 0);
+}
@@ -0,0 +1,143 @@
+#include "../../native/core/MappedCapture.h"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string TempFile(const char *name) {
+  return (fs::temp_directory_path() / name).string();
+}
+
+// Sample c of frame f, so a reader can check every frame it gets
+int16_t RampSample(uint64_t frame, int channel) {
+  return (int16_t)(frame * 2 + channel);
+}
+
+std::vector<int16_t> Ramp(uint64_t startFrame, size_t frames) {
+  std::vector<int16_t> samples(frames * 2);
+  for (size_t f = 0; f < frames; f++)
+    for (int c = 0; c < 2; c++)
+      samples[f * 2 + c] = RampSample(startFrame + f, c);
+  return samples;
+}
+
+} // namespace
+
+TEST_CASE("Mapped append file is readable while written", "[mapped]") {
+  MappedCaptureSettings settings;
+  settings.path = TempFile("native_recorder_append.pcm");
+  settings.seconds = 0.1; // 4800 frames at 48 kHz
+  MappedCaptureWriter writer(settings, 48000, 2);
+  std::string error;
+  REQUIRE(writer.Open(error));
+
+  MappedCaptureReader reader;
+  REQUIRE(reader.Open(settings.path, error));
+  REQUIRE(reader.SampleRate() == 48000);
+  REQUIRE(reader.Channels() == 2);
+  REQUIRE(reader.CapacityFrames() == 4800);
+  REQUIRE(reader.WrittenFrames() == 0);
+
+  std::vector<int16_t> first = Ramp(0, 3000);
+  writer.Write(first.data(), first.size());
+  REQUIRE(reader.WrittenFrames() == 3000);
+  REQUIRE(std::equal(first.begin(), first.end(), reader.Samples()));
+
+  // Only 1800 more fit
+  std::vector<int16_t> second = Ramp(3000, 3000);
+  writer.Write(second.data(), second.size());
+  writer.Close();
+  REQUIRE(reader.IsClosed());
+  REQUIRE(reader.WrittenFrames() == 4800);
+  REQUIRE(reader.DroppedFrames() == 1200);
+
+  uint64_t start = 4000;
+  std::vector<int16_t> out(2000 * 2);
+  REQUIRE(reader.Read(start, 2000, out.data()) == 800);
+  REQUIRE(start == 4000);
+  REQUIRE(out[0] == RampSample(4000, 0));
+  REQUIRE(out[799 * 2 + 1] == RampSample(4799, 1));
+
+  reader.Close();
+  fs::remove(settings.path);
+  REQUIRE_FALSE(reader.Open(settings.path, error));
+}
+
+TEST_CASE("Mapped ring keeps the latest frames", "[mapped]") {
+  MappedCaptureSettings settings;
+  settings.path = TempFile("native_recorder_ring.pcm");
+  settings.mode = MappedMode::Ring;
+  settings.seconds = 0.01; // 480 frames
+  MappedCaptureWriter writer(settings, 48000, 2);
+  std::string error;
+  REQUIRE(writer.Open(error));
+  std::vector<int16_t> samples = Ramp(0, 1000);
+  writer.Write(samples.data(), 700 * 2);
+  writer.Write(samples.data() + 700 * 2, 300 * 2);
+
+  MappedCaptureReader reader;
+  REQUIRE(reader.Open(settings.path, error));
+  uint64_t start = 0;
+  std::vector<int16_t> out(1000 * 2);
+  REQUIRE(reader.Read(start, 1000, out.data()) == 480);
+  REQUIRE(start == 520);
+  for (size_t i = 0; i < 480 * 2; i++)
+    REQUIRE(out[i] == samples[520 * 2 + i]);
+
+  // A packet larger than the ring keeps its own tail
+  std::vector<int16_t> large = Ramp(1000, 2000);
+  writer.Write(large.data(), large.size());
+  start = 0;
+  REQUIRE(reader.Read(start, 1000, out.data()) == 480);
+  REQUIRE(start == 2520);
+  REQUIRE(out[0] == RampSample(2520, 0));
+  writer.Close();
+  reader.Close();
+  fs::remove(settings.path);
+}
+
+TEST_CASE("Mapped ring reader never returns overwritten frames",
+          "[mapped]") {
+  MappedCaptureSettings settings;
+  settings.path = TempFile("native_recorder_ring_race.pcm");
+  settings.mode = MappedMode::Ring;
+  settings.seconds = 0.005; // 240 frames, so the writer laps the reader
+  MappedCaptureWriter writer(settings, 48000, 2);
+  std::string error;
+  REQUIRE(writer.Open(error));
+  MappedCaptureReader reader;
+  REQUIRE(reader.Open(settings.path, error));
+
+  const uint64_t totalFrames = 2000000;
+  std::thread producer([&] {
+    std::vector<int16_t> packet;
+    for (uint64_t frame = 0; frame < totalFrames; frame += 100) {
+      packet = Ramp(frame, 100);
+      writer.Write(packet.data(), packet.size());
+    }
+  });
+
+  uint64_t next = 0;
+  uint64_t received = 0;
+  bool intact = true;
+  std::vector<int16_t> out(200 * 2);
+  while (next < totalFrames && intact) {
+    uint64_t start = next;
+    size_t frames = reader.Read(start, 200, out.data());
+    for (size_t f = 0; f < frames && intact; f++)
+      intact = out[f * 2] == RampSample(start + f, 0) &&
+               out[f * 2 + 1] == RampSample(start + f, 1);
+    next = start + frames;
+    received += frames;
+  }
+  producer.join();
+  writer.Close();
+  REQUIRE(intact);
+  REQUIRE(received > 0);
+  fs::remove(settings.path);
+}
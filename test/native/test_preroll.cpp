@@ -0,0 +1,68 @@
+#include "../../native/core/PreRollBuffer.h"
+#include <catch2/catch_test_macros.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+static std::vector<int16_t> Ramp(int16_t from, size_t count) {
+  std::vector<int16_t> v(count);
+  for (size_t i = 0; i < count; i++)
+    v[i] = (int16_t)(from + i);
+  return v;
+}
+
+TEST_CASE("PreRollBuffer keeps the newest frames in order", "[preroll]") {
+  PreRollBuffer buffer(4, 2); // 4 stereo frames
+
+  auto first = Ramp(0, 6);
+  buffer.Write(first.data(), first.size());
+  REQUIRE(buffer.FrameCount() == 3);
+
+  auto second = Ramp(6, 4);
+  buffer.Write(second.data(), second.size());
+  REQUIRE(buffer.FrameCount() == 4);
+
+  std::vector<int16_t> out;
+  REQUIRE(buffer.ReadLatest(10, out) == 4);
+  REQUIRE(out == Ramp(2, 8));
+
+  REQUIRE(buffer.ReadLatest(1, out) == 1);
+  REQUIRE(out == Ramp(8, 2));
+}
+
+TEST_CASE("PreRollBuffer drops history larger than capacity", "[preroll]") {
+  PreRollBuffer buffer(3, 1);
+  auto samples = Ramp(100, 10);
+  buffer.Write(samples.data(), samples.size());
+
+  std::vector<int16_t> out;
+  REQUIRE(buffer.ReadLatest(3, out) == 3);
+  REQUIRE(out == Ramp(107, 3));
+
+  buffer.Clear();
+  REQUIRE(buffer.FrameCount() == 0);
+  REQUIRE(buffer.ReadLatest(3, out) == 0);
+  REQUIRE(out.empty());
+}
+
+TEST_CASE("PreRollBuffer mu-law round trip stays within G.711 error",
+          "[preroll]") {
+  PreRollBuffer buffer(1024, 1, PreRollBuffer::Encoding::MuLaw);
+  std::vector<int16_t> samples;
+  for (int v = -32768; v <= 32767; v += 64)
+    samples.push_back((int16_t)v);
+
+  for (size_t i = 0; i < samples.size(); i += 1024) {
+    size_t count = std::min<size_t>(1024, samples.size() - i);
+    buffer.Write(samples.data() + i, count);
+    std::vector<int16_t> out;
+    buffer.ReadLatest(count, out);
+    for (size_t j = 0; j < count; j++) {
+      int error = std::abs(out[j] - samples[i + j]);
+      // Quantisation step doubles per segment, max 1024 in the top segment
+      REQUIRE(error <= 1024);
+    }
+  }
+
+  REQUIRE(PreRollBuffer::DecodeMuLaw(PreRollBuffer::EncodeMuLaw(0)) == 0);
+}
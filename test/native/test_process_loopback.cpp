@@ -0,0 +1,162 @@
+#include "../../native/core/ProcessLoopback.h"
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A /proc with just the stat files of the given processes
+struct FakeProc {
+  fs::path root;
+
+  explicit FakeProc(std::map<int64_t, std::pair<std::string, int64_t>> stats)
+      : root(fs::temp_directory_path() / "native_recorder_proc") {
+    fs::remove_all(root);
+    for (const auto &entry : stats) {
+      fs::create_directories(root / std::to_string(entry.first));
+      std::ofstream(root / std::to_string(entry.first) / "stat")
+          << entry.first << " (" << entry.second.first << ") S "
+          << entry.second.second << " 1 1 0 -1 4194560\n";
+    }
+  }
+  ~FakeProc() { fs::remove_all(root); }
+
+  ProcessTree Tree() const {
+    std::string path = root.string();
+    return ProcessTree(
+        [path](int64_t pid) { return SystemParentProcessId(pid, path); });
+  }
+};
+
+SinkInputInfo Input(uint32_t index, uint32_t sink, int64_t processId) {
+  SinkInputInfo info;
+  info.index = index;
+  info.sink = sink;
+  info.processId = processId;
+  return info;
+}
+
+} // namespace
+
+TEST_CASE("Process loopback IDs name one process", "[loopback]") {
+  int64_t pid = 0;
+  REQUIRE(ParseProcessLoopbackId("process:4321", pid));
+  REQUIRE(pid == 4321);
+  REQUIRE(ProcessLoopbackId(pid) == "process:4321");
+
+  REQUIRE_FALSE(ParseProcessLoopbackId("process:", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("process:0", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("process:12a", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("process:-5", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("process:99999999999", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("system", pid));
+  REQUIRE_FALSE(ParseProcessLoopbackId("{0.0.0.00000000}.{abc}", pid));
+}
+
+TEST_CASE("ProcessTree follows parents from /proc", "[loopback]") {
+  // 100 is a browser with a renderer (101) that starts a helper (102)
+  FakeProc proc({{1, {"init", 0}},
+                 {100, {"browser", 1}},
+                 {101, {"Web Content (tab) 2", 100}},
+                 {102, {"helper", 101}},
+                 {200, {"player", 1}}});
+  REQUIRE(SystemParentProcessId(101, proc.root.string()) == 100);
+  REQUIRE(SystemParentProcessId(999, proc.root.string()) == -1);
+
+  ProcessTree tree = proc.Tree();
+  REQUIRE(tree.Contains(100, 100));
+  REQUIRE(tree.Contains(100, 101));
+  REQUIRE(tree.Contains(100, 102));
+  REQUIRE_FALSE(tree.Contains(100, 200));
+  REQUIRE_FALSE(tree.Contains(100, 1));
+  REQUIRE_FALSE(tree.Contains(100, 999));
+  REQUIRE(tree.Contains(101, 102));
+  REQUIRE_FALSE(tree.Contains(101, 100));
+
+  // A parent cycle from reused PIDs ends the walk
+  ProcessTree cycle([](int64_t pid) { return pid == 5 ? 6 : 5; });
+  REQUIRE_FALSE(cycle.Contains(100, 5));
+}
+
+TEST_CASE("SinkInputSelector monitors a process tree's sink inputs",
+          "[loopback]") {
+  FakeProc proc({{1, {"init", 0}},
+                 {100, {"browser", 1}},
+                 {101, {"renderer", 100}},
+                 {200, {"player", 1}}});
+  ProcessTree tree = proc.Tree();
+  SinkInputSelector selector(100, tree);
+
+  SinkInputSelector::Changes changes;
+  selector.Update(Input(7, 0, 101), changes);
+  selector.Update(Input(8, 0, 200), changes);
+  selector.Update(Input(9, 0, -1), changes);
+  REQUIRE(changes.stop.empty());
+  REQUIRE(changes.start.size() == 1);
+  REQUIRE(changes.start[0].index == 7);
+  REQUIRE(selector.Monitored().size() == 1);
+
+  // A volume change is nothing new, a move to another sink is
+  changes = SinkInputSelector::Changes();
+  selector.Update(Input(7, 0, 101), changes);
+  REQUIRE(changes.start.empty());
+  REQUIRE(changes.stop.empty());
+  selector.Update(Input(7, 1, 101), changes);
+  REQUIRE(changes.stop == std::vector<uint32_t>{7});
+  REQUIRE(changes.start.size() == 1);
+  REQUIRE(changes.start[0].sink == 1);
+
+  changes = SinkInputSelector::Changes();
+  selector.Remove(8, changes);
+  REQUIRE(changes.stop.empty());
+  selector.Remove(7, changes);
+  REQUIRE(changes.stop == std::vector<uint32_t>{7});
+  REQUIRE(selector.Monitored().empty());
+}
+
+TEST_CASE("LoopbackMixer sums sources that come and go", "[loopback]") {
+  LoopbackMixer mixer(1, 100);
+  std::vector<float> out;
+  std::vector<float> ones(50, 1.0f);
+  std::vector<float> twos(50, 2.0f);
+
+  REQUIRE(mixer.Read(out) == 0);
+  mixer.AddSource(1);
+  mixer.AddSource(2);
+
+  // Held back until both sources have the frames
+  mixer.Write(1, ones.data(), 50);
+  REQUIRE(mixer.Read(out) == 0);
+  mixer.Write(2, twos.data(), 30);
+  REQUIRE(mixer.Read(out) == 30);
+  REQUIRE(out == std::vector<float>(30, 3.0f));
+
+  // A source joining now starts level with the 20 frames waiting
+  mixer.AddSource(3);
+  mixer.Write(2, twos.data(), 20);
+  mixer.Write(3, ones.data(), 10);
+  REQUIRE(mixer.Read(out) == 20);
+  REQUIRE(out == std::vector<float>(20, 3.0f));
+
+  // Source 3 stalls: once the others are more than 100 frames ahead, it is
+  // filled with silence. The 10 frames it has are mixed first.
+  for (int i = 0; i < 3; i++) {
+    mixer.Write(1, ones.data(), 50);
+    mixer.Write(2, twos.data(), 50);
+  }
+  REQUIRE(mixer.Read(out) == 50);
+  REQUIRE(out[0] == 4.0f);
+  REQUIRE(out[10] == 3.0f);
+  REQUIRE(out[49] == 3.0f);
+
+  // A removed source no longer holds the mix back, but is drained
+  mixer.RemoveSource(3);
+  mixer.RemoveSource(2);
+  REQUIRE(mixer.Read(out) == 100);
+  REQUIRE(out[99] == 3.0f);
+  REQUIRE(mixer.SourceCount() == 1);
+}
@@ -0,0 +1,28 @@
+#include "../../native/core/ProcessUsage.h"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+
+TEST_CASE("ReadProcessUsage counts CPU time and wakeups", "[usage]") {
+  ProcessUsage before;
+  REQUIRE(ReadProcessUsage(before));
+
+  // 50 ms of work, then a few sleeps
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+  volatile uint64_t sink = 0;
+  while (std::chrono::steady_clock::now() < end) {
+    sink = sink + 1;
+  }
+  for (int i = 0; i < 5; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  ProcessUsage after;
+  REQUIRE(ReadProcessUsage(after));
+  REQUIRE(after.cpuNs - before.cpuNs >= 20000000);
+#ifdef __linux__
+  REQUIRE(after.wakeups >= before.wakeups + 5);
+#else
+  REQUIRE(after.wakeups >= before.wakeups);
+#endif
+}
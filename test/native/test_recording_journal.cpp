@@ -0,0 +1,161 @@
+#include "../../native/core/FileSink.h"
+#include "../../native/core/RecordingJournal.h"
+#include "../../native/core/WavHeader.h"
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Fresh directory under the system temp dir, removed afterwards
+struct TempDir {
+  fs::path path;
+  explicit TempDir(const char *name)
+      : path(fs::temp_directory_path() / name) {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+  ~TempDir() { fs::remove_all(path); }
+  std::string File(const char *name) const { return (path / name).string(); }
+};
+
+std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+void WriteFile(const std::string &path, const std::vector<uint8_t> &bytes) {
+  std::ofstream out(path, std::ios::binary);
+  out.write((const char *)bytes.data(), (std::streamsize)bytes.size());
+}
+
+uint32_t Get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void Append(std::vector<uint8_t> &bytes, const char *id, uint32_t size) {
+  bytes.insert(bytes.end(), id, id + 4);
+  for (int i = 0; i < 4; i++)
+    bytes.push_back((uint8_t)(size >> (8 * i)));
+}
+
+} // namespace
+
+TEST_CASE("Recovery repairs a recording abandoned mid-write", "[journal]") {
+  TempDir dir("native_recorder_journal");
+  for (bool direct : {false, true}) {
+    FileSinkSettings settings;
+    settings.path = dir.File("rec.wav");
+    settings.segmentSeconds = 0.25; // 12000 frames at 48 kHz
+    settings.checkpointSeconds = 0.1;
+    settings.direct = direct;
+
+    std::vector<std::string> errors;
+    FileSink sink(settings, 48000, 2, nullptr,
+                  [&](const std::string &error) { errors.push_back(error); });
+    std::string error;
+    REQUIRE(sink.Open(error));
+    REQUIRE(fs::exists(JournalPath(settings.path)));
+
+    std::vector<int16_t> input(28800 * 2);
+    for (size_t i = 0; i < input.size(); i++)
+      input[i] = (int16_t)(i % 65536 - 32768);
+    // Paced so no checkpoint is skipped for one still pending
+    for (size_t pos = 0; pos < 28800; pos += 480) {
+      sink.Write(input.data() + pos * 2, 480 * 2);
+      while (sink.GetWriteStats().queueDepth > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // What a killed process leaves: whatever the writer had done by then
+    fs::path crashed = dir.path / "crashed";
+    fs::create_directories(crashed);
+    for (const fs::directory_entry &entry : fs::directory_iterator(dir.path))
+      if (entry.is_regular_file())
+        fs::copy_file(entry.path(), crashed / entry.path().filename());
+
+    sink.Close();
+    REQUIRE(errors.empty());
+    REQUIRE_FALSE(fs::exists(JournalPath(settings.path)));
+
+    // Two finished segments, a third synced to its last checkpoint and an
+    // empty fourth opened ahead
+    std::string path = (crashed / "rec.wav").string();
+    std::vector<RecoveredSegment> segments;
+    REQUIRE(RecoverRecording(path, segments, error));
+    REQUIRE(segments.size() == 3);
+    REQUIRE_FALSE(segments[0].repaired);
+    REQUIRE(segments[1].checkpointFrames == 12000);
+    REQUIRE(segments[2].repaired);
+    REQUIRE(segments[2].frames == segments[2].checkpointFrames);
+    REQUIRE(segments[2].frames <= 4800);
+    if (!direct)
+      REQUIRE(segments[2].frames == 4800);
+    REQUIRE_FALSE(fs::exists(SegmentPath(path, 3)));
+    REQUIRE_FALSE(fs::exists(JournalPath(path)));
+
+    size_t frame = 0;
+    for (const RecoveredSegment &segment : segments) {
+      std::vector<uint8_t> bytes = ReadFile(segment.path);
+      REQUIRE(Get32(bytes.data() + 4) == bytes.size() - 8);
+      REQUIRE(Get32(bytes.data() + 40) == segment.frames * 4);
+      REQUIRE(std::memcmp(bytes.data() + kWavHeaderSize,
+                          input.data() + frame * 2, segment.frames * 4) == 0);
+      frame += segment.frames;
+    }
+
+    // Nothing left to do the second time
+    REQUIRE(RecoverRecording(path, segments, error));
+    REQUIRE_FALSE(segments[2].repaired);
+    fs::remove_all(crashed);
+  }
+}
+
+TEST_CASE("RepairWavFile fixes the sizes of any PCM WAV", "[journal]") {
+  TempDir dir("native_recorder_journal_repair");
+
+  // As a JS writer leaves it: a LIST chunk, sizes never filled in and a
+  // torn last frame
+  std::vector<uint8_t> bytes(kWavHeaderSize);
+  BuildWavHeader(bytes.data(), 44100, 2, 0);
+  bytes.resize(36);
+  Append(bytes, "LIST", 6);
+  bytes.insert(bytes.end(), {'I', 'N', 'F', 'O', 0, 0});
+  Append(bytes, "data", 0);
+  size_t dataOffset = bytes.size();
+  bytes.resize(dataOffset + 1000 * 4 + 3, 0x55);
+  std::string path = dir.File("js.wav");
+  WriteFile(path, bytes);
+
+  uint64_t frames = 0;
+  bool repaired = false;
+  std::string error;
+  REQUIRE(RepairWavFile(path, frames, repaired, error));
+  REQUIRE(frames == 1000);
+  REQUIRE(repaired);
+  bytes = ReadFile(path);
+  REQUIRE(Get32(bytes.data() + 4) == dataOffset - 8 + 4000);
+  REQUIRE(Get32(bytes.data() + dataOffset - 4) == 4000);
+
+  REQUIRE(RepairWavFile(path, frames, repaired, error));
+  REQUIRE_FALSE(repaired);
+
+  // Without a journal a single file is recovered as it is
+  std::vector<RecoveredSegment> segments;
+  REQUIRE(RecoverRecording(path, segments, error));
+  REQUIRE(segments.size() == 1);
+  REQUIRE(segments[0].checkpointFrames == 0);
+
+  WriteFile(path, std::vector<uint8_t>(100, 0));
+  REQUIRE_FALSE(RepairWavFile(path, frames, repaired, error));
+  REQUIRE(error.find("not a WAV") != std::string::npos);
+  REQUIRE_FALSE(RecoverRecording(dir.File("none.wav"), segments, error));
+  REQUIRE(error.find("No recording") == 0);
+}
@@ -0,0 +1,191 @@
+#include "../../native/core/CaptureScheduler.h"
+#include "../../native/core/WorkerPool.h"
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Signalable source standing in for a device stream
+class TestSource : public CaptureSource {
+public:
+  explicit TestSource(bool failOpen = false) : failOpen(failOpen) {
+#ifdef _WIN32
+    event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    if (pipe(fds) == 0) {
+      fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    }
+#endif
+  }
+
+  ~TestSource() {
+#ifdef _WIN32
+    CloseHandle(event);
+#else
+    close(fds[0]);
+    close(fds[1]);
+#endif
+  }
+
+  void Signal() {
+#ifdef _WIN32
+    SetEvent(event);
+#else
+    char byte = 1;
+    (void)!write(fds[1], &byte, 1);
+#endif
+  }
+
+  bool Open(WaitHandle &handle) override {
+    if (failOpen)
+      return false;
+    openThread = std::this_thread::get_id();
+#ifdef _WIN32
+    handle = event;
+#else
+    handle = fds[0];
+#endif
+    return true;
+  }
+
+  bool OnReady() override {
+#ifndef _WIN32
+    char bytes[64];
+    while (read(fds[0], bytes, sizeof(bytes)) > 0) {
+    }
+#endif
+    if (std::this_thread::get_id() != openThread)
+      wrongThread = true;
+    readyCount++;
+    return !detachOnReady;
+  }
+
+  void Close() override { closeCount++; }
+
+  std::atomic<int> readyCount{0};
+  std::atomic<int> closeCount{0};
+  std::atomic<bool> wrongThread{false};
+  bool detachOnReady = false;
+
+private:
+  bool failOpen;
+  std::thread::id openThread;
+#ifdef _WIN32
+  HANDLE event;
+#else
+  int fds[2] = {-1, -1};
+#endif
+};
+
+static bool WaitFor(const std::function<bool()> &condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+TEST_CASE("WorkerPool strands run in order without overlap", "[scheduler]") {
+  WorkerPool pool(3);
+  const int strandCount = 6;
+  const int taskCount = 500;
+
+  std::vector<std::shared_ptr<WorkerPool::Strand>> strands;
+  std::vector<std::vector<int>> seen(strandCount);
+  std::vector<std::atomic<int>> active(strandCount);
+  std::atomic<bool> overlapped{false};
+
+  for (int s = 0; s < strandCount; s++) {
+    strands.push_back(pool.CreateStrand());
+    active[s] = 0;
+  }
+
+  for (int i = 0; i < taskCount; i++) {
+    for (int s = 0; s < strandCount; s++) {
+      strands[s]->Post([&, s, i]() {
+        if (active[s].fetch_add(1) != 0)
+          overlapped = true;
+        seen[s].push_back(i);
+        active[s].fetch_sub(1);
+      });
+    }
+  }
+
+  for (auto &strand : strands) {
+    strand->Flush();
+  }
+
+  REQUIRE_FALSE(overlapped);
+  for (int s = 0; s < strandCount; s++) {
+    REQUIRE(seen[s].size() == (size_t)taskCount);
+    for (int i = 0; i < taskCount; i++) {
+      REQUIRE(seen[s][i] == i);
+    }
+  }
+}
+
+TEST_CASE("CaptureScheduler shares threads across sources", "[scheduler]") {
+  CaptureScheduler scheduler(16);
+  std::vector<std::shared_ptr<TestSource>> sources;
+  for (int i = 0; i < 40; i++) {
+    sources.push_back(std::make_shared<TestSource>());
+    REQUIRE(scheduler.Add(sources.back()));
+  }
+
+  REQUIRE(scheduler.ThreadCount() == 3);
+  REQUIRE(scheduler.SharedStreamCount(sources[0].get()) == 16);
+  REQUIRE(scheduler.SharedStreamCount(sources[39].get()) == 8);
+
+  for (int round = 1; round <= 3; round++) {
+    for (auto &source : sources) {
+      source->Signal();
+    }
+    for (auto &source : sources) {
+      REQUIRE(WaitFor([&]() { return source->readyCount >= round; }));
+    }
+  }
+
+  for (auto &source : sources) {
+    REQUIRE_FALSE(source->wrongThread);
+    scheduler.Remove(source);
+    REQUIRE(source->closeCount == 1);
+  }
+  REQUIRE(scheduler.SharedStreamCount(sources[0].get()) == 0);
+
+  // Freed slots are reused instead of spawning more threads
+  auto late = std::make_shared<TestSource>();
+  REQUIRE(scheduler.Add(late));
+  REQUIRE(scheduler.ThreadCount() == 3);
+  scheduler.Remove(late);
+}
+
+TEST_CASE("CaptureScheduler handles failed opens and self-detach",
+          "[scheduler]") {
+  CaptureScheduler scheduler(4);
+
+  auto broken = std::make_shared<TestSource>(true);
+  REQUIRE_FALSE(scheduler.Add(broken));
+  REQUIRE(broken->closeCount == 0);
+  REQUIRE(scheduler.SharedStreamCount(broken.get()) == 0);
+
+  auto oneShot = std::make_shared<TestSource>();
+  oneShot->detachOnReady = true;
+  REQUIRE(scheduler.Add(oneShot));
+  oneShot->Signal();
+  REQUIRE(WaitFor([&]() { return oneShot->closeCount == 1; }));
+
+  // Removing an already detached source is a no-op
+  scheduler.Remove(oneShot);
+  REQUIRE(oneShot->closeCount == 1);
+  REQUIRE(oneShot->readyCount == 1);
+}
@@ -0,0 +1,120 @@
+#include "../../native/core/Fft.h"
+#include "../../native/core/SpectrumAnalyzer.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+TEST_CASE("RealFft matches a direct DFT", "[spectrum]") {
+  for (size_t size : {4, 8, 64, 512}) {
+    std::vector<float> input(size);
+    for (size_t i = 0; i < size; i++)
+      input[i] = (float)std::sin(i * 0.37) + 0.25f * (float)(i % 3);
+
+    RealFft fft(size);
+    std::vector<float> re(size / 2 + 1), im(size / 2 + 1);
+    fft.Forward(input.data(), re.data(), im.data());
+
+    for (size_t k = 0; k <= size / 2; k++) {
+      double sumRe = 0, sumIm = 0;
+      for (size_t i = 0; i < size; i++) {
+        sumRe += input[i] * std::cos(2 * kPi * k * i / size);
+        sumIm -= input[i] * std::sin(2 * kPi * k * i / size);
+      }
+      REQUIRE(std::fabs(re[k] - sumRe) < 1e-3 * size);
+      REQUIRE(std::fabs(im[k] - sumIm) < 1e-3 * size);
+    }
+  }
+}
+
+TEST_CASE("RealFft inverse restores the input", "[spectrum]") {
+  for (size_t size : {4, 16, 1024}) {
+    std::vector<float> input(size), output(size);
+    for (size_t i = 0; i < size; i++)
+      input[i] = (float)std::cos(i * 0.61) - 0.1f * (float)(i % 5);
+
+    RealFft fft(size);
+    std::vector<float> re(size / 2 + 1), im(size / 2 + 1);
+    fft.Forward(input.data(), re.data(), im.data());
+    fft.Inverse(re.data(), im.data(), output.data());
+
+    for (size_t i = 0; i < size; i++)
+      REQUIRE(std::fabs(output[i] - input[i]) < 1e-5);
+  }
+}
+
+TEST_CASE("Spectrum settings are validated", "[spectrum]") {
+  std::string error;
+  SpectrumSettings settings;
+  REQUIRE(ValidateSpectrumSettings(settings, error));
+
+  settings.fftSize = 1000;
+  REQUIRE_FALSE(ValidateSpectrumSettings(settings, error));
+  REQUIRE(error.find("fftSize") != std::string::npos);
+
+  settings = SpectrumSettings();
+  settings.overlap = 1.0;
+  REQUIRE_FALSE(ValidateSpectrumSettings(settings, error));
+
+  settings = SpectrumSettings();
+  settings.maxFrequency = 10;
+  REQUIRE_FALSE(ValidateSpectrumSettings(settings, error));
+}
+
+TEST_CASE("SpectrumAnalyzer finds a sine in its band", "[spectrum]") {
+  SpectrumSettings settings;
+  settings.fftSize = 1024;
+  settings.bands = 16;
+  settings.updateRate = 10;
+  std::vector<float> output(1 + settings.bands);
+  SpectrumAnalyzer analyzer(settings, output.data());
+  analyzer.Configure(48000, 2);
+
+  // One second of a full-scale 1 kHz sine on both channels
+  std::vector<float> audio(48000 * 2);
+  for (size_t frame = 0; frame < 48000; frame++) {
+    float value = (float)std::sin(2 * kPi * 1000 * frame / 48000.0);
+    audio[frame * 2] = value;
+    audio[frame * 2 + 1] = value;
+  }
+  AudioBlock block = {audio.data(), 48000, 2, 48000, CaptureMetadata()};
+  analyzer.Process(block);
+
+  // Throttled to updateRate, each publication leaving the counter even
+  REQUIRE(analyzer.Updates() == 10);
+  REQUIRE(output[0] == 20.0f);
+
+  size_t loudest = 1;
+  for (size_t b = 1; b <= settings.bands; b++) {
+    if (output[b] > output[loudest])
+      loudest = b;
+  }
+  // Band b starts at 20 Hz * 1200^(b / 16): 1 kHz is band 8, output[9]
+  REQUIRE(loudest == 9);
+  REQUIRE(std::fabs(output[loudest]) < 1.0f);
+  REQUIRE(output[1] < -60.0f);
+}
+
+TEST_CASE("Analysis keeps 16-bit capture bit-exact", "[spectrum]") {
+  SpectrumSettings settings;
+  settings.fftSize = 64;
+  std::vector<float> output(1 + settings.bands);
+  auto analyzer = std::make_shared<SpectrumAnalyzer>(settings, output.data());
+
+  std::vector<int16_t> delivered;
+  CaptureCore core({48000, 1, SampleEncoding::Int16, false},
+                   [&delivered](const int16_t *data, size_t count,
+                                const CaptureMetadata &) {
+                     delivered.insert(delivered.end(), data, data + count);
+                   },
+                   {analyzer}, DitherMode::Tpdf);
+
+  std::vector<int16_t> input(4800);
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = (int16_t)(i * 7);
+  core.Push((const uint8_t *)input.data(), input.size(), CaptureMetadata());
+
+  REQUIRE(delivered == input);
+  REQUIRE(analyzer->Updates() == 3);
+}
@@ -0,0 +1,64 @@
+#include "../../native/core/StreamReuse.h"
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+SystemAudioSettings Settings(int64_t processId, bool highPriority) {
+  SystemAudioSettings settings;
+  settings.processId = processId;
+  settings.highPriority = highPriority;
+  return settings;
+}
+
+} // namespace
+
+TEST_CASE("StreamReuse restarts a stopped stream", "[reuse]") {
+  StreamReuse reuse;
+  REQUIRE(reuse.Plan(Settings(0, false)).create);
+
+  reuse.Started(Settings(0, false));
+  REQUIRE(reuse.Running());
+  REQUIRE(reuse.Reuses() == 0);
+  reuse.Stopped();
+  REQUIRE(reuse.HasStream());
+  REQUIRE_FALSE(reuse.Running());
+
+  // Same settings: just start it again
+  ReusePlan plan = reuse.Plan(Settings(0, false));
+  REQUIRE_FALSE(plan.create);
+  REQUIRE_FALSE(plan.updateFilter);
+  REQUIRE_FALSE(plan.replaceOutput);
+  reuse.Started(Settings(0, false));
+  REQUIRE(reuse.Reuses() == 1);
+  reuse.Stopped();
+
+  // Another queue priority or another application keeps the stream
+  plan = reuse.Plan(Settings(0, true));
+  REQUIRE_FALSE(plan.create);
+  REQUIRE(plan.replaceOutput);
+  REQUIRE_FALSE(plan.updateFilter);
+  plan = reuse.Plan(Settings(4321, false));
+  REQUIRE_FALSE(plan.create);
+  REQUIRE(plan.updateFilter);
+  REQUIRE_FALSE(plan.replaceOutput);
+
+  reuse.Started(Settings(4321, true));
+  REQUIRE(reuse.Reuses() == 2);
+  reuse.Stopped();
+  plan = reuse.Plan(Settings(4321, true));
+  REQUIRE_FALSE(plan.updateFilter);
+  REQUIRE_FALSE(plan.replaceOutput);
+}
+
+TEST_CASE("StreamReuse discards a failed stream", "[reuse]") {
+  StreamReuse reuse;
+  reuse.Started(Settings(0, false));
+  reuse.Failed();
+  REQUIRE_FALSE(reuse.HasStream());
+  REQUIRE_FALSE(reuse.Running());
+  REQUIRE(reuse.Plan(Settings(0, false)).create);
+
+  // Building it again is not a reuse
+  reuse.Started(Settings(0, false));
+  REQUIRE(reuse.Reuses() == 0);
+}
@@ -0,0 +1,157 @@
+#include "../../native/core/StreamClock.h"
+#include "../../native/core/SyncSession.h"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+static const double kPi = 3.14159265358979323846;
+
+namespace {
+
+struct Noise {
+  uint32_t state = 123456789;
+  double Next(double amplitude) {
+    state = state * 1664525u + 1013904223u;
+    return amplitude * ((state >> 8) / 8388608.0 - 1.0);
+  }
+};
+
+// Host time of the session start, well away from zero
+const int64_t kEpochNs = 5000000000;
+
+// A capture device sampling the same 440 Hz tone as every other device,
+// on its own clock and with its own timestamp jitter
+struct Device {
+  double trueRate;
+  int64_t startNs;
+  uint64_t position = 0;
+  std::vector<int16_t> samples;
+
+  double TimeOf(uint64_t frame) const {
+    return startNs + frame * 1e9 / trueRate;
+  }
+
+  // The next 10 ms packet, stamped with up to 100 us of jitter
+  PcmBlock Next(Noise &jitter) {
+    const size_t frames = 480;
+    samples.resize(frames);
+    for (size_t i = 0; i < frames; i++) {
+      double t = TimeOf(position + i) / 1e9;
+      samples[i] = (int16_t)std::lrint(8000 * std::sin(2 * kPi * 440 * t));
+    }
+    PcmBlock block;
+    block.samples = samples.data();
+    block.frames = frames;
+    block.channels = 1;
+    block.sampleRate = 48000;
+    block.meta.frameIndex = position;
+    block.meta.timestampNs =
+        (int64_t)TimeOf(position) + (int64_t)jitter.Next(100000);
+    position += frames;
+    return block;
+  }
+};
+
+std::shared_ptr<CaptureSink> Collect(std::vector<int16_t> &out) {
+  return std::make_shared<CallbackSink>([&out](const PcmBlock &block) {
+    out.insert(out.end(), block.samples,
+               block.samples + block.frames * block.channels);
+  });
+}
+
+} // namespace
+
+TEST_CASE("StreamClock tracks a drifting device's rate", "[sync]") {
+  StreamClock clock(48000, SyncedSink::kClockBandwidthHz);
+  Noise jitter;
+  const double trueRate = 48000 * (1 + 40e-6);
+  for (uint64_t p = 0; p < 6000; p++) {
+    uint64_t position = p * 480;
+    clock.Update(position,
+                 kEpochNs + (int64_t)(position * 1e9 / trueRate) +
+                     (int64_t)jitter.Next(300000),
+                 false);
+  }
+  REQUIRE(std::fabs((clock.Rate() / 48000 - 1) * 1e6 - 40) < 2);
+  REQUIRE(clock.Anchors() == 1);
+  // Within 20 us of the true time, far less than the jitter
+  uint64_t end = 6000 * 480;
+  int64_t expected = kEpochNs + (int64_t)(end * 1e9 / trueRate);
+  REQUIRE(std::llabs(clock.TimeOf((double)end) - expected) < 20000);
+}
+
+TEST_CASE("A session allows one master at a time", "[sync]") {
+  std::shared_ptr<SyncSession> session = SyncSession::Get("one-master");
+  REQUIRE(SyncSession::Get("one-master") == session);
+  REQUIRE(session->ClaimMaster());
+  REQUIRE_FALSE(session->ClaimMaster());
+  {
+    std::vector<int16_t> out;
+    SyncedSink master(session, true, Collect(out));
+    master.Leave();
+    REQUIRE(session->ClaimMaster());
+  }
+  session->ReleaseMaster();
+
+  std::string error;
+  REQUIRE_FALSE(ValidateSyncSettings(SyncSettings(), error));
+  SyncSettings settings;
+  settings.session = "room";
+  REQUIRE(ValidateSyncSettings(settings, error));
+}
+
+TEST_CASE("A follower stays sample-aligned with a drifting master",
+          "[sync]") {
+  std::shared_ptr<SyncSession> session = SyncSession::Get("drift");
+  REQUIRE(session->ClaimMaster());
+  std::vector<int16_t> masterOut;
+  std::vector<int16_t> followerOut;
+  SyncedSink master(session, true, Collect(masterOut));
+  SyncedSink follower(session, false, Collect(followerOut));
+
+  // The follower starts first and runs 50 ppm fast; the master 20 ppm slow
+  Device masterDevice{48000 * (1 - 20e-6), kEpochNs + 3000000};
+  Device followerDevice{48000 * (1 + 50e-6), kEpochNs};
+  Noise masterJitter;
+  Noise followerJitter;
+  followerJitter.state = 42;
+
+  const double seconds = 120;
+  while (masterDevice.TimeOf(masterDevice.position) <
+         kEpochNs + seconds * 1e9) {
+    if (followerDevice.TimeOf(followerDevice.position) <
+        masterDevice.TimeOf(masterDevice.position)) {
+      follower.OnData(followerDevice.Next(followerJitter));
+    } else {
+      master.OnData(masterDevice.Next(masterJitter));
+    }
+  }
+
+  SyncStats stats = follower.GetStats();
+  REQUIRE_FALSE(stats.master);
+  REQUIRE(stats.resyncs == 0);
+  REQUIRE(std::fabs(stats.driftPpm - 70) < 3);
+  // Under a frame, about 20 us
+  REQUIRE(std::fabs(stats.errorUs) < 20);
+  REQUIRE(stats.startFrame >= 0);
+  REQUIRE(master.GetStats().master);
+
+  // Over the last ten seconds the follower's output frame k carries what
+  // the master captured at frame startFrame + k. Unsynchronised, the two
+  // would be 8 ms apart by now.
+  size_t offset = (size_t)stats.startFrame;
+  REQUIRE(followerOut.size() + offset > 10 * 48000);
+  size_t end = std::min(followerOut.size(), masterOut.size() - offset);
+  double sum = 0;
+  size_t count = 0;
+  for (size_t k = end - 10 * 48000; k < end; k++) {
+    double diff = followerOut[k] - masterOut[offset + k];
+    sum += diff * diff;
+    count++;
+  }
+  // 8000 peak: one frame off would leave an RMS difference near 330
+  REQUIRE(std::sqrt(sum / count) < 100);
+}
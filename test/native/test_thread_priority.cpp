@@ -0,0 +1,119 @@
+#include "../../native/core/ThreadPriority.h"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+// Promotion is sticky for the thread, so every case gets a fresh one
+static void OnNewThread(const std::function<void()> &fn) {
+  std::thread thread(fn);
+  thread.join();
+}
+
+TEST_CASE("Default request leaves the thread untouched", "[priority]") {
+  OnNewThread([]() {
+    ThreadPriorityResult result = PromoteCurrentThread({});
+    REQUIRE(result.priority == ThreadPriority::Normal);
+    REQUIRE_FALSE(result.affinityApplied);
+  });
+}
+
+TEST_CASE("Realtime request reports what the OS granted", "[priority]") {
+  OnNewThread([]() {
+    ThreadPriorityRequest request;
+    request.realtime = true;
+    ThreadPriorityResult result = PromoteCurrentThread(request);
+
+#ifdef __linux__
+    int policy = 0;
+    sched_param param = {};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    REQUIRE((result.priority == ThreadPriority::Realtime) ==
+            (policy == SCHED_FIFO));
+#endif
+
+    // Asking again never reports less than the first call
+    ThreadPriorityResult again = PromoteCurrentThread(request);
+    REQUIRE((int)again.priority >= (int)result.priority);
+  });
+}
+
+TEST_CASE("Affinity pins the thread to the requested cores", "[priority]") {
+  OnNewThread([]() {
+    ThreadPriorityRequest request;
+    request.cpuCores = {0};
+    ThreadPriorityResult result = PromoteCurrentThread(request);
+
+#ifdef __linux__
+    REQUIRE(result.affinityApplied);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+    REQUIRE(CPU_COUNT(&set) == 1);
+    REQUIRE(CPU_ISSET(0, &set));
+#endif
+    REQUIRE(result.priority == ThreadPriority::Normal);
+  });
+
+  OnNewThread([]() {
+    ThreadPriorityRequest request;
+    request.cpuCores = {-1, 1 << 20};
+    REQUIRE_FALSE(PromoteCurrentThread(request).affinityApplied);
+  });
+}
+
+TEST_CASE("Priority names match the JS stats values", "[priority]") {
+  REQUIRE(std::strcmp(ThreadPriorityName(ThreadPriority::Normal), "normal") ==
+          0);
+  REQUIRE(std::strcmp(ThreadPriorityName(ThreadPriority::Elevated),
+                      "elevated") == 0);
+  REQUIRE(std::strcmp(ThreadPriorityName(ThreadPriority::Realtime),
+                      "realtime") == 0);
+}
+
+TEST_CASE("Realtime can be requested for another thread", "[priority]") {
+  std::atomic<int64_t> threadId{-1};
+  std::atomic<bool> requested{false};
+  ThreadPriorityResult result;
+  std::thread worker([&]() {
+    threadId = CurrentThreadId();
+    while (!requested)
+      std::this_thread::yield();
+    ThreadPriorityRequest request;
+    request.realtime = true;
+    result = PromoteCurrentThread(request);
+  });
+  while (threadId < 0)
+    std::this_thread::yield();
+
+#ifdef __linux__
+  rlimit before = {};
+  getrlimit(RLIMIT_RTTIME, &before);
+  bool granted = RequestRealtimeThread(threadId);
+  rlimit after = {};
+  getrlimit(RLIMIT_RTTIME, &after);
+  // The hard limit is never lowered, the soft one only for a grant
+  REQUIRE(after.rlim_max == before.rlim_max);
+  if (!granted)
+    REQUIRE(after.rlim_cur == before.rlim_cur);
+  if (granted)
+    REQUIRE((sched_getscheduler((pid_t)threadId) == SCHED_FIFO ||
+             sched_getscheduler((pid_t)threadId) == SCHED_RR));
+  requested = true;
+  worker.join();
+  // The thread keeps what it was granted
+  if (granted)
+    REQUIRE(result.priority == ThreadPriority::Realtime);
+#else
+  REQUIRE_FALSE(RequestRealtimeThread(threadId));
+  requested = true;
+  worker.join();
+#endif
+}
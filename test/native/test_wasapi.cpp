@@ -89,13 +89,14 @@ TEST_CASE("WASAPIEngine Start/Stop Microphone", "[wasapi]") {
   };
 
   bool dataReceived = false;
-  auto dataCb = [&](const uint8_t *data, size_t size) {
-    if (size > 0)
+  auto dataCb = [&](const PcmBlock &block) {
+    if (block.frames > 0)
       dataReceived = true;
   };
 
   // Start microphone with deviceType and deviceId
-  engine->Start(AudioEngine::DEVICE_TYPE_INPUT, inputDeviceId, dataCb, errorCb);
+  engine->Start(AudioEngine::DEVICE_TYPE_INPUT, inputDeviceId,
+                std::make_shared<CallbackSink>(dataCb, errorCb));
 
   std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -130,14 +131,14 @@ TEST_CASE("WASAPIEngine Start/Stop Loopback", "[wasapi]") {
   };
 
   bool dataReceived = false;
-  auto dataCb = [&](const uint8_t *data, size_t size) {
-    if (size > 0)
+  auto dataCb = [&](const PcmBlock &block) {
+    if (block.frames > 0)
       dataReceived = true;
   };
 
   // Start loopback with deviceType=output and actual device ID
-  engine->Start(AudioEngine::DEVICE_TYPE_OUTPUT, outputDeviceId, dataCb,
-                errorCb);
+  engine->Start(AudioEngine::DEVICE_TYPE_OUTPUT, outputDeviceId,
+                std::make_shared<CallbackSink>(dataCb, errorCb));
 
   std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -0,0 +1,40 @@
+const { spawnSync } = require('child_process');
+const path = require('path');
+
+const entry = JSON.stringify(path.join(__dirname, '..', 'dist', 'index'));
+
+// Runs in a child process: a start() that fails must leave nothing behind
+// that keeps the event loop alive, so the child exits by itself
+const script = `
+const { AudioRecorder } = require(${entry});
+const os = require('os');
+const path = require('path');
+
+const device = AudioRecorder.getDevices('input')[0];
+const recorder = new AudioRecorder();
+recorder
+  .start({
+    deviceType: 'input',
+    deviceId: device ? device.id : 'missing',
+    file: path.join(os.tmpdir(), 'native-recorder-missing', 'dir', 'a.wav'),
+  })
+  .then(
+    () => {
+      console.log('started');
+      process.exit(1);
+    },
+    (error) => console.log('rejected: ' + error.message)
+  );
+`;
+
+test('start() with an unwritable file rejects and lets the process exit', () => {
+  const result = spawnSync(process.execPath, ['-e', script], {
+    encoding: 'utf8',
+    timeout: 15000,
+  });
+  // A leaked callback keeps the child running until the timeout kills it
+  expect(result.error).toBeUndefined();
+  expect(result.signal).toBeNull();
+  expect(result.status).toBe(0);
+  expect(result.stdout).toMatch(/^rejected: /);
+});